@@ -0,0 +1,1195 @@
+#include "../src/categorical.h"
+#include "../src/conv.h"
+#include "../src/disk.h"
+#include "../src/distribution.h"
+#include "../src/elementwise.h"
+#include "../src/kron.h"
+#include "../src/linear_algebra.h"
+#include "../src/lowrank.h"
+#include "../src/moments.h"
+#include "../src/mvnormal.h"
+#include "../src/pipeline.h"
+#include "../src/quant.h"
+#include "../src/random.h"
+#include "../src/reduce.h"
+#include "../src/small.h"
+#include "../src/stats.h"
+#include "../src/structured.h"
+#include "../src/view.h"
+#include "../src/vmath.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Benchmark harness for LAMS
+ *
+ * Every kernel is timed over a sweep of sizes. Each sample runs the kernel
+ * enough times to last at least --min-time-us, a few warm-up samples are
+ * thrown away and the remaining per-call times give median, p99, GFLOP/s and
+ * GB/s. Results can be written as JSON (one result per line) and two such
+ * files can be compared to flag regressions.
+ *
+ *   ./bench_output [--json FILE] [--filter SUBSTR] [--reps N]
+ *                  [--warmup N] [--min-time-us US] [--quick]
+ *   ./bench_output --compare BASE.json NEW.json [--threshold PCT]
+ */
+
+#define MAX_SIZES 8
+#define MAX_RESULTS 512
+#define CONV_CHANNELS 8
+#define CONV_KERNELS 16
+#define MV_ROWS 4096
+
+// Shared fixture, every setup fills in what its group needs
+typedef struct {
+  int n;
+  Vector *v1, *v2;
+  Matrix *m1, *m2, *m3;
+  Tensor *t1, *t2;
+  BandedMatrix *band;
+  SymmetricMatrix *sym;
+  QMatrix *q1, *q2;
+  Tensor *kernels[CONV_KERNELS];
+  DiskMatrix *disk1, *disk2;
+  mvnormal_t *mv;
+  uint32_t *counts;
+  float *samples, *probs;
+  char paths[3][64];
+  Vec3 *points, *out;
+} BenchData;
+
+typedef struct {
+  const char *name;
+  int sizes[MAX_SIZES]; // 0 terminated
+  void (*setup)(BenchData *d, int n);
+  void (*run)(BenchData *d);
+  double (*flops)(int n);
+  double (*bytes)(int n);
+} Benchmark;
+
+typedef struct {
+  char name[64];
+  int n;
+  long iters;
+  int reps;
+  double median_ns, p99_ns, min_ns, mean_ns;
+  double gflops, gbps;
+} BenchResult;
+
+static volatile double sink;
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double fill_value(int i) { return (double)((i * 7919) % 1000) / 100.0; }
+
+// Setup
+// -----------------------------------------------------------------------------
+static void setup_vector(BenchData *d, int n) {
+  d->v1 = vector_new(n);
+  d->v2 = vector_new(n);
+  for (int i = 0; i < n; i++) {
+    d->v1->data[i] = fill_value(i);
+    d->v2->data[i] = fill_value(i + 1);
+  }
+}
+
+static void setup_matrix(BenchData *d, int n) {
+  d->m1 = matrix_new(n, n);
+  d->m2 = matrix_new(n, n);
+  d->v1 = vector_new(n);
+  for (int i = 0; i < n; i++) {
+    d->v1->data[i] = fill_value(i);
+    for (int j = 0; j < n; j++) {
+      d->m1->data[i][j] = fill_value(i * n + j);
+      d->m2->data[i][j] = fill_value(i * n + j + 1);
+    }
+  }
+}
+
+static void setup_tensor(BenchData *d, int n) {
+  d->t1 = tensor_new(n, n, n);
+  d->t2 = tensor_new(n, n, n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      for (int k = 0; k < n; k++) {
+        d->t1->data[i][j][k] = fill_value((i * n + j) * n + k);
+        d->t2->data[i][j][k] = fill_value((i * n + j) * n + k + 1);
+      }
+    }
+  }
+}
+
+// Diagonally dominant tridiagonal system and the packed lower triangle of
+// the matrix fixture
+static void setup_structured(BenchData *d, int n) {
+  setup_vector(d, n);
+  d->band = banded_new(n, 1, 1);
+  for (int i = 0; i < n; i++) {
+    banded_set(d->band, i, i, 4.0);
+    if (i > 0) {
+      banded_set(d->band, i, i - 1, -1.0);
+      banded_set(d->band, i - 1, i, -1.0);
+    }
+  }
+
+  d->sym = symmetric_new(n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j <= i; j++) {
+      symmetric_set(d->sym, i, j, fill_value(i * n + j));
+    }
+  }
+}
+
+static void setup_points(BenchData *d, int n) {
+  d->points = malloc(n * sizeof(Vec3));
+  d->out = malloc(n * sizeof(Vec3));
+  for (int i = 0; i < n; i++) {
+    for (int k = 0; k < 3; k++) {
+      d->points[i].data[k] = fill_value(3 * i + k);
+    }
+  }
+}
+
+// int8 copies of the matrix fixture, one scale per row
+static void setup_quant(BenchData *d, int n) {
+  setup_matrix(d, n);
+  d->q1 = qmatrix_quantize(d->m1, QUANT_INT8, QUANT_PER_ROW);
+  d->q2 = qmatrix_quantize(d->m2, QUANT_INT8, QUANT_PER_ROW);
+}
+
+// n x n image with CONV_CHANNELS channels and CONV_KERNELS 7x7 kernels,
+// the 3x3 runs use their top left corner
+static void setup_conv(BenchData *d, int n) {
+  d->n = n;
+  d->t1 = tensor_new(n, n, CONV_CHANNELS);
+  for (int c = 0; c < CONV_CHANNELS; c++) {
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++) {
+        d->t1->data[c][i][j] = fill_value((c * n + i) * n + j);
+      }
+    }
+  }
+  for (int o = 0; o < CONV_KERNELS; o++) {
+    d->kernels[o] = tensor_new(7, 7, CONV_CHANNELS);
+    for (int c = 0; c < CONV_CHANNELS; c++) {
+      for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 7; j++) {
+          d->kernels[o]->data[c][i][j] = fill_value(o + c + i * 7 + j) - 5;
+        }
+      }
+    }
+  }
+  d->t2 = tensor_new(3, 3, CONV_CHANNELS);
+  for (int c = 0; c < CONV_CHANNELS; c++) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        d->t2->data[c][i][j] = d->kernels[0]->data[c][i][j];
+      }
+    }
+  }
+}
+
+// The matrix fixture in files, the product gets a quarter of its size as
+// memory budget
+static void setup_disk(BenchData *d, int n) {
+  setup_matrix(d, n);
+  for (int i = 0; i < 3; i++) {
+    snprintf(d->paths[i], sizeof(d->paths[i]), "/tmp/lams_bench_%d_%d.bin",
+             (int)getpid(), i);
+  }
+  d->disk1 = disk_matrix_from_matrix(d->paths[0], d->m1);
+  d->disk2 = disk_matrix_from_matrix(d->paths[1], d->m2);
+}
+
+// Diagonally dominant symmetric m1 with its factor in m2, a small v1 and
+// v2 = -v1
+static void setup_cholesky(BenchData *d, int n) {
+  setup_matrix(d, n);
+  for (int i = 0; i < n; i++) {
+    d->v1->data[i] /= n;
+    for (int j = 0; j < i; j++) {
+      d->m1->data[i][j] = d->m1->data[j][i];
+    }
+    d->m1->data[i][i] += 10.0 * n;
+  }
+  matrix_free(d->m2);
+  d->m2 = matrix_cholesky(d->m1);
+  d->v2 = vector_scale(d->v1, -1.0);
+}
+
+// A and B n x n, v2 has n^2 entries and m3 is A (x) B for the explicit run
+static void setup_kron(BenchData *d, int n) {
+  setup_matrix(d, n);
+  d->v2 = vector_new(n * n);
+  for (int i = 0; i < n * n; i++) {
+    d->v2->data[i] = fill_value(i);
+  }
+  d->m3 = matrix_kronecker(d->m1, d->m2);
+}
+
+// n dimensions, the covariance from setup_cholesky and MV_ROWS observations
+// in m3
+static void setup_mvnormal(BenchData *d, int n) {
+  setup_cholesky(d, n);
+  d->mv = mvnormal_new(d->v1, d->m1);
+  d->m3 = matrix_new(MV_ROWS, n);
+  for (int i = 0; i < MV_ROWS; i++) {
+    for (int j = 0; j < n; j++) {
+      d->m3->data[i][j] = fill_value(i * n + j);
+    }
+  }
+}
+
+// Counts spread over 0 .. 100 and samples over [-4, 4)
+static void setup_stats_batch(BenchData *d, int n) {
+  d->n = n;
+  d->counts = malloc(n * sizeof(uint32_t));
+  d->samples = malloc(n * sizeof(float));
+  d->probs = malloc(n * sizeof(float));
+  for (int i = 0; i < n; i++) {
+    d->counts[i] = (i * 7919) % 101;
+    d->samples[i] = -4.0f + 8.0f * fill_value(i) / 10;
+  }
+}
+
+// The samples become probabilities in [0, 1)
+static void setup_quantile_batch(BenchData *d, int n) {
+  setup_stats_batch(d, n);
+  for (int i = 0; i < n; i++) {
+    d->samples[i] = fill_value(i) / 10;
+  }
+}
+
+static void setup_size(BenchData *d, int n) { (void)d; }
+
+static void teardown(BenchData *d) {
+  if (d->v1)
+    vector_free(d->v1);
+  if (d->v2)
+    vector_free(d->v2);
+  if (d->m1)
+    matrix_free(d->m1);
+  if (d->m2)
+    matrix_free(d->m2);
+  if (d->m3)
+    matrix_free(d->m3);
+  if (d->t1)
+    tensor_free(d->t1);
+  if (d->t2)
+    tensor_free(d->t2);
+  banded_free(d->band);
+  symmetric_free(d->sym);
+  disk_matrix_close(d->disk1);
+  disk_matrix_close(d->disk2);
+  for (int i = 0; i < 3; i++) {
+    if (d->paths[i][0])
+      unlink(d->paths[i]);
+  }
+  qmatrix_free(d->q1);
+  for (int o = 0; o < CONV_KERNELS; o++) {
+    if (d->kernels[o])
+      tensor_free(d->kernels[o]);
+  }
+  qmatrix_free(d->q2);
+  mvnormal_free(d->mv);
+  free(d->counts);
+  free(d->samples);
+  free(d->probs);
+  free(d->points);
+  free(d->out);
+  memset(d, 0, sizeof(*d));
+}
+
+// Cost models
+// -----------------------------------------------------------------------------
+static double zero(int n) { return 0; }
+static double flops_n(int n) { return n; }
+static double flops_2n(int n) { return 2.0 * n; }
+static double flops_3n(int n) { return 3.0 * n; }
+static double flops_6n(int n) { return 6.0 * n; }
+static double flops_8n(int n) { return 8.0 * n; }
+static double flops_18n(int n) { return 18.0 * n; }
+static double flops_n2(int n) { return (double)n * n; }
+static double flops_2n2(int n) { return 2.0 * n * n; }
+static double flops_2n3(int n) { return 2.0 * n * n * n; }
+static double flops_n3(int n) { return (double)n * n * n; }
+static double flops_8n3(int n) { return 8.0 * n * n * n; }
+static double flops_n3_3(int n) { return (double)n * n * n / 3.0; }
+static double flops_9n2(int n) { return 9.0 * n * n; }
+static double flops_12n2(int n) { return 12.0 * n * n; }
+static double flops_4n3(int n) { return 4.0 * n * n * n; }
+static double flops_2n4(int n) { return 2.0 * n * n * n * n; }
+static double bytes_n4(int n) { return 8.0 * n * n * n * n; }
+static double flops_mv(int n) { return (double)MV_ROWS * n * (n + 3); }
+static double bytes_mv_rows(int n) { return 8.0 * MV_ROWS * n; }
+static double bytes_n(int n) { return 8.0 * n; }
+static double bytes_2n(int n) { return 16.0 * n; }
+static double bytes_3n(int n) { return 24.0 * n; }
+static double bytes_5n(int n) { return 40.0 * n; }
+static double bytes_6n(int n) { return 48.0 * n; }
+static double bytes_n2(int n) { return 8.0 * n * n; }
+static double bytes_2n2(int n) { return 16.0 * n * n; }
+static double flops_conv3(int n) {
+  return 2.0 * CONV_KERNELS * CONV_CHANNELS * 9 * n * n;
+}
+static double flops_conv7(int n) {
+  return 2.0 * CONV_KERNELS * CONV_CHANNELS * 49 * n * n;
+}
+static double flops_pool(int n) { return 1.0 * CONV_CHANNELS * n * n; }
+static double bytes_9n2(int n) { return 9.0 * n * n; }
+static double bytes_10n2(int n) { return 10.0 * n * n; }
+static double bytes_q_mv(int n) { return (double)n * n + 16.0 * n; }
+static double bytes_3n2(int n) { return 24.0 * n * n; }
+static double bytes_sym_mv(int n) {
+  return 8.0 * ((double)n * n / 2 + 2.0 * n);
+}
+static double bytes_mv(int n) { return 8.0 * ((double)n * n + 2.0 * n); }
+static double bytes_2n3(int n) { return 16.0 * n * n * n; }
+static double bytes_3n3(int n) { return 24.0 * n * n * n; }
+
+// Vector kernels
+// -----------------------------------------------------------------------------
+static void run_vector_new(BenchData *d) { vector_free(vector_new(d->n)); }
+static void run_vector_copy(BenchData *d) { vector_free(vector_copy(d->v1)); }
+static void run_vector_add(BenchData *d) {
+  vector_free(vector_add(d->v1, d->v2));
+}
+static void run_vector_sub(BenchData *d) {
+  vector_free(vector_sub(d->v1, d->v2));
+}
+static void run_vector_scale(BenchData *d) {
+  vector_free(vector_scale(d->v1, 1.5));
+}
+static void run_vector_dot(BenchData *d) { sink += vector_dot(d->v1, d->v2); }
+static void run_vector_norm(BenchData *d) { sink += vector_norm(d->v1); }
+static void run_vector_normalize(BenchData *d) {
+  vector_free(vector_normalize(d->v1));
+}
+static void run_vector_cross(BenchData *d) {
+  vector_free(vector_cross(d->v1, d->v2));
+}
+
+// Matrix kernels
+// -----------------------------------------------------------------------------
+static void run_matrix_new(BenchData *d) {
+  matrix_free(matrix_new(d->n, d->n));
+}
+static void run_matrix_copy(BenchData *d) { matrix_free(matrix_copy(d->m1)); }
+static void run_matrix_add(BenchData *d) {
+  matrix_free(matrix_add(d->m1, d->m2));
+}
+static void run_matrix_sub(BenchData *d) {
+  matrix_free(matrix_sub(d->m1, d->m2));
+}
+static void run_matrix_scale(BenchData *d) {
+  matrix_free(matrix_scale(d->m1, 1.5));
+}
+static void run_matrix_multiply(BenchData *d) {
+  matrix_free(matrix_multiply(d->m1, d->m2));
+}
+static void run_matrix_multiply_vector(BenchData *d) {
+  matrix_free(matrix_multiply_vector(d->m1, d->v1));
+}
+static void run_matrix_transpose(BenchData *d) {
+  matrix_free(matrix_transpose(d->m1));
+}
+static void run_matrix_fill(BenchData *d) { matrix_fill(d->m1, 1.0); }
+static void run_matrix_identity(BenchData *d) {
+  matrix_free(matrix_identity(d->n));
+}
+
+// Tensor kernels
+// -----------------------------------------------------------------------------
+static void run_tensor_copy(BenchData *d) { tensor_free(tensor_copy(d->t1)); }
+static void run_tensor_add(BenchData *d) {
+  tensor_free(tensor_add(d->t1, d->t2));
+}
+static void run_tensor_sub(BenchData *d) {
+  tensor_free(tensor_sub(d->t1, d->t2));
+}
+
+// Structured kernels
+// -----------------------------------------------------------------------------
+static void run_banded_multiply_vector(BenchData *d) {
+  vector_free(banded_multiply_vector(d->band, d->v1));
+}
+static void run_banded_solve(BenchData *d) {
+  vector_free(banded_solve(d->band, d->v1));
+}
+static void run_symmetric_multiply_vector(BenchData *d) {
+  vector_free(symmetric_multiply_vector(d->sym, d->v1));
+}
+
+// Small matrix kernels
+// -----------------------------------------------------------------------------
+static void run_mat4_transform_points(BenchData *d) {
+  Mat4 m = mat4_identity();
+  m.data[0][1] = 0.5;
+  m.data[2][3] = 1.0;
+  mat4_transform_points(m, d->points, d->out, d->n);
+}
+static void run_mat4_inverse(BenchData *d) {
+  Mat4 m = mat4_identity();
+  m.data[0][1] = d->points[0].data[0];
+  sink += mat4_inverse(m).data[0][1];
+}
+
+// Element-wise kernels
+// -----------------------------------------------------------------------------
+static void run_vmath_exp(BenchData *d) {
+  vmath_exp(d->v1->data, d->v2->data, d->n);
+}
+static void run_vmath_log(BenchData *d) {
+  vmath_log(d->v1->data, d->v2->data, d->n);
+}
+static void run_vmath_erf(BenchData *d) {
+  vmath_erf(d->v1->data, d->v2->data, d->n);
+}
+static void run_vmath_tanh(BenchData *d) {
+  vmath_tanh(d->v1->data, d->v2->data, d->n);
+}
+static void run_matrix_map_exp(BenchData *d) {
+  matrix_free(matrix_map(d->m1, UNARY_EXP));
+}
+static void run_matrix_binary_vector(BenchData *d) {
+  matrix_free(matrix_binary_vector(d->m1, d->v1, BINARY_ADD));
+}
+
+// Reduction kernels
+// -----------------------------------------------------------------------------
+static void run_matrix_reduce_rows(BenchData *d) {
+  vector_free(matrix_reduce(d->m1, REDUCE_ROWS, REDUCE_SUM));
+}
+static void run_matrix_reduce_cols(BenchData *d) {
+  vector_free(matrix_reduce(d->m1, REDUCE_COLS, REDUCE_SUM));
+}
+static void run_matrix_reduce_argmax(BenchData *d) {
+  vector_free(matrix_reduce(d->m1, REDUCE_COLS, REDUCE_ARGMAX));
+}
+static void run_matrix_norm_frobenius(BenchData *d) {
+  sink += matrix_norm_frobenius(d->m1);
+}
+
+static void run_qmatrix_quantize(BenchData *d) {
+  qmatrix_free(qmatrix_quantize(d->m1, QUANT_INT8, QUANT_PER_ROW));
+}
+static void run_qmatrix_multiply_transpose(BenchData *d) {
+  matrix_free(qmatrix_multiply_transpose(d->q1, d->q2));
+}
+static void run_qmatrix_multiply_vector(BenchData *d) {
+  vector_free(qmatrix_multiply_vector(d->q1, d->v1));
+}
+
+static void run_matrix_column_dot(BenchData *d) {
+  Matrix *a = matrix_column_view(d->m1, 0), *b = matrix_column_view(d->m1, 1);
+  sink = matrix_dot(a, b);
+  matrix_view_free(a);
+  matrix_view_free(b);
+}
+static void run_matrix_axpy(BenchData *d) { matrix_axpy(d->m1, 1e-9, d->m2); }
+
+static void run_kronecker_multiply_vector(BenchData *d) {
+  vector_free(kronecker_multiply_vector(d->m1, d->m2, d->v2));
+}
+static void run_kronecker_explicit_vector(BenchData *d) {
+  matrix_free(matrix_multiply_vector(d->m3, d->v2));
+}
+
+static void run_mvnormal_logpdf_batch(BenchData *d) {
+  vector_free(mvnormal_logpdf_batch(d->mv, d->m3));
+}
+
+static void run_moments_push(BenchData *d) {
+  moments_t m;
+  moments_init(&m);
+  for (int i = 0; i < d->v1->size; i++)
+    moments_push(&m, d->v1->data[i]);
+  sink += m.m4;
+}
+static void run_moments_push_vector(BenchData *d) {
+  moments_t m;
+  moments_init(&m);
+  moments_push_vector(&m, d->v1);
+  sink += m.m4;
+}
+static void run_matrix_covariance(BenchData *d) {
+  matrix_free(matrix_covariance(d->m3));
+}
+// Uncentered X^T X through a full transpose, what it replaces
+static void run_matrix_covariance_explicit(BenchData *d) {
+  Matrix *t = matrix_transpose(d->m3);
+  matrix_free(matrix_multiply(t, d->m3));
+  matrix_free(t);
+}
+static void run_mvmoments_push_rows(BenchData *d) {
+  mvmoments_t *m = mvmoments_new(d->m3->cols);
+  mvmoments_push_rows(m, d->m3);
+  mvmoments_free(m);
+}
+
+// Updates are undone each call so the fixture stays the same
+static void run_matrix_cholesky(BenchData *d) {
+  matrix_free(matrix_cholesky(d->m1));
+}
+static void run_matrix_cholesky_update(BenchData *d) {
+  matrix_cholesky_update(d->m2, d->v1);
+  matrix_cholesky_downdate(d->m2, d->v1);
+}
+static void run_matrix_inverse_update_rank1(BenchData *d) {
+  matrix_inverse_update_rank1(d->m2, d->v1, d->v1);
+  matrix_inverse_update_rank1(d->m2, d->v2, d->v1);
+}
+
+static void run_conv2d(BenchData *d, int size, ConvAlgorithm algorithm) {
+  Tensor *kernels[CONV_KERNELS];
+  for (int o = 0; o < CONV_KERNELS; o++) {
+    kernels[o] = size == 7 ? d->kernels[o] : d->t2;
+  }
+  ConvOptions opts = {.padding = {size / 2, size / 2}, .algorithm = algorithm};
+  tensor_free(tensor_conv2d(d->t1, kernels, CONV_KERNELS, NULL, &opts));
+}
+static void run_conv2d_3x3_direct(BenchData *d) {
+  run_conv2d(d, 3, CONV_DIRECT);
+}
+static void run_conv2d_3x3_im2col(BenchData *d) {
+  run_conv2d(d, 3, CONV_IM2COL);
+}
+static void run_conv2d_7x7_direct(BenchData *d) {
+  run_conv2d(d, 7, CONV_DIRECT);
+}
+static void run_conv2d_7x7_im2col(BenchData *d) {
+  run_conv2d(d, 7, CONV_IM2COL);
+}
+static void run_pool2d_max(BenchData *d) {
+  tensor_free(tensor_pool2d(d->t1, POOL_MAX, 2, 2, NULL));
+}
+
+static void run_disk_matrix_multiply(BenchData *d) {
+  size_t budget = (size_t)d->m1->rows * d->m1->cols * sizeof(double) / 4;
+  disk_matrix_close(disk_matrix_multiply(d->disk1, d->disk2, d->paths[2],
+                                         budget > 4096 ? budget : 4096));
+}
+
+// A * B + B * A + A * A + B * B, the four products run concurrently
+static void run_pipeline_sum_products(BenchData *d) {
+  Pipeline *p = pipeline_new();
+  Future *a = pipeline_matrix(p, d->m1), *b = pipeline_matrix(p, d->m2);
+  Future *left = pipeline_add(p, pipeline_multiply(p, a, b),
+                              pipeline_multiply(p, b, a));
+  Future *right = pipeline_add(p, pipeline_multiply(p, a, a),
+                               pipeline_multiply(p, b, b));
+  pipeline_add(p, left, right);
+  pipeline_run(p);
+  pipeline_free(p);
+}
+
+// Stats kernels, n is the size parameter and the whole support is evaluated
+// -----------------------------------------------------------------------------
+static void run_binomial_pmf(BenchData *d) {
+  binomial_t bin = {d->n, 0.3};
+  for (uint32_t k = 0; k <= bin.n; k++)
+    sink += binomial_pmf(&bin, k);
+}
+static void run_binomial_cdf(BenchData *d) {
+  binomial_t bin = {d->n, 0.3};
+  for (uint32_t k = 0; k <= bin.n; k++)
+    sink += binomial_cdf(&bin, k);
+}
+static void run_geometric_pmf(BenchData *d) {
+  geometric_t geo = {0.05};
+  for (uint32_t k = 0; k <= (uint32_t)d->n; k++)
+    sink += geometric_pmf(&geo, k);
+}
+static void run_geometric_cdf(BenchData *d) {
+  geometric_t geo = {0.05};
+  for (uint32_t k = 0; k <= (uint32_t)d->n; k++)
+    sink += geometric_cdf(&geo, k);
+}
+static void run_hypergeometric_pmf(BenchData *d) {
+  hypergeometric_t hyp = {4 * d->n, 2 * d->n, d->n};
+  for (uint32_t k = 0; k <= hyp.n; k++)
+    sink += hypergeometric_pmf(&hyp, k);
+}
+static void run_hypergeometric_cdf(BenchData *d) {
+  hypergeometric_t hyp = {4 * d->n, 2 * d->n, d->n};
+  for (uint32_t k = 0; k <= hyp.n; k++)
+    sink += hypergeometric_cdf(&hyp, k);
+}
+static void run_negative_binomial_pmf(BenchData *d) {
+  negative_binomial_t neg = {5, 0.3};
+  for (uint32_t k = 0; k <= (uint32_t)d->n; k++)
+    sink += negative_binomial_pmf(&neg, k);
+}
+static void run_negative_binomial_cdf(BenchData *d) {
+  negative_binomial_t neg = {5, 0.3};
+  for (uint32_t k = 0; k <= (uint32_t)d->n; k++)
+    sink += negative_binomial_cdf(&neg, k);
+}
+static void run_poisson_pmf(BenchData *d) {
+  poisson_t poi = {d->n / 2};
+  for (uint32_t k = 0; k <= (uint32_t)d->n; k++)
+    sink += poisson_pmf(&poi, k);
+}
+static void run_poisson_cdf(BenchData *d) {
+  poisson_t poi = {d->n / 2};
+  for (uint32_t k = 0; k <= (uint32_t)d->n; k++)
+    sink += poisson_cdf(&poi, k);
+}
+static void run_binomial_pmf_table(BenchData *d) {
+  binomial_t bin = {d->n, 0.3};
+  pmf_table_t *t = binomial_pmf_table(&bin, 0);
+  sink += t->cdf[t->size - 1];
+  pmf_table_free(t);
+}
+static void run_poisson_pmf_table(BenchData *d) {
+  poisson_t poi = {d->n / 2};
+  pmf_table_t *t = poisson_pmf_table(&poi, 0);
+  sink += t->cdf[t->size - 1];
+  pmf_table_free(t);
+}
+static void run_uniform_sample_fill(BenchData *d) {
+  continuous_uniform_t uni = {0, 1, 0};
+  rng_t rng;
+  rng_seed(&rng, 1);
+  continuous_uniform_sample_fill(&uni, &rng, d->v1);
+}
+static void run_normal_sample_fill(BenchData *d) {
+  normal_t nor = {0.0, 1.0};
+  rng_t rng;
+  rng_seed(&rng, 1);
+  normal_sample_fill(&nor, &rng, d->v1);
+}
+static void run_binomial_sample_fill(BenchData *d) {
+  binomial_t bin = {1000, 0.3f};
+  rng_t rng;
+  rng_seed(&rng, 1);
+  binomial_sample_fill(&bin, &rng, d->v1);
+}
+static void run_hypergeometric_sample_fill(BenchData *d) {
+  hypergeometric_t hyp = {100000000, 50000000, 25000000};
+  rng_t rng;
+  rng_seed(&rng, 1);
+  hypergeometric_sample_fill(&hyp, &rng, d->v1);
+}
+static void run_poisson_sample_fill(BenchData *d) {
+  poisson_t poi = {500};
+  rng_t rng;
+  rng_seed(&rng, 1);
+  poisson_sample_fill(&poi, &rng, d->v1);
+}
+static void run_categorical_fill(BenchData *d, CategoricalMethod method) {
+  Vector *w = vector_new(1000);
+  for (int i = 0; i < w->size; i++)
+    w->data[i] = 1 + i % 17;
+  categorical_t *c = categorical_new(w, method);
+  rng_t rng;
+  rng_seed(&rng, 1);
+  categorical_sample_fill(c, &rng, d->v1);
+  categorical_free(c);
+  vector_free(w);
+}
+static void run_alias_sample_fill(BenchData *d) {
+  run_categorical_fill(d, CATEGORICAL_ALIAS);
+}
+static void run_guide_sample_fill(BenchData *d) {
+  run_categorical_fill(d, CATEGORICAL_GUIDE);
+}
+static void run_fenwick_sample_fill(BenchData *d) {
+  run_categorical_fill(d, CATEGORICAL_FENWICK);
+}
+static void run_poisson_pmf_batch(BenchData *d) {
+  poisson_t poi = {20};
+  poisson_pmf_batch(&poi, d->counts, d->probs, d->n);
+}
+static void run_binomial_cdf_batch(BenchData *d) {
+  binomial_t bin = {100, 0.3f};
+  binomial_cdf_batch(&bin, d->counts, d->probs, d->n);
+}
+static void run_normal_pmf_batch(BenchData *d) {
+  normal_t nor = {0.0, 1.0};
+  normal_pmf_batch(&nor, d->samples, d->probs, d->n);
+}
+static void run_normal_cdf_batch(BenchData *d) {
+  normal_t nor = {0.0, 1.0};
+  normal_cdf_batch(&nor, d->samples, d->probs, d->n);
+}
+static void run_normal_quantile_batch(BenchData *d) {
+  normal_t nor = {0.0, 1.0};
+  normal_quantile_batch(&nor, d->samples, d->probs, d->n);
+}
+static void run_binomial_quantile_batch(BenchData *d) {
+  binomial_t bin = {1000, 0.3f};
+  binomial_quantile_batch(&bin, d->samples, d->probs, d->n);
+}
+static void run_poisson_quantile_batch(BenchData *d) {
+  poisson_t poi = {1000};
+  poisson_quantile_batch(&poi, d->samples, d->probs, d->n);
+}
+static void run_normal_pmf(BenchData *d) {
+  normal_t nor = {0.0, 1.0};
+  for (int i = 0; i < d->n; i++)
+    sink += normal_pmf(&nor, -4.0f + 8.0f * i / d->n);
+}
+static void run_normal_cdf(BenchData *d) {
+  normal_t nor = {0.0, 1.0};
+  for (int i = 0; i < d->n; i++)
+    sink += normal_cdf(&nor, -4.0f + 8.0f * i / d->n);
+}
+static void run_normal_pmf_frozen(BenchData *d) {
+  normal_t nor = {0.0, 1.0};
+  distribution_t *dist = normal_freeze(&nor);
+  for (int i = 0; i < d->n; i++)
+    sink += distribution_pmf(dist, -4.0 + 8.0 * i / d->n);
+  distribution_free(dist);
+}
+static void run_geometric_pmf_frozen(BenchData *d) {
+  geometric_t geo = {0.05};
+  distribution_t *dist = geometric_freeze(&geo);
+  for (uint32_t k = 0; k <= (uint32_t)d->n; k++)
+    sink += distribution_pmf(dist, k);
+  distribution_free(dist);
+}
+
+// Registry
+// -----------------------------------------------------------------------------
+#define VSIZES {1024, 16384, 262144, 1048576}
+#define MSIZES {16, 64, 256, 512}
+#define GSIZES {16, 64, 128, 256}
+#define KSIZES {8, 16, 32, 48}
+#define TSIZES {8, 16, 32, 64}
+#define SSIZES {16, 64, 256, 1024}
+#define CSIZES {16, 32, 64, 128}
+
+static Benchmark benchmarks[] = {
+    {"vector_new", VSIZES, setup_size, run_vector_new, zero, zero},
+    {"vector_copy", VSIZES, setup_vector, run_vector_copy, zero, bytes_2n},
+    {"vector_add", VSIZES, setup_vector, run_vector_add, flops_n, bytes_3n},
+    {"vector_sub", VSIZES, setup_vector, run_vector_sub, flops_n, bytes_3n},
+    {"vector_scale", VSIZES, setup_vector, run_vector_scale, flops_n,
+     bytes_2n},
+    {"vector_dot", VSIZES, setup_vector, run_vector_dot, flops_2n, bytes_2n},
+    {"vector_norm", VSIZES, setup_vector, run_vector_norm, flops_2n, bytes_n},
+    {"vector_normalize", VSIZES, setup_vector, run_vector_normalize, flops_3n,
+     bytes_3n},
+    {"vector_cross", {3}, setup_vector, run_vector_cross, zero, zero},
+
+    {"matrix_new", MSIZES, setup_size, run_matrix_new, zero, zero},
+    {"matrix_copy", MSIZES, setup_matrix, run_matrix_copy, zero, bytes_2n2},
+    {"matrix_add", MSIZES, setup_matrix, run_matrix_add, flops_n2, bytes_3n2},
+    {"matrix_sub", MSIZES, setup_matrix, run_matrix_sub, flops_n2, bytes_3n2},
+    {"matrix_scale", MSIZES, setup_matrix, run_matrix_scale, flops_n2,
+     bytes_2n2},
+    {"matrix_multiply", GSIZES, setup_matrix, run_matrix_multiply, flops_2n3,
+     bytes_3n2},
+    {"matrix_multiply_vector", MSIZES, setup_matrix,
+     run_matrix_multiply_vector, flops_2n2, bytes_mv},
+    {"matrix_transpose", MSIZES, setup_matrix, run_matrix_transpose, zero,
+     bytes_2n2},
+    {"matrix_fill", MSIZES, setup_matrix, run_matrix_fill, zero, bytes_n2},
+    {"matrix_identity", MSIZES, setup_size, run_matrix_identity, zero,
+     bytes_n2},
+
+    {"tensor_copy", TSIZES, setup_tensor, run_tensor_copy, zero, bytes_2n3},
+    {"tensor_add", TSIZES, setup_tensor, run_tensor_add, flops_n3, bytes_3n3},
+    {"tensor_sub", TSIZES, setup_tensor, run_tensor_sub, flops_n3, bytes_3n3},
+
+    {"banded_multiply_vector", VSIZES, setup_structured,
+     run_banded_multiply_vector, flops_6n, bytes_5n},
+    {"banded_solve", VSIZES, setup_structured, run_banded_solve, flops_8n,
+     bytes_5n},
+    {"symmetric_multiply_vector", MSIZES, setup_structured,
+     run_symmetric_multiply_vector, flops_2n2, bytes_sym_mv},
+
+    {"mat4_transform_points", VSIZES, setup_points, run_mat4_transform_points,
+     flops_18n, bytes_6n},
+    {"mat4_inverse", {1}, setup_points, run_mat4_inverse, zero, zero},
+
+    {"vmath_exp", VSIZES, setup_vector, run_vmath_exp, flops_n, bytes_2n},
+    {"vmath_log", VSIZES, setup_vector, run_vmath_log, flops_n, bytes_2n},
+    {"vmath_erf", VSIZES, setup_vector, run_vmath_erf, flops_n, bytes_2n},
+    {"vmath_tanh", VSIZES, setup_vector, run_vmath_tanh, flops_n, bytes_2n},
+    {"matrix_map_exp", MSIZES, setup_matrix, run_matrix_map_exp, flops_n2,
+     bytes_2n2},
+    {"matrix_binary_vector", MSIZES, setup_matrix, run_matrix_binary_vector,
+     flops_n2, bytes_2n2},
+
+    {"matrix_reduce_rows", MSIZES, setup_matrix, run_matrix_reduce_rows,
+     flops_n2, bytes_n2},
+    {"matrix_reduce_cols", MSIZES, setup_matrix, run_matrix_reduce_cols,
+     flops_n2, bytes_n2},
+    {"matrix_reduce_argmax", MSIZES, setup_matrix, run_matrix_reduce_argmax,
+     zero, bytes_n2},
+    {"matrix_norm_frobenius", MSIZES, setup_matrix, run_matrix_norm_frobenius,
+     flops_2n2, bytes_n2},
+    {"moments_push", VSIZES, setup_vector, run_moments_push, flops_n, bytes_n},
+    {"moments_push_vector", VSIZES, setup_vector, run_moments_push_vector,
+     flops_n, bytes_n},
+
+    {"qmatrix_quantize", MSIZES, setup_matrix, run_qmatrix_quantize, flops_2n2,
+     bytes_9n2},
+    {"qmatrix_multiply_transpose", GSIZES, setup_quant,
+     run_qmatrix_multiply_transpose, flops_2n3, bytes_10n2},
+    {"qmatrix_multiply_vector", MSIZES, setup_quant,
+     run_qmatrix_multiply_vector, flops_2n2, bytes_q_mv},
+
+    {"conv2d_3x3_direct", CSIZES, setup_conv, run_conv2d_3x3_direct,
+     flops_conv3, zero},
+    {"conv2d_3x3_im2col", CSIZES, setup_conv, run_conv2d_3x3_im2col,
+     flops_conv3, zero},
+    {"conv2d_7x7_direct", CSIZES, setup_conv, run_conv2d_7x7_direct,
+     flops_conv7, zero},
+    {"conv2d_7x7_im2col", CSIZES, setup_conv, run_conv2d_7x7_im2col,
+     flops_conv7, zero},
+    {"pool2d_max", CSIZES, setup_conv, run_pool2d_max, flops_pool, zero},
+
+    {"matrix_column_dot", MSIZES, setup_matrix, run_matrix_column_dot,
+     flops_2n, bytes_2n},
+    {"matrix_axpy", MSIZES, setup_matrix, run_matrix_axpy, flops_2n2,
+     bytes_3n2},
+
+    {"kronecker_multiply_vector", KSIZES, setup_kron,
+     run_kronecker_multiply_vector, flops_4n3, bytes_2n2},
+    {"kronecker_explicit_vector", KSIZES, setup_kron,
+     run_kronecker_explicit_vector, flops_2n4, bytes_n4},
+
+    {"matrix_cholesky", GSIZES, setup_cholesky, run_matrix_cholesky,
+     flops_n3_3, bytes_2n2},
+    {"matrix_cholesky_update", MSIZES, setup_cholesky,
+     run_matrix_cholesky_update, flops_9n2, bytes_2n2},
+    {"matrix_inverse_update_rank1", MSIZES, setup_cholesky,
+     run_matrix_inverse_update_rank1, flops_12n2, bytes_3n2},
+
+    {"mvnormal_logpdf_batch", {4, 16, 64}, setup_mvnormal,
+     run_mvnormal_logpdf_batch, flops_mv, bytes_mv_rows},
+    {"mvmoments_push_rows", {4, 16, 64}, setup_mvnormal,
+     run_mvmoments_push_rows, flops_mv, bytes_mv_rows},
+    {"matrix_covariance", {16, 64, 256}, setup_mvnormal,
+     run_matrix_covariance, flops_mv, bytes_mv_rows},
+    {"matrix_covariance_explicit", {16, 64, 256}, setup_mvnormal,
+     run_matrix_covariance_explicit, flops_mv, bytes_mv_rows},
+
+    {"disk_matrix_multiply", GSIZES, setup_disk, run_disk_matrix_multiply,
+     flops_2n3, bytes_3n2},
+
+    {"pipeline_sum_products", GSIZES, setup_matrix, run_pipeline_sum_products,
+     flops_8n3, zero},
+
+    {"binomial_pmf", SSIZES, setup_size, run_binomial_pmf, zero, zero},
+    {"binomial_cdf", SSIZES, setup_size, run_binomial_cdf, zero, zero},
+    {"geometric_pmf", SSIZES, setup_size, run_geometric_pmf, zero, zero},
+    {"geometric_cdf", SSIZES, setup_size, run_geometric_cdf, zero, zero},
+    {"hypergeometric_pmf", SSIZES, setup_size, run_hypergeometric_pmf, zero,
+     zero},
+    {"hypergeometric_cdf", SSIZES, setup_size, run_hypergeometric_cdf, zero,
+     zero},
+    {"negative_binomial_pmf", SSIZES, setup_size, run_negative_binomial_pmf,
+     zero, zero},
+    {"negative_binomial_cdf", SSIZES, setup_size, run_negative_binomial_cdf,
+     zero, zero},
+    {"poisson_pmf", SSIZES, setup_size, run_poisson_pmf, zero, zero},
+    {"poisson_cdf", SSIZES, setup_size, run_poisson_cdf, zero, zero},
+    {"binomial_pmf_table", SSIZES, setup_size, run_binomial_pmf_table, zero,
+     zero},
+    {"poisson_pmf_table", SSIZES, setup_size, run_poisson_pmf_table, zero,
+     zero},
+    {"normal_pmf", SSIZES, setup_size, run_normal_pmf, zero, zero},
+    {"normal_cdf", SSIZES, setup_size, run_normal_cdf, zero, zero},
+    {"normal_pmf_frozen", SSIZES, setup_size, run_normal_pmf_frozen, zero,
+     zero},
+    {"geometric_pmf_frozen", SSIZES, setup_size, run_geometric_pmf_frozen,
+     zero, zero},
+
+    {"poisson_pmf_batch", VSIZES, setup_stats_batch, run_poisson_pmf_batch,
+     flops_n, bytes_n},
+    {"binomial_cdf_batch", VSIZES, setup_stats_batch, run_binomial_cdf_batch,
+     flops_n, bytes_n},
+    {"normal_pmf_batch", VSIZES, setup_stats_batch, run_normal_pmf_batch,
+     flops_n, bytes_n},
+    {"normal_cdf_batch", VSIZES, setup_stats_batch, run_normal_cdf_batch,
+     flops_n, bytes_n},
+    {"normal_quantile_batch", VSIZES, setup_quantile_batch,
+     run_normal_quantile_batch, flops_n, bytes_n},
+    {"binomial_quantile_batch", VSIZES, setup_quantile_batch,
+     run_binomial_quantile_batch, flops_n, bytes_n},
+    {"poisson_quantile_batch", VSIZES, setup_quantile_batch,
+     run_poisson_quantile_batch, flops_n, bytes_n},
+    {"uniform_sample_fill", VSIZES, setup_vector, run_uniform_sample_fill,
+     zero, bytes_n},
+    {"normal_sample_fill", VSIZES, setup_vector, run_normal_sample_fill, zero,
+     bytes_n},
+    {"binomial_sample_fill", VSIZES, setup_vector, run_binomial_sample_fill,
+     zero, bytes_n},
+    {"hypergeometric_sample_fill", VSIZES, setup_vector,
+     run_hypergeometric_sample_fill, zero, bytes_n},
+    {"poisson_sample_fill", VSIZES, setup_vector, run_poisson_sample_fill,
+     zero, bytes_n},
+    {"alias_sample_fill", VSIZES, setup_vector, run_alias_sample_fill, zero,
+     bytes_n},
+    {"guide_sample_fill", VSIZES, setup_vector, run_guide_sample_fill, zero,
+     bytes_n},
+    {"fenwick_sample_fill", VSIZES, setup_vector, run_fenwick_sample_fill,
+     zero, bytes_n},
+};
+
+// Measurement
+// -----------------------------------------------------------------------------
+typedef struct {
+  const char *json;
+  const char *filter;
+  int reps;
+  int warmup;
+  double min_time_ns;
+  int quick;
+} BenchOptions;
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double sample(Benchmark *b, BenchData *d, long iters) {
+  double start = now_ns();
+  for (long i = 0; i < iters; i++) {
+    b->run(d);
+  }
+  return now_ns() - start;
+}
+
+static BenchResult measure(Benchmark *b, int n, BenchOptions *opt) {
+  BenchResult r = {0};
+  BenchData d = {0};
+  double *times = malloc(opt->reps * sizeof(double));
+
+  d.n = n;
+  b->setup(&d, n);
+
+  // Grow the inner loop until one sample is long enough to time reliably
+  long iters = 1;
+  while (sample(b, &d, iters) < opt->min_time_ns && iters < (1L << 30)) {
+    iters *= 2;
+  }
+
+  for (int i = 0; i < opt->warmup; i++) {
+    sample(b, &d, iters);
+  }
+
+  double total = 0;
+  for (int i = 0; i < opt->reps; i++) {
+    times[i] = sample(b, &d, iters) / iters;
+    total += times[i];
+  }
+  qsort(times, opt->reps, sizeof(double), compare_double);
+
+  int p99 = (int)ceil(0.99 * opt->reps) - 1;
+  snprintf(r.name, sizeof(r.name), "%s", b->name);
+  r.n = n;
+  r.iters = iters;
+  r.reps = opt->reps;
+  r.median_ns = opt->reps % 2
+                    ? times[opt->reps / 2]
+                    : 0.5 * (times[opt->reps / 2 - 1] + times[opt->reps / 2]);
+  r.p99_ns = times[p99 < 0 ? 0 : p99];
+  r.min_ns = times[0];
+  r.mean_ns = total / opt->reps;
+  r.gflops = b->flops(n) / r.median_ns;
+  r.gbps = b->bytes(n) / r.median_ns;
+
+  teardown(&d);
+  free(times);
+  return r;
+}
+
+static void print_header() {
+  printf("%-28s %9s %12s %12s %10s %10s\n", "kernel", "n", "median(ns)",
+         "p99(ns)", "GFLOP/s", "GB/s");
+}
+
+static void print_result(BenchResult *r) {
+  printf("%-28s %9d %12.1f %12.1f", r->name, r->n, r->median_ns, r->p99_ns);
+  if (r->gflops > 0) {
+    printf(" %10.3f", r->gflops);
+  } else {
+    printf(" %10s", "-");
+  }
+  if (r->gbps > 0) {
+    printf(" %10.3f\n", r->gbps);
+  } else {
+    printf(" %10s\n", "-");
+  }
+}
+
+// JSON, one result object per line so files can be read back with sscanf
+// -----------------------------------------------------------------------------
+static int write_json(const char *path, BenchResult *results, int count) {
+  FILE *f = fopen(path, "w");
+
+  if (f == NULL) {
+    fprintf(stderr, "Error: write_json() cannot open %s\n", path);
+    return -1;
+  }
+
+  fprintf(f, "{\"schema\": 1, \"results\": [\n");
+  for (int i = 0; i < count; i++) {
+    BenchResult *r = &results[i];
+    fprintf(f,
+            "{\"name\": \"%s\", \"n\": %d, \"iters\": %ld, \"reps\": %d, "
+            "\"median_ns\": %.3f, \"p99_ns\": %.3f, \"min_ns\": %.3f, "
+            "\"mean_ns\": %.3f, \"gflops\": %.6f, \"gbps\": %.6f}%s\n",
+            r->name, r->n, r->iters, r->reps, r->median_ns, r->p99_ns,
+            r->min_ns, r->mean_ns, r->gflops, r->gbps,
+            i + 1 < count ? "," : "");
+  }
+  fprintf(f, "]}\n");
+
+  fclose(f);
+  return 0;
+}
+
+static int read_json(const char *path, BenchResult *results, int max) {
+  FILE *f = fopen(path, "r");
+
+  if (f == NULL) {
+    fprintf(stderr, "Error: read_json() cannot open %s\n", path);
+    return -1;
+  }
+
+  char line[1024];
+  int count = 0;
+  while (count < max && fgets(line, sizeof(line), f) != NULL) {
+    BenchResult *r = &results[count];
+    if (sscanf(line,
+               "{\"name\": \"%63[^\"]\", \"n\": %d, \"iters\": %ld, "
+               "\"reps\": %d, \"median_ns\": %lf, \"p99_ns\": %lf, "
+               "\"min_ns\": %lf, \"mean_ns\": %lf, \"gflops\": %lf, "
+               "\"gbps\": %lf}",
+               r->name, &r->n, &r->iters, &r->reps, &r->median_ns, &r->p99_ns,
+               &r->min_ns, &r->mean_ns, &r->gflops, &r->gbps) == 10) {
+      count++;
+    }
+  }
+
+  fclose(f);
+  return count;
+}
+
+// Returns the number of regressions, i.e. kernels whose median got slower by
+// more than threshold percent
+static int compare(const char *base_path, const char *new_path,
+                   double threshold) {
+  static BenchResult base[MAX_RESULTS], cur[MAX_RESULTS];
+  int nbase = read_json(base_path, base, MAX_RESULTS);
+  int ncur = read_json(new_path, cur, MAX_RESULTS);
+
+  if (nbase < 0 || ncur < 0) {
+    return -1;
+  }
+
+  int regressions = 0;
+  printf("%-28s %9s %12s %12s %9s\n", "kernel", "n", "base(ns)", "new(ns)",
+         "change");
+  for (int i = 0; i < ncur; i++) {
+    for (int j = 0; j < nbase; j++) {
+      if (strcmp(cur[i].name, base[j].name) != 0 || cur[i].n != base[j].n) {
+        continue;
+      }
+
+      double change = 100.0 * (cur[i].median_ns / base[j].median_ns - 1.0);
+      const char *flag = "";
+      if (change > threshold) {
+        flag = "  REGRESSION";
+        regressions++;
+      } else if (change < -threshold) {
+        flag = "  improved";
+      }
+      printf("%-28s %9d %12.1f %12.1f %+8.1f%%%s\n", cur[i].name, cur[i].n,
+             base[j].median_ns, cur[i].median_ns, change, flag);
+      break;
+    }
+  }
+
+  printf("\n%d regression(s) above %.1f%%\n", regressions, threshold);
+  return regressions;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--json FILE] [--filter SUBSTR] [--reps N] "
+          "[--warmup N] [--min-time-us US] [--quick]\n"
+          "       %s --compare BASE.json NEW.json [--threshold PCT]\n",
+          prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+  BenchOptions opt = {NULL, NULL, 25, 3, 2e5, 0};
+  const char *compare_base = NULL, *compare_new = NULL;
+  double threshold = 5.0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      opt.json = argv[++i];
+    } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      opt.filter = argv[++i];
+    } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+      opt.reps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      opt.warmup = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--min-time-us") == 0 && i + 1 < argc) {
+      opt.min_time_ns = atof(argv[++i]) * 1e3;
+    } else if (strcmp(argv[i], "--quick") == 0) {
+      opt.quick = 1;
+    } else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+      compare_base = argv[++i];
+      compare_new = argv[++i];
+    } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (compare_base != NULL) {
+    int regressions = compare(compare_base, compare_new, threshold);
+    return regressions == 0 ? 0 : 1;
+  }
+
+  if (opt.reps < 1) {
+    opt.reps = 1;
+  }
+
+  static BenchResult results[MAX_RESULTS];
+  int count = 0;
+  int nbench = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+  print_header();
+  for (int b = 0; b < nbench; b++) {
+    if (opt.filter != NULL && strstr(benchmarks[b].name, opt.filter) == NULL) {
+      continue;
+    }
+
+    for (int s = 0; s < MAX_SIZES && benchmarks[b].sizes[s] != 0; s++) {
+      if (opt.quick && s >= 2) {
+        break;
+      }
+      if (count == MAX_RESULTS) {
+        break;
+      }
+
+      results[count] = measure(&benchmarks[b], benchmarks[b].sizes[s], &opt);
+      print_result(&results[count]);
+      fflush(stdout);
+      count++;
+    }
+  }
+
+  if (opt.json != NULL && write_json(opt.json, results, count) != 0) {
+    return 1;
+  }
+
+  return 0;
+}
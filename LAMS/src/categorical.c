@@ -0,0 +1,326 @@
+#include "categorical.h"
+#include "instrument.h"
+#include <limits.h>
+
+// Tables
+// -----------------------------------------------------------------------------
+static void release(categorical_t *c) {
+  free(c->prob);
+  free(c->alias);
+  free(c->cdf);
+  free(c->guide);
+  free(c->tree);
+  c->prob = c->cdf = c->tree = NULL;
+  c->alias = c->guide = NULL;
+}
+
+// Vose: slots scaled to mean 1 are paired off, each under-full slot is
+// topped up by an over-full one that then joins the side it falls on.
+// work holds the under-full slots from the front and the rest from the
+// back. Whatever rounding leaves over is full.
+static int build_alias(categorical_t *c) {
+  long n = c->size, small = 0, large = n;
+  double scale = n / c->total;
+  long *work = malloc(n * sizeof(long));
+
+  c->prob = malloc(n * sizeof(double));
+  c->alias = malloc(n * sizeof(long));
+  if (work == NULL || c->prob == NULL || c->alias == NULL) {
+    free(work);
+    return -1;
+  }
+
+  for (long i = 0; i < n; i++) {
+    c->prob[i] = c->weight[i] * scale;
+    if (c->prob[i] < 1) {
+      work[small++] = i;
+    } else {
+      work[--large] = i;
+    }
+  }
+  while (small > 0 && large < n) {
+    long s = work[--small], l = work[large];
+    c->alias[s] = l;
+    c->prob[l] -= 1 - c->prob[s];
+    if (c->prob[l] < 1) {
+      large++;
+      work[small++] = l;
+    }
+  }
+  while (small > 0) {
+    long s = work[--small];
+    c->prob[s] = 1;
+    c->alias[s] = s;
+  }
+  while (large < n) {
+    long l = work[large++];
+    c->prob[l] = 1;
+    c->alias[l] = l;
+  }
+
+  free(work);
+  return 0;
+}
+
+static int build_guide(categorical_t *c) {
+  long n = c->size, i = 0;
+  double sum = 0;
+
+  c->cdf = malloc(n * sizeof(double));
+  c->guide = malloc(n * sizeof(long));
+  if (c->cdf == NULL || c->guide == NULL) {
+    return -1;
+  }
+
+  for (long k = 0; k < n; k++) {
+    sum += c->weight[k];
+    c->cdf[k] = sum;
+  }
+  c->total = sum;
+  for (long j = 0; j < n; j++) {
+    while (i < n - 1 && c->cdf[i] <= j * sum / n) {
+      i++;
+    }
+    c->guide[j] = i;
+  }
+  return 0;
+}
+
+// 1-based, each entry passes its sum on to the next range that covers it
+static int build_fenwick(categorical_t *c) {
+  long n = c->size;
+
+  c->tree = malloc((n + 1) * sizeof(double));
+  if (c->tree == NULL) {
+    return -1;
+  }
+
+  c->tree[0] = 0;
+  for (long i = 1; i <= n; i++) {
+    c->tree[i] = c->weight[i - 1];
+  }
+  for (long i = 1; i <= n; i++) {
+    long up = i + (i & -i);
+    if (up <= n) {
+      c->tree[up] += c->tree[i];
+    }
+  }
+  return 0;
+}
+
+static int build(categorical_t *c, CategoricalMethod method,
+                 const char *name) {
+  LAMS_PROF_BEGIN();
+  double total = 0;
+  int status;
+
+  for (long i = 0; i < c->size; i++) {
+    total += c->weight[i];
+  }
+  c->method = method;
+  c->total = total;
+  status = method == CATEGORICAL_ALIAS   ? build_alias(c)
+           : method == CATEGORICAL_GUIDE ? build_guide(c)
+                                         : build_fenwick(c);
+  if (status != 0) {
+    fprintf(stderr, "Error: %s() failed to allocate memory", name);
+    release(c);
+    return -1;
+  }
+
+  LAMS_PROF_END(categorical_build, c->size);
+  return 0;
+}
+
+categorical_t *categorical_new(Vector *weights, CategoricalMethod method) {
+  double total = 0;
+
+  for (int i = 0; i < weights->size; i++) {
+    double w = weights->data[i];
+    if (!(w >= 0 && w < INFINITY)) {
+      fprintf(stderr, "Error: categorical_new() weights must be finite and "
+                      "not negative");
+      return NULL;
+    }
+    total += w;
+  }
+  if (!(total > 0 && total < INFINITY)) {
+    fprintf(stderr, "Error: categorical_new() needs a positive finite total "
+                    "weight");
+    return NULL;
+  }
+
+  categorical_t *c = calloc(1, sizeof(categorical_t));
+  if (c == NULL) {
+    fprintf(stderr, "Error: categorical_new() failed to allocate memory");
+    return NULL;
+  }
+
+  c->size = weights->size;
+  c->weight = malloc(c->size * sizeof(double));
+  if (c->weight == NULL) {
+    fprintf(stderr, "Error: categorical_new() failed to allocate memory");
+    free(c);
+    return NULL;
+  }
+
+  for (long i = 0; i < c->size; i++) {
+    c->weight[i] = weights->data[i];
+  }
+  if (build(c, method, "categorical_new") != 0) {
+    categorical_free(c);
+    return NULL;
+  }
+  return c;
+}
+
+categorical_t *categorical_from_distribution(const distribution_t *d,
+                                             double tolerance,
+                                             CategoricalMethod method) {
+  if (!d->ops->discrete) {
+    fprintf(stderr, "Error: categorical_from_distribution() needs a "
+                    "discrete law");
+    return NULL;
+  }
+
+  double lo = d->lo, hi = d->hi;
+  if (tolerance > 0) {
+    lo = distribution_quantile(d, 0.5 * tolerance);
+    hi = distribution_quantile(d, 1 - 0.5 * tolerance);
+  }
+  if (!(hi - lo < INT_MAX)) {
+    fprintf(stderr, "Error: categorical_from_distribution() support too "
+                    "large, an unbounded law needs a tolerance");
+    return NULL;
+  }
+
+  Vector *pmf = vector_new(hi - lo + 1);
+  if (pmf == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < pmf->size; i++) {
+    pmf->data[i] = distribution_pmf(d, lo + i);
+  }
+  categorical_t *c = categorical_new(pmf, method);
+  vector_free(pmf);
+  if (c != NULL) {
+    c->first = lo;
+  }
+  return c;
+}
+
+void categorical_free(categorical_t *c) {
+  if (c == NULL) {
+    return;
+  }
+
+  release(c);
+  free(c->weight);
+  free(c);
+}
+
+// Draws
+// -----------------------------------------------------------------------------
+// One uniform picks the slot with its integer part and the side of the
+// slot with the rest
+static long draw_alias(const categorical_t *c, double u) {
+  double x = u * c->size;
+  long i = x;
+
+  i = i < c->size ? i : c->size - 1;
+  return x - i < c->prob[i] ? i : c->alias[i];
+}
+
+static long draw_guide(const categorical_t *c, double u) {
+  double t = u * c->total;
+  long i = c->guide[(long)(u * c->size)];
+
+  while (i < c->size - 1 && c->cdf[i] <= t) {
+    i++;
+  }
+  return i;
+}
+
+// Descends to the last index whose prefix sum is at most t, the draw is
+// the index after it
+static long draw_fenwick(const categorical_t *c, double u) {
+  double t = u * c->total;
+  long n = c->size, i = 0;
+
+  for (long step = 1L << (63 - __builtin_clzl(n)); step > 0; step >>= 1) {
+    if (i + step <= n && c->tree[i + step] <= t) {
+      i += step;
+      t -= c->tree[i];
+    }
+  }
+  if (i == n) {
+    // rounding past the end, back to the last positive weight
+    for (i = n - 1; i > 0 && c->weight[i] == 0; i--) {
+    }
+  }
+  return i;
+}
+
+static double categorical_draw(const void *ctx, rng_t *rng) {
+  const categorical_t *c = ctx;
+  double u = rng_uniform(rng);
+  long i = c->method == CATEGORICAL_ALIAS   ? draw_alias(c, u)
+           : c->method == CATEGORICAL_GUIDE ? draw_guide(c, u)
+                                            : draw_fenwick(c, u);
+  return c->first + i;
+}
+
+double categorical_sample(const categorical_t *c, rng_t *rng) {
+  return categorical_draw(c, rng);
+}
+
+int categorical_sample_fill(const categorical_t *c, rng_t *rng, Vector *out) {
+  return rng_fill(rng, out, categorical_draw, c);
+}
+
+// Updates
+// -----------------------------------------------------------------------------
+int categorical_update(categorical_t *c, long i, double weight) {
+  if (i < 0 || i >= c->size) {
+    fprintf(stderr, "Error: categorical_update() index %ld outside 0..%ld", i,
+            c->size - 1);
+    return -1;
+  }
+  if (!(weight >= 0 && weight < INFINITY) ||
+      !(c->total - c->weight[i] + weight > 0)) {
+    fprintf(stderr, "Error: categorical_update() weight must be finite, not "
+                    "negative and leave a positive total");
+    return -1;
+  }
+  if (c->method != CATEGORICAL_FENWICK &&
+      categorical_rebuild(c, CATEGORICAL_FENWICK) != 0) {
+    return -1;
+  }
+
+  double delta = weight - c->weight[i], total = 0;
+  c->weight[i] = weight;
+  for (long k = i + 1; k <= c->size; k += k & -k) {
+    c->tree[k] += delta;
+  }
+  for (long k = c->size; k > 0; k -= k & -k) {
+    total += c->tree[k];
+  }
+  c->total = total;
+  return 0;
+}
+
+// The old table stays when the new one cannot be built
+int categorical_rebuild(categorical_t *c, CategoricalMethod method) {
+  categorical_t next = *c;
+
+  next.prob = next.cdf = next.tree = NULL;
+  next.alias = next.guide = NULL;
+  if (build(&next, method, "categorical_rebuild") != 0) {
+    return -1;
+  }
+
+  release(c);
+  *c = next;
+  return 0;
+}
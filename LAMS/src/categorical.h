@@ -0,0 +1,69 @@
+#ifndef CATEGORICAL_H
+#define CATEGORICAL_H
+
+#include "distribution.h"
+#include "linear_algebra.h"
+#include "random.h"
+
+/*
+ * Categorical samplers
+ *
+ * Draw index i with probability weight[i] / sum(weight) from a fixed set of
+ * weights, or the value first + i when the weights are the pmf of a frozen
+ * discrete law from first on.
+ *
+ * CATEGORICAL_ALIAS builds Vose's alias table: slot i keeps i with
+ * probability prob[i] and gives alias[i] otherwise, so a draw is one
+ * uniform, one multiply and one comparison. CATEGORICAL_GUIDE inverts the
+ * cumulative weights, starting from the guide entry of the equal-width
+ * bin u falls in, under two comparisons on average. Both are built in
+ * O(size) and cannot change.
+ *
+ * categorical_update changes one weight. A table that is not a Fenwick
+ * tree (CATEGORICAL_FENWICK) becomes one first; the tree keeps partial sums
+ * of the weights, so updates and draws both take O(log size).
+ * categorical_rebuild turns it back into an O(1) table once the updates
+ * are over.
+ *
+ * categorical_sample_fill draws into a Vector like the fills of random.h.
+ *
+ */
+
+typedef enum {
+  CATEGORICAL_ALIAS,
+  CATEGORICAL_GUIDE,
+  CATEGORICAL_FENWICK
+} CategoricalMethod;
+
+typedef struct {
+  CategoricalMethod method;
+  long size;
+  double first; // value of index 0
+  double total; // sum of the weights
+  double *weight;
+  double *prob; // alias: chance of keeping the slot
+  long *alias;
+  double *cdf; // guide: cumulative weights
+  long *guide; // smallest i with cdf[i] > j total / size
+  double *tree; // Fenwick: tree[i] sums weight over (i - (i & -i), i]
+} categorical_t;
+
+// NULL on negative or non-finite weights, or when they are all 0
+categorical_t *categorical_new(Vector *weights, CategoricalMethod method);
+
+// The pmf of a discrete law over its support, or over the quantiles
+// tolerance / 2 and 1 - tolerance / 2, which an unbounded support needs
+categorical_t *categorical_from_distribution(const distribution_t *d,
+                                             double tolerance,
+                                             CategoricalMethod method);
+void categorical_free(categorical_t *c);
+
+double categorical_sample(const categorical_t *c, rng_t *rng);
+int categorical_sample_fill(const categorical_t *c, rng_t *rng, Vector *out);
+
+// Both return 0, or -1 on an index outside the table, an invalid weight or
+// a failed allocation
+int categorical_update(categorical_t *c, long i, double weight);
+int categorical_rebuild(categorical_t *c, CategoricalMethod method);
+
+#endif
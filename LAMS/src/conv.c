@@ -0,0 +1,354 @@
+#include "conv.h"
+#include "instrument.h"
+#include "parallel.h"
+
+// CONV_AUTO runs kernels up to this area directly, larger ones through
+// im2col while its matrix stays about L2 sized. Past that the direct loops
+// win because matrix_multiply streams the whole im2col matrix per row.
+#define DIRECT_MAX_TAPS 9
+#define IM2COL_MAX_ENTRIES (1L << 18)
+
+typedef struct {
+  int channels, in[2], kernel[2], out[2];
+  int stride[2], padding[2], dilation[2];
+} Geometry;
+
+typedef struct {
+  Tensor *input, **kernels, *out;
+  Vector *bias;
+  Matrix *columns;
+  Geometry g;
+  int flip;
+  PoolOp op;
+} ConvJob;
+
+// Geometry
+// -----------------------------------------------------------------------------
+// Whether every output along one axis has a tap inside the input, dilated
+// windows can fall wholly between padded entries
+static int windows_cover_input(const Geometry *g, int a) {
+  for (int o = 0; o < g->out[a]; o++) {
+    int start = o * g->stride[a] - g->padding[a];
+    int k = start >= 0 ? 0 : (-start + g->dilation[a] - 1) / g->dilation[a];
+    if (k >= g->kernel[a] || start + k * g->dilation[a] >= g->in[a]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int geometry(Tensor *input, int kernel_rows, int kernel_cols,
+                    ConvOptions *opts, int pool, Geometry *g,
+                    const char *name) {
+  ConvOptions none = {0};
+  opts = opts != NULL ? opts : &none;
+
+  g->channels = input->rank;
+  g->in[0] = input->rows;
+  g->in[1] = input->cols;
+  g->kernel[0] = kernel_rows;
+  g->kernel[1] = kernel_cols;
+
+  for (int a = 0; a < 2; a++) {
+    int stride = opts->stride[a], dilation = opts->dilation[a];
+    g->stride[a] = stride > 0 ? stride : pool ? g->kernel[a] : 1;
+    g->dilation[a] = dilation > 0 ? dilation : 1;
+    g->padding[a] = opts->padding[a];
+
+    int extent = g->dilation[a] * (g->kernel[a] - 1) + 1;
+    int span = g->in[a] + 2 * g->padding[a] - extent;
+    if (g->kernel[a] < 1 || g->padding[a] < 0 || span < 0 ||
+        (pool && g->padding[a] >= g->kernel[a])) {
+      fprintf(stderr, "Error: %s() invalid kernel size or padding", name);
+      return -1;
+    }
+    g->out[a] = span / g->stride[a] + 1;
+    if (pool && !windows_cover_input(g, a)) {
+      fprintf(stderr, "Error: %s() a window covers only padding", name);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Outputs o in [lo, hi) read input index o * stride + offset inside [0, size)
+static void valid_range(int offset, int stride, int size, int out, int *lo,
+                        int *hi) {
+  *lo = offset >= 0 ? 0 : (-offset + stride - 1) / stride;
+  *hi = size - offset > 0 ? (size - offset - 1) / stride + 1 : 0;
+  *hi = *hi < out ? *hi : out;
+}
+
+static int check_kernels(Tensor *input, Tensor **kernels, int num_kernels,
+                         Vector *bias) {
+  if (kernels == NULL || num_kernels < 1) {
+    fprintf(stderr, "Error: tensor_conv2d() needs at least one kernel");
+    return -1;
+  }
+  for (int o = 0; o < num_kernels; o++) {
+    if (kernels[o] == NULL || kernels[o]->rank != input->rank ||
+        kernels[o]->rows != kernels[0]->rows ||
+        kernels[o]->cols != kernels[0]->cols) {
+      fprintf(stderr, "Error: tensor_conv2d() kernels must have one channel "
+                      "per input channel and the same size");
+      return -1;
+    }
+  }
+  if (bias != NULL && bias->size != num_kernels) {
+    fprintf(stderr, "Error: tensor_conv2d() needs one bias per kernel");
+    return -1;
+  }
+  return 0;
+}
+
+static double kernel_tap(ConvJob *job, int o, int c, int ki, int kj) {
+  const Geometry *g = &job->g;
+  if (job->flip) {
+    ki = g->kernel[0] - 1 - ki;
+    kj = g->kernel[1] - 1 - kj;
+  }
+  return job->kernels[o]->data[c][ki][kj];
+}
+
+// Direct convolution
+// -----------------------------------------------------------------------------
+// Output rows r = o * out_rows + oy, each accumulates one kernel tap at a
+// time over the whole row
+static void direct_rows(long begin, long end, void *ctx) {
+  ConvJob *job = ctx;
+  const Geometry *g = &job->g;
+
+  for (long r = begin; r < end; r++) {
+    int o = r / g->out[0], oy = r % g->out[0];
+    double *y = job->out->data[o][oy];
+    double b = job->bias != NULL ? job->bias->data[o] : 0.0;
+    for (int ox = 0; ox < g->out[1]; ox++) {
+      y[ox] = b;
+    }
+
+    for (int c = 0; c < g->channels; c++) {
+      for (int ki = 0; ki < g->kernel[0]; ki++) {
+        int iy = oy * g->stride[0] - g->padding[0] + ki * g->dilation[0];
+        if (iy < 0 || iy >= g->in[0]) {
+          continue;
+        }
+        const double *x = job->input->data[c][iy];
+
+        for (int kj = 0; kj < g->kernel[1]; kj++) {
+          double w = kernel_tap(job, o, c, ki, kj);
+          int offset = kj * g->dilation[1] - g->padding[1], lo, hi;
+          valid_range(offset, g->stride[1], g->in[1], g->out[1], &lo, &hi);
+          if (g->stride[1] == 1) {
+            for (int ox = lo; ox < hi; ox++) {
+              y[ox] += w * x[ox + offset];
+            }
+          } else {
+            for (int ox = lo; ox < hi; ox++) {
+              y[ox] += w * x[ox * g->stride[1] + offset];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// im2col
+// -----------------------------------------------------------------------------
+static void im2col_rows(long begin, long end, void *ctx) {
+  ConvJob *job = ctx;
+  const Geometry *g = &job->g;
+  int taps = g->kernel[0] * g->kernel[1];
+
+  for (long r = begin; r < end; r++) {
+    int c = r / taps, ki = r % taps / g->kernel[1], kj = r % g->kernel[1];
+    double *y = job->columns->data[r];
+    int offset = kj * g->dilation[1] - g->padding[1], lo, hi;
+    valid_range(offset, g->stride[1], g->in[1], g->out[1], &lo, &hi);
+
+    for (int oy = 0; oy < g->out[0]; oy++, y += g->out[1]) {
+      int iy = oy * g->stride[0] - g->padding[0] + ki * g->dilation[0];
+      int inside = iy >= 0 && iy < g->in[0];
+      const double *x = inside ? job->input->data[c][iy] : NULL;
+      for (int ox = 0; ox < g->out[1]; ox++) {
+        y[ox] = inside && ox >= lo && ox < hi
+                    ? x[ox * g->stride[1] + offset]
+                    : 0.0;
+      }
+    }
+  }
+}
+
+static Matrix *im2col(ConvJob *job) {
+  const Geometry *g = &job->g;
+  Matrix *columns = matrix_new(g->channels * g->kernel[0] * g->kernel[1],
+                               g->out[0] * g->out[1]);
+
+  if (columns == NULL) {
+    return NULL;
+  }
+
+  job->columns = columns;
+  lams_parallel_for(columns->rows, lams_parallel_grain(columns->cols),
+                    im2col_rows, job);
+  return columns;
+}
+
+Matrix *tensor_im2col(Tensor *input, int kernel_rows, int kernel_cols,
+                      ConvOptions *opts) {
+  LAMS_PROF_BEGIN();
+  ConvJob job = {.input = input};
+
+  if (geometry(input, kernel_rows, kernel_cols, opts, 0, &job.g,
+               "tensor_im2col") != 0) {
+    return NULL;
+  }
+
+  Matrix *columns = im2col(&job);
+  LAMS_PROF_END(tensor_im2col, 0);
+  return columns;
+}
+
+// Weights as rows, times the im2col matrix, gives one output channel per row
+static int conv_im2col(ConvJob *job, int num_kernels) {
+  const Geometry *g = &job->g;
+  Matrix *columns = im2col(job);
+  Matrix *weights = matrix_new(num_kernels, columns ? columns->rows : 0);
+  Matrix *product = NULL;
+
+  if (columns != NULL && weights != NULL) {
+    for (int o = 0; o < num_kernels; o++) {
+      int k = 0;
+      for (int c = 0; c < g->channels; c++) {
+        for (int ki = 0; ki < g->kernel[0]; ki++) {
+          for (int kj = 0; kj < g->kernel[1]; kj++) {
+            weights->data[o][k++] = kernel_tap(job, o, c, ki, kj);
+          }
+        }
+      }
+    }
+    product = matrix_multiply(weights, columns);
+  }
+
+  if (product != NULL) {
+    for (int o = 0; o < num_kernels; o++) {
+      double b = job->bias != NULL ? job->bias->data[o] : 0.0;
+      const double *x = product->data[o];
+      for (int oy = 0; oy < g->out[0]; oy++, x += g->out[1]) {
+        double *y = job->out->data[o][oy];
+        for (int ox = 0; ox < g->out[1]; ox++) {
+          y[ox] = x[ox] + b;
+        }
+      }
+    }
+  }
+
+  int status = product != NULL ? 0 : -1;
+  matrix_free(columns);
+  matrix_free(weights);
+  matrix_free(product);
+  return status;
+}
+
+Tensor *tensor_conv2d(Tensor *input, Tensor **kernels, int num_kernels,
+                      Vector *bias, ConvOptions *opts) {
+  LAMS_PROF_BEGIN();
+  ConvJob job = {.input = input, .kernels = kernels, .bias = bias};
+
+  if (check_kernels(input, kernels, num_kernels, bias) != 0 ||
+      geometry(input, kernels[0]->rows, kernels[0]->cols, opts, 0, &job.g,
+               "tensor_conv2d") != 0) {
+    return NULL;
+  }
+
+  const Geometry *g = &job.g;
+  job.flip = opts != NULL && opts->mode == CONV_CONVOLVE;
+  job.out = tensor_new(g->out[0], g->out[1], num_kernels);
+  if (job.out == NULL) {
+    return NULL;
+  }
+
+  ConvAlgorithm algorithm = opts != NULL ? opts->algorithm : CONV_AUTO;
+  long taps = (long)g->channels * g->kernel[0] * g->kernel[1];
+  if (algorithm == CONV_AUTO) {
+    int large = g->kernel[0] * g->kernel[1] > DIRECT_MAX_TAPS;
+    long entries = taps * g->out[0] * g->out[1];
+    algorithm = large && entries <= IM2COL_MAX_ENTRIES ? CONV_IM2COL
+                                                       : CONV_DIRECT;
+  }
+  if (algorithm == CONV_DIRECT) {
+    lams_parallel_for((long)num_kernels * g->out[0],
+                      lams_parallel_grain(g->out[1] * taps), direct_rows,
+                      &job);
+  } else if (conv_im2col(&job, num_kernels) != 0) {
+    fprintf(stderr, "Error: tensor_conv2d() failed to allocate memory");
+    tensor_free(job.out);
+    return NULL;
+  }
+
+  LAMS_PROF_END(tensor_conv2d,
+                2.0 * num_kernels * g->out[0] * g->out[1] * taps);
+  return job.out;
+}
+
+// Pooling
+// -----------------------------------------------------------------------------
+static void pool_rows(long begin, long end, void *ctx) {
+  ConvJob *job = ctx;
+  const Geometry *g = &job->g;
+
+  for (long r = begin; r < end; r++) {
+    int c = r / g->out[0], oy = r % g->out[0];
+    double *y = job->out->data[c][oy];
+
+    for (int ox = 0; ox < g->out[1]; ox++) {
+      double acc = job->op == POOL_MAX ? -INFINITY : 0.0;
+      int count = 0;
+      for (int ki = 0; ki < g->kernel[0]; ki++) {
+        int iy = oy * g->stride[0] - g->padding[0] + ki * g->dilation[0];
+        if (iy < 0 || iy >= g->in[0]) {
+          continue;
+        }
+        const double *x = job->input->data[c][iy];
+        for (int kj = 0; kj < g->kernel[1]; kj++) {
+          int ix = ox * g->stride[1] - g->padding[1] + kj * g->dilation[1];
+          if (ix < 0 || ix >= g->in[1]) {
+            continue;
+          }
+          if (job->op == POOL_MAX) {
+            acc = x[ix] > acc ? x[ix] : acc;
+          } else {
+            acc += x[ix];
+          }
+          count++;
+        }
+      }
+      y[ox] = job->op == POOL_AVG ? acc / count : acc;
+    }
+  }
+}
+
+Tensor *tensor_pool2d(Tensor *input, PoolOp op, int window_rows,
+                      int window_cols, ConvOptions *opts) {
+  LAMS_PROF_BEGIN();
+  ConvJob job = {.input = input, .op = op};
+
+  if (geometry(input, window_rows, window_cols, opts, 1, &job.g,
+               "tensor_pool2d") != 0) {
+    return NULL;
+  }
+
+  const Geometry *g = &job.g;
+  job.out = tensor_new(g->out[0], g->out[1], g->channels);
+  if (job.out == NULL) {
+    return NULL;
+  }
+
+  long window = (long)g->kernel[0] * g->kernel[1];
+  lams_parallel_for((long)g->channels * g->out[0],
+                    lams_parallel_grain(g->out[1] * window), pool_rows, &job);
+
+  LAMS_PROF_END(tensor_pool2d,
+                (double)g->channels * g->out[0] * g->out[1] * window);
+  return job.out;
+}
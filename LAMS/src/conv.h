@@ -0,0 +1,52 @@
+#ifndef CONV_H
+#define CONV_H
+
+#include "linear_algebra.h"
+
+/*
+ * 2D convolution and pooling over Tensor channels
+ *
+ * An image is a Tensor of t->rank channels, each t->rows x t->cols. A
+ * kernel is a Tensor with as many channels as the input, one kernel per
+ * output channel. Options come in [rows, cols] pairs and a zeroed
+ * ConvOptions means stride 1, no padding, no dilation and correlation (the
+ * kernel is not flipped, as in most image and neural network code). Each
+ * output side is
+ *
+ *   (size + 2 * padding - dilation * (kernel - 1) - 1) / stride + 1
+ *
+ * CONV_AUTO runs small kernels (up to 3x3) directly and larger ones as
+ * im2col followed by matrix_multiply while the im2col matrix is small
+ * enough to stay in cache, CONV_DIRECT and CONV_IM2COL force one of the
+ * two.
+ *
+ * Pooling uses the same options with the stride defaulting to the window
+ * size. Padding is never part of a window: POOL_AVG divides by the number
+ * of input entries it covered, and a geometry where some window covers
+ * padding only is rejected.
+ *
+ */
+
+typedef enum { CONV_CORRELATE, CONV_CONVOLVE } ConvMode;
+typedef enum { CONV_AUTO, CONV_DIRECT, CONV_IM2COL } ConvAlgorithm;
+typedef enum { POOL_MAX, POOL_AVG } PoolOp;
+
+typedef struct {
+  int stride[2], padding[2], dilation[2];
+  ConvMode mode;
+  ConvAlgorithm algorithm;
+} ConvOptions;
+
+// bias may be NULL, otherwise it has one entry per kernel. opts may be NULL.
+Tensor *tensor_conv2d(Tensor *input, Tensor **kernels, int num_kernels,
+                      Vector *bias, ConvOptions *opts);
+
+// One column per output position, one row per (channel, kernel row, kernel
+// column) in that order
+Matrix *tensor_im2col(Tensor *input, int kernel_rows, int kernel_cols,
+                      ConvOptions *opts);
+
+Tensor *tensor_pool2d(Tensor *input, PoolOp op, int window_rows,
+                      int window_cols, ConvOptions *opts);
+
+#endif
@@ -0,0 +1,443 @@
+#include "disk.h"
+#include "instrument.h"
+#include "parallel.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 24
+static const char MAGIC[8] = "LAMSMAT1";
+
+typedef struct {
+  int i, j, k; // tile of C and position along the inner dimension
+} Step;
+
+// Steps in execution order with the buffer each one reads A and B from.
+// The loader fills buffers for step t once step t - 2 is done with them.
+typedef struct {
+  DiskMatrix *a, *b, *c;
+  int m, n, inner, tm, tn, tk;
+  Step *steps;
+  long count;
+  double *a_buf[2], *b_buf[2], *c_buf;
+  char *a_slot, *b_slot, *a_read, *b_read;
+  long loaded, consumed;
+  int failed;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} Schedule;
+
+typedef struct {
+  const double *a, *b;
+  double *c;
+  int inner, cols, lda, ldb, ldc;
+} TileJob;
+
+// Files
+// -----------------------------------------------------------------------------
+static int io_all(int fd, void *buf, size_t size, off_t offset, int write) {
+  char *p = buf;
+
+  while (size > 0) {
+    ssize_t done = write ? pwrite(fd, p, size, offset)
+                         : pread(fd, p, size, offset);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      return -1;
+    }
+    p += done;
+    size -= done;
+    offset += done;
+  }
+  return 0;
+}
+
+// rows x cols block at (row, col), buf rows are ld doubles apart
+static int io_block(DiskMatrix *d, double *buf, int ld, int row, int col,
+                    int rows, int cols, int write) {
+  if (row < 0 || col < 0 || rows < 0 || cols < 0 || row + rows > d->rows ||
+      col + cols > d->cols) {
+    fprintf(stderr, "Error: disk matrix block out of bounds");
+    return -1;
+  }
+
+  for (int r = 0; r < rows; r++) {
+    off_t offset =
+        HEADER_SIZE + ((off_t)(row + r) * d->cols + col) * sizeof(double);
+    if (io_all(d->fd, buf + (size_t)r * ld, cols * sizeof(double), offset,
+               write) != 0) {
+      fprintf(stderr, "Error: disk matrix I/O failed: %s", strerror(errno));
+      return -1;
+    }
+  }
+
+  long bytes = (long)rows * cols * sizeof(double);
+  __atomic_add_fetch(write ? &d->bytes_written : &d->bytes_read, bytes,
+                     __ATOMIC_RELAXED);
+  return 0;
+}
+
+static DiskMatrix *disk_matrix_wrap(int fd, int rows, int cols) {
+  DiskMatrix *d = calloc(1, sizeof(DiskMatrix));
+
+  if (d == NULL) {
+    fprintf(stderr, "Error: disk matrix failed to allocate memory");
+    close(fd);
+    return NULL;
+  }
+
+  d->fd = fd;
+  d->rows = rows;
+  d->cols = cols;
+  return d;
+}
+
+DiskMatrix *disk_matrix_create(const char *path, int rows, int cols) {
+  if (rows < 0 || cols < 0) {
+    fprintf(stderr, "Error: disk_matrix_create() negative size");
+    return NULL;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: disk_matrix_create() cannot open %s: %s", path,
+            strerror(errno));
+    return NULL;
+  }
+
+  char header[HEADER_SIZE];
+  int64_t dims[2] = {rows, cols};
+  memcpy(header, MAGIC, sizeof(MAGIC));
+  memcpy(header + sizeof(MAGIC), dims, sizeof(dims));
+
+  off_t size = HEADER_SIZE + (off_t)rows * cols * sizeof(double);
+  if (io_all(fd, header, HEADER_SIZE, 0, 1) != 0 || ftruncate(fd, size) != 0) {
+    fprintf(stderr, "Error: disk_matrix_create() cannot write %s: %s", path,
+            strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  return disk_matrix_wrap(fd, rows, cols);
+}
+
+DiskMatrix *disk_matrix_open(const char *path) {
+  int fd = open(path, O_RDWR);
+  if (fd < 0) {
+    fprintf(stderr, "Error: disk_matrix_open() cannot open %s: %s", path,
+            strerror(errno));
+    return NULL;
+  }
+
+  char header[HEADER_SIZE];
+  int64_t dims[2];
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (io_all(fd, header, HEADER_SIZE, 0, 0) != 0 ||
+      memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+    fprintf(stderr, "Error: disk_matrix_open() %s is not a matrix file", path);
+    close(fd);
+    return NULL;
+  }
+
+  memcpy(dims, header + sizeof(MAGIC), sizeof(dims));
+  if (dims[0] < 0 || dims[1] < 0 || dims[0] > INT32_MAX ||
+      dims[1] > INT32_MAX ||
+      size < HEADER_SIZE + (off_t)dims[0] * dims[1] * (off_t)sizeof(double)) {
+    fprintf(stderr, "Error: disk_matrix_open() %s is truncated", path);
+    close(fd);
+    return NULL;
+  }
+
+  return disk_matrix_wrap(fd, dims[0], dims[1]);
+}
+
+void disk_matrix_close(DiskMatrix *d) {
+  if (d == NULL) {
+    return;
+  }
+
+  close(d->fd);
+  free(d);
+}
+
+int disk_matrix_write(DiskMatrix *d, Matrix *m, int row, int col) {
+  if (row < 0 || col < 0 || row + m->rows > d->rows ||
+      col + m->cols > d->cols) {
+    fprintf(stderr, "Error: disk_matrix_write() block out of bounds");
+    return -1;
+  }
+
+  for (int r = 0; r < m->rows; r++) {
+    if (io_block(d, m->data[r], m->cols, row + r, col, 1, m->cols, 1) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+Matrix *disk_matrix_read(DiskMatrix *d, int row, int col, int rows, int cols) {
+  if (row < 0 || col < 0 || rows < 0 || cols < 0 || row + rows > d->rows ||
+      col + cols > d->cols) {
+    fprintf(stderr, "Error: disk_matrix_read() block out of bounds");
+    return NULL;
+  }
+
+  Matrix *m = matrix_new(rows, cols);
+  if (m == NULL) {
+    return NULL;
+  }
+
+  for (int r = 0; r < rows; r++) {
+    if (io_block(d, m->data[r], cols, row + r, col, 1, cols, 0) != 0) {
+      matrix_free(m);
+      return NULL;
+    }
+  }
+  return m;
+}
+
+DiskMatrix *disk_matrix_from_matrix(const char *path, Matrix *m) {
+  DiskMatrix *d = disk_matrix_create(path, m->rows, m->cols);
+
+  if (d != NULL && disk_matrix_write(d, m, 0, 0) != 0) {
+    disk_matrix_close(d);
+    return NULL;
+  }
+  return d;
+}
+
+Matrix *disk_matrix_to_matrix(DiskMatrix *d) {
+  return disk_matrix_read(d, 0, 0, d->rows, d->cols);
+}
+
+// Tiles
+// -----------------------------------------------------------------------------
+// C += A * B on contiguous tiles, rows split across the thread pool
+static void tile_rows(long begin, long end, void *ctx) {
+  TileJob *job = ctx;
+
+  for (long i = begin; i < end; i++) {
+    double *restrict c = job->c + i * job->ldc;
+    for (int k = 0; k < job->inner; k++) {
+      double s = job->a[i * job->lda + k];
+      const double *restrict b = job->b + (long)k * job->ldb;
+      for (int j = 0; j < job->cols; j++) {
+        c[j] += s * b[j];
+      }
+    }
+  }
+}
+
+static void tile_sizes(Schedule *s, long t, int *tm, int *tn, int *tk) {
+  const Step *step = &s->steps[t];
+  *tm = s->m - step->i * s->tm < s->tm ? s->m - step->i * s->tm : s->tm;
+  *tn = s->n - step->j * s->tn < s->tn ? s->n - step->j * s->tn : s->tn;
+  *tk = s->inner - step->k * s->tk < s->tk ? s->inner - step->k * s->tk
+                                           : s->tk;
+}
+
+// Snake order over the tiles of C with the inner dimension alternating
+// direction, so neighbouring steps share a tile of A or B
+static long build_steps(Schedule *s) {
+  int ni = (s->m + s->tm - 1) / s->tm, nj = (s->n + s->tn - 1) / s->tn;
+  int nk = (s->inner + s->tk - 1) / s->tk;
+  long count = (long)ni * nj * nk, t = 0, tile = 0;
+
+  s->steps = malloc((count > 0 ? count : 1) * sizeof(Step));
+  s->a_slot = malloc(count > 0 ? count : 1);
+  s->b_slot = malloc(count > 0 ? count : 1);
+  s->a_read = malloc(count > 0 ? count : 1);
+  s->b_read = malloc(count > 0 ? count : 1);
+  if (s->steps == NULL || s->a_slot == NULL || s->b_slot == NULL ||
+      s->a_read == NULL || s->b_read == NULL) {
+    return -1;
+  }
+
+  for (int i = 0; i < ni; i++) {
+    for (int jj = 0; jj < nj; jj++, tile++) {
+      int j = i % 2 == 0 ? jj : nj - 1 - jj;
+      for (int kk = 0; kk < nk; kk++) {
+        int k = tile % 2 == 0 ? kk : nk - 1 - kk;
+        s->steps[t++] = (Step){i, j, k};
+      }
+    }
+  }
+
+  for (t = 0; t < count; t++) {
+    const Step *now = &s->steps[t], *prev = t > 0 ? &s->steps[t - 1] : NULL;
+    int same_a = prev && prev->i == now->i && prev->k == now->k;
+    int same_b = prev && prev->k == now->k && prev->j == now->j;
+    s->a_read[t] = !same_a;
+    s->b_read[t] = !same_b;
+    s->a_slot[t] = prev == NULL ? 0 : same_a ? s->a_slot[t - 1]
+                                             : 1 - s->a_slot[t - 1];
+    s->b_slot[t] = prev == NULL ? 0 : same_b ? s->b_slot[t - 1]
+                                             : 1 - s->b_slot[t - 1];
+  }
+  return count;
+}
+
+static void *loader(void *arg) {
+  Schedule *s = arg;
+
+  for (long t = 0; t < s->count; t++) {
+    pthread_mutex_lock(&s->lock);
+    while (s->consumed < t - 1 && !s->failed) {
+      pthread_cond_wait(&s->changed, &s->lock);
+    }
+    int failed = s->failed;
+    pthread_mutex_unlock(&s->lock);
+    if (failed) {
+      break;
+    }
+
+    const Step *step = &s->steps[t];
+    int tm, tn, tk, status = 0;
+    tile_sizes(s, t, &tm, &tn, &tk);
+    if (s->a_read[t]) {
+      status |= io_block(s->a, s->a_buf[(int)s->a_slot[t]], s->tk,
+                         step->i * s->tm, step->k * s->tk, tm, tk, 0);
+    }
+    if (s->b_read[t]) {
+      status |= io_block(s->b, s->b_buf[(int)s->b_slot[t]], s->tn,
+                         step->k * s->tk, step->j * s->tn, tk, tn, 0);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->loaded = t + 1;
+    s->failed |= status != 0;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return NULL;
+}
+
+static int run_schedule(Schedule *s) {
+  int nk = (s->inner + s->tk - 1) / s->tk;
+
+  for (long t = 0; t < s->count; t++) {
+    pthread_mutex_lock(&s->lock);
+    while (s->loaded <= t && !s->failed) {
+      pthread_cond_wait(&s->changed, &s->lock);
+    }
+    int failed = s->failed;
+    pthread_mutex_unlock(&s->lock);
+    if (failed) {
+      return -1;
+    }
+
+    const Step *step = &s->steps[t];
+    int tm, tn, tk, status = 0;
+    tile_sizes(s, t, &tm, &tn, &tk);
+    if (t % nk == 0) {
+      memset(s->c_buf, 0, (size_t)s->tm * s->tn * sizeof(double));
+    }
+
+    TileJob job = {s->a_buf[(int)s->a_slot[t]], s->b_buf[(int)s->b_slot[t]],
+                   s->c_buf, tk, tn, s->tk, s->tn, s->tn};
+    lams_parallel_for(tm, lams_parallel_grain((long)tk * tn), tile_rows, &job);
+
+    if (t % nk == nk - 1) {
+      status = io_block(s->c, s->c_buf, s->tn, step->i * s->tm,
+                        step->j * s->tn, tm, tn, 1);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->consumed = t + 1;
+    s->failed |= status != 0;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+    if (status != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Square tiles of A, B and C with two buffers for A and B take 5 * t^2
+// doubles. Dimensions smaller than t leave room for a longer inner tile.
+static int choose_tiles(Schedule *s, size_t memory_budget) {
+  long words = memory_budget / sizeof(double);
+  long t = (long)sqrt(words / 5.0);
+  t = t > 0 ? t : 1;
+
+  s->tm = s->m < t ? (s->m > 0 ? s->m : 1) : t;
+  s->tn = s->n < t ? (s->n > 0 ? s->n : 1) : t;
+  long tk = (words - (long)s->tm * s->tn) / (2L * (s->tm + s->tn));
+  if (tk < 1) {
+    fprintf(stderr, "Error: disk_matrix_multiply() memory budget too small");
+    return -1;
+  }
+  s->tk = tk < s->inner ? tk : (s->inner > 0 ? s->inner : 1);
+  return 0;
+}
+
+DiskMatrix *disk_matrix_multiply(DiskMatrix *a, DiskMatrix *b,
+                                 const char *path, size_t memory_budget) {
+  if (a->cols != b->rows) {
+    fprintf(stderr, "Error: disk_matrix_multiply() cannot multiply matrices "
+                    "of incompatible sizes");
+    return NULL;
+  }
+
+  LAMS_PROF_BEGIN();
+  Schedule s = {.a = a, .b = b, .m = a->rows, .n = b->cols,
+                .inner = a->cols};
+  if (choose_tiles(&s, memory_budget) != 0) {
+    return NULL;
+  }
+
+  s.c = disk_matrix_create(path, s.m, s.n);
+  s.count = s.c != NULL ? build_steps(&s) : -1;
+  size_t a_size = (size_t)s.tm * s.tk, b_size = (size_t)s.tk * s.tn;
+  for (int i = 0; i < 2; i++) {
+    s.a_buf[i] = malloc(a_size * sizeof(double));
+    s.b_buf[i] = malloc(b_size * sizeof(double));
+  }
+  s.c_buf = malloc((size_t)s.tm * s.tn * sizeof(double));
+
+  int status = -1;
+  if (s.count < 0 || s.a_buf[0] == NULL || s.a_buf[1] == NULL ||
+      s.b_buf[0] == NULL || s.b_buf[1] == NULL || s.c_buf == NULL) {
+    fprintf(stderr, "Error: disk_matrix_multiply() failed to allocate memory");
+  } else {
+    pthread_t thread;
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.changed, NULL);
+    if (pthread_create(&thread, NULL, loader, &s) != 0) {
+      fprintf(stderr, "Error: disk_matrix_multiply() cannot start loader");
+    } else {
+      status = run_schedule(&s);
+      pthread_join(thread, NULL);
+    }
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.changed);
+  }
+
+  for (int i = 0; i < 2; i++) {
+    free(s.a_buf[i]);
+    free(s.b_buf[i]);
+  }
+  free(s.c_buf);
+  free(s.steps);
+  free(s.a_slot);
+  free(s.b_slot);
+  free(s.a_read);
+  free(s.b_read);
+
+  if (status != 0) {
+    if (s.c != NULL) {
+      disk_matrix_close(s.c);
+      unlink(path);
+    }
+    return NULL;
+  }
+
+  LAMS_PROF_END(disk_matrix_multiply, 2.0 * s.m * s.n * s.inner);
+  return s.c;
+}
@@ -0,0 +1,50 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include "linear_algebra.h"
+#include <stddef.h>
+
+/*
+ * File-backed matrices for products larger than memory
+ *
+ * A DiskMatrix lives in a file: a 24 byte header ("LAMSMAT1", rows and
+ * cols as 64-bit integers) followed by the entries as doubles in row
+ * order. Blocks are moved in and out with pread/pwrite, nothing is
+ * memory-mapped.
+ *
+ * disk_matrix_multiply computes C = A * B in tiles that fit a memory
+ * budget: a tile of C stays in memory while tiles of A and B along the
+ * inner dimension stream through two buffers each, the next pair read by a
+ * background thread while the current one is multiplied. Tiles of C are
+ * visited in a snake order and the inner dimension runs forwards and
+ * backwards in turn, so consecutive steps share a tile of A (along a row
+ * of C) or of B (moving to the next row) and it is not read again.
+ *
+ * bytes_read and bytes_written count the entries moved by this library.
+ *
+ */
+
+typedef struct {
+  int fd;
+  int rows, cols;
+  long bytes_read, bytes_written;
+} DiskMatrix;
+
+// create makes or truncates the file to rows x cols zeros
+DiskMatrix *disk_matrix_create(const char *path, int rows, int cols);
+DiskMatrix *disk_matrix_open(const char *path);
+void disk_matrix_close(DiskMatrix *d);
+
+// Copy a block of m to or from the file at (row, col), 0 or -1 on error
+int disk_matrix_write(DiskMatrix *d, Matrix *m, int row, int col);
+Matrix *disk_matrix_read(DiskMatrix *d, int row, int col, int rows, int cols);
+
+DiskMatrix *disk_matrix_from_matrix(const char *path, Matrix *m);
+Matrix *disk_matrix_to_matrix(DiskMatrix *d);
+
+// The result goes to a new file at path. memory_budget is in bytes and
+// covers every tile buffer, at least 40 bytes.
+DiskMatrix *disk_matrix_multiply(DiskMatrix *a, DiskMatrix *b,
+                                 const char *path, size_t memory_budget);
+
+#endif
@@ -0,0 +1,568 @@
+#include "distribution.h"
+
+static int off_support(const distribution_t *d, double x) {
+  return x < d->lo || x > d->hi || (d->ops->discrete && x != floor(x));
+}
+
+// Support, moments and operations are set, the constants are left to the
+// caller
+static distribution_t *distribution_alloc(const distribution_ops_t *ops,
+                                          double lo, double hi, double mean,
+                                          double variance) {
+  distribution_t *d = malloc(sizeof(distribution_t));
+
+  if (d == NULL) {
+    fprintf(stderr, "Error: %s_freeze() failed to allocate memory",
+            ops->name);
+    return NULL;
+  }
+
+  d->ops = ops;
+  d->lo = lo;
+  d->hi = hi;
+  d->mean = mean;
+  d->variance = variance;
+  d->skewness = 0;
+  return d;
+}
+
+static double exp_logpmf(const distribution_t *d, double x) {
+  return exp(d->ops->logpmf(d, x));
+}
+
+// Quantiles by search
+// -----------------------------------------------------------------------------
+static double frozen_cdf(const void *c, double k) {
+  const distribution_t *d = c;
+  return d->ops->cdf(d, k);
+}
+
+// Discrete laws, from the Cornish-Fisher guess of the moments
+static double generic_quantile(const distribution_t *d, double u) {
+  double guess =
+      stats_cornish_fisher(u, d->mean, sqrt(d->variance), d->skewness);
+  return stats_discrete_quantile(frozen_cdf, d, u, guess, d->lo, d->hi);
+}
+
+// Binomial
+// -----------------------------------------------------------------------------
+static double binomial_logpmf_frozen(const distribution_t *d, double x) {
+  if (off_support(d, x)) {
+    return -INFINITY;
+  }
+  return stats_log_binomial_raw(x, d->c.binomial.n, d->c.binomial.p,
+                                d->c.binomial.q);
+}
+
+static double binomial_cdf_frozen(const distribution_t *d, double x) {
+  double k = floor(x), n = d->c.binomial.n;
+  if (k < 0) {
+    return 0;
+  }
+  return k < n ? stats_incomplete_beta(n - k, k + 1, d->c.binomial.q,
+                                       d->c.binomial.p)
+               : 1;
+}
+
+static double binomial_sf_frozen(const distribution_t *d, double x) {
+  double k = floor(x), n = d->c.binomial.n;
+  if (k < 0) {
+    return 1;
+  }
+  return k < n ? stats_incomplete_beta(k + 1, n - k, d->c.binomial.p,
+                                       d->c.binomial.q)
+               : 0;
+}
+
+static double binomial_sample_frozen(const distribution_t *d, rng_t *rng) {
+  binomial_t bin = {d->c.binomial.n, d->c.binomial.p};
+  return binomial_sample(&bin, rng);
+}
+
+static const distribution_ops_t binomial_ops = {
+    "binomial", 1, exp_logpmf, binomial_logpmf_frozen, binomial_cdf_frozen,
+    binomial_sf_frozen, generic_quantile, binomial_sample_frozen};
+
+distribution_t *binomial_freeze(binomial_t *bin) {
+  if (!(bin->p >= 0 && bin->p <= 1)) {
+    fprintf(stderr, "Error: binomial_freeze() p must lie in [0, 1]");
+    return NULL;
+  }
+
+  double n = bin->n, p = bin->p, q = 1 - p;
+  distribution_t *d = distribution_alloc(&binomial_ops, 0, n, n * p, n * p * q);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.binomial.n = n;
+  d->c.binomial.p = p;
+  d->c.binomial.q = q;
+  d->skewness = d->variance > 0 ? (q - p) / sqrt(d->variance) : 0;
+  return d;
+}
+
+// Bernoulli
+// -----------------------------------------------------------------------------
+static double bernoulli_pmf_frozen(const distribution_t *d, double x) {
+  return x == 0 ? d->c.bernoulli.q : x == 1 ? d->c.bernoulli.p : 0;
+}
+
+static double bernoulli_logpmf_frozen(const distribution_t *d, double x) {
+  return log(bernoulli_pmf_frozen(d, x));
+}
+
+static double bernoulli_cdf_frozen(const distribution_t *d, double x) {
+  return x < 0 ? 0 : x < 1 ? d->c.bernoulli.q : 1;
+}
+
+static double bernoulli_sf_frozen(const distribution_t *d, double x) {
+  return x < 0 ? 1 : x < 1 ? d->c.bernoulli.p : 0;
+}
+
+static double bernoulli_quantile_frozen(const distribution_t *d, double u) {
+  if (isnan(u) || u < 0 || u > 1) {
+    return NAN;
+  }
+  return u <= d->c.bernoulli.q ? 0 : 1;
+}
+
+static double bernoulli_sample_frozen(const distribution_t *d, rng_t *rng) {
+  bernoulli_t ber = {d->c.bernoulli.p};
+  return bernoulli_sample(&ber, rng);
+}
+
+static const distribution_ops_t bernoulli_ops = {
+    "bernoulli", 1, bernoulli_pmf_frozen, bernoulli_logpmf_frozen,
+    bernoulli_cdf_frozen, bernoulli_sf_frozen, bernoulli_quantile_frozen,
+    bernoulli_sample_frozen};
+
+distribution_t *bernoulli_freeze(bernoulli_t *ber) {
+  if (!(ber->p >= 0 && ber->p <= 1)) {
+    fprintf(stderr, "Error: bernoulli_freeze() p must lie in [0, 1]");
+    return NULL;
+  }
+
+  double p = ber->p, q = 1 - p;
+  distribution_t *d = distribution_alloc(&bernoulli_ops, 0, 1, p, p * q);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.bernoulli.p = p;
+  d->c.bernoulli.q = q;
+  return d;
+}
+
+// Discrete and continuous uniform
+// -----------------------------------------------------------------------------
+// The discrete width counts the values, b - a + 1
+static double uniform_pmf_frozen(const distribution_t *d, double x) {
+  return off_support(d, x) ? 0 : 1 / d->c.uniform.width;
+}
+
+static double uniform_logpmf_frozen(const distribution_t *d, double x) {
+  return off_support(d, x) ? -INFINITY : -d->c.uniform.log_width;
+}
+
+static double uniform_cdf_frozen(const distribution_t *d, double x) {
+  double below = d->ops->discrete ? floor(x) - d->lo + 1 : x - d->lo;
+  return x < d->lo ? 0 : x >= d->hi ? 1 : below / d->c.uniform.width;
+}
+
+static double uniform_sf_frozen(const distribution_t *d, double x) {
+  return 1 - uniform_cdf_frozen(d, x);
+}
+
+static double uniform_quantile_frozen(const distribution_t *d, double u) {
+  if (isnan(u) || u < 0 || u > 1) {
+    return NAN;
+  }
+  if (!d->ops->discrete) {
+    return d->lo + u * (d->hi - d->lo);
+  }
+
+  // u * width can round across a step either way, the cdf settles it
+  double x = d->lo + ceil(u * d->c.uniform.width) - 1;
+  x = x < d->lo ? d->lo : x > d->hi ? d->hi : x;
+  if (x > d->lo && uniform_cdf_frozen(d, x - 1) >= u) {
+    return x - 1;
+  }
+  return uniform_cdf_frozen(d, x) >= u || x == d->hi ? x : x + 1;
+}
+
+static double uniform_sample_frozen(const distribution_t *d, rng_t *rng) {
+  if (d->ops->discrete) {
+    discrete_uniform_t dis = {d->c.uniform.a, d->c.uniform.b, 0};
+    return discrete_uniform_sample(&dis, rng);
+  }
+
+  continuous_uniform_t uni = {d->c.uniform.a, d->c.uniform.b, 0};
+  return continuous_uniform_sample(&uni, rng);
+}
+
+static const distribution_ops_t discrete_uniform_ops = {
+    "discrete_uniform", 1, uniform_pmf_frozen, uniform_logpmf_frozen,
+    uniform_cdf_frozen, uniform_sf_frozen, uniform_quantile_frozen,
+    uniform_sample_frozen};
+
+static const distribution_ops_t continuous_uniform_ops = {
+    "continuous_uniform", 0, uniform_pmf_frozen, uniform_logpmf_frozen,
+    uniform_cdf_frozen, uniform_sf_frozen, uniform_quantile_frozen,
+    uniform_sample_frozen};
+
+static distribution_t *uniform_freeze(const distribution_ops_t *ops,
+                                      double a, double b, double width,
+                                      double variance) {
+  distribution_t *d = distribution_alloc(ops, a, b, 0.5 * (a + b), variance);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.uniform.a = a;
+  d->c.uniform.b = b;
+  d->c.uniform.width = width;
+  d->c.uniform.log_width = log(width);
+  return d;
+}
+
+distribution_t *discrete_uniform_freeze(discrete_uniform_t *dis) {
+  if (dis->a > dis->b) {
+    fprintf(stderr, "Error: discrete_uniform_freeze() needs a <= b");
+    return NULL;
+  }
+
+  double width = (double)dis->b - dis->a + 1;
+  return uniform_freeze(&discrete_uniform_ops, dis->a, dis->b, width,
+                        (width * width - 1) / 12);
+}
+
+distribution_t *continuous_uniform_freeze(continuous_uniform_t *uni) {
+  if (uni->a >= uni->b) {
+    fprintf(stderr, "Error: continuous_uniform_freeze() needs a < b");
+    return NULL;
+  }
+
+  double width = (double)uni->b - uni->a;
+  return uniform_freeze(&continuous_uniform_ops, uni->a, uni->b, width,
+                        width * width / 12);
+}
+
+// Geometric, failures before the first success
+// -----------------------------------------------------------------------------
+static double geometric_logpmf_frozen(const distribution_t *d, double x) {
+  if (off_support(d, x)) {
+    return -INFINITY;
+  }
+  return d->c.geometric.log_p + (x == 0 ? 0 : x * d->c.geometric.log_q);
+}
+
+static double geometric_cdf_frozen(const distribution_t *d, double x) {
+  double k = floor(x);
+  return k < 0 ? 0 : -expm1((k + 1) * d->c.geometric.log_q);
+}
+
+static double geometric_sf_frozen(const distribution_t *d, double x) {
+  double k = floor(x);
+  return k < 0 ? 1 : exp((k + 1) * d->c.geometric.log_q);
+}
+
+// Smallest k with q^(k + 1) <= 1 - u, checked against the cdf for rounding
+static double geometric_quantile_frozen(const distribution_t *d, double u) {
+  if (isnan(u) || u < 0 || u > 1) {
+    return NAN;
+  }
+  if (u == 1) {
+    return d->c.geometric.p == 1 ? 0 : INFINITY;
+  }
+  if (d->c.geometric.p == 1) {
+    return 0;
+  }
+
+  double k = ceil(log1p(-u) / d->c.geometric.log_q - 1);
+  k = k < 0 ? 0 : k;
+  if (k > 0 && geometric_cdf_frozen(d, k - 1) >= u) {
+    return k - 1;
+  }
+  return geometric_cdf_frozen(d, k) >= u ? k : k + 1;
+}
+
+static double geometric_sample_frozen(const distribution_t *d, rng_t *rng) {
+  geometric_t geo = {d->c.geometric.p};
+  return geometric_sample(&geo, rng);
+}
+
+static const distribution_ops_t geometric_ops = {
+    "geometric", 1, exp_logpmf, geometric_logpmf_frozen, geometric_cdf_frozen,
+    geometric_sf_frozen, geometric_quantile_frozen, geometric_sample_frozen};
+
+distribution_t *geometric_freeze(geometric_t *geo) {
+  if (!(geo->p > 0 && geo->p <= 1)) {
+    fprintf(stderr, "Error: geometric_freeze() p must lie in (0, 1]");
+    return NULL;
+  }
+
+  double p = geo->p, q = 1 - p;
+  distribution_t *d =
+      distribution_alloc(&geometric_ops, 0, INFINITY, q / p, q / (p * p));
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.geometric.p = p;
+  d->c.geometric.log_p = log(p);
+  d->c.geometric.log_q = log1p(-p);
+  return d;
+}
+
+// Hypergeometric
+// -----------------------------------------------------------------------------
+static double hypergeometric_logpmf_frozen(const distribution_t *d,
+                                           double x) {
+  if (off_support(d, x)) {
+    return -INFINITY;
+  }
+
+  double N = d->c.hypergeometric.N, K = d->c.hypergeometric.K;
+  double n = d->c.hypergeometric.n, p = d->c.hypergeometric.p;
+  double q = d->c.hypergeometric.q;
+  return stats_log_binomial_raw(x, K, p, q) +
+         stats_log_binomial_raw(n - x, N - K, p, q) -
+         d->c.hypergeometric.log_norm;
+}
+
+static double hypergeometric_cdf_frozen(const distribution_t *d, double x) {
+  return stats_hypergeometric_tail(floor(x), d->c.hypergeometric.N,
+                                   d->c.hypergeometric.K,
+                                   d->c.hypergeometric.n, 0);
+}
+
+static double hypergeometric_sf_frozen(const distribution_t *d, double x) {
+  return stats_hypergeometric_tail(floor(x), d->c.hypergeometric.N,
+                                   d->c.hypergeometric.K,
+                                   d->c.hypergeometric.n, 1);
+}
+
+static double hypergeometric_sample_frozen(const distribution_t *d,
+                                           rng_t *rng) {
+  hypergeometric_t hyp = {d->c.hypergeometric.N, d->c.hypergeometric.K,
+                          d->c.hypergeometric.n};
+  return hypergeometric_sample(&hyp, rng);
+}
+
+static const distribution_ops_t hypergeometric_ops = {
+    "hypergeometric", 1, exp_logpmf, hypergeometric_logpmf_frozen,
+    hypergeometric_cdf_frozen, hypergeometric_sf_frozen, generic_quantile,
+    hypergeometric_sample_frozen};
+
+distribution_t *hypergeometric_freeze(hypergeometric_t *hyp) {
+  if (hyp->N == 0 || hyp->K > hyp->N || hyp->n > hyp->N) {
+    fprintf(stderr, "Error: hypergeometric_freeze() needs K <= N, n <= N "
+                    "and N > 0");
+    return NULL;
+  }
+
+  double N = hyp->N, K = hyp->K, n = hyp->n, p = n / N, q = (N - n) / N;
+  double lo = n - (N - K) > 0 ? n - (N - K) : 0, hi = n < K ? n : K;
+  double fraction = N > 1 ? (N - n) / (N - 1) : 0;
+  double mean = n * K / N;
+  distribution_t *d = distribution_alloc(&hypergeometric_ops, lo, hi, mean,
+                                         mean * (N - K) / N * fraction);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.hypergeometric.N = N;
+  d->c.hypergeometric.K = K;
+  d->c.hypergeometric.n = n;
+  d->c.hypergeometric.p = p;
+  d->c.hypergeometric.q = q;
+  d->c.hypergeometric.log_norm = stats_log_binomial_raw(n, N, p, q);
+  if (d->variance > 0 && N > 2) {
+    d->skewness = (N - 2 * K) * (N - 2 * n) /
+                  (N - 2) / (N * sqrt(d->variance));
+  }
+  return d;
+}
+
+// Negative binomial, failures before the r-th success
+// -----------------------------------------------------------------------------
+static double negative_binomial_logpmf_frozen(const distribution_t *d,
+                                              double x) {
+  if (off_support(d, x)) {
+    return -INFINITY;
+  }
+
+  double r = d->c.negative_binomial.r;
+  return log(r / (r + x)) +
+         stats_log_binomial_raw(r, r + x, d->c.negative_binomial.p,
+                                d->c.negative_binomial.q);
+}
+
+static double negative_binomial_cdf_frozen(const distribution_t *d,
+                                           double x) {
+  double k = floor(x);
+  return k < 0 ? 0
+               : stats_incomplete_beta(d->c.negative_binomial.r, k + 1,
+                                       d->c.negative_binomial.p,
+                                       d->c.negative_binomial.q);
+}
+
+static double negative_binomial_sf_frozen(const distribution_t *d,
+                                          double x) {
+  double k = floor(x);
+  return k < 0 ? 1
+               : stats_incomplete_beta(k + 1, d->c.negative_binomial.r,
+                                       d->c.negative_binomial.q,
+                                       d->c.negative_binomial.p);
+}
+
+static double negative_binomial_sample_frozen(const distribution_t *d,
+                                              rng_t *rng) {
+  negative_binomial_t neg = {d->c.negative_binomial.r,
+                             d->c.negative_binomial.p};
+  return negative_binomial_sample(&neg, rng);
+}
+
+static const distribution_ops_t negative_binomial_ops = {
+    "negative_binomial", 1, exp_logpmf, negative_binomial_logpmf_frozen,
+    negative_binomial_cdf_frozen, negative_binomial_sf_frozen,
+    generic_quantile, negative_binomial_sample_frozen};
+
+distribution_t *negative_binomial_freeze(negative_binomial_t *neg) {
+  if (neg->r == 0 || !(neg->p > 0 && neg->p <= 1)) {
+    fprintf(stderr, "Error: negative_binomial_freeze() needs r > 0 and p in "
+                    "(0, 1]");
+    return NULL;
+  }
+
+  double r = neg->r, p = neg->p, q = 1 - p;
+  distribution_t *d = distribution_alloc(&negative_binomial_ops, 0, INFINITY,
+                                         r * q / p, r * q / (p * p));
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.negative_binomial.r = r;
+  d->c.negative_binomial.p = p;
+  d->c.negative_binomial.q = q;
+  d->skewness = q > 0 ? (1 + q) / sqrt(r * q) : 0;
+  return d;
+}
+
+// Poisson
+// -----------------------------------------------------------------------------
+static double poisson_logpmf_frozen(const distribution_t *d, double x) {
+  if (off_support(d, x)) {
+    return -INFINITY;
+  }
+  return stats_log_poisson_raw(x, d->c.poisson.lambda);
+}
+
+static double poisson_cdf_frozen(const distribution_t *d, double x) {
+  double k = floor(x);
+  return k < 0 ? 0 : stats_incomplete_gamma_q(k + 1, d->c.poisson.lambda);
+}
+
+static double poisson_sf_frozen(const distribution_t *d, double x) {
+  double k = floor(x);
+  return k < 0 ? 1 : stats_incomplete_gamma_p(k + 1, d->c.poisson.lambda);
+}
+
+static double poisson_sample_frozen(const distribution_t *d, rng_t *rng) {
+  poisson_t poi = {d->c.poisson.lambda};
+  return poisson_sample(&poi, rng);
+}
+
+static const distribution_ops_t poisson_ops = {
+    "poisson", 1, exp_logpmf, poisson_logpmf_frozen, poisson_cdf_frozen,
+    poisson_sf_frozen, generic_quantile, poisson_sample_frozen};
+
+distribution_t *poisson_freeze(poisson_t *poi) {
+  double lambda = poi->lambda;
+  distribution_t *d =
+      distribution_alloc(&poisson_ops, 0, INFINITY, lambda, lambda);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.poisson.lambda = lambda;
+  d->skewness = lambda > 0 ? 1 / sqrt(lambda) : 0;
+  return d;
+}
+
+// Normal
+// -----------------------------------------------------------------------------
+static double normal_logpmf_frozen(const distribution_t *d, double x) {
+  double z = (x - d->c.normal.mu) * d->c.normal.inv_sigma;
+  return -0.5 * z * z - d->c.normal.log_norm;
+}
+
+static double normal_cdf_frozen(const distribution_t *d, double x) {
+  return 0.5 * erfc((d->c.normal.mu - x) * d->c.normal.inv_sigma * M_SQRT1_2);
+}
+
+static double normal_sf_frozen(const distribution_t *d, double x) {
+  return 0.5 * erfc((x - d->c.normal.mu) * d->c.normal.inv_sigma * M_SQRT1_2);
+}
+
+static double normal_sample_frozen(const distribution_t *d, rng_t *rng) {
+  normal_t nor = {d->c.normal.mu, d->c.normal.sigma};
+  return normal_sample(&nor, rng);
+}
+
+static double normal_quantile_frozen(const distribution_t *d, double u) {
+  return d->c.normal.mu + d->c.normal.sigma * stats_normal_quantile(u);
+}
+
+static const distribution_ops_t normal_ops = {
+    "normal", 0, exp_logpmf, normal_logpmf_frozen, normal_cdf_frozen,
+    normal_sf_frozen, normal_quantile_frozen, normal_sample_frozen};
+
+distribution_t *normal_freeze(normal_t *nor) {
+  if (!(nor->sigma > 0)) {
+    fprintf(stderr, "Error: normal_freeze() sigma must be positive");
+    return NULL;
+  }
+
+  double mu = nor->mu, sigma = nor->sigma;
+  distribution_t *d =
+      distribution_alloc(&normal_ops, -INFINITY, INFINITY, mu, sigma * sigma);
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->c.normal.mu = mu;
+  d->c.normal.sigma = sigma;
+  d->c.normal.inv_sigma = 1 / sigma;
+  d->c.normal.log_norm = log(sigma) + 0.5 * log(2 * M_PI);
+  return d;
+}
+
+// Dispatch
+// -----------------------------------------------------------------------------
+void distribution_free(distribution_t *d) { free(d); }
+
+double distribution_pmf(const distribution_t *d, double x) {
+  return d->ops->pmf(d, x);
+}
+
+double distribution_logpmf(const distribution_t *d, double x) {
+  return d->ops->logpmf(d, x);
+}
+
+double distribution_cdf(const distribution_t *d, double x) {
+  return d->ops->cdf(d, x);
+}
+
+double distribution_sf(const distribution_t *d, double x) {
+  return d->ops->sf(d, x);
+}
+
+double distribution_quantile(const distribution_t *d, double u) {
+  return d->ops->quantile(d, u);
+}
+
+double distribution_sample(const distribution_t *d, rng_t *rng) {
+  return d->ops->sample(d, rng);
+}
@@ -0,0 +1,91 @@
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+#include "random.h"
+#include "stats.h"
+
+/*
+ * Frozen distributions
+ *
+ * *_freeze takes the parameter struct of stats.h once and keeps everything
+ * that depends on the parameters alone: normalizing constants, logarithms
+ * of p and q, the population term of the hypergeometric, the mean and
+ * variance. Every law is then evaluated through the same distribution_*
+ * calls, which dispatch through a constant table of functions, so a
+ * repeated normal or geometric density is a few flops and an exp.
+ *
+ * Discrete laws take whole numbers in double, the pmf is 0 elsewhere and
+ * the cdf and sf (P(X > x)) round x down. For continuous laws the pmf is
+ * the density. quantile(u) is the smallest x of the support with
+ * cdf(x) >= u: closed forms where the law has one, otherwise
+ * stats_discrete_quantile over the frozen cdf from the Cornish-Fisher
+ * guess of mean, variance and skewness. sample draws with the samplers of
+ * random.h.
+ *
+ */
+
+typedef struct distribution_t distribution_t;
+
+typedef struct {
+  const char *name;
+  int discrete;
+  double (*pmf)(const distribution_t *d, double x);
+  double (*logpmf)(const distribution_t *d, double x);
+  double (*cdf)(const distribution_t *d, double x);
+  double (*sf)(const distribution_t *d, double x);
+  double (*quantile)(const distribution_t *d, double u);
+  double (*sample)(const distribution_t *d, rng_t *rng);
+} distribution_ops_t;
+
+struct distribution_t {
+  const distribution_ops_t *ops;
+  double lo, hi; // support, hi is INFINITY when unbounded
+  double mean, variance, skewness;
+  union {
+    struct {
+      double n, p, q;
+    } binomial;
+    struct {
+      double p, q;
+    } bernoulli;
+    struct {
+      double a, b, width, log_width;
+    } uniform;
+    struct {
+      double p, log_p, log_q;
+    } geometric;
+    struct {
+      double N, K, n, p, q, log_norm;
+    } hypergeometric;
+    struct {
+      double r, p, q;
+    } negative_binomial;
+    struct {
+      double lambda;
+    } poisson;
+    struct {
+      double mu, sigma, inv_sigma, log_norm;
+    } normal;
+  } c;
+};
+
+// NULL when the parameters do not define a distribution
+distribution_t *binomial_freeze(binomial_t *b);
+distribution_t *bernoulli_freeze(bernoulli_t *b);
+distribution_t *discrete_uniform_freeze(discrete_uniform_t *d);
+distribution_t *geometric_freeze(geometric_t *g);
+distribution_t *hypergeometric_freeze(hypergeometric_t *h);
+distribution_t *negative_binomial_freeze(negative_binomial_t *n);
+distribution_t *poisson_freeze(poisson_t *p);
+distribution_t *continuous_uniform_freeze(continuous_uniform_t *c);
+distribution_t *normal_freeze(normal_t *n);
+void distribution_free(distribution_t *d);
+
+double distribution_pmf(const distribution_t *d, double x);
+double distribution_logpmf(const distribution_t *d, double x);
+double distribution_cdf(const distribution_t *d, double x);
+double distribution_sf(const distribution_t *d, double x);
+double distribution_quantile(const distribution_t *d, double u);
+double distribution_sample(const distribution_t *d, rng_t *rng);
+
+#endif
@@ -0,0 +1,540 @@
+#include "elementwise.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "vmath.h"
+
+// A Vector, Matrix or Tensor seen as depth x rows x cols, only one of the
+// data pointers is set
+typedef struct {
+  int depth, rows, cols;
+  double ***planes;
+  double **row_data;
+  double *data;
+} Operand;
+
+static Operand vector_operand(Vector *v) {
+  Operand o = {1, 1, v->size, NULL, NULL, v->data};
+  return o;
+}
+
+static Operand matrix_operand(Matrix *m) {
+  Operand o = {1, m->rows, m->cols, NULL, m->data, NULL};
+  return o;
+}
+
+static Operand tensor_operand(Tensor *t) {
+  Operand o = {t->rank, t->rows, t->cols, t->data, NULL, NULL};
+  return o;
+}
+
+// Row i of slice d, dimensions of size 1 repeat their only entry
+static double *operand_row(const Operand *o, int d, int i) {
+  int slice = o->depth == 1 ? 0 : d;
+  int row = o->rows == 1 ? 0 : i;
+
+  if (o->planes != NULL) {
+    return o->planes[slice][row];
+  }
+  if (o->row_data != NULL) {
+    return o->row_data[row];
+  }
+  return o->data;
+}
+
+static int broadcast_dim(int a, int b, int *out) {
+  if (a == b || b == 1) {
+    *out = a;
+    return 1;
+  }
+  if (a == 1) {
+    *out = b;
+    return 1;
+  }
+  return 0;
+}
+
+static int broadcast_shape(const Operand *a, const Operand *b, int *depth,
+                           int *rows, int *cols) {
+  return broadcast_dim(a->depth, b->depth, depth) &&
+         broadcast_dim(a->rows, b->rows, rows) &&
+         broadcast_dim(a->cols, b->cols, cols);
+}
+
+// Splits the output by rows, or by blocks of columns when it is a single row
+// (a Vector), in which case *by_cols is set for the body
+static void run_rows(const Operand *out, ParallelBody body, void *ctx,
+                     int *by_cols) {
+  long rows = (long)out->depth * out->rows;
+  *by_cols = rows == 1;
+
+  if (*by_cols) {
+    lams_parallel_for(out->cols, LAMS_PARALLEL_MIN_ELEMENTS, body, ctx);
+  } else {
+    lams_parallel_for(rows, lams_parallel_grain(out->cols), body, ctx);
+  }
+}
+
+// Unary kernels
+// -----------------------------------------------------------------------------
+typedef enum { JOB_MAP, JOB_APPLY, JOB_CLAMP } UnaryKind;
+
+typedef struct {
+  const Operand *x, *y;
+  UnaryKind kind;
+  UnaryOp op;
+  double (*fn)(double);
+  double lo, hi;
+  int by_cols;
+} UnaryJob;
+
+static void map_row(UnaryOp op, const double *x, double *y, int n) {
+  switch (op) {
+  case UNARY_EXP:
+    vmath_exp(x, y, n);
+    break;
+  case UNARY_LOG:
+    vmath_log(x, y, n);
+    break;
+  case UNARY_ERF:
+    vmath_erf(x, y, n);
+    break;
+  case UNARY_TANH:
+    vmath_tanh(x, y, n);
+    break;
+  case UNARY_SQRT:
+    for (int j = 0; j < n; j++) {
+      y[j] = sqrt(x[j]);
+    }
+    break;
+  case UNARY_ABS:
+    for (int j = 0; j < n; j++) {
+      y[j] = fabs(x[j]);
+    }
+    break;
+  case UNARY_NEG:
+    for (int j = 0; j < n; j++) {
+      y[j] = -x[j];
+    }
+    break;
+  case UNARY_SQUARE:
+    for (int j = 0; j < n; j++) {
+      y[j] = x[j] * x[j];
+    }
+    break;
+  }
+}
+
+static void unary_rows(long begin, long end, void *ctx) {
+  const UnaryJob *job = ctx;
+  int rows = job->y->rows, n = job->y->cols, col = 0;
+
+  if (job->by_cols) {
+    col = begin;
+    n = end - begin;
+    begin = 0;
+    end = 1;
+  }
+
+  for (long r = begin; r < end; r++) {
+    int d = r / rows, i = r % rows;
+    const double *x = operand_row(job->x, d, i) + col;
+    double *y = operand_row(job->y, d, i) + col;
+
+    switch (job->kind) {
+    case JOB_MAP:
+      map_row(job->op, x, y, n);
+      break;
+    case JOB_APPLY:
+      for (int j = 0; j < n; j++) {
+        y[j] = job->fn(x[j]);
+      }
+      break;
+    case JOB_CLAMP:
+      // NaN fails both comparisons and passes through
+      for (int j = 0; j < n; j++) {
+        y[j] = x[j] < job->lo ? job->lo : x[j] > job->hi ? job->hi : x[j];
+      }
+      break;
+    }
+  }
+}
+
+static void unary(const Operand *x, const Operand *y, UnaryJob job) {
+  job.x = x;
+  job.y = y;
+  run_rows(y, unary_rows, &job, &job.by_cols);
+}
+
+// Binary kernels
+// -----------------------------------------------------------------------------
+typedef struct {
+  const Operand *a, *b, *y;
+  BinaryOp op;
+  int by_cols;
+} BinaryJob;
+
+// Separate loops for a full row against a full row or a repeated scalar so
+// each of them vectorizes
+#define BINARY_ROW(expr)                                                       \
+  if (full_a && full_b) {                                                      \
+    for (int j = 0; j < n; j++) {                                              \
+      double u = a[j], w = b[j];                                               \
+      y[j] = expr;                                                             \
+    }                                                                          \
+  } else if (full_a) {                                                         \
+    double w = b[0];                                                           \
+    for (int j = 0; j < n; j++) {                                              \
+      double u = a[j];                                                         \
+      y[j] = expr;                                                             \
+    }                                                                          \
+  } else {                                                                     \
+    double u = a[0];                                                           \
+    for (int j = 0; j < n; j++) {                                              \
+      double w = b[j];                                                         \
+      y[j] = expr;                                                             \
+    }                                                                          \
+  }
+
+static void binary_row(BinaryOp op, const double *a, int full_a,
+                       const double *b, int full_b, double *y, int n) {
+  switch (op) {
+  case BINARY_ADD:
+    BINARY_ROW(u + w);
+    break;
+  case BINARY_SUB:
+    BINARY_ROW(u - w);
+    break;
+  case BINARY_MUL:
+    BINARY_ROW(u * w);
+    break;
+  case BINARY_DIV:
+    BINARY_ROW(u / w);
+    break;
+  case BINARY_MIN:
+    // NaN in either operand propagates
+    BINARY_ROW(u < w || u != u ? u : w);
+    break;
+  case BINARY_MAX:
+    BINARY_ROW(u > w || u != u ? u : w);
+    break;
+  }
+}
+
+static void binary_rows(long begin, long end, void *ctx) {
+  const BinaryJob *job = ctx;
+  int rows = job->y->rows, n = job->y->cols, col = 0;
+  int full_a = job->a->cols == n;
+  int full_b = job->b->cols == n;
+
+  if (job->by_cols) {
+    col = begin;
+    n = end - begin;
+    begin = 0;
+    end = 1;
+  }
+
+  for (long r = begin; r < end; r++) {
+    int d = r / rows, i = r % rows;
+    const double *a = operand_row(job->a, d, i) + (full_a ? col : 0);
+    const double *b = operand_row(job->b, d, i) + (full_b ? col : 0);
+    binary_row(job->op, a, full_a, b, full_b, operand_row(job->y, d, i) + col,
+               n);
+  }
+}
+
+static void binary(const Operand *a, const Operand *b, const Operand *y,
+                   BinaryOp op) {
+  BinaryJob job = {a, b, y, op, 0};
+  run_rows(y, binary_rows, &job, &job.by_cols);
+}
+
+// Unary functions
+// -----------------------------------------------------------------------------
+Vector *vector_map(Vector *v, UnaryOp op) {
+  LAMS_PROF_BEGIN();
+  Vector *result = vector_new(v->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: vector_map() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = vector_operand(v), y = vector_operand(result);
+  UnaryJob job = {.kind = JOB_MAP, .op = op};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(vector_map, v->size);
+  return result;
+}
+
+Matrix *matrix_map(Matrix *m, UnaryOp op) {
+  LAMS_PROF_BEGIN();
+  Matrix *result = matrix_new(m->rows, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_map() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = matrix_operand(m), y = matrix_operand(result);
+  UnaryJob job = {.kind = JOB_MAP, .op = op};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(matrix_map, m->rows * m->cols);
+  return result;
+}
+
+Tensor *tensor_map(Tensor *t, UnaryOp op) {
+  LAMS_PROF_BEGIN();
+  Tensor *result = tensor_new(t->rows, t->cols, t->rank);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: tensor_map() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = tensor_operand(t), y = tensor_operand(result);
+  UnaryJob job = {.kind = JOB_MAP, .op = op};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(tensor_map, t->rank * t->rows * t->cols);
+  return result;
+}
+
+Vector *vector_apply(Vector *v, double (*fn)(double)) {
+  LAMS_PROF_BEGIN();
+  Vector *result = vector_new(v->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: vector_apply() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = vector_operand(v), y = vector_operand(result);
+  UnaryJob job = {.kind = JOB_APPLY, .fn = fn};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(vector_apply, 0);
+  return result;
+}
+
+Matrix *matrix_apply(Matrix *m, double (*fn)(double)) {
+  LAMS_PROF_BEGIN();
+  Matrix *result = matrix_new(m->rows, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_apply() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = matrix_operand(m), y = matrix_operand(result);
+  UnaryJob job = {.kind = JOB_APPLY, .fn = fn};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(matrix_apply, 0);
+  return result;
+}
+
+Tensor *tensor_apply(Tensor *t, double (*fn)(double)) {
+  LAMS_PROF_BEGIN();
+  Tensor *result = tensor_new(t->rows, t->cols, t->rank);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: tensor_apply() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = tensor_operand(t), y = tensor_operand(result);
+  UnaryJob job = {.kind = JOB_APPLY, .fn = fn};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(tensor_apply, 0);
+  return result;
+}
+
+Vector *vector_clamp(Vector *v, double lo, double hi) {
+  LAMS_PROF_BEGIN();
+  Vector *result = vector_new(v->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: vector_clamp() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = vector_operand(v), y = vector_operand(result);
+  UnaryJob job = {.kind = JOB_CLAMP, .lo = lo, .hi = hi};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(vector_clamp, 0);
+  return result;
+}
+
+Matrix *matrix_clamp(Matrix *m, double lo, double hi) {
+  LAMS_PROF_BEGIN();
+  Matrix *result = matrix_new(m->rows, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_clamp() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = matrix_operand(m), y = matrix_operand(result);
+  UnaryJob job = {.kind = JOB_CLAMP, .lo = lo, .hi = hi};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(matrix_clamp, 0);
+  return result;
+}
+
+Tensor *tensor_clamp(Tensor *t, double lo, double hi) {
+  LAMS_PROF_BEGIN();
+  Tensor *result = tensor_new(t->rows, t->cols, t->rank);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: tensor_clamp() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand x = tensor_operand(t), y = tensor_operand(result);
+  UnaryJob job = {.kind = JOB_CLAMP, .lo = lo, .hi = hi};
+  unary(&x, &y, job);
+
+  LAMS_PROF_END(tensor_clamp, 0);
+  return result;
+}
+
+// Broadcasting binary functions
+// -----------------------------------------------------------------------------
+Vector *vector_binary(Vector *a, Vector *b, BinaryOp op) {
+  LAMS_PROF_BEGIN();
+  Operand x = vector_operand(a), z = vector_operand(b);
+  int depth, rows, cols;
+
+  if (!broadcast_shape(&x, &z, &depth, &rows, &cols)) {
+    fprintf(stderr,
+            "Error: vector_binary() sizes %d and %d cannot be broadcast",
+            a->size, b->size);
+    return NULL;
+  }
+
+  Vector *result = vector_new(cols);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: vector_binary() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand y = vector_operand(result);
+  binary(&x, &z, &y, op);
+
+  LAMS_PROF_END(vector_binary, cols);
+  return result;
+}
+
+Matrix *matrix_binary(Matrix *a, Matrix *b, BinaryOp op) {
+  LAMS_PROF_BEGIN();
+  Operand x = matrix_operand(a), z = matrix_operand(b);
+  int depth, rows, cols;
+
+  if (!broadcast_shape(&x, &z, &depth, &rows, &cols)) {
+    fprintf(stderr,
+            "Error: matrix_binary() shapes %dx%d and %dx%d cannot be "
+            "broadcast",
+            a->rows, a->cols, b->rows, b->cols);
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(rows, cols);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_binary() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand y = matrix_operand(result);
+  binary(&x, &z, &y, op);
+
+  LAMS_PROF_END(matrix_binary, rows * cols);
+  return result;
+}
+
+Matrix *matrix_binary_vector(Matrix *m, Vector *v, BinaryOp op) {
+  LAMS_PROF_BEGIN();
+  Operand x = matrix_operand(m), z = vector_operand(v);
+  int depth, rows, cols;
+
+  if (!broadcast_shape(&x, &z, &depth, &rows, &cols)) {
+    fprintf(stderr,
+            "Error: matrix_binary_vector() shapes %dx%d and %d cannot be "
+            "broadcast",
+            m->rows, m->cols, v->size);
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(rows, cols);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_binary_vector() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand y = matrix_operand(result);
+  binary(&x, &z, &y, op);
+
+  LAMS_PROF_END(matrix_binary_vector, rows * cols);
+  return result;
+}
+
+Tensor *tensor_binary(Tensor *a, Tensor *b, BinaryOp op) {
+  LAMS_PROF_BEGIN();
+  Operand x = tensor_operand(a), z = tensor_operand(b);
+  int depth, rows, cols;
+
+  if (!broadcast_shape(&x, &z, &depth, &rows, &cols)) {
+    fprintf(stderr,
+            "Error: tensor_binary() shapes %dx%dx%d and %dx%dx%d cannot be "
+            "broadcast",
+            a->rank, a->rows, a->cols, b->rank, b->rows, b->cols);
+    return NULL;
+  }
+
+  Tensor *result = tensor_new(rows, cols, depth);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: tensor_binary() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand y = tensor_operand(result);
+  binary(&x, &z, &y, op);
+
+  LAMS_PROF_END(tensor_binary, depth * rows * cols);
+  return result;
+}
+
+Tensor *tensor_binary_matrix(Tensor *t, Matrix *m, BinaryOp op) {
+  LAMS_PROF_BEGIN();
+  Operand x = tensor_operand(t), z = matrix_operand(m);
+  int depth, rows, cols;
+
+  if (!broadcast_shape(&x, &z, &depth, &rows, &cols)) {
+    fprintf(stderr,
+            "Error: tensor_binary_matrix() shapes %dx%dx%d and %dx%d cannot "
+            "be broadcast",
+            t->rank, t->rows, t->cols, m->rows, m->cols);
+    return NULL;
+  }
+
+  Tensor *result = tensor_new(rows, cols, depth);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: tensor_binary_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  Operand y = tensor_operand(result);
+  binary(&x, &z, &y, op);
+
+  LAMS_PROF_END(tensor_binary_matrix, depth * rows * cols);
+  return result;
+}
@@ -0,0 +1,62 @@
+#ifndef ELEMENTWISE_H
+#define ELEMENTWISE_H
+
+#include "linear_algebra.h"
+
+/*
+ * Element-wise maps and broadcasting binary operations
+ *
+ * Every function returns a new Vector, Matrix or Tensor. exp, log, erf and
+ * tanh go through the vectorized kernels in vmath.h, see there for their
+ * error bounds.
+ *
+ * Binary operations broadcast like NumPy: shapes are aligned on their last
+ * dimension, a Vector is a single row, a Matrix a single slice of a Tensor,
+ * and each pair of dimensions must be equal or one of them 1. For example a
+ * 3x4 Matrix with a Vector of size 4 adds the vector to every row, a 3x1
+ * Matrix with a 1x4 Matrix gives a 3x4 Matrix.
+ *
+ * Inputs with many elements are split by rows across threads, so functions
+ * passed to *_apply must be safe to call concurrently.
+ *
+ */
+
+typedef enum {
+  UNARY_EXP,
+  UNARY_LOG,
+  UNARY_ERF,
+  UNARY_TANH,
+  UNARY_SQRT,
+  UNARY_ABS,
+  UNARY_NEG,
+  UNARY_SQUARE
+} UnaryOp;
+
+typedef enum {
+  BINARY_ADD,
+  BINARY_SUB,
+  BINARY_MUL,
+  BINARY_DIV,
+  BINARY_MIN,
+  BINARY_MAX
+} BinaryOp;
+
+// Unary functions
+Vector *vector_map(Vector *v, UnaryOp op);
+Matrix *matrix_map(Matrix *m, UnaryOp op);
+Tensor *tensor_map(Tensor *t, UnaryOp op);
+Vector *vector_apply(Vector *v, double (*fn)(double));
+Matrix *matrix_apply(Matrix *m, double (*fn)(double));
+Tensor *tensor_apply(Tensor *t, double (*fn)(double));
+Vector *vector_clamp(Vector *v, double lo, double hi);
+Matrix *matrix_clamp(Matrix *m, double lo, double hi);
+Tensor *tensor_clamp(Tensor *t, double lo, double hi);
+
+// Broadcasting binary functions
+Vector *vector_binary(Vector *a, Vector *b, BinaryOp op);
+Matrix *matrix_binary(Matrix *a, Matrix *b, BinaryOp op);
+Matrix *matrix_binary_vector(Matrix *m, Vector *v, BinaryOp op);
+Tensor *tensor_binary(Tensor *a, Tensor *b, BinaryOp op);
+Tensor *tensor_binary_matrix(Tensor *t, Matrix *m, BinaryOp op);
+
+#endif
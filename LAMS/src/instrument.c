@@ -0,0 +1,185 @@
+#include "instrument.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *kernel_names[LAMS_K_COUNT] = {
+#define LAMS_KERNEL_NAME(name) #name,
+    LAMS_KERNELS(LAMS_KERNEL_NAME)
+#undef LAMS_KERNEL_NAME
+};
+
+// Every thread owns one block of counters, only the owner adds to it and
+// reset clears it from any thread. Blocks are kept on a global list for
+// snapshots and are never freed so counts from finished threads are not
+// lost.
+typedef struct CounterBlock {
+  lams_counter_t kernels[LAMS_K_COUNT];
+  struct CounterBlock *next;
+} CounterBlock;
+
+static CounterBlock *blocks = NULL;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int lams_instrument_enabled(void) {
+#ifdef LAMS_INSTRUMENT
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+const char *lams_kernel_name(lams_kernel_t k) {
+  if (k < 0 || k >= LAMS_K_COUNT) {
+    return "unknown";
+  }
+  return kernel_names[k];
+}
+
+void lams_instrument_snapshot(lams_snapshot_t *s) {
+  memset(s, 0, sizeof(*s));
+
+  pthread_mutex_lock(&blocks_lock);
+  for (CounterBlock *b = blocks; b != NULL; b = b->next) {
+    for (int i = 0; i < LAMS_K_COUNT; i++) {
+      lams_counter_t *c = &b->kernels[i];
+      s->kernels[i].calls += __atomic_load_n(&c->calls, __ATOMIC_RELAXED);
+      s->kernels[i].ns += __atomic_load_n(&c->ns, __ATOMIC_RELAXED);
+      s->kernels[i].flops += __atomic_load_n(&c->flops, __ATOMIC_RELAXED);
+      s->kernels[i].bytes_allocated +=
+          __atomic_load_n(&c->bytes_allocated, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&blocks_lock);
+}
+
+void lams_instrument_reset(void) {
+  pthread_mutex_lock(&blocks_lock);
+  for (CounterBlock *b = blocks; b != NULL; b = b->next) {
+    for (int i = 0; i < LAMS_K_COUNT; i++) {
+      lams_counter_t *c = &b->kernels[i];
+      __atomic_store_n(&c->calls, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&c->ns, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&c->flops, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&c->bytes_allocated, 0, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&blocks_lock);
+}
+
+int lams_instrument_dump_json(FILE *f, const lams_snapshot_t *s) {
+  int first = 1;
+
+  fprintf(f, "{\"enabled\": %s, \"kernels\": {",
+          lams_instrument_enabled() ? "true" : "false");
+  for (int i = 0; i < LAMS_K_COUNT; i++) {
+    const lams_counter_t *c = &s->kernels[i];
+    if (c->calls == 0 && c->bytes_allocated == 0) {
+      continue;
+    }
+
+    fprintf(f,
+            "%s\n  \"%s\": {\"calls\": %llu, \"ns\": %llu, \"flops\": %llu, "
+            "\"bytes_allocated\": %llu}",
+            first ? "" : ",", kernel_names[i], (unsigned long long)c->calls,
+            (unsigned long long)c->ns, (unsigned long long)c->flops,
+            (unsigned long long)c->bytes_allocated);
+    first = 0;
+  }
+  fprintf(f, "%s}}\n", first ? "" : "\n");
+
+  return ferror(f) ? -1 : 0;
+}
+
+int lams_instrument_dump_prometheus(FILE *f, const lams_snapshot_t *s) {
+  static const struct {
+    const char *name;
+    const char *help;
+  } metrics[] = {
+      {"lams_kernel_calls_total", "Number of calls per LAMS kernel."},
+      {"lams_kernel_seconds_total", "Wall time spent per LAMS kernel."},
+      {"lams_kernel_flops_total", "Floating point operations per LAMS kernel."},
+      {"lams_kernel_allocated_bytes_total", "Bytes allocated per LAMS kernel."},
+  };
+
+  for (int m = 0; m < 4; m++) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", metrics[m].name,
+            metrics[m].help, metrics[m].name);
+
+    for (int i = 0; i < LAMS_K_COUNT; i++) {
+      const lams_counter_t *c = &s->kernels[i];
+      if (c->calls == 0 && c->bytes_allocated == 0) {
+        continue;
+      }
+
+      fprintf(f, "%s{kernel=\"%s\"} ", metrics[m].name, kernel_names[i]);
+      switch (m) {
+      case 0:
+        fprintf(f, "%llu\n", (unsigned long long)c->calls);
+        break;
+      case 1:
+        fprintf(f, "%.9f\n", c->ns * 1e-9);
+        break;
+      case 2:
+        fprintf(f, "%llu\n", (unsigned long long)c->flops);
+        break;
+      default:
+        fprintf(f, "%llu\n", (unsigned long long)c->bytes_allocated);
+        break;
+      }
+    }
+  }
+
+  return ferror(f) ? -1 : 0;
+}
+
+#ifdef LAMS_INSTRUMENT
+
+static _Thread_local CounterBlock *local_block = NULL;
+
+static CounterBlock *counter_block() {
+  if (local_block != NULL) {
+    return local_block;
+  }
+
+  CounterBlock *b = calloc(1, sizeof(CounterBlock));
+  if (b == NULL) {
+    fprintf(stderr, "Error: counter_block() failed to allocate memory");
+    abort();
+  }
+
+  pthread_mutex_lock(&blocks_lock);
+  b->next = blocks;
+  blocks = b;
+  pthread_mutex_unlock(&blocks_lock);
+
+  local_block = b;
+  return b;
+}
+
+// An atomic add, so a reset from another thread cannot land between the
+// owner's load and store and be overwritten. The line is the owner's, so
+// the add rarely contends.
+static inline void bump(uint64_t *p, uint64_t v) {
+  __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+}
+
+uint64_t lams_instrument_begin(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void lams_instrument_end(lams_kernel_t k, uint64_t start, uint64_t flops) {
+  lams_counter_t *c = &counter_block()->kernels[k];
+  bump(&c->calls, 1);
+  bump(&c->ns, lams_instrument_begin() - start);
+  bump(&c->flops, flops);
+}
+
+void lams_instrument_alloc(lams_kernel_t k, uint64_t bytes) {
+  bump(&counter_block()->kernels[k].bytes_allocated, bytes);
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Optional instrumentation of the LAMS kernels
+ *
+ * Built with -DLAMS_INSTRUMENT (make INSTRUMENT=1) every listed kernel
+ * records its call count, wall time, FLOPs and bytes allocated into
+ * per-thread counters. Without the flag the hooks expand to nothing and the
+ * snapshot API reports zeros.
+ *
+ * Times are inclusive, e.g. vector_copy also counts the vector_new it calls.
+ *
+ */
+
+#define LAMS_KERNELS(X)                                                        \
+  X(vector_new)                                                                \
+  X(vector_copy)                                                               \
+  X(vector_add)                                                                \
+  X(vector_sub)                                                                \
+  X(vector_scale)                                                              \
+  X(vector_dot)                                                                \
+  X(vector_norm)                                                               \
+  X(vector_normalize)                                                          \
+  X(vector_cross)                                                              \
+  X(vector_from_array)                                                         \
+  X(vector_to_array)                                                           \
+  X(matrix_new)                                                                \
+  X(matrix_copy)                                                               \
+  X(matrix_add)                                                                \
+  X(matrix_sub)                                                                \
+  X(matrix_scale)                                                              \
+  X(matrix_multiply)                                                           \
+  X(matrix_multiply_vector)                                                    \
+  X(matrix_transpose)                                                          \
+  X(matrix_fill)                                                               \
+  X(matrix_set)                                                                \
+  X(matrix_identity)                                                           \
+  X(tensor_new)                                                                \
+  X(tensor_insert)                                                             \
+  X(tensor_copy)                                                               \
+  X(tensor_add)                                                                \
+  X(tensor_sub)                                                                \
+  X(banded_multiply_vector)                                                    \
+  X(banded_multiply_matrix)                                                    \
+  X(banded_solve)                                                              \
+  X(symmetric_multiply_vector)                                                 \
+  X(symmetric_multiply_matrix)                                                 \
+  X(symmetric_solve)                                                           \
+  X(triangular_multiply_vector)                                                \
+  X(triangular_multiply_matrix)                                                \
+  X(triangular_solve)                                                          \
+  X(vector_map)                                                                \
+  X(matrix_map)                                                                \
+  X(tensor_map)                                                                \
+  X(vector_apply)                                                              \
+  X(matrix_apply)                                                              \
+  X(tensor_apply)                                                              \
+  X(vector_clamp)                                                              \
+  X(matrix_clamp)                                                              \
+  X(tensor_clamp)                                                              \
+  X(vector_binary)                                                             \
+  X(matrix_binary)                                                             \
+  X(matrix_binary_vector)                                                      \
+  X(tensor_binary)                                                             \
+  X(tensor_binary_matrix)                                                      \
+  X(matrix_reduce)                                                             \
+  X(matrix_norm_frobenius)                                                     \
+  X(qmatrix_quantize)                                                          \
+  X(qmatrix_gemm_int32)                                                        \
+  X(qmatrix_multiply_transpose)                                                \
+  X(qmatrix_multiply_vector)                                                   \
+  X(tensor_conv2d)                                                             \
+  X(tensor_im2col)                                                             \
+  X(tensor_pool2d)                                                             \
+  X(disk_matrix_multiply)                                                      \
+  X(matrix_cholesky)                                                           \
+  X(matrix_cholesky_update)                                                    \
+  X(matrix_cholesky_downdate)                                                  \
+  X(matrix_cholesky_solve)                                                     \
+  X(matrix_inverse_update_rank1)                                               \
+  X(matrix_inverse_update)                                                     \
+  X(matrix_view)                                                               \
+  X(matrix_dot)                                                                \
+  X(matrix_axpy)                                                               \
+  X(matrix_scale_in_place)                                                     \
+  X(matrix_kronecker)                                                          \
+  X(matrix_khatri_rao)                                                         \
+  X(kronecker_multiply_vector)                                                 \
+  X(kronecker_multiply_matrix)                                                 \
+  X(mvnormal_logpdf_batch)                                                     \
+  X(binomial_pmf)                                                              \
+  X(binomial_cdf)                                                              \
+  X(bernoulli_pmf)                                                             \
+  X(bernoulli_cdf)                                                             \
+  X(discrete_uniform_pmf)                                                      \
+  X(discrete_uniform_cdf)                                                      \
+  X(geometric_pmf)                                                             \
+  X(geometric_cdf)                                                             \
+  X(hypergeometric_pmf)                                                        \
+  X(hypergeometric_cdf)                                                        \
+  X(negative_binomial_pmf)                                                     \
+  X(negative_binomial_cdf)                                                     \
+  X(poisson_pmf)                                                               \
+  X(poisson_cdf)                                                               \
+  X(continuous_uniform_pmf)                                                    \
+  X(continuous_uniform_cdf)                                                    \
+  X(normal_pmf)                                                                \
+  X(normal_cdf)                                                                \
+  X(binomial_sf)                                                               \
+  X(hypergeometric_sf)                                                         \
+  X(negative_binomial_sf)                                                      \
+  X(poisson_sf)                                                                \
+  X(binomial_pmf_batch)                                                        \
+  X(binomial_cdf_batch)                                                        \
+  X(binomial_quantile_batch)                                                   \
+  X(bernoulli_pmf_batch)                                                       \
+  X(bernoulli_cdf_batch)                                                       \
+  X(bernoulli_quantile_batch)                                                  \
+  X(discrete_uniform_pmf_batch)                                                \
+  X(discrete_uniform_cdf_batch)                                                \
+  X(discrete_uniform_quantile_batch)                                           \
+  X(geometric_pmf_batch)                                                       \
+  X(geometric_cdf_batch)                                                       \
+  X(geometric_quantile_batch)                                                  \
+  X(hypergeometric_pmf_batch)                                                  \
+  X(hypergeometric_cdf_batch)                                                  \
+  X(hypergeometric_quantile_batch)                                             \
+  X(negative_binomial_pmf_batch)                                               \
+  X(negative_binomial_cdf_batch)                                               \
+  X(negative_binomial_quantile_batch)                                          \
+  X(poisson_pmf_batch)                                                         \
+  X(poisson_cdf_batch)                                                         \
+  X(poisson_quantile_batch)                                                    \
+  X(continuous_uniform_pmf_batch)                                              \
+  X(continuous_uniform_logpdf_batch)                                           \
+  X(continuous_uniform_cdf_batch)                                              \
+  X(continuous_uniform_quantile_batch)                                         \
+  X(normal_pmf_batch)                                                          \
+  X(normal_logpdf_batch)                                                       \
+  X(normal_cdf_batch)                                                          \
+  X(normal_quantile_batch)                                                     \
+  X(pmf_table)                                                                 \
+  X(sample_fill)                                                               \
+  X(categorical_build)                                                         \
+  X(moments_push_array)                                                        \
+  X(moments_push_vector)                                                       \
+  X(mvmoments_push)                                                            \
+  X(mvmoments_push_rows)                                                       \
+  X(matrix_covariance)
+
+typedef enum {
+#define LAMS_KERNEL_ENUM(name) LAMS_K_##name,
+  LAMS_KERNELS(LAMS_KERNEL_ENUM)
+#undef LAMS_KERNEL_ENUM
+      LAMS_K_COUNT
+} lams_kernel_t;
+
+typedef struct {
+  uint64_t calls;
+  uint64_t ns;
+  uint64_t flops;
+  uint64_t bytes_allocated;
+} lams_counter_t;
+
+typedef struct {
+  lams_counter_t kernels[LAMS_K_COUNT];
+} lams_snapshot_t;
+
+int lams_instrument_enabled(void);
+const char *lams_kernel_name(lams_kernel_t k);
+void lams_instrument_snapshot(lams_snapshot_t *s);
+void lams_instrument_reset(void);
+int lams_instrument_dump_json(FILE *f, const lams_snapshot_t *s);
+int lams_instrument_dump_prometheus(FILE *f, const lams_snapshot_t *s);
+
+#ifdef LAMS_INSTRUMENT
+
+uint64_t lams_instrument_begin(void);
+void lams_instrument_end(lams_kernel_t k, uint64_t start, uint64_t flops);
+void lams_instrument_alloc(lams_kernel_t k, uint64_t bytes);
+
+#define LAMS_PROF_BEGIN() uint64_t lams_prof_start_ = lams_instrument_begin()
+#define LAMS_PROF_END(kernel, flops)                                           \
+  lams_instrument_end(LAMS_K_##kernel, lams_prof_start_, (uint64_t)(flops))
+#define LAMS_PROF_ALLOC(kernel, bytes)                                         \
+  lams_instrument_alloc(LAMS_K_##kernel, (uint64_t)(bytes))
+
+#else
+
+#define LAMS_PROF_BEGIN() ((void)0)
+#define LAMS_PROF_END(kernel, flops) ((void)0)
+#define LAMS_PROF_ALLOC(kernel, bytes) ((void)0)
+
+#endif
+
+#endif
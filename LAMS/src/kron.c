@@ -0,0 +1,174 @@
+#include "kron.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "view.h"
+#include <string.h>
+
+typedef struct {
+  Matrix *A, *B, *result;
+} KronJob;
+
+// Explicit products
+// -----------------------------------------------------------------------------
+// Row i * p + k of A (x) B is row i of A with every entry spread over row k
+// of B
+static void kronecker_rows(long begin, long end, void *ctx) {
+  KronJob *job = ctx;
+  int p = job->B->rows, q = job->B->cols;
+
+  for (long r = begin; r < end; r++) {
+    const double *a = job->A->data[r / p], *b = job->B->data[r % p];
+    double *out = job->result->data[r];
+    for (int j = 0; j < job->A->cols; j++) {
+      for (int l = 0; l < q; l++) {
+        out[j * q + l] = a[j] * b[l];
+      }
+    }
+  }
+}
+
+static void khatri_rao_rows(long begin, long end, void *ctx) {
+  KronJob *job = ctx;
+  int p = job->B->rows;
+
+  for (long r = begin; r < end; r++) {
+    const double *a = job->A->data[r / p], *b = job->B->data[r % p];
+    double *out = job->result->data[r];
+    for (int j = 0; j < job->A->cols; j++) {
+      out[j] = a[j] * b[j];
+    }
+  }
+}
+
+Matrix *matrix_kronecker(Matrix *A, Matrix *B) {
+  LAMS_PROF_BEGIN();
+  Matrix *result = matrix_new(A->rows * B->rows, A->cols * B->cols);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_kronecker() failed to allocate memory");
+    return NULL;
+  }
+
+  KronJob job = {A, B, result};
+  lams_parallel_for(result->rows, lams_parallel_grain(result->cols),
+                    kronecker_rows, &job);
+
+  LAMS_PROF_END(matrix_kronecker, (double)result->rows * result->cols);
+  return result;
+}
+
+Matrix *matrix_khatri_rao(Matrix *A, Matrix *B) {
+  LAMS_PROF_BEGIN();
+  if (A->cols != B->cols) {
+    fprintf(stderr, "Error: matrix_khatri_rao() needs the same number of "
+                    "columns");
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(A->rows * B->rows, A->cols);
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_khatri_rao() failed to allocate memory");
+    return NULL;
+  }
+
+  KronJob job = {A, B, result};
+  lams_parallel_for(result->rows, lams_parallel_grain(result->cols),
+                    khatri_rao_rows, &job);
+
+  LAMS_PROF_END(matrix_khatri_rao, (double)result->rows * result->cols);
+  return result;
+}
+
+// Implicit products
+// -----------------------------------------------------------------------------
+Vector *kronecker_multiply_vector(Matrix *A, Matrix *B, Vector *x) {
+  LAMS_PROF_BEGIN();
+  int n = A->cols, q = B->cols, m = A->rows, p = B->rows;
+  if (x->size != n * q) {
+    fprintf(stderr, "Error: kronecker_multiply_vector() sizes do not match");
+    return NULL;
+  }
+
+  // x read by rows as an n x q matrix, without copying it
+  double **rows = malloc(n * sizeof(double *));
+  Vector *result = vector_new(m * p);
+  if (rows == NULL || result == NULL) {
+    fprintf(stderr, "Error: kronecker_multiply_vector() failed to allocate "
+                    "memory");
+    free(rows);
+    if (result != NULL) {
+      vector_free(result);
+    }
+    return NULL;
+  }
+  for (int i = 0; i < n; i++) {
+    rows[i] = x->data + (long)i * q;
+  }
+  Matrix X = {n, q, rows};
+
+  Matrix *Bt = matrix_transpose(B);
+  Matrix *XBt = Bt != NULL ? matrix_multiply(&X, Bt) : NULL;
+  Matrix *Y = XBt != NULL ? matrix_multiply(A, XBt) : NULL;
+  if (Y != NULL) {
+    for (int i = 0; i < m; i++) {
+      memcpy(result->data + (long)i * p, Y->data[i], p * sizeof(double));
+    }
+  } else if (result != NULL) {
+    vector_free(result);
+    result = NULL;
+  }
+
+  free(rows);
+  matrix_free(Bt);
+  matrix_free(XBt);
+  matrix_free(Y);
+  LAMS_PROF_END(kronecker_multiply_vector, 2.0 * n * q * (m + p));
+  return result;
+}
+
+// Row block k of the result is the sum over i of A[k][i] * B X_i, where X_i
+// is row block i of X
+Matrix *kronecker_multiply_matrix(Matrix *A, Matrix *B, Matrix *X) {
+  LAMS_PROF_BEGIN();
+  int n = A->cols, q = B->cols, m = A->rows, p = B->rows, c = X->cols;
+  if (X->rows != n * q) {
+    fprintf(stderr, "Error: kronecker_multiply_matrix() sizes do not match");
+    return NULL;
+  }
+
+  Matrix **BX = calloc(n, sizeof(Matrix *));
+  Matrix *result = matrix_new(m * p, c);
+  int status = BX != NULL && result != NULL ? 0 : -1;
+
+  for (int i = 0; i < n && status == 0; i++) {
+    Matrix *Xi = matrix_view(X, i * q, 0, q, c);
+    BX[i] = Xi != NULL ? matrix_multiply(B, Xi) : NULL;
+    status = BX[i] != NULL ? 0 : -1;
+    matrix_view_free(Xi);
+  }
+
+  if (status == 0) {
+    matrix_fill(result, 0.0);
+    for (int k = 0; k < m; k++) {
+      Matrix *Yk = matrix_view(result, k * p, 0, p, c);
+      for (int i = 0; i < n; i++) {
+        if (A->data[k][i] != 0.0) {
+          matrix_axpy(Yk, A->data[k][i], BX[i]);
+        }
+      }
+      matrix_view_free(Yk);
+    }
+  } else {
+    fprintf(stderr, "Error: kronecker_multiply_matrix() failed to allocate "
+                    "memory");
+    matrix_free(result);
+    result = NULL;
+  }
+
+  for (int i = 0; BX != NULL && i < n; i++) {
+    matrix_free(BX[i]);
+  }
+  free(BX);
+  LAMS_PROF_END(kronecker_multiply_matrix, 2.0 * n * q * c * (m + p));
+  return result;
+}
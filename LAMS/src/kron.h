@@ -0,0 +1,30 @@
+#ifndef KRON_H
+#define KRON_H
+
+#include "linear_algebra.h"
+
+/*
+ * Kronecker and Khatri-Rao products
+ *
+ * For A (m x n) and B (p x q), A (x) B is the mp x nq matrix of blocks
+ * A[i][j] * B. The Khatri-Rao product of A (m x k) and B (p x k) is the
+ * mp x k matrix whose column j is the Kronecker product of column j of A
+ * and column j of B.
+ *
+ * Both are built explicitly by matrix_kronecker and matrix_khatri_rao, but
+ * (A (x) B) x never needs the big matrix: with x read by rows as an n x q
+ * matrix X, it is A X B^T read by rows. kronecker_multiply_vector does that
+ * with two matrix_multiply calls in O(nq(m + p)) instead of O(mnpq) work,
+ * and kronecker_multiply_matrix does the same for every column of X
+ * through views of its row blocks.
+ *
+ */
+
+Matrix *matrix_kronecker(Matrix *A, Matrix *B);
+Matrix *matrix_khatri_rao(Matrix *A, Matrix *B);
+
+// x has A->cols * B->cols entries, the result A->rows * B->rows
+Vector *kronecker_multiply_vector(Matrix *A, Matrix *B, Vector *x);
+Matrix *kronecker_multiply_matrix(Matrix *A, Matrix *B, Matrix *X);
+
+#endif
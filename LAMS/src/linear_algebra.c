@@ -1,12 +1,88 @@
 #include "linear_algebra.h"
+#include "instrument.h"
+#include "parallel.h"
 #include <stdio.h>
 
+// Element-wise kernels
+// -----------------------------------------------------------------------------
+// Shared by the Vector, Matrix and Tensor functions below. Large inputs are
+// split across the thread pool, Vectors by elements and Matrices and Tensors
+// by rows, row r being slice r / rows, row r % rows.
+typedef enum { ELEMENTS_ADD, ELEMENTS_SUB, ELEMENTS_SCALE } ElementsOp;
+
+typedef struct {
+  ElementsOp op;
+  double s;
+  const double *a, *b;
+  double *y;
+  double ***rows_a, ***rows_b, ***rows_y;
+  int rows, cols;
+} ElementsJob;
+
+static void elements_span(const ElementsJob *job, const double *a,
+                          const double *b, double *y, long n) {
+  switch (job->op) {
+  case ELEMENTS_ADD:
+    for (long j = 0; j < n; j++) {
+      y[j] = a[j] + b[j];
+    }
+    break;
+  case ELEMENTS_SUB:
+    for (long j = 0; j < n; j++) {
+      y[j] = a[j] - b[j];
+    }
+    break;
+  case ELEMENTS_SCALE:
+    for (long j = 0; j < n; j++) {
+      y[j] = a[j] * job->s;
+    }
+    break;
+  }
+}
+
+static void elements_vector(long begin, long end, void *ctx) {
+  const ElementsJob *job = ctx;
+  elements_span(job, job->a + begin, job->b ? job->b + begin : NULL,
+                job->y + begin, end - begin);
+}
+
+static void elements_rows(long begin, long end, void *ctx) {
+  const ElementsJob *job = ctx;
+
+  for (long r = begin; r < end; r++) {
+    int d = r / job->rows, i = r % job->rows;
+    elements_span(job, job->rows_a[d][i],
+                  job->rows_b ? job->rows_b[d][i] : NULL, job->rows_y[d][i],
+                  job->cols);
+  }
+}
+
+static void elements_vector_run(ElementsOp op, Vector *a, Vector *b,
+                                Vector *y, double s) {
+  ElementsJob job = {.op = op, .s = s, .a = a->data, .y = y->data};
+  job.b = b ? b->data : NULL;
+  lams_parallel_for(y->size, LAMS_PARALLEL_MIN_ELEMENTS, elements_vector,
+                    &job);
+}
+
+static void elements_rows_run(ElementsOp op, double ***a, double ***b,
+                              double ***y, int slices, int rows, int cols,
+                              double s) {
+  ElementsJob job = {.op = op, .s = s, .rows_a = a, .rows_b = b, .rows_y = y,
+                     .rows = rows, .cols = cols};
+  lams_parallel_for((long)slices * rows, lams_parallel_grain(cols),
+                    elements_rows, &job);
+}
+
 // Vector functions
 // -----------------------------------------------------------------------------
 Vector *vector_new(int n) {
+  LAMS_PROF_BEGIN();
   Vector *v = malloc(sizeof(Vector));
   v->size = n;
   v->data = malloc(n * sizeof(double));
+  LAMS_PROF_ALLOC(vector_new, sizeof(Vector) + n * sizeof(double));
+  LAMS_PROF_END(vector_new, 0);
   return v;
 }
 
@@ -17,6 +93,7 @@ void vector_free(Vector *v) {
 }
 
 Vector *vector_copy(Vector *v) {
+  LAMS_PROF_BEGIN();
   Vector *v_copy = vector_new(v->size);
 
   if (v_copy == NULL) {
@@ -28,10 +105,12 @@ Vector *vector_copy(Vector *v) {
     v_copy->data[i] = v->data[i];
   }
 
+  LAMS_PROF_END(vector_copy, 0);
   return v_copy;
 }
 
 Vector *vector_add(Vector *a, Vector *b) {
+  LAMS_PROF_BEGIN();
   if (a->size != b->size) {
     fprintf(stderr, "Error: vector_add() vectors must be the same size");
     return NULL;
@@ -44,14 +123,14 @@ Vector *vector_add(Vector *a, Vector *b) {
     return NULL;
   }
 
-  for (int i = 0; i < a->size; i++) {
-    result->data[i] = a->data[i] + b->data[i];
-  }
+  elements_vector_run(ELEMENTS_ADD, a, b, result, 0.0);
 
+  LAMS_PROF_END(vector_add, a->size);
   return result;
 }
 
 Vector *vector_sub(Vector *a, Vector *b) {
+  LAMS_PROF_BEGIN();
   if (a->size != b->size) {
     fprintf(stderr, "Error: vector_sub() vectors must be the same size");
     return NULL;
@@ -64,14 +143,14 @@ Vector *vector_sub(Vector *a, Vector *b) {
     return NULL;
   }
 
-  for (int i = 0; i < a->size; i++) {
-    result->data[i] = a->data[i] - b->data[i];
-  }
+  elements_vector_run(ELEMENTS_SUB, a, b, result, 0.0);
 
+  LAMS_PROF_END(vector_sub, a->size);
   return result;
 }
 
 Vector *vector_scale(Vector *v, double c) {
+  LAMS_PROF_BEGIN();
   Vector *result = vector_new(v->size);
 
   if (result == NULL) {
@@ -79,14 +158,14 @@ Vector *vector_scale(Vector *v, double c) {
     return NULL;
   }
 
-  for (int i = 0; i < v->size; i++) {
-    result->data[i] = v->data[i] * c;
-  }
+  elements_vector_run(ELEMENTS_SCALE, v, NULL, result, c);
 
+  LAMS_PROF_END(vector_scale, v->size);
   return result;
 }
 
 double vector_dot(Vector *a, Vector *b) {
+  LAMS_PROF_BEGIN();
   double result = 0;
 
   if (a->size != b->size) {
@@ -98,20 +177,24 @@ double vector_dot(Vector *a, Vector *b) {
     result += a->data[i] * b->data[i];
   }
 
+  LAMS_PROF_END(vector_dot, 2 * a->size);
   return result;
 }
 
 double vector_norm(Vector *v) {
+  LAMS_PROF_BEGIN();
   double result = 0;
 
   for (int i = 0; i < v->size; i++) {
     result += v->data[i] * v->data[i];
   }
 
+  LAMS_PROF_END(vector_norm, 2 * v->size);
   return sqrt(result);
 }
 
 Vector *vector_normalize(Vector *v) {
+  LAMS_PROF_BEGIN();
   Vector *result = vector_new(v->size);
 
   if (result == NULL) {
@@ -125,10 +208,12 @@ Vector *vector_normalize(Vector *v) {
     result->data[i] = v->data[i] / norm;
   }
 
+  LAMS_PROF_END(vector_normalize, 3 * v->size);
   return result;
 }
 
 Vector *vector_cross(Vector *a, Vector *b) {
+  LAMS_PROF_BEGIN();
   if (a->size != b->size) {
     fprintf(stderr, "Error: vector_cross() vectors must be the same size");
     return NULL;
@@ -146,10 +231,12 @@ Vector *vector_cross(Vector *a, Vector *b) {
                       a->data[(i + 2) % 3] * b->data[(i + 1) % 3];
   }
 
+  LAMS_PROF_END(vector_cross, 9);
   return result;
 }
 
 Vector *vector_from_array(int size, double array[]) {
+  LAMS_PROF_BEGIN();
   Vector *result = vector_new(size);
 
   if (result == NULL) {
@@ -161,22 +248,27 @@ Vector *vector_from_array(int size, double array[]) {
     result->data[i] = array[i];
   }
 
+  LAMS_PROF_END(vector_from_array, 0);
   return result;
 }
 
 double *vector_to_array(Vector *v) {
+  LAMS_PROF_BEGIN();
   double *result = malloc(sizeof(double) * v->size);
+  LAMS_PROF_ALLOC(vector_to_array, sizeof(double) * v->size);
 
   for (int i = 0; i < v->size; i++) {
     result[i] = v->data[i];
   }
 
+  LAMS_PROF_END(vector_to_array, 0);
   return result;
 }
 
 // Matrix functions
 // -----------------------------------------------------------------------------
 Matrix *matrix_new(int rows, int cols) {
+  LAMS_PROF_BEGIN();
   Matrix *result = (Matrix *)malloc(sizeof(Matrix));
 
   if (result == NULL) {
@@ -202,6 +294,9 @@ Matrix *matrix_new(int rows, int cols) {
     }
   }
 
+  LAMS_PROF_ALLOC(matrix_new, sizeof(Matrix) + rows * sizeof(double *) +
+                                  (size_t)rows * cols * sizeof(double));
+  LAMS_PROF_END(matrix_new, 0);
   return result;
 }
 
@@ -229,6 +324,7 @@ void matrix_free_tensor(Matrix *m) {
 }
 
 Matrix *matrix_copy(Matrix *m) {
+  LAMS_PROF_BEGIN();
   Matrix *result = matrix_new(m->rows, m->cols);
 
   for (int i = 0; i < m->rows; i++) {
@@ -237,11 +333,13 @@ Matrix *matrix_copy(Matrix *m) {
     }
   }
 
+  LAMS_PROF_END(matrix_copy, 0);
   return result;
 }
 
 Matrix *matrix_add(Matrix *a, Matrix *b) {
-  if (a->rows != b->rows && a->cols != b->cols) {
+  LAMS_PROF_BEGIN();
+  if (a->rows != b->rows || a->cols != b->cols) {
     fprintf(stderr,
             "Error: matrix_add() cannot add matrices of different sizes");
     return NULL;
@@ -255,17 +353,16 @@ Matrix *matrix_add(Matrix *a, Matrix *b) {
     return NULL;
   }
 
-  for (int i = 0; i < a->rows; i++) {
-    for (int j = 0; j < a->cols; j++) {
-      result->data[i][j] = a->data[i][j] + b->data[i][j];
-    }
-  }
+  elements_rows_run(ELEMENTS_ADD, &a->data, &b->data, &result->data, 1,
+                    a->rows, a->cols, 0.0);
 
+  LAMS_PROF_END(matrix_add, a->rows * a->cols);
   return result;
 }
 
 Matrix *matrix_sub(Matrix *a, Matrix *b) {
-  if (a->rows != b->rows && a->cols != b->cols) {
+  LAMS_PROF_BEGIN();
+  if (a->rows != b->rows || a->cols != b->cols) {
     fprintf(stderr,
             "Error: matrix_sub() cannot subtract matrices of different sizes");
     return NULL;
@@ -279,16 +376,15 @@ Matrix *matrix_sub(Matrix *a, Matrix *b) {
     return NULL;
   }
 
-  for (int i = 0; i < a->rows; i++) {
-    for (int j = 0; j < a->cols; j++) {
-      result->data[i][j] = a->data[i][j] - b->data[i][j];
-    }
-  }
+  elements_rows_run(ELEMENTS_SUB, &a->data, &b->data, &result->data, 1,
+                    a->rows, a->cols, 0.0);
 
+  LAMS_PROF_END(matrix_sub, a->rows * a->cols);
   return result;
 }
 
 Matrix *matrix_scale(Matrix *m, double s) {
+  LAMS_PROF_BEGIN();
   Matrix *result = matrix_new(m->rows, m->cols);
 
   if (result == NULL) {
@@ -298,16 +394,72 @@ Matrix *matrix_scale(Matrix *m, double s) {
     return NULL;
   }
 
-  for (int i = 0; i < m->rows; i++) {
-    for (int j = 0; j < m->cols; j++) {
-      result->data[i][j] = m->data[i][j] * s;
+  elements_rows_run(ELEMENTS_SCALE, &m->data, NULL, &result->data, 1, m->rows,
+                    m->cols, s);
+
+  LAMS_PROF_END(matrix_scale, m->rows * m->cols);
+  return result;
+}
+
+// Rows of the result accumulate scaled rows of b, so every inner loop runs
+// along contiguous rows. Four result rows share each load of b, and columns
+// go in blocks so the rows being accumulated stay in L1.
+#define MULTIPLY_COLS 256
+
+typedef struct {
+  Matrix *a, *b, *y;
+} MultiplyJob;
+
+static void multiply_block(MultiplyJob *job, long i, int rows, int jb,
+                           int len) {
+  double *y[4];
+  for (int r = 0; r < rows; r++) {
+    y[r] = job->y->data[i + r] + jb;
+    for (int j = 0; j < len; j++) {
+      y[r][j] = 0.0;
     }
   }
 
-  return result;
+  for (int k = 0; k < job->a->cols; k++) {
+    const double *restrict x = job->b->data[k] + jb;
+    if (rows == 4) {
+      double *restrict y0 = y[0], *restrict y1 = y[1];
+      double *restrict y2 = y[2], *restrict y3 = y[3];
+      double s0 = job->a->data[i][k], s1 = job->a->data[i + 1][k];
+      double s2 = job->a->data[i + 2][k], s3 = job->a->data[i + 3][k];
+      for (int j = 0; j < len; j++) {
+        y0[j] += s0 * x[j];
+        y1[j] += s1 * x[j];
+        y2[j] += s2 * x[j];
+        y3[j] += s3 * x[j];
+      }
+    } else {
+      for (int r = 0; r < rows; r++) {
+        double *restrict yr = y[r];
+        double s = job->a->data[i + r][k];
+        for (int j = 0; j < len; j++) {
+          yr[j] += s * x[j];
+        }
+      }
+    }
+  }
+}
+
+static void multiply_rows(long begin, long end, void *ctx) {
+  MultiplyJob *job = ctx;
+  int n = job->b->cols;
+
+  for (long i = begin; i < end; i += 4) {
+    int rows = end - i < 4 ? end - i : 4;
+    for (int jb = 0; jb < n; jb += MULTIPLY_COLS) {
+      int len = n - jb < MULTIPLY_COLS ? n - jb : MULTIPLY_COLS;
+      multiply_block(job, i, rows, jb, len);
+    }
+  }
 }
 
 Matrix *matrix_multiply(Matrix *a, Matrix *b) {
+  LAMS_PROF_BEGIN();
   if (a->cols != b->rows) {
     fprintf(stderr, "Error: matrix_multiply() cannot multiply matrices of "
                     "incompatible sizes");
@@ -323,19 +475,16 @@ Matrix *matrix_multiply(Matrix *a, Matrix *b) {
     return NULL;
   }
 
-  for (int i = 0; i < a->rows; i++) {
-    for (int j = 0; j < b->cols; j++) {
-      result->data[i][j] = 0;
-      for (int k = 0; k < a->cols; k++) {
-        result->data[i][j] += round(a->data[i][k] * b->data[k][j]);
-      }
-    }
-  }
+  MultiplyJob job = {a, b, result};
+  lams_parallel_for(a->rows, lams_parallel_grain((long)a->cols * b->cols),
+                    multiply_rows, &job);
 
+  LAMS_PROF_END(matrix_multiply, 2.0 * a->rows * a->cols * b->cols);
   return result;
 }
 
 Matrix *matrix_multiply_vector(Matrix *m, Vector *v) {
+  LAMS_PROF_BEGIN();
   if (m->cols != v->size) {
     fprintf(stderr, "Error: matrix_muliply_vector() cannot multiply matrix and "
                     "vector of incompatible sizes");
@@ -357,10 +506,12 @@ Matrix *matrix_multiply_vector(Matrix *m, Vector *v) {
     }
   }
 
+  LAMS_PROF_END(matrix_multiply_vector, 2 * m->rows * m->cols);
   return result;
 }
 
 Matrix *matrix_transpose(Matrix *m) {
+  LAMS_PROF_BEGIN();
   Matrix *result = matrix_new(m->cols, m->rows);
 
   for (int i = 0; i < m->rows; i++) {
@@ -369,18 +520,23 @@ Matrix *matrix_transpose(Matrix *m) {
     }
   }
 
+  LAMS_PROF_END(matrix_transpose, 0);
   return result;
 }
 
 void matrix_fill(Matrix *m, double value) {
+  LAMS_PROF_BEGIN();
   for (int i = 0; i < m->rows; i++) {
     for (int j = 0; j < m->cols; j++) {
       m->data[i][j] = value;
     }
   }
+
+  LAMS_PROF_END(matrix_fill, 0);
 }
 
 void matrix_set(Matrix *m, double data[], int size) {
+  LAMS_PROF_BEGIN();
   if (size != m->rows * m->cols) {
     fprintf(
         stderr,
@@ -401,6 +557,8 @@ void matrix_set(Matrix *m, double data[], int size) {
     int col = i % m->cols; // calculate the column index
     m->data[row][col] = data[i];
   }
+
+  LAMS_PROF_END(matrix_set, 0);
 }
 
 void matrix_print(Matrix *m) {
@@ -414,6 +572,7 @@ void matrix_print(Matrix *m) {
 }
 
 Matrix *matrix_identity(int size) {
+  LAMS_PROF_BEGIN();
   Matrix *result = matrix_new(size, size);
 
   for (int i = 0; i < size; i++) {
@@ -426,12 +585,14 @@ Matrix *matrix_identity(int size) {
     }
   }
 
+  LAMS_PROF_END(matrix_identity, 0);
   return result;
 }
 
 // Tensor functions
 // -----------------------------------------------------------------------------
 Tensor *tensor_new(int rows, int cols, int rank) {
+  LAMS_PROF_BEGIN();
   Tensor *t = (Tensor *)malloc(sizeof(Tensor));
 
   if (t == NULL) {
@@ -459,10 +620,15 @@ Tensor *tensor_new(int rows, int cols, int rank) {
     }
   }
 
+  LAMS_PROF_ALLOC(tensor_new, sizeof(Tensor) + rank * sizeof(double **) +
+                                  (size_t)rank * rows * sizeof(double *) +
+                                  (size_t)rank * rows * cols * sizeof(double));
+  LAMS_PROF_END(tensor_new, 0);
   return t;
 }
 
 void tensor_insert(Tensor *t, Matrix *m, int index) {
+  LAMS_PROF_BEGIN();
   if (index >= t->rank) {
     fprintf(stderr, "tensor_insert: index out of bounds");
     return;
@@ -478,6 +644,8 @@ void tensor_insert(Tensor *t, Matrix *m, int index) {
       t->data[index][i][j] = m->data[i][j];
     }
   }
+
+  LAMS_PROF_END(tensor_insert, 0);
 }
 
 void tensor_free(Tensor *t) {
@@ -496,6 +664,7 @@ void tensor_free(Tensor *t) {
 }
 
 Tensor *tensor_copy(Tensor *src) {
+  LAMS_PROF_BEGIN();
   Tensor *dest = tensor_new(src->rows, src->cols, src->rank);
 
   for (int i = 0; i < src->rank; i++) {
@@ -506,6 +675,7 @@ Tensor *tensor_copy(Tensor *src) {
     }
   }
 
+  LAMS_PROF_END(tensor_copy, 0);
   return dest;
 }
 
@@ -523,48 +693,42 @@ void tensor_print(Tensor *t) {
 }
 
 Tensor *tensor_add(Tensor *t1, Tensor *t2) {
-  if (t1->rank != t2->rank) {
-    fprintf(stderr, "tensor_add: tensors must have the same rank");
+  LAMS_PROF_BEGIN();
+  if (t1->rank != t2->rank || t1->rows != t2->rows || t1->cols != t2->cols) {
+    fprintf(stderr, "tensor_add: tensors must have the same shape");
     return NULL;
   }
 
-  Tensor *result = tensor_new(t1->rank, t1->rows, t1->cols);
+  Tensor *result = tensor_new(t1->rows, t1->cols, t1->rank);
   if (result == NULL) {
     fprintf(stderr, "tensor_add: failed to allocate memory");
     return NULL;
   }
 
-  for (int i = 0; i < t1->rank; i++) {
-    for (int j = 0; j < t1->rows; j++) {
-      for (int k = 0; k < t1->cols; k++) {
-        result->data[i][j][k] = t1->data[i][j][k] + t2->data[i][j][k];
-      }
-    }
-  }
+  elements_rows_run(ELEMENTS_ADD, t1->data, t2->data, result->data, t1->rank,
+                    t1->rows, t1->cols, 0.0);
 
+  LAMS_PROF_END(tensor_add, t1->rank * t1->rows * t1->cols);
   return result;
 }
 
 Tensor *tensor_sub(Tensor *t1, Tensor *t2) {
-  if (t1->rank != t2->rank) {
-    fprintf(stderr, "tensor_sub: tensors must have the same rank");
+  LAMS_PROF_BEGIN();
+  if (t1->rank != t2->rank || t1->rows != t2->rows || t1->cols != t2->cols) {
+    fprintf(stderr, "tensor_sub: tensors must have the same shape");
     return NULL;
   }
 
-  Tensor *result = tensor_new(t1->rank, t1->rows, t1->cols);
+  Tensor *result = tensor_new(t1->rows, t1->cols, t1->rank);
   if (result == NULL) {
     fprintf(stderr, "tensor_sub: failed to allocate memory");
     return NULL;
   }
 
-  for (int i = 0; i < t1->rank; i++) {
-    for (int j = 0; j < t1->rows; j++) {
-      for (int k = 0; k < t1->cols; k++) {
-        result->data[i][j][k] = t1->data[i][j][k] - t2->data[i][j][k];
-      }
-    }
-  }
+  elements_rows_run(ELEMENTS_SUB, t1->data, t2->data, result->data, t1->rank,
+                    t1->rows, t1->cols, 0.0);
 
+  LAMS_PROF_END(tensor_sub, t1->rank * t1->rows * t1->cols);
   return result;
 }
 
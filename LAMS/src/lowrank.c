@@ -0,0 +1,559 @@
+#include "lowrank.h"
+#include "instrument.h"
+#include "parallel.h"
+#include <string.h>
+
+// Pivots smaller than this times the largest trigger a refactorization
+#define DEFAULT_TOLERANCE 1e-8
+
+// Inverse updates whose pivots lose more digits than this are refused
+#define INVERSE_MARGIN 1e-10
+
+typedef struct {
+  Matrix *R;
+  int k;
+} TrailingJob;
+
+typedef struct {
+  Matrix *y;
+  const double *w, *z;
+  double scale;
+} OuterJob;
+
+static int is_square(Matrix *m, int n, const char *name) {
+  if (m->rows != m->cols || (n >= 0 && m->rows != n)) {
+    fprintf(stderr, "Error: %s() sizes do not match", name);
+    return 0;
+  }
+  return 1;
+}
+
+// Factorization
+// -----------------------------------------------------------------------------
+// Rows below k lose their component along row k, each row reads row k in
+// order
+static void trailing_rows(long begin, long end, void *ctx) {
+  TrailingJob *job = ctx;
+  int n = job->R->cols;
+  const double *rk = job->R->data[job->k];
+
+  for (long i = job->k + 1 + begin; i < job->k + 1 + end; i++) {
+    double s = rk[i];
+    double *ri = job->R->data[i];
+    for (int j = i; j < n; j++) {
+      ri[j] -= s * rk[j];
+    }
+  }
+}
+
+// R holds the upper triangle of A on entry and its factor on success
+static int factor_in_place(Matrix *R) {
+  int n = R->rows;
+
+  for (int k = 0; k < n; k++) {
+    double *rk = R->data[k];
+    if (!(rk[k] > 0.0)) {
+      return -1;
+    }
+    double d = sqrt(rk[k]);
+    rk[k] = d;
+    for (int j = k + 1; j < n; j++) {
+      rk[j] /= d;
+    }
+
+    TrailingJob job = {R, k};
+    lams_parallel_for(n - k - 1, lams_parallel_grain(n - k), trailing_rows,
+                      &job);
+  }
+  return 0;
+}
+
+static void copy_upper(Matrix *R, Matrix *A) {
+  for (int i = 0; i < A->rows; i++) {
+    for (int j = 0; j < A->cols; j++) {
+      R->data[i][j] = j >= i ? A->data[i][j] : 0.0;
+    }
+  }
+}
+
+Matrix *matrix_cholesky(Matrix *A) {
+  LAMS_PROF_BEGIN();
+  if (!is_square(A, -1, "matrix_cholesky")) {
+    return NULL;
+  }
+
+  Matrix *R = matrix_new(A->rows, A->cols);
+  if (R == NULL) {
+    return NULL;
+  }
+
+  copy_upper(R, A);
+  if (factor_in_place(R) != 0) {
+    fprintf(stderr, "Error: matrix_cholesky() matrix is not positive definite");
+    matrix_free(R);
+    return NULL;
+  }
+
+  LAMS_PROF_END(matrix_cholesky, (double)A->rows * A->rows * A->rows / 3);
+  return R;
+}
+
+// Rank one changes
+// -----------------------------------------------------------------------------
+// |p|^2 with R^T p = x, A - x x^T stays positive definite while it is
+// below 1
+static double downdate_norm(Matrix *R, const double *x) {
+  int n = R->rows;
+  double *p = malloc(n * sizeof(double)), norm = 0.0;
+
+  if (p == NULL) {
+    return INFINITY;
+  }
+
+  memcpy(p, x, n * sizeof(double));
+  for (int i = 0; i < n; i++) {
+    const double *ri = R->data[i];
+    p[i] /= ri[i];
+    norm += p[i] * p[i];
+    for (int j = i + 1; j < n; j++) {
+      p[j] -= ri[j] * p[i];
+    }
+  }
+
+  free(p);
+  return norm;
+}
+
+// Rotates x into R one row at a time, sign 1 adds x x^T and -1 removes it
+static int rank1(Matrix *R, const double *x_in, double sign) {
+  int n = R->rows;
+  double *x = malloc(n * sizeof(double));
+
+  if (x == NULL) {
+    fprintf(stderr, "Error: cholesky update failed to allocate memory");
+    return -1;
+  }
+  if (sign < 0 && !(downdate_norm(R, x_in) < 1.0 - CHOLESKY_MARGIN)) {
+    free(x);
+    return -1;
+  }
+
+  memcpy(x, x_in, n * sizeof(double));
+  for (int k = 0; k < n; k++) {
+    double *rk = R->data[k];
+    double d = rk[k], xk = x[k];
+    double r = sign > 0 ? hypot(d, xk) : sqrt((d - xk) * (d + xk));
+    double c = r / d, s = xk / d;
+
+    rk[k] = r;
+    for (int j = k + 1; j < n; j++) {
+      rk[j] = (rk[j] + sign * s * x[j]) / c;
+      x[j] = c * x[j] - s * rk[j];
+    }
+  }
+
+  free(x);
+  return 0;
+}
+
+int matrix_cholesky_update(Matrix *R, Vector *x) {
+  LAMS_PROF_BEGIN();
+  if (!is_square(R, x->size, "matrix_cholesky_update")) {
+    return -1;
+  }
+
+  int status = rank1(R, x->data, 1.0);
+  LAMS_PROF_END(matrix_cholesky_update, 4.0 * R->rows * R->rows);
+  return status;
+}
+
+int matrix_cholesky_downdate(Matrix *R, Vector *x) {
+  LAMS_PROF_BEGIN();
+  if (!is_square(R, x->size, "matrix_cholesky_downdate")) {
+    return -1;
+  }
+
+  int status = rank1(R, x->data, -1.0);
+  LAMS_PROF_END(matrix_cholesky_downdate, 5.0 * R->rows * R->rows);
+  return status;
+}
+
+int matrix_cholesky_update_rank(Matrix *R, Matrix *X) {
+  if (!is_square(R, X->cols, "matrix_cholesky_update_rank")) {
+    return -1;
+  }
+
+  for (int r = 0; r < X->rows; r++) {
+    Vector row = {X->cols, X->data[r]};
+    if (matrix_cholesky_update(R, &row) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// A rejected row undoes the ones before it, so R is either fully
+// downdated or as it was
+int matrix_cholesky_downdate_rank(Matrix *R, Matrix *X) {
+  if (!is_square(R, X->cols, "matrix_cholesky_downdate_rank")) {
+    return -1;
+  }
+
+  Matrix *saved = matrix_copy(R);
+  if (saved == NULL) {
+    return -1;
+  }
+
+  int status = 0;
+  for (int r = 0; r < X->rows && status == 0; r++) {
+    Vector row = {X->cols, X->data[r]};
+    status = matrix_cholesky_downdate(R, &row);
+  }
+
+  if (status != 0) {
+    for (int i = 0; i < R->rows; i++) {
+      memcpy(R->data[i], saved->data[i], R->cols * sizeof(double));
+    }
+  }
+  matrix_free(saved);
+  return status;
+}
+
+Matrix *matrix_cholesky_solve(Matrix *R, Matrix *b) {
+  LAMS_PROF_BEGIN();
+  if (!is_square(R, b->rows, "matrix_cholesky_solve")) {
+    return NULL;
+  }
+
+  Matrix *y = matrix_copy(b);
+  if (y == NULL) {
+    return NULL;
+  }
+
+  int n = R->rows, m = b->cols;
+  // R^T y = b, then R x = y, whole rows of y at a time
+  for (int i = 0; i < n; i++) {
+    double *yi = y->data[i];
+    for (int c = 0; c < m; c++) {
+      yi[c] /= R->data[i][i];
+    }
+    for (int j = i + 1; j < n; j++) {
+      double s = R->data[i][j];
+      double *yj = y->data[j];
+      for (int c = 0; c < m; c++) {
+        yj[c] -= s * yi[c];
+      }
+    }
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    double *yi = y->data[i];
+    for (int j = i + 1; j < n; j++) {
+      double s = R->data[i][j];
+      const double *yj = y->data[j];
+      for (int c = 0; c < m; c++) {
+        yi[c] -= s * yj[c];
+      }
+    }
+    for (int c = 0; c < m; c++) {
+      yi[c] /= R->data[i][i];
+    }
+  }
+
+  LAMS_PROF_END(matrix_cholesky_solve, 2.0 * n * n * m);
+  return y;
+}
+
+double matrix_cholesky_logdet(Matrix *R) {
+  double sum = 0.0;
+
+  for (int k = 0; k < R->rows; k++) {
+    sum += log(R->data[k][k]);
+  }
+  return 2.0 * sum;
+}
+
+// Cholesky with a kept matrix
+// -----------------------------------------------------------------------------
+Cholesky *cholesky_new(Matrix *A) {
+  Cholesky *c = calloc(1, sizeof(Cholesky));
+
+  if (c == NULL) {
+    fprintf(stderr, "Error: cholesky_new() failed to allocate memory");
+    return NULL;
+  }
+
+  c->A = matrix_copy(A);
+  c->R = c->A != NULL ? matrix_cholesky(A) : NULL;
+  c->tolerance = DEFAULT_TOLERANCE;
+  if (c->R == NULL) {
+    cholesky_free(c);
+    return NULL;
+  }
+  return c;
+}
+
+void cholesky_free(Cholesky *c) {
+  if (c == NULL) {
+    return;
+  }
+
+  matrix_free(c->A);
+  matrix_free(c->R);
+  free(c);
+}
+
+static int refactor(Cholesky *c) {
+  Matrix *R = matrix_new(c->A->rows, c->A->cols);
+
+  if (R == NULL) {
+    return -1;
+  }
+
+  copy_upper(R, c->A);
+  int status = factor_in_place(R);
+  if (status == 0) {
+    for (int i = 0; i < R->rows; i++) {
+      memcpy(c->R->data[i], R->data[i], R->cols * sizeof(double));
+    }
+    c->refactorizations++;
+  }
+
+  matrix_free(R);
+  return status;
+}
+
+static int check(Cholesky *c) {
+  double lo = INFINITY, hi = 0.0;
+
+  for (int k = 0; k < c->R->rows; k++) {
+    double d = c->R->data[k][k];
+    lo = d < lo ? d : lo;
+    hi = d > hi ? d : hi;
+  }
+  return lo < c->tolerance * hi ? refactor(c) : 0;
+}
+
+// A += sign * x x^T
+static void rank1_symmetric(Matrix *A, const double *x, double sign) {
+  for (int i = 0; i < A->rows; i++) {
+    double s = sign * x[i];
+    double *ai = A->data[i];
+    for (int j = 0; j < A->cols; j++) {
+      ai[j] += s * x[j];
+    }
+  }
+}
+
+int cholesky_update(Cholesky *c, Vector *x) {
+  if (matrix_cholesky_update(c->R, x) != 0) {
+    return -1;
+  }
+
+  rank1_symmetric(c->A, x->data, 1.0);
+  return check(c);
+}
+
+int cholesky_downdate(Cholesky *c, Vector *x) {
+  if (!is_square(c->R, x->size, "cholesky_downdate")) {
+    return -1;
+  }
+
+  rank1_symmetric(c->A, x->data, -1.0);
+  if (matrix_cholesky_downdate(c->R, x) == 0) {
+    return check(c);
+  }
+
+  // Too close to the margin for the update, A itself decides
+  if (refactor(c) != 0) {
+    rank1_symmetric(c->A, x->data, 1.0);
+    return -1;
+  }
+  return 0;
+}
+
+int cholesky_update_rank(Cholesky *c, Matrix *X) {
+  for (int r = 0; r < X->rows; r++) {
+    Vector row = {X->cols, X->data[r]};
+    if (cholesky_update(c, &row) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int cholesky_downdate_rank(Cholesky *c, Matrix *X) {
+  for (int r = 0; r < X->rows; r++) {
+    Vector row = {X->cols, X->data[r]};
+    if (cholesky_downdate(c, &row) != 0) {
+      // Put the rows already taken out back in
+      while (--r >= 0) {
+        Vector back = {X->cols, X->data[r]};
+        cholesky_update(c, &back);
+      }
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Inverse updates
+// -----------------------------------------------------------------------------
+// y -= scale * w z^T
+static void outer_rows(long begin, long end, void *ctx) {
+  OuterJob *job = ctx;
+  int n = job->y->cols;
+
+  for (long i = begin; i < end; i++) {
+    double s = job->scale * job->w[i];
+    double *yi = job->y->data[i];
+    for (int j = 0; j < n; j++) {
+      yi[j] -= s * job->z[j];
+    }
+  }
+}
+
+int matrix_inverse_update_rank1(Matrix *inverse, Vector *u, Vector *v) {
+  LAMS_PROF_BEGIN();
+  if (!is_square(inverse, u->size, "matrix_inverse_update_rank1") ||
+      v->size != u->size) {
+    return -1;
+  }
+
+  int n = inverse->rows;
+  double *w = calloc(n, sizeof(double)), *z = calloc(n, sizeof(double));
+  if (w == NULL || z == NULL) {
+    fprintf(stderr, "Error: matrix_inverse_update_rank1() failed to allocate");
+    free(w);
+    free(z);
+    return -1;
+  }
+
+  // w = A^-1 u, z = v^T A^-1
+  double vw = 0.0;
+  for (int i = 0; i < n; i++) {
+    const double *row = inverse->data[i];
+    double s = 0.0;
+    for (int j = 0; j < n; j++) {
+      s += row[j] * u->data[j];
+      z[j] += v->data[i] * row[j];
+    }
+    w[i] = s;
+    vw += v->data[i] * s;
+  }
+
+  double denominator = 1.0 + vw;
+  int status = -1;
+  if (fabs(denominator) > INVERSE_MARGIN * (1.0 + fabs(vw))) {
+    OuterJob job = {inverse, w, z, 1.0 / denominator};
+    lams_parallel_for(n, lams_parallel_grain(n), outer_rows, &job);
+    status = 0;
+  }
+
+  free(w);
+  free(z);
+  LAMS_PROF_END(matrix_inverse_update_rank1, 6.0 * n * n);
+  return status;
+}
+
+// Solves S X = B in place with partial pivoting, S is overwritten. Pivots
+// below INVERSE_MARGIN times scale count as singular.
+static int lu_solve(Matrix *S, Matrix *B, double scale) {
+  int k = S->rows;
+
+  for (int p = 0; p < k; p++) {
+    int best = p;
+    for (int i = p + 1; i < k; i++) {
+      best = fabs(S->data[i][p]) > fabs(S->data[best][p]) ? i : best;
+    }
+    if (!(fabs(S->data[best][p]) > INVERSE_MARGIN * scale)) {
+      return -1;
+    }
+
+    double *t = S->data[p];
+    S->data[p] = S->data[best];
+    S->data[best] = t;
+    t = B->data[p];
+    B->data[p] = B->data[best];
+    B->data[best] = t;
+
+    for (int i = p + 1; i < k; i++) {
+      double f = S->data[i][p] / S->data[p][p];
+      for (int j = p; j < k; j++) {
+        S->data[i][j] -= f * S->data[p][j];
+      }
+      for (int j = 0; j < B->cols; j++) {
+        B->data[i][j] -= f * B->data[p][j];
+      }
+    }
+  }
+
+  for (int p = k - 1; p >= 0; p--) {
+    double *bp = B->data[p];
+    for (int i = p + 1; i < k; i++) {
+      double f = S->data[p][i];
+      for (int j = 0; j < B->cols; j++) {
+        bp[j] -= f * B->data[i][j];
+      }
+    }
+    for (int j = 0; j < B->cols; j++) {
+      bp[j] /= S->data[p][p];
+    }
+  }
+  return 0;
+}
+
+// (A + U C V)^-1 = A^-1 - W (I + C V W)^-1 C Z with W = A^-1 U and
+// Z = V A^-1, which needs no inverse of C
+int matrix_inverse_update(Matrix *inverse, Matrix *U, Matrix *C, Matrix *V) {
+  LAMS_PROF_BEGIN();
+  int n = inverse->rows, k = U->cols;
+  if (inverse->cols != n || U->rows != n || V->rows != k || V->cols != n ||
+      (C != NULL && (C->rows != k || C->cols != k))) {
+    fprintf(stderr, "Error: matrix_inverse_update() sizes do not match");
+    return -1;
+  }
+
+  Matrix *W = matrix_multiply(inverse, U);
+  Matrix *Z = matrix_multiply(V, inverse);
+  Matrix *VW = W != NULL ? matrix_multiply(V, W) : NULL;
+  Matrix *S = VW != NULL && C != NULL ? matrix_multiply(C, VW) : VW;
+  Matrix *B = Z != NULL && C != NULL ? matrix_multiply(C, Z) : Z;
+  Matrix *P = NULL;
+
+  int status = -1;
+  if (S != NULL && B != NULL) {
+    // Measured before adding I, which cancellation may have eaten
+    double scale = 1.0;
+    for (int i = 0; i < k; i++) {
+      for (int j = 0; j < k; j++) {
+        scale = fmax(scale, fabs(S->data[i][j]));
+      }
+      S->data[i][i] += 1.0;
+    }
+    status = lu_solve(S, B, scale);
+  }
+  if (status == 0) {
+    P = matrix_multiply(W, B);
+    status = P != NULL ? 0 : -1;
+  }
+  if (status == 0) {
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++) {
+        inverse->data[i][j] -= P->data[i][j];
+      }
+    }
+  }
+
+  if (S != VW) {
+    matrix_free(S);
+  }
+  if (B != Z) {
+    matrix_free(B);
+  }
+  matrix_free(VW);
+  matrix_free(W);
+  matrix_free(Z);
+  matrix_free(P);
+  LAMS_PROF_END(matrix_inverse_update, 4.0 * n * n * k);
+  return status;
+}
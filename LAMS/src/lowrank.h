@@ -0,0 +1,66 @@
+#ifndef LOWRANK_H
+#define LOWRANK_H
+
+#include "linear_algebra.h"
+
+/*
+ * Cholesky factors and inverses under low-rank changes
+ *
+ * Factors are upper triangular, A = R^T R, so every update walks rows of
+ * R in memory order. Entries below the diagonal of R are zero.
+ *
+ * matrix_cholesky_update and matrix_cholesky_downdate change R in place to
+ * the factor of A + x x^T or A - x x^T in O(n^2). A downdate first checks
+ * that the result stays positive definite with a margin (solving
+ * R^T p = x, it needs |p|^2 < 1 - CHOLESKY_MARGIN) and leaves R untouched
+ * with -1 otherwise. The rank-k versions apply one row of X at a time.
+ *
+ * Cholesky keeps A next to its factor. Its updates fall back to a full
+ * refactorization of A when a downdate is rejected or when the smallest
+ * pivot drops below tolerance times the largest (rounding in the updates
+ * has then grown too large to trust), counting them in refactorizations.
+ *
+ * matrix_inverse_update_rank1 (Sherman-Morrison) and
+ * matrix_inverse_update (Woodbury) turn A^-1 into (A + u v^T)^-1 or
+ * (A + U C V)^-1 in place. They return -1 and leave it untouched when the
+ * update is close to singular, in which case the inverse should be
+ * recomputed from scratch.
+ *
+ */
+
+#define CHOLESKY_MARGIN 1e-12
+
+typedef struct {
+  Matrix *A; // kept in step with every update
+  Matrix *R; // upper triangular, A = R^T R
+  double tolerance;
+  int refactorizations;
+} Cholesky;
+
+// New upper factor of a symmetric positive definite A, NULL otherwise.
+// Only the upper triangle of A is read.
+Matrix *matrix_cholesky(Matrix *A);
+
+int matrix_cholesky_update(Matrix *R, Vector *x);
+int matrix_cholesky_downdate(Matrix *R, Vector *x);
+int matrix_cholesky_update_rank(Matrix *R, Matrix *X);
+int matrix_cholesky_downdate_rank(Matrix *R, Matrix *X);
+
+// Solves A x = b for every column of b
+Matrix *matrix_cholesky_solve(Matrix *R, Matrix *b);
+
+// log det A = 2 * sum of log R_kk, without overflow for large n
+double matrix_cholesky_logdet(Matrix *R);
+
+Cholesky *cholesky_new(Matrix *A);
+void cholesky_free(Cholesky *c);
+int cholesky_update(Cholesky *c, Vector *x);
+int cholesky_downdate(Cholesky *c, Vector *x);
+int cholesky_update_rank(Cholesky *c, Matrix *X);
+int cholesky_downdate_rank(Cholesky *c, Matrix *X);
+
+// C may be NULL for the identity. U is n x k, C is k x k and V is k x n.
+int matrix_inverse_update_rank1(Matrix *inverse, Vector *u, Vector *v);
+int matrix_inverse_update(Matrix *inverse, Matrix *U, Matrix *C, Matrix *V);
+
+#endif
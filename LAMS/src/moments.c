@@ -0,0 +1,557 @@
+#include "moments.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "reduce.h"
+
+// Values folded in at once by moments_push_array, and per thread by
+// moments_push_vector
+#define MOMENTS_CHUNK 256
+#define MOMENTS_BLOCK (1 << 14)
+
+typedef struct {
+  const double *x;
+  long n;
+  moments_t *partial;
+} MomentsJob;
+
+// Rows of a group are read COMOMENT_BLOCK at a time. There are at most
+// COMOMENT_GROUPS groups and their partial comoments take at most
+// COMOMENT_BUDGET doubles; both depend on the shape alone.
+#define COMOMENT_BLOCK 64
+#define COMOMENT_GROUPS 16
+#define COMOMENT_BUDGET (1 << 22)
+
+typedef struct {
+  Matrix *X;
+  const double *center;
+  int groups;
+  double **partial; // dim x dim upper triangle, then the dim sums
+  double **block;   // COMOMENT_BLOCK x dim centered rows
+  long grain;       // over rows of the comoment within a block
+} ComomentJob;
+
+typedef struct {
+  const double *block;
+  int dim, rows;
+  double *C;
+} SyrkJob;
+
+// Univariate
+// -----------------------------------------------------------------------------
+void moments_init(moments_t *m) {
+  m->count = 0;
+  m->mean = m->m2 = m->m3 = m->m4 = 0;
+  m->min = INFINITY;
+  m->max = -INFINITY;
+}
+
+// Welford's update with the third and fourth powers on top
+void moments_push(moments_t *m, double x) {
+  double n = m->count + 1, delta = x - m->mean, dn = delta / n;
+  double dn2 = dn * dn, term = delta * dn * m->count;
+
+  m->mean += dn;
+  m->m4 += term * dn2 * (n * n - 3 * n + 3) + 6 * dn2 * m->m2 - 4 * dn * m->m3;
+  m->m3 += term * dn * (n - 2) - 3 * dn * m->m2;
+  m->m2 += term;
+  m->count = n;
+  m->min = x < m->min ? x : m->min;
+  m->max = x > m->max ? x : m->max;
+}
+
+// Pebay's pairwise update, the higher sums first since they read the lower
+void moments_merge(moments_t *m, const moments_t *other) {
+  double na = m->count, nb = other->count, n = na + nb;
+  if (nb == 0) {
+    return;
+  }
+  if (na == 0) {
+    *m = *other;
+    return;
+  }
+
+  double delta = other->mean - m->mean, dn = delta / n, dn2 = dn * dn;
+  double term = delta * dn * na * nb;
+
+  m->m4 += other->m4 + term * dn2 * (na * na - na * nb + nb * nb) +
+           6 * dn2 * (na * na * other->m2 + nb * nb * m->m2) +
+           4 * dn * (na * other->m3 - nb * m->m3);
+  m->m3 += other->m3 + term * dn * (na - nb) +
+           3 * dn * (na * other->m2 - nb * m->m2);
+  m->m2 += other->m2 + term;
+  m->mean += dn * nb;
+  m->count = n;
+  m->min = other->min < m->min ? other->min : m->min;
+  m->max = other->max > m->max ? other->max : m->max;
+}
+
+// Moments of n <= MOMENTS_CHUNK values in two passes, four lanes each
+static void chunk_moments(moments_t *c, const double *x, long n) {
+  double sum[4] = {0}, lo[4], hi[4];
+  double s2[4] = {0}, s3[4] = {0}, s4[4] = {0};
+  long j = 0;
+
+  for (int l = 0; l < 4; l++) {
+    lo[l] = INFINITY;
+    hi[l] = -INFINITY;
+  }
+  for (; j + 4 <= n; j += 4) {
+    for (int l = 0; l < 4; l++) {
+      double t = x[j + l];
+      sum[l] += t;
+      lo[l] = t < lo[l] ? t : lo[l];
+      hi[l] = t > hi[l] ? t : hi[l];
+    }
+  }
+  for (; j < n; j++) {
+    sum[0] += x[j];
+    lo[0] = x[j] < lo[0] ? x[j] : lo[0];
+    hi[0] = x[j] > hi[0] ? x[j] : hi[0];
+  }
+
+  double mean = ((sum[0] + sum[1]) + (sum[2] + sum[3])) / n;
+  for (j = 0; j + 4 <= n; j += 4) {
+    for (int l = 0; l < 4; l++) {
+      double d = x[j + l] - mean, d2 = d * d;
+      s2[l] += d2;
+      s3[l] += d2 * d;
+      s4[l] += d2 * d2;
+    }
+  }
+  for (; j < n; j++) {
+    double d = x[j] - mean, d2 = d * d;
+    s2[0] += d2;
+    s3[0] += d2 * d;
+    s4[0] += d2 * d2;
+  }
+
+  c->count = n;
+  c->mean = mean;
+  c->m2 = (s2[0] + s2[1]) + (s2[2] + s2[3]);
+  c->m3 = (s3[0] + s3[1]) + (s3[2] + s3[3]);
+  c->m4 = (s4[0] + s4[1]) + (s4[2] + s4[3]);
+  c->min = fmin(fmin(lo[0], lo[1]), fmin(lo[2], lo[3]));
+  c->max = fmax(fmax(hi[0], hi[1]), fmax(hi[2], hi[3]));
+}
+
+static void push_chunks(moments_t *m, const double *x, long n) {
+  moments_t chunk;
+
+  for (long i = 0; i < n; i += MOMENTS_CHUNK) {
+    chunk_moments(&chunk, x + i, n - i < MOMENTS_CHUNK ? n - i : MOMENTS_CHUNK);
+    moments_merge(m, &chunk);
+  }
+}
+
+void moments_push_array(moments_t *m, const double *x, long n) {
+  LAMS_PROF_BEGIN();
+  push_chunks(m, x, n);
+  LAMS_PROF_END(moments_push_array, 5 * n);
+}
+
+static void moments_blocks(long begin, long end, void *ctx) {
+  MomentsJob *job = ctx;
+
+  for (long b = begin; b < end; b++) {
+    long first = b * MOMENTS_BLOCK, size = job->n - first;
+    moments_init(&job->partial[b]);
+    push_chunks(&job->partial[b], job->x + first,
+                size < MOMENTS_BLOCK ? size : MOMENTS_BLOCK);
+  }
+}
+
+// Block partials are merged in order, whichever thread made them
+void moments_push_vector(moments_t *m, Vector *v) {
+  LAMS_PROF_BEGIN();
+  long n = v->size, blocks = (n + MOMENTS_BLOCK - 1) / MOMENTS_BLOCK;
+  moments_t *partial = malloc(blocks * sizeof(moments_t));
+
+  if (partial == NULL) {
+    push_chunks(m, v->data, n);
+  } else {
+    MomentsJob job = {v->data, n, partial};
+    lams_parallel_for(blocks, 1, moments_blocks, &job);
+    for (long b = 0; b < blocks; b++) {
+      moments_merge(m, &partial[b]);
+    }
+    free(partial);
+  }
+  LAMS_PROF_END(moments_push_vector, 5 * n);
+}
+
+double moments_variance(const moments_t *m) {
+  return m->count > 0 ? m->m2 / m->count : NAN;
+}
+
+double moments_sample_variance(const moments_t *m) {
+  return m->count > 1 ? m->m2 / (m->count - 1) : NAN;
+}
+
+double moments_skewness(const moments_t *m) {
+  return m->count > 0 ? sqrt(m->count) * m->m3 / pow(m->m2, 1.5) : NAN;
+}
+
+double moments_kurtosis(const moments_t *m) {
+  return m->count > 0 ? m->count * m->m4 / (m->m2 * m->m2) - 3 : NAN;
+}
+
+// Centered comoments
+// -----------------------------------------------------------------------------
+// C[i][j] += sum of d[i] d[j] over the rows d of a block, for the rows
+// [begin, end) of C and j >= i. Row i of C stays in cache while the block
+// streams past it, four block rows per pass.
+static void syrk_rows(long begin, long end, void *ctx) {
+  SyrkJob *job = ctx;
+  int dim = job->dim;
+
+  for (long i = begin; i < end; i++) {
+    double *c = job->C + i * dim;
+    int r = 0;
+    for (; r + 4 <= job->rows; r += 4) {
+      const double *d0 = job->block + (long)r * dim, *d1 = d0 + dim;
+      const double *d2 = d1 + dim, *d3 = d2 + dim;
+      double s0 = d0[i], s1 = d1[i], s2 = d2[i], s3 = d3[i];
+      for (int j = i; j < dim; j++) {
+        c[j] += (s0 * d0[j] + s1 * d1[j]) + (s2 * d2[j] + s3 * d3[j]);
+      }
+    }
+    for (; r < job->rows; r++) {
+      const double *d = job->block + (long)r * dim;
+      double s = d[i];
+      for (int j = i; j < dim; j++) {
+        c[j] += s * d[j];
+      }
+    }
+  }
+}
+
+// Each group walks its rows in order, centering one block at a time and
+// adding its products into the group's own partial
+static void comoment_groups(long begin, long end, void *ctx) {
+  ComomentJob *job = ctx;
+  Matrix *X = job->X;
+  int dim = X->cols;
+
+  for (long g = begin; g < end; g++) {
+    long first = g * X->rows / job->groups;
+    long last = (g + 1) * X->rows / job->groups;
+    double *C = job->partial[g], *sum = C + (long)dim * dim;
+    double *block = job->block[g];
+
+    for (long r0 = first; r0 < last; r0 += COMOMENT_BLOCK) {
+      int rows = last - r0 < COMOMENT_BLOCK ? last - r0 : COMOMENT_BLOCK;
+      for (int r = 0; r < rows; r++) {
+        const double *x = X->data[r0 + r];
+        double *d = block + (long)r * dim;
+        for (int j = 0; j < dim; j++) {
+          d[j] = x[j] - job->center[j];
+          sum[j] += d[j];
+        }
+      }
+      SyrkJob syrk = {block, dim, rows, C};
+      lams_parallel_for(dim, job->grain, syrk_rows, &syrk);
+    }
+  }
+}
+
+// Upper triangle of the sum of (x - center)(x - center)^T over the rows of
+// X into C, and the sum of x - center into sum. Groups of rows run in
+// parallel and their partials are added in order.
+static int centered_comoment(Matrix *X, const double *center, Matrix *C,
+                             double *sum) {
+  int dim = X->cols;
+  if (dim == 0) {
+    return 0;
+  }
+  long blocks = (X->rows + COMOMENT_BLOCK - 1) / COMOMENT_BLOCK;
+  long budget = COMOMENT_BUDGET / ((long)dim * dim + dim);
+  int groups = COMOMENT_GROUPS;
+  groups = blocks < groups ? blocks : groups;
+  groups = budget < groups ? (budget > 1 ? budget : 1) : groups;
+
+  double **partial = calloc(groups, sizeof(double *));
+  double **block = calloc(groups, sizeof(double *));
+  int status = partial != NULL && block != NULL ? 0 : -1;
+  for (int g = 0; g < groups && status == 0; g++) {
+    partial[g] = calloc((long)dim * dim + dim, sizeof(double));
+    block[g] = malloc((long)COMOMENT_BLOCK * dim * sizeof(double));
+    status = partial[g] != NULL && block[g] != NULL ? 0 : -1;
+  }
+
+  if (status == 0) {
+    // Rows of C are split too when the groups leave threads idle
+    long grain = lams_parallel_grain((long)COMOMENT_BLOCK * dim);
+    ComomentJob job = {X, center, groups, partial, block,
+                       groups >= lams_num_threads() ? dim
+                       : grain > 8                  ? grain
+                                                    : 8};
+    lams_parallel_for(groups, 1, comoment_groups, &job);
+
+    for (int j = 0; j < dim; j++) {
+      sum[j] = 0;
+    }
+    for (int g = 0; g < groups; g++) {
+      for (int i = 0; i < dim; i++) {
+        const double *p = partial[g] + (long)i * dim;
+        double *c = C->data[i];
+        for (int j = i; j < dim; j++) {
+          c[j] = g > 0 ? c[j] + p[j] : p[j];
+        }
+        sum[i] += partial[g][(long)dim * dim + i];
+      }
+    }
+  }
+
+  for (int g = 0; partial != NULL && block != NULL && g < groups; g++) {
+    free(partial[g]);
+    free(block[g]);
+  }
+  free(partial);
+  free(block);
+  return status;
+}
+
+// Multivariate
+// -----------------------------------------------------------------------------
+mvmoments_t *mvmoments_new(int dim) {
+  mvmoments_t *m = calloc(1, sizeof(mvmoments_t));
+  if (m == NULL) {
+    fprintf(stderr, "Error: mvmoments_new() failed to allocate memory");
+    return NULL;
+  }
+
+  m->dim = dim;
+  m->mean = vector_new(dim);
+  m->comoment = matrix_new(dim, dim);
+  if (m->mean == NULL || m->mean->data == NULL || m->comoment == NULL) {
+    fprintf(stderr, "Error: mvmoments_new() failed to allocate memory");
+    mvmoments_free(m);
+    return NULL;
+  }
+
+  for (int i = 0; i < dim; i++) {
+    m->mean->data[i] = 0;
+  }
+  matrix_fill(m->comoment, 0);
+  return m;
+}
+
+void mvmoments_free(mvmoments_t *m) {
+  if (m == NULL) {
+    return;
+  }
+
+  if (m->mean != NULL) {
+    vector_free(m->mean);
+  }
+  matrix_free(m->comoment);
+  free(m);
+}
+
+// comoment += (n - 1) / n d d^T with d = x - mean, read off the old mean
+// before it moves
+int mvmoments_push(mvmoments_t *m, Vector *x) {
+  if (x->size != m->dim) {
+    fprintf(stderr, "Error: mvmoments_push() needs %d entries, got %d",
+            m->dim, x->size);
+    return -1;
+  }
+
+  LAMS_PROF_BEGIN();
+  double n = m->count + 1, scale = m->count / n;
+  double *mean = m->mean->data;
+  const double *v = x->data;
+
+  for (int i = 0; i < m->dim; i++) {
+    double *c = m->comoment->data[i], s = scale * (v[i] - mean[i]);
+    for (int j = i; j < m->dim; j++) {
+      c[j] += s * (v[j] - mean[j]);
+    }
+  }
+  for (int i = 0; i < m->dim; i++) {
+    mean[i] += (v[i] - mean[i]) / n;
+  }
+  m->count = n;
+  LAMS_PROF_END(mvmoments_push, (long)m->dim * (m->dim + 3));
+  return 0;
+}
+
+int mvmoments_push_rows(mvmoments_t *m, Matrix *X) {
+  if (X->cols != m->dim) {
+    fprintf(stderr, "Error: mvmoments_push_rows() observations need %d "
+                    "columns",
+            m->dim);
+    return -1;
+  }
+  if (X->rows == 0) {
+    return 0;
+  }
+  if (m->dim == 0) {
+    m->count += X->rows;
+    return 0;
+  }
+
+  LAMS_PROF_BEGIN();
+  int dim = m->dim;
+  Vector *center = matrix_reduce(X, REDUCE_COLS, REDUCE_MEAN);
+  Matrix *C = matrix_new(dim, dim);
+  double *sum = malloc(dim * sizeof(double));
+  if (center == NULL || C == NULL || sum == NULL ||
+      centered_comoment(X, center->data, C, sum) != 0) {
+    fprintf(stderr, "Error: mvmoments_push_rows() failed to allocate memory");
+    if (center != NULL) {
+      vector_free(center);
+    }
+    matrix_free(C);
+    free(sum);
+    return -1;
+  }
+
+  // The block mean is center + sum / nb, its comoment C - sum sum^T / nb,
+  // then both merge in
+  double nb = X->rows, n = m->count + nb, weight = m->count * nb / n;
+  double *delta = center->data, *mean = m->mean->data;
+  for (int j = 0; j < dim; j++) {
+    delta[j] += sum[j] / nb - mean[j];
+  }
+  for (int i = 0; i < dim; i++) {
+    double *c = m->comoment->data[i];
+    const double *cb = C->data[i];
+    double s = sum[i] / nb, w = weight * delta[i];
+    for (int j = i; j < dim; j++) {
+      c[j] += cb[j] - s * sum[j] + w * delta[j];
+    }
+  }
+  for (int j = 0; j < dim; j++) {
+    mean[j] += delta[j] * nb / n;
+  }
+  m->count = n;
+
+  vector_free(center);
+  matrix_free(C);
+  free(sum);
+  LAMS_PROF_END(mvmoments_push_rows, (long)X->rows * dim * (dim + 3));
+  return 0;
+}
+
+int mvmoments_merge(mvmoments_t *m, const mvmoments_t *other) {
+  if (other->dim != m->dim) {
+    fprintf(stderr, "Error: mvmoments_merge() dimensions %d and %d do not "
+                    "match",
+            m->dim, other->dim);
+    return -1;
+  }
+  if (other->count == 0) {
+    return 0;
+  }
+
+  double na = m->count, nb = other->count, n = na + nb;
+  double weight = na * nb / n;
+  double *mean = m->mean->data;
+  const double *mb = other->mean->data;
+
+  for (int i = 0; i < m->dim; i++) {
+    double *c = m->comoment->data[i];
+    const double *cb = other->comoment->data[i];
+    double w = weight * (mb[i] - mean[i]);
+    for (int j = i; j < m->dim; j++) {
+      c[j] += cb[j] + w * (mb[j] - mean[j]);
+    }
+  }
+  for (int i = 0; i < m->dim; i++) {
+    mean[i] += (mb[i] - mean[i]) * nb / n;
+  }
+  m->count = n;
+  return 0;
+}
+
+Matrix *mvmoments_covariance(const mvmoments_t *m) {
+  if (m->count < 2) {
+    fprintf(stderr, "Error: mvmoments_covariance() needs two observations");
+    return NULL;
+  }
+
+  Matrix *cov = matrix_new(m->dim, m->dim);
+  if (cov == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < m->dim; i++) {
+    for (int j = i; j < m->dim; j++) {
+      cov->data[i][j] = cov->data[j][i] =
+          m->comoment->data[i][j] / (m->count - 1);
+    }
+  }
+  return cov;
+}
+
+// Covariance
+// -----------------------------------------------------------------------------
+// Two passes: the column means, then the comoment around them, less the
+// outer product of the leftover sums (Chan, Golub and LeVeque's correction
+// for the rounding in the means)
+Matrix *matrix_covariance(Matrix *X) {
+  if (X->rows < 2) {
+    fprintf(stderr, "Error: matrix_covariance() needs two observations");
+    return NULL;
+  }
+  if (X->cols == 0) {
+    return matrix_new(0, 0);
+  }
+
+  LAMS_PROF_BEGIN();
+  int dim = X->cols;
+  double n = X->rows;
+  Vector *center = matrix_reduce(X, REDUCE_COLS, REDUCE_MEAN);
+  Matrix *C = matrix_new(dim, dim);
+  double *sum = malloc(dim * sizeof(double));
+  if (center == NULL || C == NULL || sum == NULL ||
+      centered_comoment(X, center->data, C, sum) != 0) {
+    fprintf(stderr, "Error: matrix_covariance() failed to allocate memory");
+    matrix_free(C);
+    C = NULL;
+  } else {
+    for (int i = 0; i < dim; i++) {
+      for (int j = i; j < dim; j++) {
+        C->data[i][j] = C->data[j][i] =
+            (C->data[i][j] - sum[i] * sum[j] / n) / (n - 1);
+      }
+    }
+  }
+
+  if (center != NULL) {
+    vector_free(center);
+  }
+  free(sum);
+  LAMS_PROF_END(matrix_covariance, n * dim * (dim + 3));
+  return C;
+}
+
+Matrix *matrix_correlation(Matrix *X) {
+  Matrix *C = matrix_covariance(X);
+  if (C == NULL || C->rows == 0) {
+    return C;
+  }
+
+  int dim = C->rows;
+  double *scale = malloc(dim * sizeof(double));
+  if (scale == NULL) {
+    fprintf(stderr, "Error: matrix_correlation() failed to allocate memory");
+    matrix_free(C);
+    return NULL;
+  }
+
+  for (int i = 0; i < dim; i++) {
+    scale[i] = C->data[i][i] > 0 ? 1 / sqrt(C->data[i][i]) : NAN;
+  }
+  for (int i = 0; i < dim; i++) {
+    for (int j = 0; j < dim; j++) {
+      C->data[i][j] = i == j && !isnan(scale[i])
+                          ? 1
+                          : C->data[i][j] * scale[i] * scale[j];
+    }
+  }
+
+  free(scale);
+  return C;
+}
@@ -0,0 +1,85 @@
+#ifndef MOMENTS_H
+#define MOMENTS_H
+
+#include "linear_algebra.h"
+
+/*
+ * Streaming moments
+ *
+ * moments_t keeps the count, mean, minimum, maximum and the sums m2, m3,
+ * m4 of the powers of the deviations from the current mean, so the data
+ * never has to be held. moments_push folds in one value with Welford's
+ * update carried to the fourth moment (Pebay). moments_push_array cuts its
+ * input into chunks, takes the moments of each chunk in two passes over
+ * four independent accumulators (they vectorize) and merges them in.
+ * moments_push_vector does the same with chunks spread across threads;
+ * the chunks depend on the size alone, so the result does not depend on
+ * the number of threads.
+ *
+ * moments_merge combines two accumulators with Pebay's pairwise formulas,
+ * exact up to rounding, so shards or threads can be summarized apart and
+ * merged in any grouping.
+ *
+ * moments_variance divides by n like REDUCE_VAR, moments_sample_variance
+ * by n - 1. Skewness and excess kurtosis are the population g1 and g2.
+ * All of them are NAN until there is enough data.
+ *
+ * mvmoments_t does the same for vectors: a running mean and the upper
+ * triangle of the comoment, the sum of (x - mean)(x - mean)^T, changed by
+ * one rank-1 update per observation. mvmoments_push_rows takes a block of
+ * observations (rows) at once and merges its moments in, taking them with
+ * the kernel of matrix_covariance below.
+ * mvmoments_covariance returns the full sample covariance (divided by
+ * n - 1).
+ *
+ * matrix_covariance and matrix_correlation take the rows of X as the
+ * observations. They make two passes: the column means, then the products
+ * of the centered rows, like SYRK on the upper triangle only. Rows are
+ * cut into groups whose count depends on the shape alone; every group
+ * centers a few dozen rows at a time and adds their products into its own
+ * partial, the groups run in parallel and the partials are added in
+ * order. The result is the same for any number of threads and X is never
+ * transposed or copied whole. A column without variance has NAN
+ * correlations.
+ *
+ */
+
+typedef struct {
+  double count;
+  double mean;
+  double m2, m3, m4; // sums of powers of the deviations from the mean
+  double min, max;
+} moments_t;
+
+void moments_init(moments_t *m);
+void moments_push(moments_t *m, double x);
+void moments_push_array(moments_t *m, const double *x, long n);
+void moments_push_vector(moments_t *m, Vector *v);
+void moments_merge(moments_t *m, const moments_t *other);
+
+double moments_variance(const moments_t *m);
+double moments_sample_variance(const moments_t *m);
+double moments_skewness(const moments_t *m);
+double moments_kurtosis(const moments_t *m);
+
+typedef struct {
+  int dim;
+  double count;
+  Vector *mean;
+  Matrix *comoment; // upper triangle, the rest is left at 0
+} mvmoments_t;
+
+mvmoments_t *mvmoments_new(int dim);
+void mvmoments_free(mvmoments_t *m);
+
+// All return 0, or -1 when the sizes do not match or memory runs out
+int mvmoments_push(mvmoments_t *m, Vector *x);
+int mvmoments_push_rows(mvmoments_t *m, Matrix *X);
+int mvmoments_merge(mvmoments_t *m, const mvmoments_t *other);
+
+// NULL with fewer than two observations
+Matrix *mvmoments_covariance(const mvmoments_t *m);
+Matrix *matrix_covariance(Matrix *X);
+Matrix *matrix_correlation(Matrix *X);
+
+#endif
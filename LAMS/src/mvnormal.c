@@ -0,0 +1,150 @@
+#include "mvnormal.h"
+#include "instrument.h"
+#include "lowrank.h"
+#include "parallel.h"
+
+// Largest |a_ij - a_ji| accepted, relative to sqrt(|a_ii a_jj|)
+#define SYMMETRY_TOLERANCE 1e-12
+
+typedef struct {
+  mvnormal_t *mv;
+  Matrix *X;
+  double *out;
+  double offset, scale; // out = offset + scale * distance
+} MvnormalJob;
+
+mvnormal_t *mvnormal_new(Vector *mean, Matrix *covariance) {
+  if (covariance->rows != mean->size || covariance->cols != mean->size) {
+    fprintf(stderr, "Error: mvnormal_new() mean and covariance sizes do not "
+                    "match");
+    return NULL;
+  }
+  // matrix_cholesky reads the upper triangle only
+  double **a = covariance->data;
+  for (int i = 0; i < mean->size; i++) {
+    for (int j = i + 1; j < mean->size; j++) {
+      double scale = sqrt(fabs(a[i][i] * a[j][j]));
+      if (!(fabs(a[i][j] - a[j][i]) <= SYMMETRY_TOLERANCE * scale)) {
+        fprintf(stderr, "Error: mvnormal_new() covariance is not symmetric");
+        return NULL;
+      }
+    }
+  }
+
+  mvnormal_t *mv = calloc(1, sizeof(mvnormal_t));
+  if (mv == NULL) {
+    fprintf(stderr, "Error: mvnormal_new() failed to allocate memory");
+    return NULL;
+  }
+
+  mv->dim = mean->size;
+  mv->mean = vector_copy(mean);
+  mv->covariance = matrix_copy(covariance);
+  mv->R = matrix_cholesky(covariance);
+  if (mv->mean == NULL || mv->covariance == NULL || mv->R == NULL) {
+    mvnormal_free(mv);
+    return NULL;
+  }
+
+  mv->log_det = matrix_cholesky_logdet(mv->R);
+  return mv;
+}
+
+void mvnormal_free(mvnormal_t *mv) {
+  if (mv == NULL) {
+    return;
+  }
+
+  if (mv->mean != NULL) {
+    vector_free(mv->mean);
+  }
+  matrix_free(mv->covariance);
+  matrix_free(mv->R);
+  free(mv);
+}
+
+// |z|^2 with R^T z = x - mean, z is scratch of dim entries. Row i of R is
+// read in order while z_i is pushed into the entries after it.
+static double mahalanobis(mvnormal_t *mv, const double *x, double *z) {
+  int d = mv->dim;
+  double sum = 0.0;
+
+  for (int i = 0; i < d; i++) {
+    z[i] = x[i] - mv->mean->data[i];
+  }
+  for (int i = 0; i < d; i++) {
+    const double *r = mv->R->data[i];
+    double zi = z[i] / r[i];
+    sum += zi * zi;
+    for (int j = i + 1; j < d; j++) {
+      z[j] -= r[j] * zi;
+    }
+  }
+  return sum;
+}
+
+static void mahalanobis_rows(long begin, long end, void *ctx) {
+  MvnormalJob *job = ctx;
+  double *z = malloc(job->mv->dim * sizeof(double));
+
+  if (z == NULL) {
+    for (long i = begin; i < end; i++) {
+      job->out[i] = NAN;
+    }
+    return;
+  }
+
+  for (long i = begin; i < end; i++) {
+    job->out[i] =
+        job->offset + job->scale * mahalanobis(job->mv, job->X->data[i], z);
+  }
+  free(z);
+}
+
+static Vector *batch(mvnormal_t *mv, Matrix *X, double offset, double scale,
+                     const char *name) {
+  if (X->cols != mv->dim) {
+    fprintf(stderr, "Error: %s() observations need %d columns", name,
+            mv->dim);
+    return NULL;
+  }
+
+  Vector *result = vector_new(X->rows);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  MvnormalJob job = {mv, X, result->data, offset, scale};
+  lams_parallel_for(X->rows, lams_parallel_grain((long)mv->dim * mv->dim),
+                    mahalanobis_rows, &job);
+  return result;
+}
+
+Vector *mvnormal_mahalanobis_batch(mvnormal_t *mv, Matrix *X) {
+  return batch(mv, X, 0.0, 1.0, "mvnormal_mahalanobis_batch");
+}
+
+Vector *mvnormal_logpdf_batch(mvnormal_t *mv, Matrix *X) {
+  LAMS_PROF_BEGIN();
+  double offset = -0.5 * (mv->dim * log(2 * M_PI) + mv->log_det);
+  Vector *result = batch(mv, X, offset, -0.5, "mvnormal_logpdf_batch");
+  LAMS_PROF_END(mvnormal_logpdf_batch, (double)X->rows * mv->dim * mv->dim);
+  return result;
+}
+
+double mvnormal_logpdf(mvnormal_t *mv, Vector *x) {
+  Matrix row = {1, x->size, &x->data};
+  Vector *result = mvnormal_logpdf_batch(mv, &row);
+
+  if (result == NULL) {
+    return NAN;
+  }
+
+  double value = result->data[0];
+  vector_free(result);
+  return value;
+}
+
+double mvnormal_pdf(mvnormal_t *mv, Vector *x) {
+  return exp(mvnormal_logpdf(mv, x));
+}
@@ -0,0 +1,39 @@
+#ifndef MVNORMAL_H
+#define MVNORMAL_H
+
+#include "linear_algebra.h"
+
+/*
+ * Multivariate normal distribution
+ *
+ * mvnormal_new copies the mean and covariance and factors the covariance
+ * once (upper Cholesky factor R, covariance = R^T R), caching R and the log
+ * determinant. Every density evaluation then costs one triangular solve
+ * per observation and no further factorization.
+ *
+ * mvnormal_logpdf_batch scores every row of X as one observation. Rows are
+ * solved independently against the cached factor, split across threads.
+ *
+ */
+
+typedef struct {
+  int dim;
+  Vector *mean;
+  Matrix *covariance;
+  Matrix *R;      // upper triangular, covariance = R^T R
+  double log_det; // log determinant of the covariance
+} mvnormal_t;
+
+// NULL when the covariance is not symmetric (up to rounding) positive
+// definite
+mvnormal_t *mvnormal_new(Vector *mean, Matrix *covariance);
+void mvnormal_free(mvnormal_t *mv);
+
+double mvnormal_logpdf(mvnormal_t *mv, Vector *x);
+double mvnormal_pdf(mvnormal_t *mv, Vector *x);
+Vector *mvnormal_logpdf_batch(mvnormal_t *mv, Matrix *X);
+
+// Squared Mahalanobis distance of every row of X from the mean
+Vector *mvnormal_mahalanobis_batch(mvnormal_t *mv, Matrix *X);
+
+#endif
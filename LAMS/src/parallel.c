@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+#define MAX_PARTIALS 4096
+#define SPINS_BEFORE_SLEEP 256
+
+typedef struct {
+  long pending; // ranges not finished yet, including split off halves
+  long grain;
+  ParallelBody body;
+  void *ctx;
+  ParallelGroup *group; // spawned jobs are heap allocated and freed when done
+} Job;
+
+typedef struct {
+  long begin, end;
+  Job *job;
+} Task;
+
+// Ring buffer of tasks, the owner pushes and pops at the bottom and thieves
+// take from the top. top and bottom only grow, slots are taken modulo the
+// capacity.
+typedef struct {
+  pthread_mutex_t lock;
+  Task *tasks;
+  long top, bottom, capacity;
+} Deque;
+
+// Deque 0 is shared by all threads outside the pool, workers use 1..
+static int num_threads;
+static Deque *deques;
+static long queued;
+static int sleepers;
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static _Thread_local int self = 0;
+
+// Thread count
+// -----------------------------------------------------------------------------
+// CPUs allowed by the cgroup quota rounded up, 0 if there is no limit
+static int cgroup_cpu_limit(void) {
+  long quota = -1, period = 0;
+  char text[32];
+
+  FILE *f = fopen("/sys/fs/cgroup/cpu.max", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%31s %ld", text, &period) == 2 && strcmp(text, "max")) {
+      quota = atol(text);
+    }
+    fclose(f);
+  } else {
+    f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+    if (f != NULL) {
+      if (fscanf(f, "%ld", &quota) != 1) {
+        quota = -1;
+      }
+      fclose(f);
+    }
+    f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+    if (f != NULL) {
+      if (fscanf(f, "%ld", &period) != 1) {
+        period = 0;
+      }
+      fclose(f);
+    }
+  }
+
+  if (quota <= 0 || period <= 0) {
+    return 0;
+  }
+  return (int)((quota + period - 1) / period);
+}
+
+static void configure(void) {
+  const char *env = getenv("LAMS_NUM_THREADS");
+  char *end;
+  long n = env != NULL ? strtol(env, &end, 10) : 0;
+
+  if (env == NULL || *end != '\0' || n < 1) {
+    cpu_set_t set;
+    n = sched_getaffinity(0, sizeof(set), &set) == 0
+            ? CPU_COUNT(&set)
+            : sysconf(_SC_NPROCESSORS_ONLN);
+
+    int limit = cgroup_cpu_limit();
+    if (limit > 0 && limit < n) {
+      n = limit;
+    }
+  }
+
+  num_threads = n < 1 ? 1 : n > MAX_THREADS ? MAX_THREADS : (int)n;
+}
+
+int lams_num_threads(void) {
+  pthread_once(&config_once, configure);
+  return num_threads;
+}
+
+long lams_parallel_grain(long row_length) {
+  if (row_length < 1) {
+    return LAMS_PARALLEL_MIN_ELEMENTS;
+  }
+  long grain = LAMS_PARALLEL_MIN_ELEMENTS / row_length;
+  return grain < 1 ? 1 : grain;
+}
+
+// Deques
+// -----------------------------------------------------------------------------
+static void run_task(Task t);
+
+// Runs the task inline when the deque cannot grow
+static void deque_push(Deque *d, Task t) {
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom - d->top == d->capacity) {
+    long capacity = d->capacity ? 2 * d->capacity : 64;
+    Task *tasks = malloc(capacity * sizeof(Task));
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&d->lock);
+      fprintf(stderr, "Error: deque_push() failed to allocate memory");
+      run_task(t);
+      return;
+    }
+    for (long i = d->top; i < d->bottom; i++) {
+      tasks[i % capacity] = d->tasks[i % d->capacity];
+    }
+    free(d->tasks);
+    d->tasks = tasks;
+    d->capacity = capacity;
+  }
+  d->tasks[d->bottom % d->capacity] = t;
+  d->bottom++;
+  pthread_mutex_unlock(&d->lock);
+
+  __atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&sleep_lock);
+  }
+}
+
+static int deque_take(Deque *d, Task *t, int steal) {
+  int found = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) {
+    if (steal) {
+      *t = d->tasks[d->top % d->capacity];
+      d->top++;
+    } else {
+      d->bottom--;
+      *t = d->tasks[d->bottom % d->capacity];
+    }
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  if (found) {
+    __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+  }
+  return found;
+}
+
+// Own deque first, then steal starting at the next thread
+static int find_task(Task *t) {
+  if (__atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0) {
+    return 0;
+  }
+  if (deque_take(&deques[self], t, 0)) {
+    return 1;
+  }
+  for (int k = 1; k < num_threads; k++) {
+    if (deque_take(&deques[(self + k) % num_threads], t, 1)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Workers
+// -----------------------------------------------------------------------------
+// Splits off upper halves for other threads until the range is below two
+// grains, then runs it
+static void run_task(Task t) {
+  Job *job = t.job;
+
+  while (t.end - t.begin >= 2 * job->grain) {
+    long mid = t.begin + (t.end - t.begin) / 2;
+    __atomic_add_fetch(&job->pending, 1, __ATOMIC_RELAXED);
+    deque_push(&deques[self], (Task){mid, t.end, job});
+    t.end = mid;
+  }
+
+  // A loop's job lives on its caller's stack and may be gone as soon as
+  // pending reaches 0, so group is read first
+  ParallelGroup *group = job->group;
+  job->body(t.begin, t.end, job->ctx);
+  if (__atomic_sub_fetch(&job->pending, 1, __ATOMIC_ACQ_REL) == 0 && group) {
+    free(job);
+    __atomic_sub_fetch(&group->pending, 1, __ATOMIC_RELEASE);
+  }
+}
+
+static void *worker(void *arg) {
+  self = (int)(long)arg;
+  Task t;
+
+  for (;;) {
+    int spins = 0;
+    while (!find_task(&t)) {
+      if (++spins < SPINS_BEFORE_SLEEP) {
+        sched_yield();
+        continue;
+      }
+
+      pthread_mutex_lock(&sleep_lock);
+      __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+      while (__atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0) {
+        pthread_cond_wait(&wake, &sleep_lock);
+      }
+      __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&sleep_lock);
+      spins = 0;
+    }
+    run_task(t);
+  }
+  return NULL;
+}
+
+static void start_pool(void) {
+  deques = calloc(num_threads, sizeof(Deque));
+  for (int i = 0; i < num_threads; i++) {
+    pthread_mutex_init(&deques[i].lock, NULL);
+  }
+
+  // Work still gets done by the callers if a worker cannot be started
+  for (long i = 1; i < num_threads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker, (void *)i) == 0) {
+      pthread_detach(thread);
+    }
+  }
+}
+
+// Loops
+// -----------------------------------------------------------------------------
+// Help with queued work, ours or anyone's, until the counter is zero
+static void help_until_zero(long *pending) {
+  Task t;
+  while (__atomic_load_n(pending, __ATOMIC_ACQUIRE) > 0) {
+    if (find_task(&t)) {
+      run_task(t);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+void lams_parallel_for(long n, long grain, ParallelBody body, void *ctx) {
+  if (grain < 1) {
+    grain = 1;
+  }
+
+  if (n < 2 * grain || lams_num_threads() < 2) {
+    if (n > 0) {
+      body(0, n, ctx);
+    }
+    return;
+  }
+
+  pthread_once(&pool_once, start_pool);
+
+  Job job = {1, grain, body, ctx, NULL};
+  run_task((Task){0, n, &job});
+  help_until_zero(&job.pending);
+}
+
+void lams_parallel_spawn(ParallelGroup *group, ParallelBody body, void *ctx) {
+  pthread_once(&config_once, configure);
+  pthread_once(&pool_once, start_pool);
+
+  Job *job = malloc(sizeof(Job));
+  if (job == NULL) {
+    fprintf(stderr, "Error: lams_parallel_spawn() failed to allocate memory");
+    body(0, 1, ctx);
+    return;
+  }
+
+  *job = (Job){1, 1, body, ctx, group};
+  __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+  deque_push(&deques[self], (Task){0, 1, job});
+}
+
+void lams_parallel_wait(ParallelGroup *group) {
+  help_until_zero(&group->pending);
+}
+
+typedef struct {
+  long n, chunk;
+  ParallelReduceBody body;
+  void *ctx;
+  double *partials;
+} ReduceJob;
+
+static void reduce_chunks(long begin, long end, void *ctx) {
+  ReduceJob *job = ctx;
+
+  for (long c = begin; c < end; c++) {
+    long lo = c * job->chunk;
+    long hi = lo + job->chunk < job->n ? lo + job->chunk : job->n;
+    job->partials[c] = job->body(lo, hi, job->ctx);
+  }
+}
+
+double lams_parallel_reduce(long n, long grain, double identity,
+                            ParallelReduceBody body, ParallelCombine combine,
+                            void *ctx) {
+  if (n <= 0) {
+    return identity;
+  }
+  if (grain < 1) {
+    grain = 1;
+  }
+
+  long chunks = (n + grain - 1) / grain;
+  chunks = chunks > MAX_PARTIALS ? MAX_PARTIALS : chunks;
+  long chunk = (n + chunks - 1) / chunks;
+  chunks = (n + chunk - 1) / chunk;
+
+  if (chunks == 1) {
+    return combine(identity, body(0, n, ctx));
+  }
+
+  double *partials = malloc(chunks * sizeof(double));
+  if (partials == NULL) {
+    fprintf(stderr, "Error: lams_parallel_reduce() failed to allocate memory");
+    return combine(identity, body(0, n, ctx));
+  }
+
+  ReduceJob job = {n, chunk, body, ctx, partials};
+  lams_parallel_for(chunks, 1, reduce_chunks, &job);
+
+  double result = identity;
+  for (long c = 0; c < chunks; c++) {
+    result = combine(result, partials[c]);
+  }
+
+  free(partials);
+  return result;
+}
@@ -0,0 +1,59 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/*
+ * Library-wide thread pool
+ *
+ * Workers are started on the first call that is large enough to split.
+ * Every worker owns a deque of ranges: it splits its range in halves,
+ * pushes the upper halves and keeps working on the lower one, idle workers
+ * steal the oldest (largest) halves from the others. The calling thread
+ * takes part and waits for its own loop by running queued work, so nested
+ * parallel loops do not deadlock.
+ *
+ * The pool size is LAMS_NUM_THREADS when set, otherwise the CPUs this
+ * process may run on, capped by the cgroup CPU quota (cgroup v2 cpu.max or
+ * v1 cpu.cfs_quota_us) so containers are not oversubscribed.
+ *
+ * Independent tasks can also be spawned into a ParallelGroup and waited
+ * for, tasks may spawn more tasks into the same group while it runs.
+ *
+ */
+
+// Loops over at least this many elements are worth splitting, kernels use
+// it to derive their grain
+#define LAMS_PARALLEL_MIN_ELEMENTS (1 << 15)
+
+typedef void (*ParallelBody)(long begin, long end, void *ctx);
+typedef double (*ParallelReduceBody)(long begin, long end, void *ctx);
+typedef double (*ParallelCombine)(double a, double b);
+
+// Tasks spawned and not finished yet, start from {0}
+typedef struct {
+  long pending;
+} ParallelGroup;
+
+int lams_num_threads(void);
+
+// Calls body on disjoint ranges covering [0, n), each between grain and
+// 2 * grain long unless n itself is shorter. Loops shorter than two grains
+// run on the calling thread.
+void lams_parallel_for(long n, long grain, ParallelBody body, void *ctx);
+
+// Folds body over consecutive ranges of about grain elements with combine,
+// starting from identity. The ranges depend only on n and grain, so the
+// result is the same for any number of threads.
+double lams_parallel_reduce(long n, long grain, double identity,
+                            ParallelReduceBody body, ParallelCombine combine,
+                            void *ctx);
+
+// Queues body(0, 1, ctx) to run on the pool
+void lams_parallel_spawn(ParallelGroup *group, ParallelBody body, void *ctx);
+
+// Runs queued work until every task spawned into group has finished
+void lams_parallel_wait(ParallelGroup *group);
+
+// Grain for a loop over rows of the given length
+long lams_parallel_grain(long row_length);
+
+#endif
@@ -0,0 +1,374 @@
+#include "pipeline.h"
+#include "parallel.h"
+
+typedef enum {
+  PIPELINE_INPUT,
+  PIPELINE_ADD,
+  PIPELINE_SUB,
+  PIPELINE_SCALE,
+  PIPELINE_MULTIPLY,
+  PIPELINE_TRANSPOSE,
+  PIPELINE_CALL
+} PipelineOp;
+
+struct Future {
+  Pipeline *pipeline;
+  PipelineOp op;
+  double s;
+  PipelineFn fn;
+  void *ctx;
+  Future **inputs, **consumers;
+  int num_inputs, num_consumers, capacity;
+  int waiting; // inputs not computed yet
+  int users;   // consumers not finished yet, the value is released at 0
+  int keep;
+  Matrix *value;
+  Future *next;
+};
+
+struct Pipeline {
+  Future *futures; // newest first
+  ParallelGroup group;
+  int started, failed;
+};
+
+Pipeline *pipeline_new(void) {
+  Pipeline *p = calloc(1, sizeof(Pipeline));
+
+  if (p == NULL) {
+    fprintf(stderr, "Error: pipeline_new() failed to allocate memory");
+    return NULL;
+  }
+  return p;
+}
+
+void pipeline_free(Pipeline *p) {
+  if (p == NULL) {
+    return;
+  }
+
+  Future *f = p->futures;
+  while (f != NULL) {
+    Future *next = f->next;
+    if (f->op != PIPELINE_INPUT) {
+      matrix_free(f->value);
+    }
+    free(f->inputs);
+    free(f->consumers);
+    free(f);
+    f = next;
+  }
+  free(p);
+}
+
+// Graph construction
+// -----------------------------------------------------------------------------
+static int add_consumer(Future *f, Future *consumer) {
+  if (f->num_consumers == f->capacity) {
+    int capacity = f->capacity ? 2 * f->capacity : 4;
+    Future **consumers = realloc(f->consumers, capacity * sizeof(Future *));
+    if (consumers == NULL) {
+      return -1;
+    }
+    f->consumers = consumers;
+    f->capacity = capacity;
+  }
+  f->consumers[f->num_consumers++] = consumer;
+  return 0;
+}
+
+static Future *future_new(Pipeline *p, PipelineOp op, Future **inputs,
+                          int n) {
+  if (p == NULL || p->started) {
+    fprintf(stderr, "Error: pipeline operation on a started pipeline");
+    return NULL;
+  }
+  for (int i = 0; i < n; i++) {
+    if (inputs[i] == NULL || inputs[i]->pipeline != p) {
+      fprintf(stderr, "Error: pipeline operation on an invalid future");
+      return NULL;
+    }
+  }
+
+  Future *f = calloc(1, sizeof(Future));
+  if (f == NULL || (n > 0 && (f->inputs = malloc(n * sizeof(Future *))) ==
+                                 NULL)) {
+    fprintf(stderr, "Error: pipeline operation failed to allocate memory");
+    free(f);
+    return NULL;
+  }
+
+  f->pipeline = p;
+  f->op = op;
+  f->num_inputs = n;
+  for (int i = 0; i < n; i++) {
+    f->inputs[i] = inputs[i];
+    if (add_consumer(inputs[i], f) != 0) {
+      // Undo the edges added so far, f is not reachable yet
+      for (int k = 0; k < i; k++) {
+        inputs[k]->num_consumers--;
+      }
+      fprintf(stderr, "Error: pipeline operation failed to allocate memory");
+      free(f->inputs);
+      free(f);
+      return NULL;
+    }
+  }
+
+  f->next = p->futures;
+  p->futures = f;
+  return f;
+}
+
+Future *pipeline_matrix(Pipeline *p, Matrix *m) {
+  if (m == NULL) {
+    fprintf(stderr, "Error: pipeline_matrix() needs a matrix");
+    return NULL;
+  }
+
+  Future *f = future_new(p, PIPELINE_INPUT, NULL, 0);
+  if (f != NULL) {
+    f->value = m;
+  }
+  return f;
+}
+
+Future *pipeline_add(Pipeline *p, Future *a, Future *b) {
+  return future_new(p, PIPELINE_ADD, (Future *[]){a, b}, 2);
+}
+
+Future *pipeline_sub(Pipeline *p, Future *a, Future *b) {
+  return future_new(p, PIPELINE_SUB, (Future *[]){a, b}, 2);
+}
+
+Future *pipeline_scale(Pipeline *p, Future *a, double s) {
+  Future *f = future_new(p, PIPELINE_SCALE, &a, 1);
+  if (f != NULL) {
+    f->s = s;
+  }
+  return f;
+}
+
+Future *pipeline_multiply(Pipeline *p, Future *a, Future *b) {
+  return future_new(p, PIPELINE_MULTIPLY, (Future *[]){a, b}, 2);
+}
+
+Future *pipeline_transpose(Pipeline *p, Future *a) {
+  return future_new(p, PIPELINE_TRANSPOSE, &a, 1);
+}
+
+Future *pipeline_call(Pipeline *p, PipelineFn fn, void *ctx, Future **inputs,
+                      int n) {
+  if (fn == NULL || n < 0 || (n > 0 && inputs == NULL)) {
+    fprintf(stderr, "Error: pipeline_call() needs a function and its inputs");
+    return NULL;
+  }
+
+  Future *f = future_new(p, PIPELINE_CALL, inputs, n);
+  if (f != NULL) {
+    f->fn = fn;
+    f->ctx = ctx;
+  }
+  return f;
+}
+
+void pipeline_keep(Future *f) {
+  if (f != NULL) {
+    f->keep = 1;
+  }
+}
+
+// In-place element-wise operations
+// -----------------------------------------------------------------------------
+// y = y op other, or other op y when reversed
+typedef struct {
+  PipelineOp op;
+  Matrix *y, *other;
+  double s;
+  int reversed;
+} InPlaceJob;
+
+static void in_place_rows(long begin, long end, void *ctx) {
+  InPlaceJob *job = ctx;
+  int n = job->y->cols;
+
+  for (long i = begin; i < end; i++) {
+    double *y = job->y->data[i];
+    const double *x = job->other ? job->other->data[i] : NULL;
+    if (job->op == PIPELINE_SCALE) {
+      for (int j = 0; j < n; j++) {
+        y[j] *= job->s;
+      }
+    } else if (job->op == PIPELINE_ADD) {
+      for (int j = 0; j < n; j++) {
+        y[j] += x[j];
+      }
+    } else if (job->reversed) {
+      for (int j = 0; j < n; j++) {
+        y[j] = x[j] - y[j];
+      }
+    } else {
+      for (int j = 0; j < n; j++) {
+        y[j] -= x[j];
+      }
+    }
+  }
+}
+
+// An intermediate result can be overwritten once its only consumer is
+// the one asking, every other reader has finished
+static int reusable(Future *input) {
+  return input->op != PIPELINE_INPUT && !input->keep &&
+         __atomic_load_n(&input->users, __ATOMIC_ACQUIRE) == 1;
+}
+
+static Matrix *compute_in_place(Future *f, Matrix **args) {
+  Matrix *other = f->op == PIPELINE_SCALE ? NULL : args[1];
+  int reversed = 0;
+  Future *target = f->inputs[0];
+
+  if (other != NULL &&
+      (args[0]->rows != other->rows || args[0]->cols != other->cols)) {
+    return NULL;
+  }
+
+  if (!reusable(target)) {
+    if (other == NULL || !reusable(f->inputs[1])) {
+      return NULL;
+    }
+    target = f->inputs[1];
+    other = args[0];
+    reversed = 1;
+  }
+
+  InPlaceJob job = {f->op, target->value, other, f->s, reversed};
+  lams_parallel_for(job.y->rows, lams_parallel_grain(job.y->cols),
+                    in_place_rows, &job);
+
+  // The result now belongs to f, the input has nothing left to release
+  target->value = NULL;
+  return job.y;
+}
+
+// Execution
+// -----------------------------------------------------------------------------
+static Matrix *compute(Future *f, Matrix **args) {
+  Matrix *result;
+
+  switch (f->op) {
+  case PIPELINE_ADD:
+  case PIPELINE_SUB:
+  case PIPELINE_SCALE:
+    result = compute_in_place(f, args);
+    if (result != NULL) {
+      return result;
+    }
+    return f->op == PIPELINE_ADD   ? matrix_add(args[0], args[1])
+           : f->op == PIPELINE_SUB ? matrix_sub(args[0], args[1])
+                                   : matrix_scale(args[0], f->s);
+  case PIPELINE_MULTIPLY:
+    return matrix_multiply(args[0], args[1]);
+  case PIPELINE_TRANSPOSE:
+    return matrix_transpose(args[0]);
+  case PIPELINE_CALL:
+    return f->fn(args, f->ctx);
+  case PIPELINE_INPUT:
+    break;
+  }
+  return f->value;
+}
+
+static void run_future(long begin, long end, void *ctx) {
+  Future *f = ctx;
+  Pipeline *p = f->pipeline;
+  Matrix *stack_args[2];
+  Matrix **args = f->num_inputs <= 2 ? stack_args
+                                     : malloc(f->num_inputs * sizeof(Matrix *));
+  int ready = args != NULL;
+  (void)begin;
+  (void)end;
+
+  for (int i = 0; ready && i < f->num_inputs; i++) {
+    args[i] = f->inputs[i]->value;
+    ready = args[i] != NULL;
+  }
+
+  // Inputs that failed leave this one NULL as well
+  f->value = ready ? compute(f, args) : NULL;
+  if (f->value == NULL) {
+    __atomic_store_n(&p->failed, 1, __ATOMIC_RELAXED);
+  }
+  if (args != stack_args) {
+    free(args);
+  }
+
+  for (int i = 0; i < f->num_inputs; i++) {
+    Future *input = f->inputs[i];
+    if (__atomic_sub_fetch(&input->users, 1, __ATOMIC_ACQ_REL) == 0 &&
+        input->op != PIPELINE_INPUT && !input->keep) {
+      matrix_free(input->value);
+      input->value = NULL;
+    }
+  }
+
+  for (int i = 0; i < f->num_consumers; i++) {
+    Future *consumer = f->consumers[i];
+    if (__atomic_sub_fetch(&consumer->waiting, 1, __ATOMIC_ACQ_REL) == 0) {
+      lams_parallel_spawn(&p->group, run_future, consumer);
+    }
+  }
+}
+
+int pipeline_start(Pipeline *p) {
+  if (p == NULL || p->started) {
+    fprintf(stderr, "Error: pipeline_start() pipeline is missing or started");
+    return -1;
+  }
+  p->started = 1;
+
+  // Counters are set for every future before anything runs
+  for (Future *f = p->futures; f != NULL; f = f->next) {
+    f->users = f->num_consumers;
+    f->keep |= f->num_consumers == 0;
+    f->waiting = 0;
+    for (int i = 0; i < f->num_inputs; i++) {
+      f->waiting += f->inputs[i]->op != PIPELINE_INPUT;
+    }
+  }
+
+  for (Future *f = p->futures; f != NULL; f = f->next) {
+    if (f->op != PIPELINE_INPUT && f->waiting == 0) {
+      lams_parallel_spawn(&p->group, run_future, f);
+    }
+  }
+  return 0;
+}
+
+int pipeline_wait(Pipeline *p) {
+  if (p == NULL || !p->started) {
+    fprintf(stderr, "Error: pipeline_wait() pipeline was not started");
+    return -1;
+  }
+
+  lams_parallel_wait(&p->group);
+  return p->failed ? -1 : 0;
+}
+
+int pipeline_run(Pipeline *p) {
+  if (pipeline_start(p) != 0) {
+    return -1;
+  }
+  return pipeline_wait(p);
+}
+
+Matrix *future_value(Future *f) { return f != NULL ? f->value : NULL; }
+
+Matrix *future_take(Future *f) {
+  if (f == NULL) {
+    return NULL;
+  }
+
+  Matrix *m = f->value;
+  f->value = NULL;
+  return m;
+}
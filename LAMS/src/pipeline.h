@@ -0,0 +1,58 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "linear_algebra.h"
+
+/*
+ * Asynchronous Matrix pipelines
+ *
+ * Operations on a Pipeline return a Future right away and only record their
+ * inputs, building a dependency graph. pipeline_start queues every operation
+ * whose inputs are ready on the thread pool (see parallel.h) and returns,
+ * operations queue their consumers as they finish, and pipeline_wait helps
+ * until everything has run. Independent operations, for example the two
+ * products in (A * B) + (C * D), run at the same time.
+ *
+ * Matrices passed to pipeline_matrix belong to the caller and are never
+ * changed. Intermediate results are freed as soon as their last consumer has
+ * finished, or reused in place by an add, sub or scale that is their only
+ * consumer. Results of pipeline_keep futures and of futures nothing consumes
+ * are kept until pipeline_free, unless taken with future_take.
+ *
+ * Functions passed to pipeline_call may run on any thread, concurrently with
+ * other operations.
+ *
+ */
+
+typedef struct Pipeline Pipeline;
+typedef struct Future Future;
+
+// Returns a new Matrix computed from the inputs, or NULL on failure
+typedef Matrix *(*PipelineFn)(Matrix **inputs, void *ctx);
+
+Pipeline *pipeline_new(void);
+void pipeline_free(Pipeline *p);
+
+// Operations, each returns NULL if an input is NULL or memory runs out
+Future *pipeline_matrix(Pipeline *p, Matrix *m);
+Future *pipeline_add(Pipeline *p, Future *a, Future *b);
+Future *pipeline_sub(Pipeline *p, Future *a, Future *b);
+Future *pipeline_scale(Pipeline *p, Future *a, double s);
+Future *pipeline_multiply(Pipeline *p, Future *a, Future *b);
+Future *pipeline_transpose(Pipeline *p, Future *a);
+Future *pipeline_call(Pipeline *p, PipelineFn fn, void *ctx, Future **inputs,
+                      int n);
+void pipeline_keep(Future *f);
+
+// Returns 0 when every operation succeeded, -1 if any failed or the
+// pipeline was already started. Operations after a failed one are skipped.
+int pipeline_start(Pipeline *p);
+int pipeline_wait(Pipeline *p);
+int pipeline_run(Pipeline *p);
+
+// The result of a finished future, NULL if it failed or was released.
+// future_value keeps it owned by the pipeline, future_take hands it over.
+Matrix *future_value(Future *f);
+Matrix *future_take(Future *f);
+
+#endif
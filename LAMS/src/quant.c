@@ -0,0 +1,349 @@
+#include "quant.h"
+#include "instrument.h"
+#include "parallel.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Rows of b kept hot while every row of a in a range goes over them
+#define ROW_BLOCK 64
+
+typedef int32_t (*DotI8)(const int8_t *a, const int8_t *b, int n,
+                         int64_t b_sum);
+
+typedef struct {
+  QMatrix *a, *b;
+  int32_t *raw; // qmatrix_gemm_int32 output, or
+  double **out; // scaled output rows
+  DotI8 dot_i8;
+} GemmJob;
+
+// Parameters
+// -----------------------------------------------------------------------------
+static int qmin(QuantType type) { return type == QUANT_INT8 ? -128 : -32767; }
+static int qmax(QuantType type) { return type == QUANT_INT8 ? 127 : 32767; }
+
+static void choose_params(QuantType type, double lo, double hi, double *scale,
+                          int32_t *zero_point) {
+  lo = lo < 0.0 ? lo : 0.0;
+  hi = hi > 0.0 ? hi : 0.0;
+
+  double s = (hi - lo) / (qmax(type) - qmin(type));
+  s = s > 0.0 && isfinite(s) ? s : 1.0;
+  long z = qmin(type) - lround(lo / s);
+
+  *scale = s;
+  *zero_point = z < qmin(type) ? qmin(type) : z > qmax(type) ? qmax(type) : z;
+}
+
+static void row_range(const double *x, int n, double *lo, double *hi) {
+  for (int j = 0; j < n; j++) {
+    *lo = x[j] < *lo ? x[j] : *lo;
+    *hi = x[j] > *hi ? x[j] : *hi;
+  }
+}
+
+// Dot products over whole padded rows
+// -----------------------------------------------------------------------------
+static int32_t dot_i8_scalar(const int8_t *a, const int8_t *b, int n,
+                             int64_t b_sum) {
+  int32_t sum = 0;
+  (void)b_sum;
+
+  for (int j = 0; j < n; j++) {
+    sum += a[j] * b[j];
+  }
+  return sum;
+}
+
+#if defined(__x86_64__)
+// Sign extends 16 bytes at a time, madd sums pairs of products exactly
+__attribute__((target("avx2"))) static int32_t
+dot_i8_avx2(const int8_t *a, const int8_t *b, int n, int64_t b_sum) {
+  __m256i acc = _mm256_setzero_si256();
+  (void)b_sum;
+
+  for (int j = 0; j < n; j += 16) {
+    __m128i x8 = _mm_load_si128((const __m128i *)(a + j));
+    __m128i y8 = _mm_load_si128((const __m128i *)(b + j));
+    __m256i x = _mm256_cvtepi8_epi16(x8), y = _mm256_cvtepi8_epi16(y8);
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+  }
+
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                            _mm256_extracti128_si256(acc, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+}
+
+// vpdpbusd multiplies unsigned by signed bytes, so a is shifted by 128
+// (flipping its sign bit) and 128 * sum(b) is taken off again
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) static int32_t
+dot_i8_vnni(const int8_t *a, const int8_t *b, int n, int64_t b_sum) {
+  const __m512i flip = _mm512_set1_epi8((char)0x80);
+  __m512i acc = _mm512_setzero_si512();
+
+  for (int j = 0; j < n; j += 64) {
+    __m512i x = _mm512_xor_si512(_mm512_load_si512(a + j), flip);
+    acc = _mm512_dpbusd_epi32(acc, x, _mm512_load_si512(b + j));
+  }
+  return _mm512_reduce_add_epi32(acc) - (int32_t)(128 * b_sum);
+}
+#endif
+
+static DotI8 dot_i8 = dot_i8_scalar;
+
+static void dot_i8_init(void) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512vnni") &&
+      __builtin_cpu_supports("avx512bw")) {
+    dot_i8 = dot_i8_vnni;
+  } else if (__builtin_cpu_supports("avx2")) {
+    dot_i8 = dot_i8_avx2;
+  }
+#endif
+}
+
+// Pairs of products fit in 32 bits, which lets the compiler use pmaddwd
+static int64_t dot_i16(const int16_t *a, const int16_t *b, int n) {
+  int64_t sum = 0;
+
+  for (int j = 0; j < n; j += 2) {
+    sum += (int32_t)(a[j] * b[j] + a[j + 1] * b[j + 1]);
+  }
+  return sum;
+}
+
+// Quantization
+// -----------------------------------------------------------------------------
+static QMatrix *qmatrix_new(int rows, int cols, QuantType type,
+                            QuantScheme scheme) {
+  QMatrix *q = calloc(1, sizeof(QMatrix));
+
+  if (q == NULL) {
+    fprintf(stderr, "Error: qmatrix_quantize() failed to allocate memory");
+    return NULL;
+  }
+
+  int size = type == QUANT_INT8 ? 1 : 2;
+  int per_line = 64 / size;
+  q->rows = rows;
+  q->cols = cols;
+  q->stride = (cols + per_line - 1) / per_line * per_line;
+  q->type = type;
+  q->scheme = scheme;
+  q->scale = malloc(rows * sizeof(double));
+  q->zero_point = malloc(rows * sizeof(int32_t));
+  q->row_sum = malloc(rows * sizeof(int64_t));
+  q->data = aligned_alloc(64, (size_t)rows * q->stride * size + 64);
+
+  if (q->scale == NULL || q->zero_point == NULL || q->row_sum == NULL ||
+      q->data == NULL) {
+    fprintf(stderr, "Error: qmatrix_quantize() failed to allocate memory");
+    qmatrix_free(q);
+    return NULL;
+  }
+
+  memset(q->data, 0, (size_t)rows * q->stride * size);
+  LAMS_PROF_ALLOC(qmatrix_quantize,
+                  (size_t)rows * (q->stride * size + sizeof(double) +
+                                  sizeof(int32_t) + sizeof(int64_t)));
+  return q;
+}
+
+void qmatrix_free(QMatrix *q) {
+  if (q == NULL) {
+    return;
+  }
+
+  free(q->scale);
+  free(q->zero_point);
+  free(q->row_sum);
+  free(q->data);
+  free(q);
+}
+
+QMatrix *qmatrix_quantize(Matrix *m, QuantType type, QuantScheme scheme) {
+  LAMS_PROF_BEGIN();
+  QMatrix *q = qmatrix_new(m->rows, m->cols, type, scheme);
+
+  if (q == NULL) {
+    return NULL;
+  }
+
+  double lo = 0.0, hi = 0.0;
+  if (scheme == QUANT_PER_TENSOR) {
+    for (int i = 0; i < m->rows; i++) {
+      row_range(m->data[i], m->cols, &lo, &hi);
+    }
+  }
+
+  for (int i = 0; i < m->rows; i++) {
+    if (scheme == QUANT_PER_ROW) {
+      lo = hi = 0.0;
+      row_range(m->data[i], m->cols, &lo, &hi);
+    }
+    choose_params(type, lo, hi, &q->scale[i], &q->zero_point[i]);
+
+    double inverse = 1.0 / q->scale[i];
+    int64_t sum = 0;
+    for (int j = 0; j < m->cols; j++) {
+      long v = lround(m->data[i][j] * inverse) + q->zero_point[i];
+      v = v < qmin(type) ? qmin(type) : v > qmax(type) ? qmax(type) : v;
+      if (type == QUANT_INT8) {
+        ((int8_t *)q->data)[(size_t)i * q->stride + j] = (int8_t)v;
+      } else {
+        ((int16_t *)q->data)[(size_t)i * q->stride + j] = (int16_t)v;
+      }
+      sum += v;
+    }
+    q->row_sum[i] = sum;
+  }
+
+  LAMS_PROF_END(qmatrix_quantize, 2 * m->rows * m->cols);
+  return q;
+}
+
+Matrix *qmatrix_dequantize(QMatrix *q) {
+  Matrix *m = matrix_new(q->rows, q->cols);
+
+  if (m == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < q->rows; i++) {
+    size_t row = (size_t)i * q->stride;
+    for (int j = 0; j < q->cols; j++) {
+      int v = q->type == QUANT_INT8 ? ((int8_t *)q->data)[row + j]
+                                    : ((int16_t *)q->data)[row + j];
+      m->data[i][j] = q->scale[i] * (v - q->zero_point[i]);
+    }
+  }
+  return m;
+}
+
+// Products
+// -----------------------------------------------------------------------------
+// Rows [begin, end) of a against every row of b. The raw sums are corrected
+// for both zero points: sum (qa - za)(qb - zb) = sum qa qb - zb sum qa
+// - za sum qb + k za zb.
+static void gemm_rows(long begin, long end, void *ctx) {
+  GemmJob *job = ctx;
+  QMatrix *a = job->a, *b = job->b;
+  int k = a->cols, n = a->stride;
+
+  for (int jb = 0; jb < b->rows; jb += ROW_BLOCK) {
+    int je = jb + ROW_BLOCK < b->rows ? jb + ROW_BLOCK : b->rows;
+    for (long i = begin; i < end; i++) {
+      int64_t za = a->zero_point[i];
+      for (int j = jb; j < je; j++) {
+        int64_t zb = b->zero_point[j], raw;
+        if (a->type == QUANT_INT8) {
+          raw = job->dot_i8((int8_t *)a->data + (size_t)i * n,
+                       (int8_t *)b->data + (size_t)j * n, n, b->row_sum[j]);
+        } else {
+          raw = dot_i16((int16_t *)a->data + (size_t)i * n,
+                        (int16_t *)b->data + (size_t)j * n, n);
+        }
+        int64_t sum = raw - zb * a->row_sum[i] - za * b->row_sum[j] +
+                      (int64_t)k * za * zb;
+
+        if (job->raw != NULL) {
+          job->raw[i * b->rows + j] = (int32_t)sum;
+        } else {
+          job->out[i][j] = a->scale[i] * b->scale[j] * (double)sum;
+        }
+      }
+    }
+  }
+}
+
+static int gemm_check(QMatrix *a, QMatrix *b, const char *name) {
+  if (a->cols != b->cols || a->type != b->type) {
+    fprintf(stderr, "Error: %s() operands need the same columns and type",
+            name);
+    return -1;
+  }
+  return 0;
+}
+
+static void gemm_run(GemmJob *job) {
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, dot_i8_init);
+  job->dot_i8 = dot_i8;
+
+  long work = (long)job->b->rows * job->a->cols;
+  lams_parallel_for(job->a->rows, lams_parallel_grain(work), gemm_rows, job);
+}
+
+int qmatrix_gemm_int32(QMatrix *a, QMatrix *b, int32_t *c) {
+  if (gemm_check(a, b, "qmatrix_gemm_int32") != 0) {
+    return -1;
+  }
+  if (a->type != QUANT_INT8) {
+    fprintf(stderr, "Error: qmatrix_gemm_int32() needs int8 operands");
+    return -1;
+  }
+
+  LAMS_PROF_BEGIN();
+  GemmJob job = {a, b, c, NULL, NULL};
+  gemm_run(&job);
+
+  LAMS_PROF_END(qmatrix_gemm_int32, 2L * a->rows * b->rows * a->cols);
+  return 0;
+}
+
+Matrix *qmatrix_multiply_transpose(QMatrix *a, QMatrix *b) {
+  if (gemm_check(a, b, "qmatrix_multiply_transpose") != 0) {
+    return NULL;
+  }
+
+  LAMS_PROF_BEGIN();
+  Matrix *result = matrix_new(a->rows, b->rows);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  GemmJob job = {a, b, NULL, result->data, NULL};
+  gemm_run(&job);
+
+  LAMS_PROF_END(qmatrix_multiply_transpose, 2L * a->rows * b->rows * a->cols);
+  return result;
+}
+
+Vector *qmatrix_multiply_vector(QMatrix *a, Vector *v) {
+  if (a->cols != v->size) {
+    fprintf(stderr, "Error: qmatrix_multiply_vector() sizes do not match");
+    return NULL;
+  }
+
+  LAMS_PROF_BEGIN();
+  Matrix row = {1, v->size, &v->data};
+  QMatrix *x = qmatrix_quantize(&row, a->type, QUANT_PER_TENSOR);
+  Vector *result = vector_new(a->rows);
+  double **rows = malloc((a->rows > 0 ? a->rows : 1) * sizeof(double *));
+  if (x == NULL || result == NULL || rows == NULL) {
+    fprintf(stderr, "Error: qmatrix_multiply_vector() failed to allocate");
+    qmatrix_free(x);
+    vector_free(result);
+    free(rows);
+    return NULL;
+  }
+
+  // a times the single row of x gives one column, stored as the vector
+  for (int i = 0; i < a->rows; i++) {
+    rows[i] = &result->data[i];
+  }
+  GemmJob job = {a, x, NULL, rows, NULL};
+  gemm_run(&job);
+
+  qmatrix_free(x);
+  free(rows);
+  LAMS_PROF_END(qmatrix_multiply_vector, 2L * a->rows * a->cols);
+  return result;
+}
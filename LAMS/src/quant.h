@@ -0,0 +1,53 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+#include "linear_algebra.h"
+#include <stdint.h>
+
+/*
+ * Quantized matrices
+ *
+ * Entries are stored as int8 or int16 with an affine map
+ *
+ *   x ~= scale * (q - zero_point)
+ *
+ * shared by the whole matrix (QUANT_PER_TENSOR) or chosen for each row
+ * (QUANT_PER_ROW). The range always includes 0, so zeros are exact. int16
+ * uses -32767 .. 32767 so pairs of products fit in 32 bits.
+ *
+ * Products pair rows with rows, C = A * B^T, which is what scoring a batch
+ * of embeddings against a database of embeddings needs and keeps both
+ * operands in row order. int8 products accumulate in int32 through AVX-512
+ * VNNI or AVX2 when the CPU has them, with a portable fallback otherwise;
+ * they are exact for rows of up to 32768 entries. int16 products accumulate
+ * in int64.
+ *
+ */
+
+typedef enum { QUANT_INT8, QUANT_INT16 } QuantType;
+typedef enum { QUANT_PER_TENSOR, QUANT_PER_ROW } QuantScheme;
+
+typedef struct {
+  int rows, cols;
+  int stride; // entries between rows, padded with zeros to 64 bytes
+  QuantType type;
+  QuantScheme scheme;
+  double *scale;       // one per row, all equal for QUANT_PER_TENSOR
+  int32_t *zero_point; // same
+  int64_t *row_sum;    // sum of q over each row
+  void *data;          // int8_t or int16_t, rows * stride
+} QMatrix;
+
+QMatrix *qmatrix_quantize(Matrix *m, QuantType type, QuantScheme scheme);
+Matrix *qmatrix_dequantize(QMatrix *q);
+void qmatrix_free(QMatrix *q);
+
+// Sums of (qa - za) * (qb - zb) over each pair of rows, rows(a) x rows(b)
+// written to c. Only int8, returns 0 or -1 on mismatched operands.
+int qmatrix_gemm_int32(QMatrix *a, QMatrix *b, int32_t *c);
+
+// A * B^T and A * v, scaled back to doubles. v is quantized like A.
+Matrix *qmatrix_multiply_transpose(QMatrix *a, QMatrix *b);
+Vector *qmatrix_multiply_vector(QMatrix *a, Vector *v);
+
+#endif
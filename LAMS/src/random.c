@@ -0,0 +1,941 @@
+#include "random.h"
+#include "instrument.h"
+#include "parallel.h"
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Variates of one stream, enough to amortize its jumps
+#define BLOCK (1 << 16)
+
+// Words generated at a time by the four lanes of a uniform or normal fill
+#define WORDS 256
+
+// Ziggurat of 256 layers: start of the tail and area of each layer
+#define ZIGGURAT_R 3.6541528853610088
+#define ZIGGURAT_V 0.00492867323399
+
+// Below these the binomial and Poisson are inverted sequentially
+#define BTPE_MIN 30
+#define PTRS_MIN 10
+
+// Below this variance (a standard deviation of 50) walking from the mode
+// beats HRUA, whose hat is scaled by 2 sqrt(2 / e) and 3 - 2 sqrt(3 / e)
+#define HRUA_MIN_VARIANCE 2500
+#define HRUA_D1 1.7155277699214135
+#define HRUA_D2 0.8989161620588988
+
+// Fills out with n variates from rng, faster than n calls of an RngDraw
+typedef void (*BlockFn)(const void *c, rng_t *rng, double *out, long n);
+
+typedef void (*WordsFn)(rng_t *lane, uint64_t *w);
+
+typedef struct {
+  RngDraw draw;
+  BlockFn block; // or NULL
+  const void *c;
+  const rng_t *streams;
+  double *out;
+  long n;
+} FillJob;
+
+// Generator
+// -----------------------------------------------------------------------------
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+void rng_seed(rng_t *rng, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    rng->s[i] = z ^ (z >> 31);
+  }
+}
+
+uint64_t rng_next(rng_t *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+// The state polynomial times x^distance, as a sum of the states passed
+static void jump(rng_t *rng, const uint64_t poly[4]) {
+  uint64_t s[4] = {0, 0, 0, 0};
+
+  for (int i = 0; i < 4; i++) {
+    for (int b = 0; b < 64; b++) {
+      if (poly[i] & (uint64_t)1 << b) {
+        for (int j = 0; j < 4; j++) {
+          s[j] ^= rng->s[j];
+        }
+      }
+      rng_next(rng);
+    }
+  }
+  for (int j = 0; j < 4; j++) {
+    rng->s[j] = s[j];
+  }
+}
+
+void rng_jump(rng_t *rng) {
+  static const uint64_t poly[4] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+                                   0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+  jump(rng, poly);
+}
+
+void rng_long_jump(rng_t *rng) {
+  static const uint64_t poly[4] = {0x76e15d3efefdcbbf, 0xc5004e441c522fb3,
+                                   0x77710069854ee241, 0x39109bb02acbe635};
+  jump(rng, poly);
+}
+
+static double to_uniform(uint64_t w) { return (w >> 11) * 0x1.0p-53; }
+
+double rng_uniform(rng_t *rng) { return to_uniform(rng_next(rng)); }
+
+// Uniform on (0, 1), safe to take the logarithm of
+static double open_uniform(rng_t *rng) {
+  return ((rng_next(rng) >> 12) + 0.5) * 0x1.0p-52;
+}
+
+// Four lanes
+// -----------------------------------------------------------------------------
+// Words 4 i + l of w come from lane l, whichever way they are computed
+static void words_scalar(rng_t *lane, uint64_t *w) {
+  for (int i = 0; i < WORDS; i += 4) {
+    for (int l = 0; l < 4; l++) {
+      w[i + l] = rng_next(&lane[l]);
+    }
+  }
+}
+
+#if defined(__x86_64__)
+// Register j holds word j of the four states, multiplies by 5 and 9 are
+// shifts and adds since AVX2 has no 64-bit multiply
+__attribute__((target("avx2"))) static void words_avx2(rng_t *lane,
+                                                       uint64_t *w) {
+  __m256i s[4];
+
+  for (int j = 0; j < 4; j++) {
+    s[j] = _mm256_set_epi64x(lane[3].s[j], lane[2].s[j], lane[1].s[j],
+                             lane[0].s[j]);
+  }
+  for (int i = 0; i < WORDS; i += 4) {
+    __m256i x = _mm256_add_epi64(_mm256_slli_epi64(s[1], 2), s[1]);
+    x = _mm256_or_si256(_mm256_slli_epi64(x, 7), _mm256_srli_epi64(x, 57));
+    x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+    _mm256_storeu_si256((__m256i *)(w + i), x);
+
+    __m256i t = _mm256_slli_epi64(s[1], 17);
+    s[2] = _mm256_xor_si256(s[2], s[0]);
+    s[3] = _mm256_xor_si256(s[3], s[1]);
+    s[1] = _mm256_xor_si256(s[1], s[2]);
+    s[0] = _mm256_xor_si256(s[0], s[3]);
+    s[2] = _mm256_xor_si256(s[2], t);
+    s[3] = _mm256_or_si256(_mm256_slli_epi64(s[3], 45),
+                           _mm256_srli_epi64(s[3], 19));
+  }
+  for (int j = 0; j < 4; j++) {
+    uint64_t v[4];
+    _mm256_storeu_si256((__m256i *)v, s[j]);
+    for (int l = 0; l < 4; l++) {
+      lane[l].s[j] = v[l];
+    }
+  }
+}
+#endif
+
+static WordsFn words = words_scalar;
+
+// Lane l is rng long jumped l times
+static void lanes(const rng_t *rng, rng_t lane[4]) {
+  lane[0] = *rng;
+  for (int l = 1; l < 4; l++) {
+    lane[l] = lane[l - 1];
+    rng_long_jump(&lane[l]);
+  }
+}
+
+// Ziggurat
+// -----------------------------------------------------------------------------
+// Layer i spans [0, x_i] under f(x) = exp(-x^2 / 2), scaled to 52-bit
+// integers: w[i] = x_i / 2^52, k[i] = 2^52 x_(i - 1) / x_i, the part of the
+// layer under the layer above, f[i] = f(x_i). Layer 0 is the base strip,
+// widened to the area of a layer with the tail past R.
+static uint64_t zig_k[256];
+static double zig_w[256], zig_f[256];
+
+static void ziggurat_init(void) {
+  const double m = 0x1.0p52;
+  double x = ZIGGURAT_R, previous = x;
+  double q = ZIGGURAT_V / exp(-0.5 * x * x);
+
+  zig_k[0] = x / q * m;
+  zig_k[1] = 0;
+  zig_w[0] = q / m;
+  zig_w[255] = x / m;
+  zig_f[0] = 1;
+  zig_f[255] = exp(-0.5 * x * x);
+  for (int i = 254; i >= 1; i--) {
+    x = sqrt(-2 * log(ZIGGURAT_V / x + exp(-0.5 * x * x)));
+    zig_k[i + 1] = x / previous * m;
+    previous = x;
+    zig_f[i] = exp(-0.5 * x * x);
+    zig_w[i] = x / m;
+  }
+
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    words = words_avx2;
+  }
+#endif
+}
+
+static void random_init(void) {
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, ziggurat_init);
+}
+
+// The wedge and the tail of a try that fell outside the layer below
+static int ziggurat_slow(int i, int negative, double x, rng_t *rng,
+                         double *z) {
+  if (i == 0) {
+    for (;;) {
+      double t = -log(open_uniform(rng)) / ZIGGURAT_R;
+      if (-2 * log(open_uniform(rng)) > t * t) {
+        *z = negative ? -(ZIGGURAT_R + t) : ZIGGURAT_R + t;
+        return 1;
+      }
+    }
+  }
+  if (zig_f[i] + rng_uniform(rng) * (zig_f[i - 1] - zig_f[i]) <
+      exp(-0.5 * x * x)) {
+    *z = negative ? -x : x;
+    return 1;
+  }
+  return 0;
+}
+
+// One try from the word w: the low byte picks the layer, the next bit the
+// sign and 52 bits the position. Inside the layer below is accepted at once
+// (over 98% of words), the wedge and the tail draw more from rng. 0 when
+// the try is rejected.
+static inline int ziggurat(uint64_t w, rng_t *rng, double *z) {
+  int i = w & 0xff, negative = (w >> 8) & 1;
+  uint64_t j = (w >> 9) & ((1ULL << 52) - 1);
+  double x = j * zig_w[i];
+
+  if (j < zig_k[i]) {
+    *z = negative ? -x : x;
+    return 1;
+  }
+  return ziggurat_slow(i, negative, x, rng, z);
+}
+
+static double standard_normal(rng_t *rng) {
+  double z;
+  while (!ziggurat(rng_next(rng), rng, &z)) {
+  }
+  return z;
+}
+
+// Marsaglia and Tsang, shape >= 1
+static double standard_gamma(double shape, rng_t *rng) {
+  double d = shape - 1.0 / 3, c = 1 / sqrt(9 * d);
+
+  for (;;) {
+    double z = standard_normal(rng), v = 1 + c * z;
+    if (v <= 0) {
+      continue;
+    }
+    v = v * v * v;
+    double u = open_uniform(rng);
+    if (u < 1 - 0.0331 * z * z * z * z ||
+        log(u) < 0.5 * z * z + d * (1 - v + log(v))) {
+      return d * v;
+    }
+  }
+}
+
+// Fills
+// -----------------------------------------------------------------------------
+static void fill_blocks(long begin, long end, void *ctx) {
+  FillJob *job = ctx;
+
+  for (long b = begin; b < end; b++) {
+    rng_t rng = job->streams[b];
+    long start = b * BLOCK;
+    long n = job->n - start < BLOCK ? job->n - start : BLOCK;
+    double *out = job->out + start;
+
+    if (job->block != NULL) {
+      job->block(job->c, &rng, out, n);
+      continue;
+    }
+    for (long i = 0; i < n; i++) {
+      out[i] = job->draw(job->c, &rng);
+    }
+  }
+}
+
+static int fill(rng_t *rng, Vector *out, RngDraw draw, BlockFn block,
+                const void *c, const char *name) {
+  LAMS_PROF_BEGIN();
+  long n = out->size, blocks = (n + BLOCK - 1) / BLOCK;
+  rng_t *streams = malloc(blocks * sizeof(rng_t));
+
+  if (blocks > 0 && streams == NULL) {
+    fprintf(stderr, "Error: %s() failed to allocate memory", name);
+    return -1;
+  }
+
+  random_init();
+  for (long b = 0; b < blocks; b++) {
+    rng_jump(rng);
+    streams[b] = *rng;
+  }
+  rng_jump(rng);
+
+  FillJob job = {draw, block, c, streams, out->data, n};
+  lams_parallel_for(blocks, 1, fill_blocks, &job);
+  free(streams);
+  LAMS_PROF_END(sample_fill, n);
+  return 0;
+}
+
+int rng_fill(rng_t *rng, Vector *out, RngDraw draw, const void *c) {
+  return fill(rng, out, draw, NULL, c, "rng_fill");
+}
+
+// Uniform, Bernoulli and normal
+// -----------------------------------------------------------------------------
+typedef struct {
+  double a, width;
+} UniformSampler;
+
+static double uniform_draw(const void *c, rng_t *rng) {
+  const UniformSampler *s = c;
+  return s->a + s->width * rng_uniform(rng);
+}
+
+static void uniform_block(const void *c, rng_t *rng, double *out, long n) {
+  const UniformSampler *s = c;
+  rng_t lane[4];
+  uint64_t w[WORDS];
+
+  lanes(rng, lane);
+  for (long start = 0; start < n; start += WORDS) {
+    long m = n - start < WORDS ? n - start : WORDS;
+    words(lane, w);
+    for (long i = 0; i < m; i++) {
+      out[start + i] = s->a + s->width * to_uniform(w[i]);
+    }
+  }
+}
+
+double continuous_uniform_sample(continuous_uniform_t *uni, rng_t *rng) {
+  UniformSampler s = {uni->a, (double)uni->b - uni->a};
+  return uni->a > uni->b ? NAN : uniform_draw(&s, rng);
+}
+
+int continuous_uniform_sample_fill(continuous_uniform_t *uni, rng_t *rng,
+                                   Vector *out) {
+  if (uni->a > uni->b) {
+    fprintf(stderr, "Error: continuous_uniform_sample_fill() needs a <= b");
+    return -1;
+  }
+
+  UniformSampler s = {uni->a, (double)uni->b - uni->a};
+  return fill(rng, out, uniform_draw, uniform_block, &s,
+              "continuous_uniform_sample_fill");
+}
+
+static double bernoulli_draw(const void *c, rng_t *rng) {
+  return rng_uniform(rng) < *(const double *)c;
+}
+
+double bernoulli_sample(bernoulli_t *ber, rng_t *rng) {
+  double p = ber->p;
+  return p >= 0 && p <= 1 ? bernoulli_draw(&p, rng) : NAN;
+}
+
+int bernoulli_sample_fill(bernoulli_t *ber, rng_t *rng, Vector *out) {
+  double p = ber->p;
+  if (!(p >= 0 && p <= 1)) {
+    fprintf(stderr, "Error: bernoulli_sample_fill() p must lie in [0, 1]");
+    return -1;
+  }
+  return fill(rng, out, bernoulli_draw, NULL, &p, "bernoulli_sample_fill");
+}
+
+typedef struct {
+  double mu, sigma;
+} NormalSampler;
+
+static double normal_draw(const void *c, rng_t *rng) {
+  const NormalSampler *s = c;
+  return s->mu + s->sigma * standard_normal(rng);
+}
+
+// Rejected words are retried from lane 0, which the next batch of words
+// continues from
+static void normal_block(const void *c, rng_t *rng, double *out, long n) {
+  const NormalSampler *s = c;
+  rng_t lane[4];
+  uint64_t w[WORDS];
+
+  lanes(rng, lane);
+  for (long start = 0; start < n; start += WORDS) {
+    long m = n - start < WORDS ? n - start : WORDS;
+    words(lane, w);
+    for (long i = 0; i < m; i++) {
+      double z;
+      if (!ziggurat(w[i], &lane[0], &z)) {
+        z = standard_normal(&lane[0]);
+      }
+      out[start + i] = s->mu + s->sigma * z;
+    }
+  }
+}
+
+double normal_sample(normal_t *nor, rng_t *rng) {
+  NormalSampler s = {nor->mu, nor->sigma};
+  if (!(nor->sigma >= 0)) {
+    return NAN;
+  }
+
+  random_init();
+  return normal_draw(&s, rng);
+}
+
+int normal_sample_fill(normal_t *nor, rng_t *rng, Vector *out) {
+  if (!(nor->sigma >= 0)) {
+    fprintf(stderr, "Error: normal_sample_fill() sigma must not be negative");
+    return -1;
+  }
+
+  NormalSampler s = {nor->mu, nor->sigma};
+  return fill(rng, out, normal_draw, normal_block, &s, "normal_sample_fill");
+}
+
+// Discrete uniform and geometric
+// -----------------------------------------------------------------------------
+typedef struct {
+  double a;
+  uint64_t range, threshold; // 2^32 mod range
+} DiscreteUniformSampler;
+
+// Lemire's multiply and shift, words whose low half lands in the first
+// 2^32 mod range values are redrawn so every outcome is equally likely
+static double discrete_uniform_draw(const void *c, rng_t *rng) {
+  const DiscreteUniformSampler *s = c;
+
+  for (;;) {
+    uint64_t m = (rng_next(rng) >> 32) * s->range;
+    if ((m & 0xffffffff) >= s->threshold) {
+      return s->a + (m >> 32);
+    }
+  }
+}
+
+static int discrete_uniform_setup(DiscreteUniformSampler *s,
+                                  discrete_uniform_t *dis) {
+  if (dis->a > dis->b) {
+    return -1;
+  }
+
+  s->a = dis->a;
+  s->range = (uint64_t)dis->b - dis->a + 1;
+  s->threshold = ((1ULL << 32) - s->range) % s->range;
+  return 0;
+}
+
+double discrete_uniform_sample(discrete_uniform_t *dis, rng_t *rng) {
+  DiscreteUniformSampler s;
+  return discrete_uniform_setup(&s, dis) == 0 ? discrete_uniform_draw(&s, rng)
+                                              : NAN;
+}
+
+int discrete_uniform_sample_fill(discrete_uniform_t *dis, rng_t *rng,
+                                 Vector *out) {
+  DiscreteUniformSampler s;
+  if (discrete_uniform_setup(&s, dis) != 0) {
+    fprintf(stderr, "Error: discrete_uniform_sample_fill() needs a <= b");
+    return -1;
+  }
+  return fill(rng, out, discrete_uniform_draw, NULL, &s,
+              "discrete_uniform_sample_fill");
+}
+
+// P(floor(log(u) / log(q)) >= k) = P(u <= q^k) = q^k
+static double geometric_draw(const void *c, rng_t *rng) {
+  double inv_log_q = *(const double *)c;
+  return inv_log_q == 0 ? 0 : floor(log(open_uniform(rng)) * inv_log_q);
+}
+
+static int geometric_setup(double *inv_log_q, geometric_t *geo) {
+  if (!(geo->p > 0 && geo->p <= 1)) {
+    return -1;
+  }
+
+  *inv_log_q = geo->p == 1 ? 0 : 1 / log1p(-geo->p);
+  return 0;
+}
+
+double geometric_sample(geometric_t *geo, rng_t *rng) {
+  double inv_log_q;
+  return geometric_setup(&inv_log_q, geo) == 0 ? geometric_draw(&inv_log_q,
+                                                                rng)
+                                               : NAN;
+}
+
+int geometric_sample_fill(geometric_t *geo, rng_t *rng, Vector *out) {
+  double inv_log_q;
+  if (geometric_setup(&inv_log_q, geo) != 0) {
+    fprintf(stderr, "Error: geometric_sample_fill() p must lie in (0, 1]");
+    return -1;
+  }
+  return fill(rng, out, geometric_draw, NULL, &inv_log_q,
+              "geometric_sample_fill");
+}
+
+// Poisson
+// -----------------------------------------------------------------------------
+typedef struct {
+  double lambda;
+  double a, b, inv_alpha, v_r; // PTRS
+} PoissonSampler;
+
+static void poisson_setup(PoissonSampler *s, double lambda) {
+  s->lambda = lambda;
+  s->b = 0.931 + 2.53 * sqrt(lambda);
+  s->a = -0.059 + 0.02483 * s->b;
+  s->inv_alpha = 1.1239 + 1.1328 / (s->b - 3.4);
+  s->v_r = 0.9277 - 3.6224 / (s->b - 2);
+}
+
+// Sequential search of the cdf from 0
+static double poisson_inversion(double lambda, rng_t *rng) {
+  double u = rng_uniform(rng), f = exp(-lambda), k = 0;
+
+  while (u > f && f > 0) {
+    u -= f;
+    k++;
+    f *= lambda / k;
+  }
+  return k;
+}
+
+// Transformed rejection with squeeze: k = floor((2 a / us + b) U + lambda
+// + 0.43) with U uniform on (-1/2, 1/2), us = 1/2 - |U|, is accepted at
+// once in the centre and otherwise against the log pmf
+static double poisson_draw(const void *c, rng_t *rng) {
+  const PoissonSampler *s = c;
+
+  if (s->lambda < PTRS_MIN) {
+    return s->lambda > 0 ? poisson_inversion(s->lambda, rng) : 0;
+  }
+  for (;;) {
+    double u = rng_uniform(rng) - 0.5, v = open_uniform(rng);
+    double us = 0.5 - fabs(u);
+    if (us < 0.013 && v > us) {
+      continue;
+    }
+
+    double k = floor((2 * s->a / us + s->b) * u + s->lambda + 0.43);
+    if (us >= 0.07 && v <= s->v_r) {
+      return k;
+    }
+    if (k < 0) {
+      continue;
+    }
+    if (log(v * s->inv_alpha / (s->a / (us * us) + s->b)) <=
+        stats_log_poisson_raw(k, s->lambda)) {
+      return k;
+    }
+  }
+}
+
+double poisson_sample(poisson_t *poi, rng_t *rng) {
+  PoissonSampler s;
+  poisson_setup(&s, poi->lambda);
+  return poisson_draw(&s, rng);
+}
+
+int poisson_sample_fill(poisson_t *poi, rng_t *rng, Vector *out) {
+  PoissonSampler s;
+  poisson_setup(&s, poi->lambda);
+  return fill(rng, out, poisson_draw, NULL, &s, "poisson_sample_fill");
+}
+
+// Negative binomial, failures before the r-th success
+// -----------------------------------------------------------------------------
+typedef struct {
+  double r, scale; // the Poisson mean is a gamma(r) variate times q / p
+} NegativeBinomialSampler;
+
+static double negative_binomial_draw(const void *c, rng_t *rng) {
+  const NegativeBinomialSampler *s = c;
+  PoissonSampler poisson;
+
+  if (s->scale == 0) {
+    return 0;
+  }
+  poisson_setup(&poisson, s->scale * standard_gamma(s->r, rng));
+  return poisson_draw(&poisson, rng);
+}
+
+static int negative_binomial_setup(NegativeBinomialSampler *s,
+                                   negative_binomial_t *neg) {
+  if (neg->r == 0 || !(neg->p > 0 && neg->p <= 1)) {
+    return -1;
+  }
+
+  s->r = neg->r;
+  s->scale = (1 - (double)neg->p) / neg->p;
+  return 0;
+}
+
+double negative_binomial_sample(negative_binomial_t *neg, rng_t *rng) {
+  NegativeBinomialSampler s;
+  if (negative_binomial_setup(&s, neg) != 0) {
+    return NAN;
+  }
+
+  random_init();
+  return negative_binomial_draw(&s, rng);
+}
+
+int negative_binomial_sample_fill(negative_binomial_t *neg, rng_t *rng,
+                                  Vector *out) {
+  NegativeBinomialSampler s;
+  if (negative_binomial_setup(&s, neg) != 0) {
+    fprintf(stderr, "Error: negative_binomial_sample_fill() needs r > 0 and "
+                    "p in (0, 1]");
+    return -1;
+  }
+  return fill(rng, out, negative_binomial_draw, NULL, &s,
+              "negative_binomial_sample_fill");
+}
+
+// Binomial
+// -----------------------------------------------------------------------------
+// Draws for p' = min(p, q) and reflects them when p > 1/2. BTPE covers the
+// pmf with a triangle, two parallelograms and two exponential tails around
+// the mode m; the inversion keeps q^n and restarts past a far bound.
+typedef struct {
+  double n, p, q, reflect;
+  double q_n, bound; // inversion
+  double m, p1, xm, xl, xr, c, lambda_l, lambda_r, p2, p3, p4, npq; // BTPE
+} BinomialSampler;
+
+static int binomial_setup(BinomialSampler *s, binomial_t *bin) {
+  if (!(bin->p >= 0 && bin->p <= 1)) {
+    return -1;
+  }
+
+  double n = bin->n, p = bin->p < 0.5 ? bin->p : 1 - (double)bin->p;
+  double q = 1 - p, np = n * p;
+  s->n = n;
+  s->p = p;
+  s->q = q;
+  s->reflect = bin->p > 0.5;
+  s->npq = np * q;
+  if (np < BTPE_MIN) {
+    s->q_n = exp(n * log1p(-p));
+    s->bound = fmin(n, np + 10 * sqrt(s->npq + 1));
+    return 0;
+  }
+
+  double fm = np + p, a;
+  s->m = floor(fm);
+  s->p1 = floor(2.195 * sqrt(s->npq) - 4.6 * q) + 0.5;
+  s->xm = s->m + 0.5;
+  s->xl = s->xm - s->p1;
+  s->xr = s->xm + s->p1;
+  s->c = 0.134 + 20.5 / (15.3 + s->m);
+  a = (fm - s->xl) / (fm - s->xl * p);
+  s->lambda_l = a * (1 + a / 2);
+  a = (s->xr - fm) / (s->xr * q);
+  s->lambda_r = a * (1 + a / 2);
+  s->p2 = s->p1 * (1 + 2 * s->c);
+  s->p3 = s->p2 + s->c / s->lambda_l;
+  s->p4 = s->p3 + s->c / s->lambda_r;
+  return 0;
+}
+
+static double binomial_inversion(const BinomialSampler *s, rng_t *rng) {
+  double x = 0, f = s->q_n, u = rng_uniform(rng);
+
+  while (u > f) {
+    x++;
+    if (x > s->bound) {
+      x = 0;
+      f = s->q_n;
+      u = rng_uniform(rng);
+    } else {
+      u -= f;
+      f *= (s->n - x + 1) * s->p / (x * s->q);
+    }
+  }
+  return x;
+}
+
+// v <= f(y) / f(m), by the recurrence of the pmf near the mode and
+// otherwise by a squeeze of its logarithm before the exact value
+static int btpe_accept(const BinomialSampler *s, double y, double v) {
+  double k = fabs(y - s->m);
+
+  if (k <= 20 || k >= s->npq / 2 - 1) {
+    double ratio = s->p / s->q, a = ratio * (s->n + 1), f = 1;
+    if (s->m < y) {
+      for (double i = s->m + 1; i <= y; i++) {
+        f *= a / i - ratio;
+      }
+    } else {
+      for (double i = y + 1; i <= s->m; i++) {
+        f /= a / i - ratio;
+      }
+    }
+    return v <= f;
+  }
+
+  double rho = k / s->npq *
+               ((k * (k / 3 + 0.625) + 1.0 / 6) / s->npq + 0.5);
+  double t = -k * k / (2 * s->npq), log_v = log(v);
+  if (log_v < t - rho) {
+    return 1;
+  }
+  if (log_v > t + rho) {
+    return 0;
+  }
+  return log_v <= stats_log_binomial_raw(y, s->n, s->p, s->q) -
+                      stats_log_binomial_raw(s->m, s->n, s->p, s->q);
+}
+
+static double btpe(const BinomialSampler *s, rng_t *rng) {
+  for (;;) {
+    double u = rng_uniform(rng) * s->p4, v = rng_uniform(rng), y;
+
+    if (u <= s->p1) {
+      return floor(s->xm - s->p1 * v + u);
+    }
+    if (u <= s->p2) {
+      double x = s->xl + (u - s->p1) / s->c;
+      v = v * s->c + 1 - fabs(s->m - x + 0.5) / s->p1;
+      if (v > 1) {
+        continue;
+      }
+      y = floor(x);
+    } else if (u <= s->p3) {
+      y = floor(s->xl + log(v) / s->lambda_l);
+      if (y < 0 || v == 0) {
+        continue;
+      }
+      v *= (u - s->p2) * s->lambda_l;
+    } else {
+      y = floor(s->xr - log(v) / s->lambda_r);
+      if (y > s->n || v == 0) {
+        continue;
+      }
+      v *= (u - s->p3) * s->lambda_r;
+    }
+    if (btpe_accept(s, y, v)) {
+      return y;
+    }
+  }
+}
+
+static double binomial_draw(const void *c, rng_t *rng) {
+  const BinomialSampler *s = c;
+  double x;
+
+  if (s->p == 0) {
+    x = 0;
+  } else if (s->n * s->p < BTPE_MIN) {
+    x = binomial_inversion(s, rng);
+  } else {
+    x = btpe(s, rng);
+  }
+  return s->reflect ? s->n - x : x;
+}
+
+double binomial_sample(binomial_t *bin, rng_t *rng) {
+  BinomialSampler s;
+  return binomial_setup(&s, bin) == 0 ? binomial_draw(&s, rng) : NAN;
+}
+
+int binomial_sample_fill(binomial_t *bin, rng_t *rng, Vector *out) {
+  BinomialSampler s;
+  if (binomial_setup(&s, bin) != 0) {
+    fprintf(stderr, "Error: binomial_sample_fill() p must lie in [0, 1]");
+    return -1;
+  }
+  return fill(rng, out, binomial_draw, NULL, &s, "binomial_sample_fill");
+}
+
+// Hypergeometric
+// -----------------------------------------------------------------------------
+// With a small variance the pmf and cdf at the mode are kept, a draw walks
+// from there by the ratios of successive pmfs to the smallest k with
+// cdf(k) >= u, about a standard deviation of steps. Otherwise HRUA
+// (Stadlober's ratio of uniforms) draws for the smaller of K and N - K
+// and of n and N - n and reflects the result. The pmf relative to the mode
+// is a product of four factorial ratios, each taken by Stirling's series
+// around its value at the mode, so a try costs four log1p.
+typedef struct {
+  double N, K, n, lo, hi;
+  double mode, pmf, cdf; // walk
+  double sample, a, h, b, base[4], log_base[4], error_base[4]; // HRUA
+  int hrua, flip_good, flip_sample;
+} HypergeometricSampler;
+
+// log (base + d)! - log base!, base > 0
+static double log_factorial_ratio(const HypergeometricSampler *s, int i,
+                                  double d) {
+  double base = s->base[i];
+  if (base + d == 0) {
+    return -lgamma(base + 1);
+  }
+  return (base + d + 0.5) * log1p(d / base) + d * (s->log_base[i] - 1) +
+         stats_stirling_error(base + d) - s->error_base[i];
+}
+
+static void hrua_setup(HypergeometricSampler *s) {
+  double N = s->N;
+  s->flip_good = s->K > N - s->K;
+  s->flip_sample = s->n > N - s->n;
+  s->sample = s->flip_sample ? N - s->n : s->n;
+
+  double good = s->flip_good ? N - s->K : s->K, sample = s->sample;
+  double variance =
+      (N - sample) * sample * (good / N) * ((N - good) / N) / (N - 1);
+  double c = sqrt(variance + 0.5);
+  double mode = floor((sample + 1) * (good + 1) / (N + 2));
+  s->a = sample * good / N + 0.5;
+  s->h = HRUA_D1 * c + HRUA_D2;
+  s->b = fmin((sample < good ? sample : good) + 1, floor(s->a + 16 * c));
+  s->mode = mode;
+
+  // k!, (good - k)!, (sample - k)! and (N - good - sample + k)! at the mode
+  double base[4] = {mode, good - mode, sample - mode,
+                    N - good - sample + mode};
+  for (int i = 0; i < 4; i++) {
+    s->base[i] = base[i];
+    s->log_base[i] = log(base[i]);
+    s->error_base[i] = stats_stirling_error(base[i]);
+  }
+}
+
+static double hrua(const HypergeometricSampler *s, rng_t *rng) {
+  double k;
+
+  for (;;) {
+    double u = rng_uniform(rng), v = rng_uniform(rng);
+    double x = s->a + s->h * (v - 0.5) / u;
+    if (u == 0 || x < 0 || x >= s->b) {
+      continue;
+    }
+
+    // t = log pmf(k) / pmf(mode)
+    k = floor(x);
+    double d = k - s->mode;
+    double t = -(log_factorial_ratio(s, 0, d) + log_factorial_ratio(s, 1, -d) +
+                 log_factorial_ratio(s, 2, -d) + log_factorial_ratio(s, 3, d));
+    if (u * (4 - u) - 3 <= t) {
+      break;
+    }
+    if (u * (u - t) >= 1) {
+      continue;
+    }
+    if (2 * log(u) <= t) {
+      break;
+    }
+  }
+
+  k = s->flip_good ? s->sample - k : k;
+  return s->flip_sample ? s->K - k : k;
+}
+
+static int hypergeometric_setup(HypergeometricSampler *s,
+                                hypergeometric_t *hyp) {
+  if (hyp->N == 0 || hyp->K > hyp->N || hyp->n > hyp->N) {
+    return -1;
+  }
+
+  double N = hyp->N, K = hyp->K, n = hyp->n, p = n / N, q = (N - n) / N;
+  double mode = floor((n + 1) * (K + 1) / (N + 2));
+  s->N = N;
+  s->K = K;
+  s->n = n;
+  s->lo = n - (N - K) > 0 ? n - (N - K) : 0;
+  s->hi = n < K ? n : K;
+  double variance = N > 1 ? n * (K / N) * ((N - K) / N) * (N - n) / (N - 1)
+                           : 0;
+  s->hrua = variance >= HRUA_MIN_VARIANCE;
+  if (s->hrua) {
+    hrua_setup(s);
+    return 0;
+  }
+
+  s->mode = mode < s->lo ? s->lo : mode > s->hi ? s->hi : mode;
+  s->pmf = exp(stats_log_binomial_raw(s->mode, K, p, q) +
+               stats_log_binomial_raw(n - s->mode, N - K, p, q) -
+               stats_log_binomial_raw(n, N, p, q));
+  s->cdf = stats_hypergeometric_tail(s->mode, N, K, n, 0);
+  return 0;
+}
+
+static double hypergeometric_draw(const void *c, rng_t *rng) {
+  const HypergeometricSampler *s = c;
+  if (s->hrua) {
+    return hrua(s, rng);
+  }
+
+  double u = rng_uniform(rng), k = s->mode, f = s->pmf, F = s->cdf;
+  double rest = s->N - s->K - s->n;
+
+  if (u <= F) {
+    // F - f = cdf(k - 1)
+    while (k > s->lo && F - f >= u) {
+      F -= f;
+      f *= k * (rest + k) / ((s->K - k + 1) * (s->n - k + 1));
+      k--;
+    }
+    return k;
+  }
+  while (k < s->hi && F < u) {
+    f *= (s->K - k) * (s->n - k) / ((k + 1) * (rest + k + 1));
+    F += f;
+    k++;
+  }
+  return k;
+}
+
+double hypergeometric_sample(hypergeometric_t *hyp, rng_t *rng) {
+  HypergeometricSampler s;
+  return hypergeometric_setup(&s, hyp) == 0 ? hypergeometric_draw(&s, rng)
+                                            : NAN;
+}
+
+int hypergeometric_sample_fill(hypergeometric_t *hyp, rng_t *rng,
+                               Vector *out) {
+  HypergeometricSampler s;
+  if (hypergeometric_setup(&s, hyp) != 0) {
+    fprintf(stderr, "Error: hypergeometric_sample_fill() needs K <= N, "
+                    "n <= N and N > 0");
+    return -1;
+  }
+  return fill(rng, out, hypergeometric_draw, NULL, &s,
+              "hypergeometric_sample_fill");
+}
@@ -0,0 +1,77 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "linear_algebra.h"
+#include "stats.h"
+#include <stdint.h>
+
+/*
+ * Random variates
+ *
+ * rng_t is xoshiro256** (Blackman and Vigna): 256 bits of state, period
+ * 2^256 - 1 and a few shifts, rotations and additions per 64-bit word.
+ * rng_seed expands a 64-bit seed with splitmix64. rng_jump advances a
+ * generator by 2^128 words and rng_long_jump by 2^192, so the successive
+ * jumps of one seeded generator are streams that never meet in practice,
+ * one for each thread.
+ *
+ * *_sample draws one variate of a law of stats.h, NAN when the parameters
+ * do not define one. Normals come from a 256 layer ziggurat (Marsaglia and
+ * Tsang), binomials from BTPE (Kachitvichyanukul and Schmeiser) once
+ * n min(p, q) >= 30, Poissons from PTRS (Hormann) once lambda >= 10, both
+ * by inversion below. Geometrics invert the cdf, hypergeometrics come
+ * from HRUA (Stadlober) or, with a standard deviation below 50, search
+ * the cdf outwards from the mode, and negative binomials are Poissons of
+ * gamma variates (Marsaglia and Tsang). All of them are exact.
+ *
+ * *_sample_fill writes out->size variates into out and returns 0, or -1
+ * on invalid parameters. out is cut into blocks of fixed length and block
+ * b draws from rng jumped b + 1 times, so blocks run on any thread and the
+ * values depend on the seed and the size alone; rng ends up past all of
+ * them. Uniform and normal fills take their words from four streams at
+ * once, with AVX2 where the CPU has it. rng_fill does the same for any
+ * draw(c, rng).
+ *
+ */
+
+typedef struct {
+  uint64_t s[4];
+} rng_t;
+
+void rng_seed(rng_t *rng, uint64_t seed);
+void rng_jump(rng_t *rng);
+void rng_long_jump(rng_t *rng);
+uint64_t rng_next(rng_t *rng);
+
+// Uniform on [0, 1) with 53 random bits
+double rng_uniform(rng_t *rng);
+
+// One variate from the constants c
+typedef double (*RngDraw)(const void *c, rng_t *rng);
+
+int rng_fill(rng_t *rng, Vector *out, RngDraw draw, const void *c);
+
+double binomial_sample(binomial_t *b, rng_t *rng);
+double bernoulli_sample(bernoulli_t *b, rng_t *rng);
+double discrete_uniform_sample(discrete_uniform_t *d, rng_t *rng);
+double geometric_sample(geometric_t *g, rng_t *rng);
+double hypergeometric_sample(hypergeometric_t *h, rng_t *rng);
+double negative_binomial_sample(negative_binomial_t *n, rng_t *rng);
+double poisson_sample(poisson_t *p, rng_t *rng);
+double continuous_uniform_sample(continuous_uniform_t *c, rng_t *rng);
+double normal_sample(normal_t *n, rng_t *rng);
+
+int binomial_sample_fill(binomial_t *b, rng_t *rng, Vector *out);
+int bernoulli_sample_fill(bernoulli_t *b, rng_t *rng, Vector *out);
+int discrete_uniform_sample_fill(discrete_uniform_t *d, rng_t *rng,
+                                 Vector *out);
+int geometric_sample_fill(geometric_t *g, rng_t *rng, Vector *out);
+int hypergeometric_sample_fill(hypergeometric_t *h, rng_t *rng, Vector *out);
+int negative_binomial_sample_fill(negative_binomial_t *n, rng_t *rng,
+                                  Vector *out);
+int poisson_sample_fill(poisson_t *p, rng_t *rng, Vector *out);
+int continuous_uniform_sample_fill(continuous_uniform_t *c, rng_t *rng,
+                                   Vector *out);
+int normal_sample_fill(normal_t *n, rng_t *rng, Vector *out);
+
+#endif
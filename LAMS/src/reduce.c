@@ -0,0 +1,277 @@
+#include "reduce.h"
+#include "instrument.h"
+#include "parallel.h"
+
+// Columns whose running values a column reduction keeps on the stack at a
+// time
+#define REDUCE_TILE 256
+
+typedef struct {
+  Matrix *m;
+  ReduceOp op;
+  double *out;
+} ReduceJob;
+
+// Row reductions
+// -----------------------------------------------------------------------------
+// Four independent partial sums, so the loop vectorizes without reassociation
+// flags
+#define SUM4(term)                                                             \
+  double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;                               \
+  int j = 0;                                                                   \
+  for (; j + 4 <= n; j += 4) {                                                 \
+    double t0 = x[j], t1 = x[j + 1], t2 = x[j + 2], t3 = x[j + 3];             \
+    s0 += term(t0);                                                            \
+    s1 += term(t1);                                                            \
+    s2 += term(t2);                                                            \
+    s3 += term(t3);                                                            \
+  }                                                                            \
+  for (; j < n; j++) {                                                         \
+    double t0 = x[j];                                                          \
+    s0 += term(t0);                                                            \
+  }                                                                            \
+  return (s0 + s1) + (s2 + s3);
+
+#define TERM_PLAIN(t) (t)
+#define TERM_ABS(t) fabs(t)
+#define TERM_SQUARE(t) ((t) * (t))
+#define TERM_DEVIATION(t) (((t) - mean) * ((t) - mean))
+
+static double row_sum(const double *x, int n) { SUM4(TERM_PLAIN) }
+static double row_sum_abs(const double *x, int n) { SUM4(TERM_ABS) }
+static double row_sum_squares(const double *x, int n) { SUM4(TERM_SQUARE) }
+static double row_sum_deviations(const double *x, int n, double mean) {
+  SUM4(TERM_DEVIATION)
+}
+
+// Index of the first minimum (sign 1) or maximum (sign -1) of |x| or x, or
+// of the first NaN
+static int row_extreme(const double *x, int n, double sign, int absolute) {
+  int best = n > 0 ? 0 : -1;
+  double best_value = n > 0 ? sign * (absolute ? fabs(x[0]) : x[0]) : 0.0;
+
+  for (int j = 1; j < n && best_value == best_value; j++) {
+    double v = sign * (absolute ? fabs(x[j]) : x[j]);
+    if (v < best_value || v != v) {
+      best_value = v;
+      best = j;
+    }
+  }
+  return best;
+}
+
+static double reduce_row(ReduceOp op, const double *x, int n) {
+  int k;
+
+  switch (op) {
+  case REDUCE_SUM:
+    return row_sum(x, n);
+  case REDUCE_MEAN:
+    return row_sum(x, n) / n;
+  case REDUCE_VAR:
+    return row_sum_deviations(x, n, row_sum(x, n) / n) / n;
+  case REDUCE_MIN:
+    k = row_extreme(x, n, 1.0, 0);
+    return k < 0 ? INFINITY : x[k];
+  case REDUCE_MAX:
+    k = row_extreme(x, n, -1.0, 0);
+    return k < 0 ? -INFINITY : x[k];
+  case REDUCE_ARGMIN:
+    return row_extreme(x, n, 1.0, 0);
+  case REDUCE_ARGMAX:
+    return row_extreme(x, n, -1.0, 0);
+  case REDUCE_NORM1:
+    return row_sum_abs(x, n);
+  case REDUCE_NORM2:
+    return sqrt(row_sum_squares(x, n));
+  case REDUCE_NORM_INF:
+    k = row_extreme(x, n, -1.0, 1);
+    return k < 0 ? 0.0 : fabs(x[k]);
+  }
+  return NAN;
+}
+
+static void reduce_rows(long begin, long end, void *ctx) {
+  ReduceJob *job = ctx;
+
+  for (long i = begin; i < end; i++) {
+    job->out[i] = reduce_row(job->op, job->m->data[i], job->m->cols);
+  }
+}
+
+static double square_rows(long begin, long end, void *ctx) {
+  Matrix *m = ctx;
+  double sum = 0.0;
+
+  for (long i = begin; i < end; i++) {
+    sum += row_sum_squares(m->data[i], m->cols);
+  }
+  return sum;
+}
+
+static double add(double a, double b) { return a + b; }
+
+// Column reductions over columns [begin, end), every row is read in order
+// -----------------------------------------------------------------------------
+static void reduce_cols(long begin, long end, void *ctx) {
+  ReduceJob *job = ctx;
+  Matrix *m = job->m;
+  double *out = job->out;
+  int rows = m->rows;
+
+  switch (job->op) {
+  case REDUCE_SUM:
+  case REDUCE_MEAN:
+  case REDUCE_VAR:
+    for (long j = begin; j < end; j++) {
+      out[j] = 0.0;
+    }
+    for (int i = 0; i < rows; i++) {
+      const double *x = m->data[i];
+      for (long j = begin; j < end; j++) {
+        out[j] += x[j];
+      }
+    }
+    if (job->op == REDUCE_SUM) {
+      break;
+    }
+
+    for (long j = begin; j < end; j++) {
+      out[j] /= rows;
+    }
+    if (job->op == REDUCE_MEAN) {
+      break;
+    }
+
+    // Second pass for the variance, one tile of columns at a time, the
+    // means are replaced at the end
+    for (long t = begin; t < end; t += REDUCE_TILE) {
+      long stop = end - t < REDUCE_TILE ? end : t + REDUCE_TILE;
+      double acc[REDUCE_TILE] = {0};
+      for (int i = 0; i < rows; i++) {
+        const double *x = m->data[i];
+        for (long j = t; j < stop; j++) {
+          double d = x[j] - out[j];
+          acc[j - t] += d * d;
+        }
+      }
+      for (long j = t; j < stop; j++) {
+        out[j] = acc[j - t] / rows;
+      }
+    }
+    break;
+
+  case REDUCE_NORM1:
+  case REDUCE_NORM2:
+    for (long j = begin; j < end; j++) {
+      out[j] = 0.0;
+    }
+    for (int i = 0; i < rows; i++) {
+      const double *x = m->data[i];
+      if (job->op == REDUCE_NORM1) {
+        for (long j = begin; j < end; j++) {
+          out[j] += fabs(x[j]);
+        }
+      } else {
+        for (long j = begin; j < end; j++) {
+          out[j] += x[j] * x[j];
+        }
+      }
+    }
+    if (job->op == REDUCE_NORM2) {
+      for (long j = begin; j < end; j++) {
+        out[j] = sqrt(out[j]);
+      }
+    }
+    break;
+
+  case REDUCE_MIN:
+  case REDUCE_MAX:
+  case REDUCE_NORM_INF:
+    for (long j = begin; j < end; j++) {
+      out[j] = job->op == REDUCE_MIN ? INFINITY
+               : job->op == REDUCE_MAX ? -INFINITY
+                                       : 0.0;
+    }
+    for (int i = 0; i < rows; i++) {
+      const double *x = m->data[i];
+      if (job->op == REDUCE_MIN) {
+        for (long j = begin; j < end; j++) {
+          out[j] = x[j] < out[j] || x[j] != x[j] ? x[j] : out[j];
+        }
+      } else if (job->op == REDUCE_MAX) {
+        for (long j = begin; j < end; j++) {
+          out[j] = x[j] > out[j] || x[j] != x[j] ? x[j] : out[j];
+        }
+      } else {
+        for (long j = begin; j < end; j++) {
+          double a = fabs(x[j]);
+          out[j] = a > out[j] || a != a ? a : out[j];
+        }
+      }
+    }
+    break;
+
+  case REDUCE_ARGMIN:
+  case REDUCE_ARGMAX: {
+    // Best values so far next to their row indices, a tile at a time
+    double sign = job->op == REDUCE_ARGMIN ? 1.0 : -1.0;
+    for (long t = begin; t < end; t += REDUCE_TILE) {
+      long stop = end - t < REDUCE_TILE ? end : t + REDUCE_TILE;
+      double best[REDUCE_TILE];
+      for (long j = t; j < stop; j++) {
+        best[j - t] = rows > 0 ? sign * m->data[0][j] : 0.0;
+        out[j] = rows > 0 ? 0.0 : -1.0;
+      }
+      for (int i = 1; i < rows; i++) {
+        const double *x = m->data[i];
+        for (long j = t; j < stop; j++) {
+          double v = sign * x[j], b = best[j - t];
+          int take = v < b || (v != v && b == b);
+          out[j] = take ? i : out[j];
+          best[j - t] = take ? v : b;
+        }
+      }
+    }
+    break;
+  }
+  }
+}
+
+// Public functions
+// -----------------------------------------------------------------------------
+Vector *matrix_reduce(Matrix *m, Axis axis, ReduceOp op) {
+  LAMS_PROF_BEGIN();
+  int n = axis == REDUCE_ROWS ? m->rows : m->cols;
+  Vector *result = vector_new(n);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: matrix_reduce() failed to allocate memory");
+    return NULL;
+  }
+
+  ReduceJob job = {m, op, result->data};
+
+  // Rows are split across threads, column reductions are split by columns
+  // so every thread still reads its part of each row in order
+  int other = axis == REDUCE_ROWS ? m->cols : m->rows;
+  long grain = lams_parallel_grain(other);
+  if (axis == REDUCE_ROWS) {
+    lams_parallel_for(n, grain, reduce_rows, &job);
+  } else {
+    // At least a cache line of columns per thread
+    lams_parallel_for(n, grain > 8 ? grain : 8, reduce_cols, &job);
+  }
+
+  LAMS_PROF_END(matrix_reduce, (long)m->rows * m->cols);
+  return result;
+}
+
+double matrix_norm_frobenius(Matrix *m) {
+  LAMS_PROF_BEGIN();
+  double sum = lams_parallel_reduce(m->rows, lams_parallel_grain(m->cols), 0.0,
+                                    square_rows, add, m);
+
+  LAMS_PROF_END(matrix_norm_frobenius, 2 * m->rows * m->cols);
+  return sqrt(sum);
+}
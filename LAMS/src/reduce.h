@@ -0,0 +1,39 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include "linear_algebra.h"
+
+/*
+ * Reductions of a Matrix along one axis
+ *
+ * REDUCE_ROWS gives one value per row (a Vector of m->rows entries),
+ * REDUCE_COLS one value per column (m->cols entries). Column reductions
+ * walk the matrix row by row and accumulate into the whole output at once,
+ * so memory is read in order instead of striding down each column.
+ *
+ * REDUCE_VAR is the population variance (divides by n). REDUCE_ARGMIN and
+ * REDUCE_ARGMAX store the index of the first extreme entry as a double.
+ * NaN propagates along both axes: the extremes and norms of a row or
+ * column holding a NaN are NaN, and ARGMIN/ARGMAX give its first NaN.
+ *
+ */
+
+typedef enum { REDUCE_ROWS, REDUCE_COLS } Axis;
+
+typedef enum {
+  REDUCE_SUM,
+  REDUCE_MEAN,
+  REDUCE_VAR,
+  REDUCE_MIN,
+  REDUCE_MAX,
+  REDUCE_ARGMIN,
+  REDUCE_ARGMAX,
+  REDUCE_NORM1,
+  REDUCE_NORM2,
+  REDUCE_NORM_INF
+} ReduceOp;
+
+Vector *matrix_reduce(Matrix *m, Axis axis, ReduceOp op);
+double matrix_norm_frobenius(Matrix *m);
+
+#endif
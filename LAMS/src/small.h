@@ -0,0 +1,320 @@
+#ifndef SMALL_H
+#define SMALL_H
+
+#include "linear_algebra.h"
+
+/*
+ * Fixed-size vectors and matrices (2, 3 and 4) with inline storage
+ *
+ * Vec2/Vec3/Vec4 and Mat2/Mat3/Mat4 are plain structs passed by value, so
+ * they live on the stack or in registers and never touch the heap. The
+ * generic operations are generated per size by SMALL_DEFINE below; every
+ * loop has a compile-time trip count and is fully unrolled. Determinants
+ * and inverses use closed forms per size.
+ *
+ * The inverses do not check for singularity, a zero determinant gives
+ * non-finite entries. Check mat*_det first when that can happen.
+ *
+ */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define SMALL_UNROLL _Pragma("GCC unroll 4")
+#elif defined(__clang__)
+#define SMALL_UNROLL _Pragma("unroll")
+#else
+#define SMALL_UNROLL
+#endif
+
+#define SMALL_DEFINE(N)                                                        \
+  typedef struct {                                                             \
+    double data[N];                                                            \
+  } Vec##N;                                                                    \
+                                                                               \
+  typedef struct {                                                             \
+    double data[N][N];                                                         \
+  } Mat##N;                                                                    \
+                                                                               \
+  static inline Vec##N vec##N##_add(Vec##N a, Vec##N b) {                      \
+    Vec##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      r.data[i] = a.data[i] + b.data[i];                                       \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Vec##N vec##N##_sub(Vec##N a, Vec##N b) {                      \
+    Vec##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      r.data[i] = a.data[i] - b.data[i];                                       \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Vec##N vec##N##_scale(Vec##N a, double s) {                    \
+    Vec##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      r.data[i] = a.data[i] * s;                                               \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline double vec##N##_dot(Vec##N a, Vec##N b) {                      \
+    double r = 0;                                                              \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      r += a.data[i] * b.data[i];                                              \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline double vec##N##_norm(Vec##N a) {                               \
+    return sqrt(vec##N##_dot(a, a));                                           \
+  }                                                                            \
+                                                                               \
+  static inline Vec##N vec##N##_normalize(Vec##N a) {                          \
+    return vec##N##_scale(a, 1.0 / vec##N##_norm(a));                          \
+  }                                                                            \
+                                                                               \
+  static inline Vec##N vec##N##_from_vector(Vector *v) {                       \
+    Vec##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      r.data[i] = v->data[i];                                                  \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Vector *vec##N##_to_vector(Vec##N a) {                         \
+    return vector_from_array(N, a.data);                                       \
+  }                                                                            \
+                                                                               \
+  static inline Mat##N mat##N##_identity(void) {                               \
+    Mat##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[i][j] = i == j;                                                 \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Mat##N mat##N##_add(Mat##N a, Mat##N b) {                      \
+    Mat##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[i][j] = a.data[i][j] + b.data[i][j];                            \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Mat##N mat##N##_sub(Mat##N a, Mat##N b) {                      \
+    Mat##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[i][j] = a.data[i][j] - b.data[i][j];                            \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Mat##N mat##N##_scale(Mat##N a, double s) {                    \
+    Mat##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[i][j] = a.data[i][j] * s;                                       \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Mat##N mat##N##_transpose(Mat##N a) {                          \
+    Mat##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[j][i] = a.data[i][j];                                           \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  /* Each row of the result is a sum of scaled rows of b, which maps onto */   \
+  /* whole-row SIMD multiply-adds */                                           \
+  static inline Mat##N mat##N##_multiply(Mat##N a, Mat##N b) {                 \
+    Mat##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[i][j] = a.data[i][0] * b.data[0][j];                            \
+      }                                                                        \
+      SMALL_UNROLL for (int k = 1; k < N; k++) {                               \
+        SMALL_UNROLL for (int j = 0; j < N; j++) {                             \
+          r.data[i][j] += a.data[i][k] * b.data[k][j];                         \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Vec##N mat##N##_multiply_vec(Mat##N a, Vec##N v) {             \
+    Vec##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      r.data[i] = 0;                                                           \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[i] += a.data[i][j] * v.data[j];                                 \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline void mat##N##_multiply_vec_array(Mat##N a, const Vec##N *v,    \
+                                                 Vec##N *out, int count) {     \
+    for (int p = 0; p < count; p++) {                                          \
+      out[p] = mat##N##_multiply_vec(a, v[p]);                                 \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline Mat##N mat##N##_from_matrix(Matrix *m) {                       \
+    Mat##N r;                                                                  \
+    SMALL_UNROLL for (int i = 0; i < N; i++) {                                 \
+      SMALL_UNROLL for (int j = 0; j < N; j++) {                               \
+        r.data[i][j] = m->data[i][j];                                          \
+      }                                                                        \
+    }                                                                          \
+    return r;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline Matrix *mat##N##_to_matrix(Mat##N a) {                         \
+    Matrix *m = matrix_new(N, N);                                              \
+    if (m == NULL) {                                                           \
+      return NULL;                                                             \
+    }                                                                          \
+    matrix_set(m, &a.data[0][0], N * N);                                       \
+    return m;                                                                  \
+  }
+
+SMALL_DEFINE(2)
+SMALL_DEFINE(3)
+SMALL_DEFINE(4)
+
+// Size specific functions
+// -----------------------------------------------------------------------------
+static inline Vec3 vec3_cross(Vec3 a, Vec3 b) {
+  Vec3 r = {{a.data[1] * b.data[2] - a.data[2] * b.data[1],
+             a.data[2] * b.data[0] - a.data[0] * b.data[2],
+             a.data[0] * b.data[1] - a.data[1] * b.data[0]}};
+  return r;
+}
+
+static inline double mat2_det(Mat2 m) {
+  return m.data[0][0] * m.data[1][1] - m.data[0][1] * m.data[1][0];
+}
+
+static inline Mat2 mat2_inverse(Mat2 m) {
+  double inv = 1.0 / mat2_det(m);
+  Mat2 r = {{{m.data[1][1] * inv, -m.data[0][1] * inv},
+             {-m.data[1][0] * inv, m.data[0][0] * inv}}};
+  return r;
+}
+
+static inline double mat3_det(Mat3 m) {
+  return m.data[0][0] * (m.data[1][1] * m.data[2][2] -
+                         m.data[1][2] * m.data[2][1]) -
+         m.data[0][1] * (m.data[1][0] * m.data[2][2] -
+                         m.data[1][2] * m.data[2][0]) +
+         m.data[0][2] * (m.data[1][0] * m.data[2][1] -
+                         m.data[1][1] * m.data[2][0]);
+}
+
+// Adjugate over determinant, the columns of the adjugate are cross products
+// of the rows
+static inline Mat3 mat3_inverse(Mat3 m) {
+  Vec3 r0 = {{m.data[0][0], m.data[0][1], m.data[0][2]}};
+  Vec3 r1 = {{m.data[1][0], m.data[1][1], m.data[1][2]}};
+  Vec3 r2 = {{m.data[2][0], m.data[2][1], m.data[2][2]}};
+  Vec3 c0 = vec3_cross(r1, r2);
+  Vec3 c1 = vec3_cross(r2, r0);
+  Vec3 c2 = vec3_cross(r0, r1);
+  double inv = 1.0 / vec3_dot(r0, c0);
+
+  Mat3 r;
+  for (int i = 0; i < 3; i++) {
+    r.data[i][0] = c0.data[i] * inv;
+    r.data[i][1] = c1.data[i] * inv;
+    r.data[i][2] = c2.data[i] * inv;
+  }
+  return r;
+}
+
+// The 4x4 determinant and inverse share the twelve 2x2 minors of the top and
+// bottom row pairs (Laplace expansion)
+typedef struct {
+  double s[6], c[6];
+} Mat4Minors;
+
+static inline Mat4Minors mat4_minors(Mat4 m) {
+  double(*a)[4] = m.data;
+  Mat4Minors r = {{a[0][0] * a[1][1] - a[1][0] * a[0][1],
+                   a[0][0] * a[1][2] - a[1][0] * a[0][2],
+                   a[0][0] * a[1][3] - a[1][0] * a[0][3],
+                   a[0][1] * a[1][2] - a[1][1] * a[0][2],
+                   a[0][1] * a[1][3] - a[1][1] * a[0][3],
+                   a[0][2] * a[1][3] - a[1][2] * a[0][3]},
+                  {a[2][0] * a[3][1] - a[3][0] * a[2][1],
+                   a[2][0] * a[3][2] - a[3][0] * a[2][2],
+                   a[2][0] * a[3][3] - a[3][0] * a[2][3],
+                   a[2][1] * a[3][2] - a[3][1] * a[2][2],
+                   a[2][1] * a[3][3] - a[3][1] * a[2][3],
+                   a[2][2] * a[3][3] - a[3][2] * a[2][3]}};
+  return r;
+}
+
+static inline double mat4_det_minors(Mat4Minors k) {
+  return k.s[0] * k.c[5] - k.s[1] * k.c[4] + k.s[2] * k.c[3] +
+         k.s[3] * k.c[2] - k.s[4] * k.c[1] + k.s[5] * k.c[0];
+}
+
+static inline double mat4_det(Mat4 m) {
+  return mat4_det_minors(mat4_minors(m));
+}
+
+static inline Mat4 mat4_inverse(Mat4 m) {
+  double(*a)[4] = m.data;
+  Mat4Minors k = mat4_minors(m);
+  const double *s = k.s, *c = k.c;
+  double inv = 1.0 / mat4_det_minors(k);
+
+  Mat4 r = {{{(a[1][1] * c[5] - a[1][2] * c[4] + a[1][3] * c[3]) * inv,
+              (-a[0][1] * c[5] + a[0][2] * c[4] - a[0][3] * c[3]) * inv,
+              (a[3][1] * s[5] - a[3][2] * s[4] + a[3][3] * s[3]) * inv,
+              (-a[2][1] * s[5] + a[2][2] * s[4] - a[2][3] * s[3]) * inv},
+             {(-a[1][0] * c[5] + a[1][2] * c[2] - a[1][3] * c[1]) * inv,
+              (a[0][0] * c[5] - a[0][2] * c[2] + a[0][3] * c[1]) * inv,
+              (-a[3][0] * s[5] + a[3][2] * s[2] - a[3][3] * s[1]) * inv,
+              (a[2][0] * s[5] - a[2][2] * s[2] + a[2][3] * s[1]) * inv},
+             {(a[1][0] * c[4] - a[1][1] * c[2] + a[1][3] * c[0]) * inv,
+              (-a[0][0] * c[4] + a[0][1] * c[2] - a[0][3] * c[0]) * inv,
+              (a[3][0] * s[4] - a[3][1] * s[2] + a[3][3] * s[0]) * inv,
+              (-a[2][0] * s[4] + a[2][1] * s[2] - a[2][3] * s[0]) * inv},
+             {(-a[1][0] * c[3] + a[1][1] * c[1] - a[1][2] * c[0]) * inv,
+              (a[0][0] * c[3] - a[0][1] * c[1] + a[0][2] * c[0]) * inv,
+              (-a[3][0] * s[3] + a[3][1] * s[1] - a[3][2] * s[0]) * inv,
+              (a[2][0] * s[3] - a[2][1] * s[1] + a[2][2] * s[0]) * inv}}};
+  return r;
+}
+
+// Applies the affine transform m (last row 0 0 0 1) to 3D points
+static inline Vec3 mat4_transform_point(Mat4 m, Vec3 p) {
+  Vec3 r;
+  SMALL_UNROLL for (int i = 0; i < 3; i++) {
+    r.data[i] = m.data[i][0] * p.data[0] + m.data[i][1] * p.data[1] +
+                m.data[i][2] * p.data[2] + m.data[i][3];
+  }
+  return r;
+}
+
+static inline void mat4_transform_points(Mat4 m, const Vec3 *points,
+                                         Vec3 *out, int count) {
+  for (int p = 0; p < count; p++) {
+    out[p] = mat4_transform_point(m, points[p]);
+  }
+}
+
+#endif
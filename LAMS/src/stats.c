@@ -1,4 +1,5 @@
 #include "stats.h"
+#include "instrument.h"
 #include <math.h>
 
 // Means
@@ -153,117 +154,605 @@ float continuous_uniform_median(continuous_uniform_t *uni) {
 
 float normal_median(normal_t *nor) { return nor->mu; }
 
-// PMF
+// Log-domain building blocks
+// Catherine Loader, "Fast and accurate computation of binomial
+// probabilities" (2000): pmfs as Stirling-series errors plus deviance terms,
+// without the cancellation of lgamma differences for large counts
+
+// log(n!) - log(sqrt(2 pi n) (n / e)^n)
+double stats_stirling_error(double n) {
+  const double S0 = 1.0 / 12, S1 = 1.0 / 360, S2 = 1.0 / 1260;
+  const double S3 = 1.0 / 1680, S4 = 1.0 / 1188;
+  double nn = n * n;
 
-float binomial_coefficient(int n, int k) {
-  float result = 1;
-  for (int i = 1; i <= k; i++) {
-    result *= (n - k + i) / (float)i;
+  if (n <= 0) {
+    return 0;
   }
-  return result;
+  if (n <= 15) {
+    return lgamma(n + 1) - (n + 0.5) * log(n) + n - 0.5 * log(2 * M_PI);
+  }
+  if (n > 500) {
+    return (S0 - S1 / nn) / n;
+  }
+  if (n > 80) {
+    return (S0 - (S1 - S2 / nn) / nn) / n;
+  }
+  if (n > 35) {
+    return (S0 - (S1 - (S2 - S3 / nn) / nn) / nn) / n;
+  }
+  return (S0 - (S1 - (S2 - (S3 - S4 / nn) / nn) / nn) / nn) / n;
+}
+
+// x log(x / np) + np - x, by its series when x is close to np
+double stats_bd0(double x, double np) {
+  if (fabs(x - np) >= 0.1 * (x + np)) {
+    return x * log(x / np) + np - x;
+  }
+
+  double v = (x - np) / (x + np), s = (x - np) * v, ej = 2 * x * v;
+  v *= v;
+  for (int j = 1; j < 1000; j++) {
+    ej *= v;
+    double next = s + ej / (2 * j + 1);
+    if (next == s) {
+      return next;
+    }
+    s = next;
+  }
+  return s;
+}
+
+// log of C(n, x) p^x q^(n - x) for real x and n, q = 1 - p
+double stats_log_binomial_raw(double x, double n, double p, double q) {
+  if (p == 0) {
+    return x == 0 ? 0 : -INFINITY;
+  }
+  if (q == 0) {
+    return x == n ? 0 : -INFINITY;
+  }
+  if (x < 0 || x > n) {
+    return -INFINITY;
+  }
+  if (x == 0) {
+    return n == 0 ? 0 : p < 0.1 ? -stats_bd0(n, n * q) - n * p : n * log(q);
+  }
+  if (x == n) {
+    return q < 0.1 ? -stats_bd0(n, n * p) - n * q : n * log(p);
+  }
+
+  double lc = stats_stirling_error(n) - stats_stirling_error(x) -
+              stats_stirling_error(n - x) - stats_bd0(x, n * p) -
+              stats_bd0(n - x, n * q);
+  return lc - 0.5 * (log(2 * M_PI) + log(x) + log1p(-x / n));
+}
+
+// log of lambda^x e^-lambda / x!
+double stats_log_poisson_raw(double x, double lambda) {
+  if (lambda == 0) {
+    return x == 0 ? 0 : -INFINITY;
+  }
+  if (x == 0) {
+    return -lambda;
+  }
+  return -stats_stirling_error(x) - stats_bd0(x, lambda) -
+         0.5 * log(2 * M_PI * x);
+}
+
+// Tail probabilities
+// Regularized incomplete beta and gamma functions by the modified Lentz
+// continued fraction (and the gamma series below its mean), with the
+// x^a (1 - x)^b and x^a e^-x factors taken from the pmfs above
+
+#define TAIL_EPS 1e-15
+#define TAIL_TINY 1e-300
+#define TAIL_MAX_ITER 1000000
+
+static double lentz_clamp(double v) {
+  return fabs(v) < TAIL_TINY ? TAIL_TINY : v;
+}
+
+// x^a (1 - x)^b / (a B(a, b)), y = 1 - x
+static double beta_front(double a, double b, double x, double y) {
+  if (b >= 1) {
+    return y * exp(stats_log_binomial_raw(a, a + b - 1, x, y));
+  }
+  return exp(a * log(x) + b * log(y) + lgamma(a + b) - lgamma(a + 1) -
+             lgamma(b));
+}
+
+static double beta_fraction(double a, double b, double x) {
+  double c = 1, d = 1 / lentz_clamp(1 - (a + b) * x / (a + 1)), h = d;
+
+  for (int m = 1; m < TAIL_MAX_ITER; m++) {
+    double m2 = 2.0 * m;
+    double aa = m * (b - m) * x / ((a + m2 - 1) * (a + m2));
+    d = 1 / lentz_clamp(1 + aa * d);
+    c = lentz_clamp(1 + aa / c);
+    h *= d * c;
+
+    aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1));
+    d = 1 / lentz_clamp(1 + aa * d);
+    c = lentz_clamp(1 + aa / c);
+    h *= d * c;
+    if (fabs(d * c - 1) < TAIL_EPS) {
+      break;
+    }
+  }
+  return h;
+}
+
+// I_x(a, b), y = 1 - x passed separately so tails near x = 1 keep their
+// digits
+double stats_incomplete_beta(double a, double b, double x, double y) {
+  if (x <= 0) {
+    return 0;
+  }
+  if (y <= 0) {
+    return 1;
+  }
+  if (x < (a + 1) / (a + b + 2)) {
+    return beta_front(a, b, x, y) * beta_fraction(a, b, x);
+  }
+  return 1 - beta_front(b, a, y, x) * beta_fraction(b, a, y);
+}
+
+// Series of P(a, x), for x below a + 1
+static double gamma_series(double a, double x) {
+  double term = 1, sum = 1;
+
+  for (int n = 1; n < TAIL_MAX_ITER && term > sum * TAIL_EPS; n++) {
+    term *= x / (a + n);
+    sum += term;
+  }
+  return exp(stats_log_poisson_raw(a, x)) * sum;
+}
+
+// Continued fraction of Q(a, x), for x above a + 1
+static double gamma_fraction(double a, double x) {
+  double b = x + 1 - a, c = 1 / TAIL_TINY, d = 1 / b, h = d;
+
+  for (int i = 1; i < TAIL_MAX_ITER; i++) {
+    double an = -i * (i - a);
+    b += 2;
+    d = 1 / lentz_clamp(an * d + b);
+    c = lentz_clamp(b + an / c);
+    h *= d * c;
+    if (fabs(d * c - 1) < TAIL_EPS) {
+      break;
+    }
+  }
+  return a * exp(stats_log_poisson_raw(a, x)) * h;
+}
+
+double stats_incomplete_gamma_p(double a, double x) {
+  if (x <= 0) {
+    return 0;
+  }
+  return x < a + 1 ? gamma_series(a, x) : 1 - gamma_fraction(a, x);
+}
+
+double stats_incomplete_gamma_q(double a, double x) {
+  if (x <= 0) {
+    return 1;
+  }
+  return x < a + 1 ? 1 - gamma_series(a, x) : gamma_fraction(a, x);
+}
+
+static double log_hypergeometric_raw(double k, double N, double K,
+                                     double n) {
+  double p = n / N, q = (N - n) / N;
+  return stats_log_binomial_raw(k, K, p, q) +
+         stats_log_binomial_raw(n - k, N - K, p, q) -
+         stats_log_binomial_raw(n, N, p, q);
+}
+
+// P(X <= k), or P(X > k) when upper is set. The tail on the far side of the
+// mode is summed outwards from k with the ratio of successive pmfs, until
+// its terms stop counting
+double stats_hypergeometric_tail(double k, double N, double K, double n,
+                                 int upper) {
+  double lo = n - (N - K) > 0 ? n - (N - K) : 0, hi = n < K ? n : K;
+  double mode = floor((n + 1) * (K + 1) / (N + 2)), sum = 0, term = 1;
+  int lower_sum = k < mode;
+
+  if (k < lo || k >= hi) {
+    return (k >= hi) != upper;
+  }
+
+  if (lower_sum) {
+    for (double i = k; i >= lo && term > sum * TAIL_EPS; i--) {
+      sum += term;
+      term *= i * (N - K - n + i) / ((K - i + 1) * (n - i + 1));
+    }
+    sum *= exp(log_hypergeometric_raw(k, N, K, n));
+  } else {
+    for (double i = k + 1; i <= hi && term > sum * TAIL_EPS; i++) {
+      sum += term;
+      term *= (K - i) * (n - i) / ((i + 1) * (N - K - n + i + 1));
+    }
+    sum *= exp(log_hypergeometric_raw(k + 1, N, K, n));
+  }
+  return lower_sum != upper ? sum : 1 - sum;
+}
+
+// Quantiles
+// Peter Acklam's rational approximation of the normal quantile (relative
+// error below 1.2e-9) and one Halley step on erfc, which brings it to
+// double precision. Discrete quantiles start from the Cornish-Fisher
+// expansion and search the cdf from there.
+
+static const double acklam_a[] = {
+    -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+    1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+static const double acklam_b[] = {
+    -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+    6.680131188771972e+01, -1.328068155288572e+01};
+static const double acklam_c[] = {
+    -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+    -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+static const double acklam_d[] = {
+    7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+    3.754408661907416e+00};
+
+// Lower half, p <= 1/2
+static double normal_quantile_lower(double p) {
+  const double *a = acklam_a, *b = acklam_b, *c = acklam_c, *d = acklam_d;
+  double x;
+
+  if (p < 0.02425) {
+    double q = sqrt(-2 * log(p));
+    x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+        ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+  } else {
+    double q = p - 0.5, r = q * q;
+    x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) *
+        q / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+  }
+
+  double e = 0.5 * erfc(-x * M_SQRT1_2) - p;
+  double u = e * sqrt(2 * M_PI) * exp(0.5 * x * x);
+  return x - u / (1 + 0.5 * x * u);
+}
+
+double stats_normal_quantile(double p) {
+  if (isnan(p) || p < 0 || p > 1) {
+    return NAN;
+  }
+  if (p == 0 || p == 1) {
+    return p == 0 ? -INFINITY : INFINITY;
+  }
+  return p <= 0.5 ? normal_quantile_lower(p) : -normal_quantile_lower(1 - p);
+}
+
+// mean + sd (z + (z^2 - 1) skewness / 6) for the normal quantile z of u
+double stats_cornish_fisher(double u, double mean, double sd,
+                            double skewness) {
+  double z = stats_normal_quantile(u);
+  double x = mean + sd * (z + (z * z - 1) * skewness / 6);
+  return isfinite(x) ? x : mean;
+}
+
+// Smallest k in [above, ...] with cdf(k) >= u, given cdf(below) < u, by
+// bisection
+static double quantile_bisect(StatsCdf cdf, const void *c, double u,
+                              double below, double above) {
+  while (above - below > 1) {
+    double mid = floor(below + 0.5 * (above - below));
+    if (cdf(c, mid) >= u) {
+      above = mid;
+    } else {
+      below = mid;
+    }
+  }
+  return above;
+}
+
+// Steps of 1, 2, 4, ... away from the guess bracket the answer, so a guess
+// d off costs O(log d) evaluations of the cdf and a good one two
+double stats_discrete_quantile(StatsCdf cdf, const void *c, double u,
+                               double guess, double lo, double hi) {
+  if (isnan(u) || u < 0 || u > 1) {
+    return NAN;
+  }
+  if (u == 0 || u == 1) {
+    return u == 0 ? lo : hi;
+  }
+
+  double k = floor(guess + 0.5), step = 1;
+  k = k >= lo ? k : lo;
+  k = k <= hi ? k : hi;
+  if (cdf(c, k) >= u) {
+    while (k > lo) {
+      double below = k - step > lo ? k - step : lo;
+      if (cdf(c, below) < u) {
+        return quantile_bisect(cdf, c, u, below, k);
+      }
+      k = below;
+      step *= 2;
+    }
+    return lo;
+  }
+
+  while (k < hi) {
+    double above = k + step < hi ? k + step : hi;
+    if (cdf(c, above) >= u) {
+      return quantile_bisect(cdf, c, u, k, above);
+    }
+    k = above;
+    step *= 2;
+  }
+  return hi;
+}
+
+// Log PMF
+// The pmfs below take exp of these in double and round to float once
+
+static double log_binomial_pmf(binomial_t *bin, uint32_t k) {
+  return stats_log_binomial_raw(k, bin->n, bin->p, 1 - (double)bin->p);
+}
+
+static double log_hypergeometric_pmf(hypergeometric_t *hyp, uint32_t k) {
+  double N = hyp->N, K = hyp->K, n = hyp->n;
+  if (k > K || k > n || n - k > N - K || n > N) {
+    return -INFINITY;
+  }
+
+  return log_hypergeometric_raw(k, N, K, n);
+}
+
+// r == 0 is the point mass at 0
+static double log_negative_binomial_pmf(negative_binomial_t *neg,
+                                        uint32_t k) {
+  double r = neg->r;
+  if (neg->r == 0) {
+    return k == 0 ? 0 : -INFINITY;
+  }
+  return log(r / (r + k)) +
+         stats_log_binomial_raw(r, r + k, neg->p, 1 - (double)neg->p);
 }
 
+float binomial_logpmf(binomial_t *bin, uint32_t k) {
+  return log_binomial_pmf(bin, k);
+}
+
+float hypergeometric_logpmf(hypergeometric_t *hyp, uint32_t k) {
+  return log_hypergeometric_pmf(hyp, k);
+}
+
+float negative_binomial_logpmf(negative_binomial_t *neg, uint32_t k) {
+  return log_negative_binomial_pmf(neg, k);
+}
+
+float poisson_logpmf(poisson_t *poi, uint32_t k) {
+  return stats_log_poisson_raw(k, poi->lambda);
+}
+
+// PMF
+
 float binomial_pmf(binomial_t *bin, uint32_t k) {
-  return binomial_coefficient(bin->n, k) * pow(bin->p, k) *
-         pow(1 - bin->p, bin->n - k);
+  LAMS_PROF_BEGIN();
+  float result = exp(log_binomial_pmf(bin, k));
+  LAMS_PROF_END(binomial_pmf, 0);
+  return result;
 }
 
 float bernoulli_pmf(bernoulli_t *ber, uint32_t k) {
-  return k == 0 ? 1 - ber->p : ber->p;
+  LAMS_PROF_BEGIN();
+  float result = k == 0 ? 1 - ber->p : ber->p;
+  LAMS_PROF_END(bernoulli_pmf, 0);
+  return result;
 }
 
 float discrete_uniform_pmf(discrete_uniform_t *dis, uint32_t k) {
-  return k >= dis->a && k <= dis->b ? 1 / (float)(dis->b - dis->a + 1) : 0;
+  LAMS_PROF_BEGIN();
+  float result =
+      k >= dis->a && k <= dis->b ? 1 / (float)(dis->b - dis->a + 1) : 0;
+  LAMS_PROF_END(discrete_uniform_pmf, 0);
+  return result;
 }
 
 float geometric_pmf(geometric_t *geo, uint32_t k) {
-  return pow(1 - geo->p, k) * geo->p;
+  LAMS_PROF_BEGIN();
+  float result = pow(1 - geo->p, k) * geo->p;
+  LAMS_PROF_END(geometric_pmf, 0);
+  return result;
 }
 
 float hypergeometric_pmf(hypergeometric_t *hyp, uint32_t k) {
-  return binomial_coefficient(hyp->K, k) *
-         binomial_coefficient(hyp->N - hyp->K, hyp->n - k) /
-         binomial_coefficient(hyp->N, hyp->n);
+  LAMS_PROF_BEGIN();
+  float result = exp(log_hypergeometric_pmf(hyp, k));
+  LAMS_PROF_END(hypergeometric_pmf, 0);
+  return result;
 }
 
 float negative_binomial_pmf(negative_binomial_t *neg, uint32_t k) {
-  return binomial_coefficient(k + neg->r - 1, k) * pow(neg->p, neg->r) *
-         pow(1 - neg->p, k);
-}
-
-float factorial(uint32_t n) {
-  float result = 1;
-  for (int i = 1; i <= n; i++) {
-    result *= i;
-  }
+  LAMS_PROF_BEGIN();
+  float result = exp(log_negative_binomial_pmf(neg, k));
+  LAMS_PROF_END(negative_binomial_pmf, 0);
   return result;
 }
 
 float poisson_pmf(poisson_t *poi, uint32_t k) {
-  return pow(poi->lambda, k) * exp(-poi->lambda) / factorial(k);
+  LAMS_PROF_BEGIN();
+  float result = exp(stats_log_poisson_raw(k, poi->lambda));
+  LAMS_PROF_END(poisson_pmf, 0);
+  return result;
 }
 
 float continuous_uniform_pmf(continuous_uniform_t *uni, float x) {
-  return x >= uni->a && x <= uni->b ? 1 / (uni->b - uni->a) : 0;
+  LAMS_PROF_BEGIN();
+  float result = x >= uni->a && x <= uni->b ? 1 / (uni->b - uni->a) : 0;
+  LAMS_PROF_END(continuous_uniform_pmf, 0);
+  return result;
 }
 
 float normal_pmf(normal_t *nor, float x) {
-  return exp(-pow(x - nor->mu, 2) / (2 * pow(nor->sigma, 2))) /
-         (sqrt(2 * M_PI) * nor->sigma);
+  LAMS_PROF_BEGIN();
+  float result = exp(-pow(x - nor->mu, 2) / (2 * pow(nor->sigma, 2))) /
+                 (sqrt(2 * M_PI) * nor->sigma);
+  LAMS_PROF_END(normal_pmf, 0);
+  return result;
 }
 
 // CDF
 
 float binomial_cdf(binomial_t *bin, uint32_t k) {
-  float result = 0;
-  for (int i = 0; i <= k; i++) {
-    result += binomial_pmf(bin, i);
-  }
+  LAMS_PROF_BEGIN();
+  double p = bin->p, q = 1 - p;
+  float result = k < bin->n ? stats_incomplete_beta(bin->n - k, k + 1.0, q, p)
+                            : 1;
+  LAMS_PROF_END(binomial_cdf, 0);
   return result;
 }
 
 float bernoulli_cdf(bernoulli_t *ber, uint32_t k) {
-  return k == 0 ? 1 - ber->p : 1;
+  LAMS_PROF_BEGIN();
+  float result = k == 0 ? 1 - ber->p : 1;
+  LAMS_PROF_END(bernoulli_cdf, 0);
+  return result;
 }
 
 float discrete_uniform_cdf(discrete_uniform_t *dis, uint32_t k) {
-  return k >= dis->b   ? 1
-         : k >= dis->a ? (k - dis->a + 1) / (float)(dis->b - dis->a + 1)
-                       : 0;
+  LAMS_PROF_BEGIN();
+  float result = k >= dis->b ? 1
+                 : k >= dis->a
+                     ? (k - dis->a + 1) / (float)(dis->b - dis->a + 1)
+                     : 0;
+  LAMS_PROF_END(discrete_uniform_cdf, 0);
+  return result;
 }
 
 float geometric_cdf(geometric_t *geo, uint32_t k) {
-  return 1 - pow(1 - geo->p, k + 1);
+  LAMS_PROF_BEGIN();
+  float result = 1 - pow(1 - geo->p, k + 1);
+  LAMS_PROF_END(geometric_cdf, 0);
+  return result;
 }
 
 float hypergeometric_cdf(hypergeometric_t *hyp, uint32_t k) {
-  float result = 0;
-  for (int i = 0; i <= k; i++) {
-    result += hypergeometric_pmf(hyp, i);
-  }
+  LAMS_PROF_BEGIN();
+  float result = stats_hypergeometric_tail(k, hyp->N, hyp->K, hyp->n, 0);
+  LAMS_PROF_END(hypergeometric_cdf, 0);
   return result;
 }
 
 float negative_binomial_cdf(negative_binomial_t *neg, uint32_t k) {
-  float result = 0;
-  for (int i = 0; i <= k; i++) {
-    result += negative_binomial_pmf(neg, i);
-  }
+  LAMS_PROF_BEGIN();
+  double p = neg->p, q = 1 - p;
+  float result = neg->r > 0 ? stats_incomplete_beta(neg->r, k + 1.0, p, q) : 1;
+  LAMS_PROF_END(negative_binomial_cdf, 0);
   return result;
 }
 
 float poisson_cdf(poisson_t *poi, uint32_t k) {
-  float result = 0;
-  for (int i = 0; i <= k; i++) {
-    result += poisson_pmf(poi, i);
-  }
+  LAMS_PROF_BEGIN();
+  float result = stats_incomplete_gamma_q(k + 1.0, poi->lambda);
+  LAMS_PROF_END(poisson_cdf, 0);
   return result;
 }
 
 float continuous_uniform_cdf(continuous_uniform_t *uni, float x) {
-  return x >= uni->b ? 1 : x >= uni->a ? (x - uni->a) / (uni->b - uni->a) : 0;
+  LAMS_PROF_BEGIN();
+  float result = x >= uni->b   ? 1
+                 : x >= uni->a ? (x - uni->a) / (uni->b - uni->a)
+                               : 0;
+  LAMS_PROF_END(continuous_uniform_cdf, 0);
+  return result;
 }
 
 float normal_cdf(normal_t *nor, float x) {
-  return 0.5 * (1 + erf((x - nor->mu) / (nor->sigma * sqrt(2))));
+  LAMS_PROF_BEGIN();
+  float result = 0.5 * (1 + erf((x - nor->mu) / (nor->sigma * sqrt(2))));
+  LAMS_PROF_END(normal_cdf, 0);
+  return result;
+}
+
+// Survival functions
+
+float binomial_sf(binomial_t *bin, uint32_t k) {
+  LAMS_PROF_BEGIN();
+  double p = bin->p, q = 1 - p;
+  float result = k < bin->n ? stats_incomplete_beta(k + 1.0, bin->n - k, p, q)
+                            : 0;
+  LAMS_PROF_END(binomial_sf, 0);
+  return result;
+}
+
+float hypergeometric_sf(hypergeometric_t *hyp, uint32_t k) {
+  LAMS_PROF_BEGIN();
+  float result = stats_hypergeometric_tail(k, hyp->N, hyp->K, hyp->n, 1);
+  LAMS_PROF_END(hypergeometric_sf, 0);
+  return result;
+}
+
+float negative_binomial_sf(negative_binomial_t *neg, uint32_t k) {
+  LAMS_PROF_BEGIN();
+  double p = neg->p, q = 1 - p;
+  float result = neg->r > 0 ? stats_incomplete_beta(k + 1.0, neg->r, q, p) : 0;
+  LAMS_PROF_END(negative_binomial_sf, 0);
+  return result;
+}
+
+float poisson_sf(poisson_t *poi, uint32_t k) {
+  LAMS_PROF_BEGIN();
+  float result = stats_incomplete_gamma_p(k + 1.0, poi->lambda);
+  LAMS_PROF_END(poisson_sf, 0);
+  return result;
+}
+
+// Quantiles
+// Through the batch kernels, one entry at a time
+
+float binomial_quantile(binomial_t *bin, float u) {
+  float result;
+  binomial_quantile_batch(bin, &u, &result, 1);
+  return result;
+}
+
+float bernoulli_quantile(bernoulli_t *ber, float u) {
+  float result;
+  bernoulli_quantile_batch(ber, &u, &result, 1);
+  return result;
+}
+
+float discrete_uniform_quantile(discrete_uniform_t *dis, float u) {
+  float result;
+  discrete_uniform_quantile_batch(dis, &u, &result, 1);
+  return result;
+}
+
+float geometric_quantile(geometric_t *geo, float u) {
+  float result;
+  geometric_quantile_batch(geo, &u, &result, 1);
+  return result;
+}
+
+float hypergeometric_quantile(hypergeometric_t *hyp, float u) {
+  float result;
+  hypergeometric_quantile_batch(hyp, &u, &result, 1);
+  return result;
+}
+
+float negative_binomial_quantile(negative_binomial_t *neg, float u) {
+  float result;
+  negative_binomial_quantile_batch(neg, &u, &result, 1);
+  return result;
+}
+
+float poisson_quantile(poisson_t *poi, float u) {
+  float result;
+  poisson_quantile_batch(poi, &u, &result, 1);
+  return result;
+}
+
+float continuous_uniform_quantile(continuous_uniform_t *uni, float u) {
+  float result;
+  continuous_uniform_quantile_batch(uni, &u, &result, 1);
+  return result;
+}
+
+float normal_quantile(normal_t *nor, float u) {
+  float result;
+  normal_quantile_batch(nor, &u, &result, 1);
+  return result;
 }
@@ -68,73 +68,255 @@ typedef struct {
 float binomial_mean(binomial_t *b);
 float binomial_variance(binomial_t *b);
 float binomial_skewness(binomial_t *b);
-float binomial_stddev(binomial_t *b);
+float binomial_std_dev(binomial_t *b);
 float binomial_median(binomial_t *b);
 float binomial_pmf(binomial_t *b, uint32_t k);
 float binomial_cdf(binomial_t *b, uint32_t k);
+float binomial_sf(binomial_t *b, uint32_t k);
+float binomial_logpmf(binomial_t *b, uint32_t k);
+float binomial_quantile(binomial_t *b, float u);
 
 float bernoulli_mean(bernoulli_t *b);
 float bernoulli_variance(bernoulli_t *b);
-float bernoulli_stddev(bernoulli_t *b);
+float bernoulli_std_dev(bernoulli_t *b);
 float bernoulli_skewness(bernoulli_t *b);
 float bernoulli_median(bernoulli_t *b);
 float bernoulli_pmf(bernoulli_t *b, uint32_t k);
 float bernoulli_cdf(bernoulli_t *b, uint32_t k);
+float bernoulli_quantile(bernoulli_t *b, float u);
 
 float discrete_uniform_mean(discrete_uniform_t *d);
 float discrete_uniform_variance(discrete_uniform_t *d);
-float discrete_uniform_stddev(discrete_uniform_t *d);
+float discrete_uniform_std_dev(discrete_uniform_t *d);
 float discrete_uniform_skewness(discrete_uniform_t *d);
 float discrete_uniform_median(discrete_uniform_t *d);
 float discrete_uniform_pmf(discrete_uniform_t *d, uint32_t k);
 float discrete_uniform_cdf(discrete_uniform_t *d, uint32_t k);
+float discrete_uniform_quantile(discrete_uniform_t *d, float u);
 
 float geometric_mean(geometric_t *g);
 float geometric_variance(geometric_t *g);
-float geometric_stddev(geometric_t *g);
+float geometric_std_dev(geometric_t *g);
 float geometric_skewness(geometric_t *g);
 float geometric_median(geometric_t *g);
 float geometric_pmf(geometric_t *g, uint32_t k);
 float geometric_cdf(geometric_t *g, uint32_t k);
+float geometric_quantile(geometric_t *g, float u);
 
 float hypergeometric_mean(hypergeometric_t *h);
 float hypergeometric_variance(hypergeometric_t *h);
-float hypergeometric_stddev(hypergeometric_t *h);
+float hypergeometric_std_dev(hypergeometric_t *h);
 float hypergeometric_skewness(hypergeometric_t *h);
 float hypergeometric_median(hypergeometric_t *h);
 float hypergeometric_pmf(hypergeometric_t *h, uint32_t k);
 float hypergeometric_cdf(hypergeometric_t *h, uint32_t k);
+float hypergeometric_sf(hypergeometric_t *h, uint32_t k);
+float hypergeometric_logpmf(hypergeometric_t *h, uint32_t k);
+float hypergeometric_quantile(hypergeometric_t *h, float u);
 
-float negativebinomal_mean(negative_binomial_t *n);
-float negativebinomal_variance(negative_binomial_t *n);
-float negativebinomal_stddev(negative_binomial_t *n);
-float negativebinomal_skewness(negative_binomial_t *n);
-float negativebinomal_median(negative_binomial_t *n);
-float negativebinomal_pmf(negative_binomial_t *n, uint32_t k);
-float negativebinomal_cdf(negative_binomial_t *n, uint32_t k);
+float negative_binomial_mean(negative_binomial_t *n);
+float negative_binomial_variance(negative_binomial_t *n);
+float negative_binomial_std_dev(negative_binomial_t *n);
+float negative_binomial_skewness(negative_binomial_t *n);
+float negative_binomial_median(negative_binomial_t *n);
+float negative_binomial_pmf(negative_binomial_t *n, uint32_t k);
+float negative_binomial_cdf(negative_binomial_t *n, uint32_t k);
+float negative_binomial_sf(negative_binomial_t *n, uint32_t k);
+float negative_binomial_logpmf(negative_binomial_t *n, uint32_t k);
+float negative_binomial_quantile(negative_binomial_t *n, float u);
 
 float poisson_mean(poisson_t *p);
 float poisson_variance(poisson_t *p);
-float poisson_stddev(poisson_t *p);
+float poisson_std_dev(poisson_t *p);
 float poisson_skewness(poisson_t *p);
 float poisson_median(poisson_t *p);
 float poisson_pmf(poisson_t *p, uint32_t k);
 float poisson_cdf(poisson_t *p, uint32_t k);
+float poisson_sf(poisson_t *p, uint32_t k);
+float poisson_logpmf(poisson_t *p, uint32_t k);
+float poisson_quantile(poisson_t *p, float u);
 
 float continuous_uniform_mean(continuous_uniform_t *c);
 float continuous_uniform_variance(continuous_uniform_t *c);
-float continuous_uniform_stddev(continuous_uniform_t *c);
+float continuous_uniform_std_dev(continuous_uniform_t *c);
 float continuous_uniform_skewness(continuous_uniform_t *c);
 float continuous_uniform_median(continuous_uniform_t *c);
 float continuous_uniform_pmf(continuous_uniform_t *c, float k);
 float continuous_uniform_cdf(continuous_uniform_t *c, float k);
+float continuous_uniform_quantile(continuous_uniform_t *c, float u);
 
 float normal_mean(normal_t *n);
 float normal_variance(normal_t *n);
-float normal_stddev(normal_t *n);
+float normal_std_dev(normal_t *n);
 float normal_skewness(normal_t *n);
 float normal_median(normal_t *n);
 float normal_pmf(normal_t *n, float k);
 float normal_cdf(normal_t *n, float k);
+float normal_quantile(normal_t *n, float u);
+
+/*
+ * Log-domain building blocks
+ *
+ * The binomial, hypergeometric, negative binomial and Poisson pmfs are
+ * evaluated in O(1) as exp of their *_logpmf, built from Stirling-series
+ * errors and deviance terms (Loader's saddle point form) instead of
+ * products of binomial coefficients, so large counts neither overflow nor
+ * lose digits to cancelling lgamma terms. The pieces take real arguments
+ * and double precision for use elsewhere.
+ *
+ */
+
+double stats_stirling_error(double n);
+double stats_bd0(double x, double np);
+double stats_log_binomial_raw(double x, double n, double p, double q);
+double stats_log_poisson_raw(double x, double lambda);
+
+/*
+ * Tail probabilities
+ *
+ * The binomial, negative binomial and Poisson cdfs and survival functions
+ * (*_sf, P(X > k)) are regularized incomplete beta and gamma functions,
+ * evaluated by continued fractions whose length grows with the square root
+ * of the counts rather than with k. Each tail is computed directly, so
+ * probabilities far below machine epsilon keep their relative accuracy.
+ * The hypergeometric tails are summed outwards from k on the far side of
+ * the mode and stop once the terms no longer count.
+ *
+ * stats_incomplete_beta(a, b, x, y) is I_x(a, b) with y = 1 - x given
+ * separately, stats_incomplete_gamma_p and _q are P(a, x) and Q(a, x).
+ *
+ */
+
+double stats_incomplete_beta(double a, double b, double x, double y);
+double stats_incomplete_gamma_p(double a, double x);
+double stats_incomplete_gamma_q(double a, double x);
+double stats_hypergeometric_tail(double k, double N, double K, double n,
+                                 int upper);
+
+/*
+ * Quantiles
+ *
+ * *_quantile(u) is the smallest k (or x) with cdf >= u, NAN for u outside
+ * [0, 1]. The normal quantile is a rational approximation refined by one
+ * Halley step to double precision. Discrete quantiles start from the
+ * Cornish-Fisher expansion of mean, standard deviation and skewness, which
+ * lands within a step or two of the answer, and evaluate the tail
+ * probabilities above in steps of 1, 2, 4, ... until the answer is
+ * bracketed, then bisect; no query walks the support from 0.
+ *
+ * stats_discrete_quantile searches any cdf(c, k) over [lo, hi] from guess.
+ *
+ */
+
+typedef double (*StatsCdf)(const void *c, double k);
+
+double stats_normal_quantile(double p);
+double stats_cornish_fisher(double u, double mean, double sd,
+                            double skewness);
+double stats_discrete_quantile(StatsCdf cdf, const void *c, double u,
+                               double guess, double lo, double hi);
+
+/*
+ * Tables
+ *
+ * *_pmf_table fills pmf[i] = P(X = first + i) and cdf[i] = P(X <= first + i)
+ * in O(size): the pmf is evaluated once at the mode and every other entry
+ * is one multiply by the ratio of successive pmfs, walking out of the mode
+ * in both directions so the products never start from an underflowed tail.
+ *
+ * With tolerance 0 the table covers a bounded support whole and an
+ * unbounded one up to where the pmf underflows. A positive tolerance drops
+ * the two tails once each holds less than tolerance / 2, leaving a window
+ * around the mode, and the cdf still counts the mass cut off below it.
+ *
+ */
+
+typedef struct {
+  long first;
+  long size;
+  double *pmf;
+  double *cdf;
+} pmf_table_t;
+
+pmf_table_t *binomial_pmf_table(binomial_t *b, double tolerance);
+pmf_table_t *hypergeometric_pmf_table(hypergeometric_t *h, double tolerance);
+pmf_table_t *negative_binomial_pmf_table(negative_binomial_t *n,
+                                         double tolerance);
+pmf_table_t *poisson_pmf_table(poisson_t *p, double tolerance);
+void pmf_table_free(pmf_table_t *t);
+
+/*
+ * Batch evaluation
+ *
+ * out[i] is the function at k[i] (or x[i]) for n entries of contiguous
+ * arrays. Constants of the parameters are computed once per call, log pmfs
+ * use the building blocks above and vmath_exp in blocks of doubles, and
+ * long arrays are split across threads. Discrete pmfs whose inputs span a
+ * range much smaller than n are looked up in a table, and so are their
+ * cdfs, which otherwise go through the tail probabilities above one entry
+ * at a time. Quantiles take u in [0, 1] and run the searches above, each
+ * entry on its own.
+ *
+ */
+
+void binomial_pmf_batch(binomial_t *b, const uint32_t *k, float *out, long n);
+void binomial_cdf_batch(binomial_t *b, const uint32_t *k, float *out, long n);
+void binomial_quantile_batch(binomial_t *b, const float *u, float *out,
+                             long n);
+
+void bernoulli_pmf_batch(bernoulli_t *b, const uint32_t *k, float *out,
+                         long n);
+void bernoulli_cdf_batch(bernoulli_t *b, const uint32_t *k, float *out,
+                         long n);
+void bernoulli_quantile_batch(bernoulli_t *b, const float *u, float *out,
+                              long n);
+
+void discrete_uniform_pmf_batch(discrete_uniform_t *d, const uint32_t *k,
+                                float *out, long n);
+void discrete_uniform_cdf_batch(discrete_uniform_t *d, const uint32_t *k,
+                                float *out, long n);
+void discrete_uniform_quantile_batch(discrete_uniform_t *d, const float *u,
+                                     float *out, long n);
+
+void geometric_pmf_batch(geometric_t *g, const uint32_t *k, float *out,
+                         long n);
+void geometric_cdf_batch(geometric_t *g, const uint32_t *k, float *out,
+                         long n);
+void geometric_quantile_batch(geometric_t *g, const float *u, float *out,
+                              long n);
+
+void hypergeometric_pmf_batch(hypergeometric_t *h, const uint32_t *k,
+                              float *out, long n);
+void hypergeometric_cdf_batch(hypergeometric_t *h, const uint32_t *k,
+                              float *out, long n);
+void hypergeometric_quantile_batch(hypergeometric_t *h, const float *u,
+                                   float *out, long n);
+
+void negative_binomial_pmf_batch(negative_binomial_t *n, const uint32_t *k,
+                                 float *out, long count);
+void negative_binomial_cdf_batch(negative_binomial_t *n, const uint32_t *k,
+                                 float *out, long count);
+void negative_binomial_quantile_batch(negative_binomial_t *n, const float *u,
+                                      float *out, long count);
+
+void poisson_pmf_batch(poisson_t *p, const uint32_t *k, float *out, long n);
+void poisson_cdf_batch(poisson_t *p, const uint32_t *k, float *out, long n);
+void poisson_quantile_batch(poisson_t *p, const float *u, float *out,
+                            long n);
+
+void continuous_uniform_pmf_batch(continuous_uniform_t *c, const float *x,
+                                  float *out, long n);
+void continuous_uniform_logpdf_batch(continuous_uniform_t *c, const float *x,
+                                     float *out, long n);
+void continuous_uniform_cdf_batch(continuous_uniform_t *c, const float *x,
+                                  float *out, long n);
+void continuous_uniform_quantile_batch(continuous_uniform_t *c, const float *u,
+                                       float *out, long n);
+
+void normal_pmf_batch(normal_t *n, const float *x, float *out, long count);
+void normal_logpdf_batch(normal_t *n, const float *x, float *out, long count);
+void normal_cdf_batch(normal_t *n, const float *x, float *out, long count);
+void normal_quantile_batch(normal_t *n, const float *u, float *out,
+                           long count);
 
 #endif
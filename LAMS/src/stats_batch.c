@@ -0,0 +1,667 @@
+#include "instrument.h"
+#include "parallel.h"
+#include "stats.h"
+#include "vmath.h"
+
+// Entries converted to double and handed to vmath at a time
+#define CHUNK 256
+
+// Fills y with a function of x for n entries, c holds the constants
+typedef void (*ChunkFn)(const void *c, const double *x, double *y, int n);
+
+typedef struct {
+  ChunkFn fn;
+  const void *c;
+  int take_exp; // fn gives logarithms
+  const uint32_t *k;
+  const float *x;
+  float *out;
+  const double *table;
+  long table_size;
+} BatchJob;
+
+static double xlog(double x, double log_y) { return x == 0 ? 0 : x * log_y; }
+
+
+// Runner
+// -----------------------------------------------------------------------------
+static void batch_rows(long begin, long end, void *ctx) {
+  BatchJob *job = ctx;
+  double x[CHUNK], y[CHUNK];
+
+  if (job->table != NULL) {
+    long last = job->table_size - 1;
+    for (long i = begin; i < end; i++) {
+      long k = job->k[i];
+      job->out[i] = job->table[k < last ? k : last];
+    }
+    return;
+  }
+
+  for (long start = begin; start < end; start += CHUNK) {
+    int m = end - start < CHUNK ? end - start : CHUNK;
+    for (int i = 0; i < m; i++) {
+      x[i] = job->k != NULL ? job->k[start + i] : job->x[start + i];
+    }
+    job->fn(job->c, x, y, m);
+    if (job->take_exp) {
+      vmath_exp(y, y, m);
+    }
+    for (int i = 0; i < m; i++) {
+      job->out[start + i] = y[i];
+    }
+  }
+}
+
+static void run(BatchJob *job, long n) {
+  lams_parallel_for(n, lams_parallel_grain(1), batch_rows, job);
+}
+
+static double max_rows(long begin, long end, void *ctx) {
+  const uint32_t *k = ctx;
+  uint32_t max = 0;
+
+  for (long i = begin; i < end; i++) {
+    max = k[i] > max ? k[i] : max;
+  }
+  return max;
+}
+
+static double max_of(double a, double b) { return a > b ? a : b; }
+
+static long max_k(const uint32_t *k, long n) {
+  return lams_parallel_reduce(n, lams_parallel_grain(1), 0.0, max_rows,
+                              max_of, (void *)k);
+}
+
+// pmf (or its running sum) of 0 .. size - 1
+static double *table(ChunkFn log_pmf, const void *c, long size,
+                     int cumulative) {
+  double *t = malloc(size * sizeof(double));
+  double x[CHUNK], sum = 0.0;
+
+  if (t == NULL) {
+    return NULL;
+  }
+
+  for (long start = 0; start < size; start += CHUNK) {
+    int m = size - start < CHUNK ? size - start : CHUNK;
+    for (int i = 0; i < m; i++) {
+      x[i] = start + i;
+    }
+    log_pmf(c, x, t + start, m);
+    vmath_exp(t + start, t + start, m);
+  }
+  for (long i = 0; cumulative && i < size; i++) {
+    sum += t[i];
+    t[i] = sum < 1.0 ? sum : 1.0;
+  }
+  return t;
+}
+
+// Table size for inputs up to their largest, a finite support ends with a
+// zero pmf entry that stands for everything past it
+static long table_size(long support, const uint32_t *k, long n) {
+  long size = n > 0 ? max_k(k, n) + 1 : 0;
+  return support >= 0 && support + 2 < size ? support + 2 : size;
+}
+
+// Inputs drawn from a small range are looked up in a table of the pmf,
+// others get their own log pmf
+static void discrete_pmf(ChunkFn log_pmf, const void *c, long support,
+                         const uint32_t *k, float *out, long n) {
+  BatchJob job = {log_pmf, c, 1, k, NULL, out, NULL, 0};
+  long size = table_size(support, k, n);
+
+  double *t = size < n / 4 ? table(log_pmf, c, size, 0) : NULL;
+  job.table = t;
+  job.table_size = size;
+  run(&job, n);
+  free(t);
+}
+
+// The same for cdfs, whose table is the running sum of the pmf and whose
+// single entries are tail probabilities
+static void discrete_cdf(ChunkFn log_pmf, ChunkFn cdf, const void *c,
+                         long support, const uint32_t *k, float *out,
+                         long n) {
+  BatchJob job = {cdf, c, 0, k, NULL, out, NULL, 0};
+  long size = table_size(support, k, n);
+
+  double *t = size < n / 4 ? table(log_pmf, c, size, 1) : NULL;
+  job.table = t;
+  job.table_size = size;
+  run(&job, n);
+  free(t);
+}
+
+static void continuous(ChunkFn fn, const void *c, int take_exp,
+                       const float *x, float *out, long n) {
+  BatchJob job = {fn, c, take_exp, NULL, x, out, NULL, 0};
+  run(&job, n);
+}
+
+static void discrete(ChunkFn fn, const void *c, int take_exp,
+                     const uint32_t *k, float *out, long n) {
+  BatchJob job = {fn, c, take_exp, k, NULL, out, NULL, 0};
+  run(&job, n);
+}
+
+// Kernels
+// -----------------------------------------------------------------------------
+typedef struct {
+  double n, p, q;
+} BinomialConst;
+
+static void binomial_log_pmf(const void *c, const double *k, double *y,
+                             int m) {
+  const BinomialConst *b = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = stats_log_binomial_raw(k[i], b->n, b->p, b->q);
+  }
+}
+
+static void binomial_cdf_chunk(const void *c, const double *k, double *y,
+                               int m) {
+  const BinomialConst *b = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = k[i] < b->n ? stats_incomplete_beta(b->n - k[i], k[i] + 1, b->q,
+                                               b->p)
+                       : 1;
+  }
+}
+
+// The binomial term of the whole population is the same for every k
+typedef struct {
+  double N, K, n, p, q, log_norm;
+} HypergeometricConst;
+
+static void hypergeometric_log_pmf(const void *c, const double *k, double *y,
+                                   int m) {
+  const HypergeometricConst *h = c;
+  for (int i = 0; i < m; i++) {
+    int inside = k[i] <= h->K && k[i] <= h->n && h->n - k[i] <= h->N - h->K;
+    y[i] = inside ? stats_log_binomial_raw(k[i], h->K, h->p, h->q) +
+                        stats_log_binomial_raw(h->n - k[i], h->N - h->K,
+                                               h->p, h->q) -
+                        h->log_norm
+                  : -INFINITY;
+  }
+}
+
+static void hypergeometric_cdf_chunk(const void *c, const double *k,
+                                     double *y, int m) {
+  const HypergeometricConst *h = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = stats_hypergeometric_tail(k[i], h->N, h->K, h->n, 0);
+  }
+}
+
+typedef struct {
+  double r, p, q;
+} NegativeBinomialConst;
+
+static void negative_binomial_log_pmf(const void *c, const double *k,
+                                      double *y, int m) {
+  const NegativeBinomialConst *nb = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = nb->r == 0 ? (k[i] == 0 ? 0 : -INFINITY)
+                      : log(nb->r / (nb->r + k[i])) +
+                            stats_log_binomial_raw(nb->r, nb->r + k[i], nb->p,
+                                                   nb->q);
+  }
+}
+
+static void negative_binomial_cdf_chunk(const void *c, const double *k,
+                                        double *y, int m) {
+  const NegativeBinomialConst *nb = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = nb->r > 0 ? stats_incomplete_beta(nb->r, k[i] + 1, nb->p, nb->q)
+                     : 1;
+  }
+}
+
+typedef struct {
+  double lambda;
+} PoissonConst;
+
+static void poisson_log_pmf(const void *c, const double *k, double *y,
+                            int m) {
+  const PoissonConst *p = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = stats_log_poisson_raw(k[i], p->lambda);
+  }
+}
+
+static void poisson_cdf_chunk(const void *c, const double *k, double *y,
+                              int m) {
+  const PoissonConst *p = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = stats_incomplete_gamma_q(k[i] + 1, p->lambda);
+  }
+}
+
+typedef struct {
+  double p, log_p, log_q;
+} GeometricConst;
+
+static void geometric_log_pmf(const void *c, const double *k, double *y,
+                              int m) {
+  const GeometricConst *g = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = g->log_p + xlog(k[i], g->log_q);
+  }
+}
+
+static void geometric_cdf_chunk(const void *c, const double *k, double *y,
+                                int m) {
+  const GeometricConst *g = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = (k[i] + 1) * g->log_q;
+  }
+  vmath_expm1(y, y, m);
+  for (int i = 0; i < m; i++) {
+    y[i] = -y[i];
+  }
+}
+
+typedef struct {
+  double p, q;
+} BernoulliConst;
+
+static void bernoulli_pmf_chunk(const void *c, const double *k, double *y,
+                                int m) {
+  const BernoulliConst *b = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = k[i] == 0 ? b->q : b->p;
+  }
+}
+
+static void bernoulli_cdf_chunk(const void *c, const double *k, double *y,
+                                int m) {
+  const BernoulliConst *b = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = k[i] == 0 ? b->q : 1;
+  }
+}
+
+// Discrete uniform counts the values up to x (offset 1), continuous
+// measures the length (offset 0)
+typedef struct {
+  double lo, hi, offset, width;
+} UniformConst;
+
+static void uniform_pmf_chunk(const void *c, const double *x, double *y,
+                              int m) {
+  const UniformConst *u = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = x[i] >= u->lo && x[i] <= u->hi ? 1 / u->width : 0;
+  }
+}
+
+static void uniform_log_pdf_chunk(const void *c, const double *x, double *y,
+                                  int m) {
+  const UniformConst *u = c;
+  double log_density = -log(u->width);
+  for (int i = 0; i < m; i++) {
+    y[i] = x[i] >= u->lo && x[i] <= u->hi ? log_density : -INFINITY;
+  }
+}
+
+static void uniform_cdf_chunk(const void *c, const double *x, double *y,
+                              int m) {
+  const UniformConst *u = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = x[i] >= u->hi   ? 1
+           : x[i] >= u->lo ? (x[i] - u->lo + u->offset) / u->width
+                           : 0;
+  }
+}
+
+typedef struct {
+  double mu, inv_sigma, log_norm;
+} NormalConst;
+
+static void normal_log_pdf_chunk(const void *c, const double *x, double *y,
+                                 int m) {
+  const NormalConst *nc = c;
+  for (int i = 0; i < m; i++) {
+    double z = (x[i] - nc->mu) * nc->inv_sigma;
+    y[i] = -0.5 * z * z - nc->log_norm;
+  }
+}
+
+static void normal_cdf_chunk(const void *c, const double *x, double *y,
+                             int m) {
+  const NormalConst *nc = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = (x[i] - nc->mu) * nc->inv_sigma * M_SQRT1_2;
+  }
+  vmath_erf(y, y, m);
+  for (int i = 0; i < m; i++) {
+    y[i] = 0.5 * (1 + y[i]);
+  }
+}
+
+// A discrete law as the quantile search sees it, cdf is one of the chunk
+// kernels above
+typedef struct {
+  ChunkFn cdf;
+  const void *c;
+  double lo, hi, mean, sd, skewness;
+} QuantileConst;
+
+static double cdf_at(const void *ctx, double k) {
+  const QuantileConst *q = ctx;
+  double y;
+  q->cdf(q->c, &k, &y, 1);
+  return y;
+}
+
+static void discrete_quantile_chunk(const void *ctx, const double *u,
+                                    double *y, int m) {
+  const QuantileConst *q = ctx;
+  for (int i = 0; i < m; i++) {
+    double guess = stats_cornish_fisher(u[i], q->mean, q->sd, q->skewness);
+    y[i] = stats_discrete_quantile(cdf_at, q, u[i], guess, q->lo, q->hi);
+  }
+}
+
+// The geometric cdf inverts in closed form, the search only settles the
+// rounding
+static void geometric_quantile_chunk(const void *ctx, const double *u,
+                                     double *y, int m) {
+  const QuantileConst *q = ctx;
+  const GeometricConst *g = q->c;
+  for (int i = 0; i < m; i++) {
+    double guess = ceil(log1p(-u[i]) / g->log_q - 1);
+    y[i] = stats_discrete_quantile(cdf_at, q, u[i], guess, q->lo, q->hi);
+  }
+}
+
+static void uniform_quantile_chunk(const void *c, const double *u, double *y,
+                                   int m) {
+  const UniformConst *uc = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = u[i] >= 0 && u[i] <= 1 ? uc->lo + u[i] * uc->width : NAN;
+  }
+}
+
+static void normal_quantile_chunk(const void *c, const double *u, double *y,
+                                  int m) {
+  const NormalConst *nc = c;
+  for (int i = 0; i < m; i++) {
+    y[i] = nc->mu + stats_normal_quantile(u[i]) / nc->inv_sigma;
+  }
+}
+
+// Public functions
+// -----------------------------------------------------------------------------
+static HypergeometricConst hypergeometric_const(hypergeometric_t *hyp) {
+  double N = hyp->N, n = hyp->n, p = n / N, q = (N - n) / N;
+  return (HypergeometricConst){N, hyp->K, n, p, q,
+                              stats_log_binomial_raw(n, N, p, q)};
+}
+
+void binomial_pmf_batch(binomial_t *bin, const uint32_t *k, float *out,
+                        long n) {
+  LAMS_PROF_BEGIN();
+  BinomialConst c = {bin->n, bin->p, 1 - (double)bin->p};
+  discrete_pmf(binomial_log_pmf, &c, bin->n, k, out, n);
+  LAMS_PROF_END(binomial_pmf_batch, n);
+}
+
+void binomial_cdf_batch(binomial_t *bin, const uint32_t *k, float *out,
+                        long n) {
+  LAMS_PROF_BEGIN();
+  BinomialConst c = {bin->n, bin->p, 1 - (double)bin->p};
+  discrete_cdf(binomial_log_pmf, binomial_cdf_chunk, &c, bin->n, k, out,
+               n);
+  LAMS_PROF_END(binomial_cdf_batch, n);
+}
+
+void binomial_quantile_batch(binomial_t *bin, const float *u, float *out,
+                             long n) {
+  LAMS_PROF_BEGIN();
+  double p = bin->p, q = 1 - p, sd = sqrt(bin->n * p * q);
+  BinomialConst c = {bin->n, p, q};
+  QuantileConst qc = {binomial_cdf_chunk, &c, 0, bin->n, bin->n * p, sd,
+                      sd > 0 ? (q - p) / sd : 0};
+  continuous(discrete_quantile_chunk, &qc, 0, u, out, n);
+  LAMS_PROF_END(binomial_quantile_batch, n);
+}
+
+void bernoulli_pmf_batch(bernoulli_t *ber, const uint32_t *k, float *out,
+                         long n) {
+  LAMS_PROF_BEGIN();
+  BernoulliConst c = {ber->p, 1 - ber->p};
+  discrete(bernoulli_pmf_chunk, &c, 0, k, out, n);
+  LAMS_PROF_END(bernoulli_pmf_batch, n);
+}
+
+void bernoulli_cdf_batch(bernoulli_t *ber, const uint32_t *k, float *out,
+                         long n) {
+  LAMS_PROF_BEGIN();
+  BernoulliConst c = {ber->p, 1 - ber->p};
+  discrete(bernoulli_cdf_chunk, &c, 0, k, out, n);
+  LAMS_PROF_END(bernoulli_cdf_batch, n);
+}
+
+void bernoulli_quantile_batch(bernoulli_t *ber, const float *u, float *out,
+                              long n) {
+  LAMS_PROF_BEGIN();
+  double p = ber->p, q = 1 - p, sd = sqrt(p * q);
+  BernoulliConst c = {p, q};
+  QuantileConst qc = {bernoulli_cdf_chunk, &c, 0, 1, p, sd,
+                      sd > 0 ? (q - p) / sd : 0};
+  continuous(discrete_quantile_chunk, &qc, 0, u, out, n);
+  LAMS_PROF_END(bernoulli_quantile_batch, n);
+}
+
+void discrete_uniform_pmf_batch(discrete_uniform_t *dis, const uint32_t *k,
+                                float *out, long n) {
+  LAMS_PROF_BEGIN();
+  UniformConst c = {dis->a, dis->b, 1, (double)dis->b - dis->a + 1};
+  discrete(uniform_pmf_chunk, &c, 0, k, out, n);
+  LAMS_PROF_END(discrete_uniform_pmf_batch, n);
+}
+
+void discrete_uniform_cdf_batch(discrete_uniform_t *dis, const uint32_t *k,
+                                float *out, long n) {
+  LAMS_PROF_BEGIN();
+  UniformConst c = {dis->a, dis->b, 1, (double)dis->b - dis->a + 1};
+  discrete(uniform_cdf_chunk, &c, 0, k, out, n);
+  LAMS_PROF_END(discrete_uniform_cdf_batch, n);
+}
+
+void discrete_uniform_quantile_batch(discrete_uniform_t *dis, const float *u,
+                                     float *out, long n) {
+  LAMS_PROF_BEGIN();
+  double width = (double)dis->b - dis->a + 1;
+  UniformConst c = {dis->a, dis->b, 1, width};
+  QuantileConst qc = {uniform_cdf_chunk, &c, dis->a, dis->b,
+                      0.5 * ((double)dis->a + dis->b),
+                      sqrt((width * width - 1) / 12), 0};
+  continuous(discrete_quantile_chunk, &qc, 0, u, out, n);
+  LAMS_PROF_END(discrete_uniform_quantile_batch, n);
+}
+
+void geometric_pmf_batch(geometric_t *geo, const uint32_t *k, float *out,
+                         long n) {
+  LAMS_PROF_BEGIN();
+  GeometricConst c = {geo->p, log(geo->p), log1p(-geo->p)};
+  discrete(geometric_log_pmf, &c, 1, k, out, n);
+  LAMS_PROF_END(geometric_pmf_batch, n);
+}
+
+void geometric_cdf_batch(geometric_t *geo, const uint32_t *k, float *out,
+                         long n) {
+  LAMS_PROF_BEGIN();
+  GeometricConst c = {geo->p, log(geo->p), log1p(-geo->p)};
+  discrete(geometric_cdf_chunk, &c, 0, k, out, n);
+  LAMS_PROF_END(geometric_cdf_batch, n);
+}
+
+void geometric_quantile_batch(geometric_t *geo, const float *u, float *out,
+                              long n) {
+  LAMS_PROF_BEGIN();
+  GeometricConst c = {geo->p, log(geo->p), log1p(-geo->p)};
+  QuantileConst qc = {geometric_cdf_chunk, &c, 0, INFINITY, 0, 0, 0};
+  continuous(geometric_quantile_chunk, &qc, 0, u, out, n);
+  LAMS_PROF_END(geometric_quantile_batch, n);
+}
+
+void hypergeometric_pmf_batch(hypergeometric_t *hyp, const uint32_t *k,
+                              float *out, long n) {
+  LAMS_PROF_BEGIN();
+  HypergeometricConst c = hypergeometric_const(hyp);
+  long support = hyp->n < hyp->K ? hyp->n : hyp->K;
+  discrete_pmf(hypergeometric_log_pmf, &c, support, k, out, n);
+  LAMS_PROF_END(hypergeometric_pmf_batch, n);
+}
+
+void hypergeometric_cdf_batch(hypergeometric_t *hyp, const uint32_t *k,
+                              float *out, long n) {
+  LAMS_PROF_BEGIN();
+  HypergeometricConst c = hypergeometric_const(hyp);
+  long support = hyp->n < hyp->K ? hyp->n : hyp->K;
+  discrete_cdf(hypergeometric_log_pmf, hypergeometric_cdf_chunk, &c, support,
+               k, out, n);
+  LAMS_PROF_END(hypergeometric_cdf_batch, n);
+}
+
+void hypergeometric_quantile_batch(hypergeometric_t *hyp, const float *u,
+                                   float *out, long n) {
+  LAMS_PROF_BEGIN();
+  HypergeometricConst c = hypergeometric_const(hyp);
+  double N = c.N, K = c.K, m = c.n, mean = m * K / N;
+  double variance = N > 1 ? mean * (N - K) / N * (N - m) / (N - 1) : 0;
+  double spread = sqrt(m * K * (N - K) * (N - m)) * (N - 2);
+  double skewness = spread > 0 ? (N - 2 * K) * sqrt(N - 1) * (N - 2 * m) /
+                                     spread
+                               : 0;
+  QuantileConst qc = {hypergeometric_cdf_chunk, &c,
+                      m - (N - K) > 0 ? m - (N - K) : 0, m < K ? m : K,
+                      mean, sqrt(variance), skewness};
+  continuous(discrete_quantile_chunk, &qc, 0, u, out, n);
+  LAMS_PROF_END(hypergeometric_quantile_batch, n);
+}
+
+void negative_binomial_pmf_batch(negative_binomial_t *neg, const uint32_t *k,
+                                 float *out, long n) {
+  LAMS_PROF_BEGIN();
+  NegativeBinomialConst c = {neg->r, neg->p, 1 - (double)neg->p};
+  discrete_pmf(negative_binomial_log_pmf, &c, -1, k, out, n);
+  LAMS_PROF_END(negative_binomial_pmf_batch, n);
+}
+
+void negative_binomial_cdf_batch(negative_binomial_t *neg, const uint32_t *k,
+                                 float *out, long n) {
+  LAMS_PROF_BEGIN();
+  NegativeBinomialConst c = {neg->r, neg->p, 1 - (double)neg->p};
+  discrete_cdf(negative_binomial_log_pmf, negative_binomial_cdf_chunk, &c,
+               -1, k, out, n);
+  LAMS_PROF_END(negative_binomial_cdf_batch, n);
+}
+
+void negative_binomial_quantile_batch(negative_binomial_t *neg, const float *u,
+                                      float *out, long n) {
+  LAMS_PROF_BEGIN();
+  double r = neg->r, p = neg->p, q = 1 - p;
+  NegativeBinomialConst c = {r, p, q};
+  QuantileConst qc = {negative_binomial_cdf_chunk, &c, 0, INFINITY,
+                      r * q / p, sqrt(r * q) / p,
+                      r * q > 0 ? (1 + q) / sqrt(r * q) : 0};
+  continuous(discrete_quantile_chunk, &qc, 0, u, out, n);
+  LAMS_PROF_END(negative_binomial_quantile_batch, n);
+}
+
+void poisson_pmf_batch(poisson_t *poi, const uint32_t *k, float *out,
+                       long n) {
+  LAMS_PROF_BEGIN();
+  PoissonConst c = {poi->lambda};
+  discrete_pmf(poisson_log_pmf, &c, -1, k, out, n);
+  LAMS_PROF_END(poisson_pmf_batch, n);
+}
+
+void poisson_cdf_batch(poisson_t *poi, const uint32_t *k, float *out,
+                       long n) {
+  LAMS_PROF_BEGIN();
+  PoissonConst c = {poi->lambda};
+  discrete_cdf(poisson_log_pmf, poisson_cdf_chunk, &c, -1, k, out, n);
+  LAMS_PROF_END(poisson_cdf_batch, n);
+}
+
+void poisson_quantile_batch(poisson_t *poi, const float *u, float *out,
+                            long n) {
+  LAMS_PROF_BEGIN();
+  double lambda = poi->lambda;
+  PoissonConst c = {lambda};
+  QuantileConst qc = {poisson_cdf_chunk, &c, 0, INFINITY, lambda,
+                      sqrt(lambda), lambda > 0 ? 1 / sqrt(lambda) : 0};
+  continuous(discrete_quantile_chunk, &qc, 0, u, out, n);
+  LAMS_PROF_END(poisson_quantile_batch, n);
+}
+
+void continuous_uniform_pmf_batch(continuous_uniform_t *uni, const float *x,
+                                  float *out, long n) {
+  LAMS_PROF_BEGIN();
+  UniformConst c = {uni->a, uni->b, 0, (double)uni->b - uni->a};
+  continuous(uniform_pmf_chunk, &c, 0, x, out, n);
+  LAMS_PROF_END(continuous_uniform_pmf_batch, n);
+}
+
+void continuous_uniform_logpdf_batch(continuous_uniform_t *uni,
+                                     const float *x, float *out, long n) {
+  LAMS_PROF_BEGIN();
+  UniformConst c = {uni->a, uni->b, 0, (double)uni->b - uni->a};
+  continuous(uniform_log_pdf_chunk, &c, 0, x, out, n);
+  LAMS_PROF_END(continuous_uniform_logpdf_batch, n);
+}
+
+void continuous_uniform_cdf_batch(continuous_uniform_t *uni, const float *x,
+                                  float *out, long n) {
+  LAMS_PROF_BEGIN();
+  UniformConst c = {uni->a, uni->b, 0, (double)uni->b - uni->a};
+  continuous(uniform_cdf_chunk, &c, 0, x, out, n);
+  LAMS_PROF_END(continuous_uniform_cdf_batch, n);
+}
+
+void continuous_uniform_quantile_batch(continuous_uniform_t *uni,
+                                       const float *u, float *out, long n) {
+  LAMS_PROF_BEGIN();
+  UniformConst c = {uni->a, uni->b, 0, (double)uni->b - uni->a};
+  continuous(uniform_quantile_chunk, &c, 0, u, out, n);
+  LAMS_PROF_END(continuous_uniform_quantile_batch, n);
+}
+
+void normal_pmf_batch(normal_t *nor, const float *x, float *out, long n) {
+  LAMS_PROF_BEGIN();
+  NormalConst c = {nor->mu, 1.0 / nor->sigma,
+                   log(nor->sigma) + 0.5 * log(2 * M_PI)};
+  continuous(normal_log_pdf_chunk, &c, 1, x, out, n);
+  LAMS_PROF_END(normal_pmf_batch, n);
+}
+
+void normal_logpdf_batch(normal_t *nor, const float *x, float *out, long n) {
+  LAMS_PROF_BEGIN();
+  NormalConst c = {nor->mu, 1.0 / nor->sigma,
+                   log(nor->sigma) + 0.5 * log(2 * M_PI)};
+  continuous(normal_log_pdf_chunk, &c, 0, x, out, n);
+  LAMS_PROF_END(normal_logpdf_batch, n);
+}
+
+void normal_cdf_batch(normal_t *nor, const float *x, float *out, long n) {
+  LAMS_PROF_BEGIN();
+  NormalConst c = {nor->mu, 1.0 / nor->sigma, 0};
+  continuous(normal_cdf_chunk, &c, 0, x, out, n);
+  LAMS_PROF_END(normal_cdf_batch, n);
+}
+
+void normal_quantile_batch(normal_t *nor, const float *u, float *out,
+                           long n) {
+  LAMS_PROF_BEGIN();
+  NormalConst c = {nor->mu, 1.0 / nor->sigma, 0};
+  continuous(normal_quantile_chunk, &c, 0, u, out, n);
+  LAMS_PROF_END(normal_quantile_batch, n);
+}
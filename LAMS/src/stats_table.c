@@ -0,0 +1,239 @@
+#include "instrument.h"
+#include "stats.h"
+#include <float.h>
+
+// A discrete law as seen by the table builder, c holds the constants
+typedef struct {
+  double lo, hi; // support, hi is INFINITY when unbounded
+  double mode;
+  double (*up)(const void *c, double k);   // pmf(k + 1) / pmf(k)
+  double (*down)(const void *c, double k); // pmf(k - 1) / pmf(k)
+  double (*log_pmf)(const void *c, double k);
+  double (*cdf)(const void *c, double k);
+  const void *c;
+} TableLaw;
+
+// Window
+// -----------------------------------------------------------------------------
+// Walks away from the mode until the support ends or, with a tolerance, the
+// rest of the tail is bounded below tolerance / 2. Past the mode the ratios
+// of these log-concave pmfs only fall, so the rest of the tail is at most
+// pmf(k) r / (1 - r) for the ratio r at k. Without a tolerance unbounded
+// tails end where the pmf leaves the normal doubles (denormals times a
+// ratio close to 1 can round back to themselves).
+static double window_end(const TableLaw *law, double tolerance, int dir) {
+  double (*ratio)(const void *, double) = dir > 0 ? law->up : law->down;
+  double end = dir > 0 ? law->hi : law->lo;
+  double k = law->mode, pmf = exp(law->log_pmf(law->c, k));
+
+  while (k != end) {
+    double r = ratio(law->c, k);
+    if (tolerance > 0 ? r < 1 && pmf * r / (1 - r) <= 0.5 * tolerance
+                      : pmf < DBL_MIN && end == INFINITY) {
+      break;
+    }
+    pmf *= r;
+    k += dir;
+  }
+  return k;
+}
+
+static pmf_table_t *pmf_table(const TableLaw *law, double tolerance,
+                              const char *name) {
+  LAMS_PROF_BEGIN();
+  double first = window_end(law, tolerance, -1);
+  double last = window_end(law, tolerance, 1);
+  long size = last - first + 1, m = law->mode - first;
+
+  pmf_table_t *t = malloc(sizeof(pmf_table_t));
+  double *pmf = malloc(size * sizeof(double));
+  double *cdf = malloc(size * sizeof(double));
+  if (t == NULL || pmf == NULL || cdf == NULL) {
+    fprintf(stderr, "Error: %s() failed to allocate memory", name);
+    free(t);
+    free(pmf);
+    free(cdf);
+    return NULL;
+  }
+
+  // Both ways out of the mode, each entry one multiply from its neighbour
+  pmf[m] = exp(law->log_pmf(law->c, law->mode));
+  for (long i = m + 1; i < size; i++) {
+    pmf[i] = pmf[i - 1] * law->up(law->c, first + i - 1);
+  }
+  for (long i = m - 1; i >= 0; i--) {
+    pmf[i] = pmf[i + 1] * law->down(law->c, first + i + 1);
+  }
+
+  double sum = first > law->lo ? law->cdf(law->c, first - 1) : 0;
+  for (long i = 0; i < size; i++) {
+    sum += pmf[i];
+    cdf[i] = sum < 1 ? sum : 1;
+  }
+
+  t->first = first;
+  t->size = size;
+  t->pmf = pmf;
+  t->cdf = cdf;
+  LAMS_PROF_END(pmf_table, size);
+  return t;
+}
+
+void pmf_table_free(pmf_table_t *t) {
+  if (t == NULL) {
+    return;
+  }
+
+  free(t->pmf);
+  free(t->cdf);
+  free(t);
+}
+
+// Laws
+// -----------------------------------------------------------------------------
+typedef struct {
+  double n, p, q, odds; // odds = p / q
+} BinomialTable;
+
+static double binomial_up(const void *c, double k) {
+  const BinomialTable *b = c;
+  return (b->n - k) / (k + 1) * b->odds;
+}
+
+static double binomial_down(const void *c, double k) {
+  const BinomialTable *b = c;
+  return k / (b->n - k + 1) / b->odds;
+}
+
+static double binomial_log_pmf(const void *c, double k) {
+  const BinomialTable *b = c;
+  return stats_log_binomial_raw(k, b->n, b->p, b->q);
+}
+
+static double binomial_cdf_at(const void *c, double k) {
+  const BinomialTable *b = c;
+  return k < b->n ? stats_incomplete_beta(b->n - k, k + 1, b->q, b->p) : 1;
+}
+
+pmf_table_t *binomial_pmf_table(binomial_t *bin, double tolerance) {
+  double n = bin->n, p = bin->p, q = 1 - p;
+  double mode = floor((n + 1) * p);
+  BinomialTable c = {n, p, q, p / q};
+  TableLaw law = {0, n, mode < n ? mode : n, binomial_up, binomial_down,
+                  binomial_log_pmf, binomial_cdf_at, &c};
+  return pmf_table(&law, tolerance, "binomial_pmf_table");
+}
+
+typedef struct {
+  double lambda;
+} PoissonTable;
+
+static double poisson_up(const void *c, double k) {
+  return ((const PoissonTable *)c)->lambda / (k + 1);
+}
+
+static double poisson_down(const void *c, double k) {
+  return k / ((const PoissonTable *)c)->lambda;
+}
+
+static double poisson_log_pmf(const void *c, double k) {
+  return stats_log_poisson_raw(k, ((const PoissonTable *)c)->lambda);
+}
+
+static double poisson_cdf_at(const void *c, double k) {
+  return stats_incomplete_gamma_q(k + 1, ((const PoissonTable *)c)->lambda);
+}
+
+pmf_table_t *poisson_pmf_table(poisson_t *poi, double tolerance) {
+  PoissonTable c = {poi->lambda};
+  TableLaw law = {0, INFINITY, floor(c.lambda), poisson_up, poisson_down,
+                  poisson_log_pmf, poisson_cdf_at, &c};
+  return pmf_table(&law, tolerance, "poisson_pmf_table");
+}
+
+// Failures before the r-th success
+typedef struct {
+  double r, p, q;
+} NegativeBinomialTable;
+
+static double negative_binomial_up(const void *c, double k) {
+  const NegativeBinomialTable *nb = c;
+  return (k + nb->r) / (k + 1) * nb->q;
+}
+
+static double negative_binomial_down(const void *c, double k) {
+  const NegativeBinomialTable *nb = c;
+  return k / (k + nb->r - 1) / nb->q;
+}
+
+static double negative_binomial_log_pmf(const void *c, double k) {
+  const NegativeBinomialTable *nb = c;
+  return log(nb->r / (nb->r + k)) +
+         stats_log_binomial_raw(nb->r, nb->r + k, nb->p, nb->q);
+}
+
+static double negative_binomial_cdf_at(const void *c, double k) {
+  const NegativeBinomialTable *nb = c;
+  return stats_incomplete_beta(nb->r, k + 1, nb->p, nb->q);
+}
+
+pmf_table_t *negative_binomial_pmf_table(negative_binomial_t *neg,
+                                         double tolerance) {
+  if (neg->r == 0) {
+    fprintf(stderr, "Error: negative_binomial_pmf_table() needs r > 0");
+    return NULL;
+  }
+
+  double r = neg->r, p = neg->p, q = 1 - p;
+  NegativeBinomialTable c = {r, p, q};
+  double mode = r > 1 ? floor((r - 1) * q / p) : 0;
+  TableLaw law = {0, INFINITY, mode, negative_binomial_up,
+                  negative_binomial_down, negative_binomial_log_pmf,
+                  negative_binomial_cdf_at, &c};
+  return pmf_table(&law, tolerance, "negative_binomial_pmf_table");
+}
+
+typedef struct {
+  double N, K, n;
+} HypergeometricTable;
+
+static double hypergeometric_up(const void *c, double k) {
+  const HypergeometricTable *h = c;
+  return (h->K - k) * (h->n - k) / ((k + 1) * (h->N - h->K - h->n + k + 1));
+}
+
+static double hypergeometric_down(const void *c, double k) {
+  const HypergeometricTable *h = c;
+  return k * (h->N - h->K - h->n + k) / ((h->K - k + 1) * (h->n - k + 1));
+}
+
+static double hypergeometric_log_pmf(const void *c, double k) {
+  const HypergeometricTable *h = c;
+  double p = h->n / h->N, q = (h->N - h->n) / h->N;
+  return stats_log_binomial_raw(k, h->K, p, q) +
+         stats_log_binomial_raw(h->n - k, h->N - h->K, p, q) -
+         stats_log_binomial_raw(h->n, h->N, p, q);
+}
+
+static double hypergeometric_cdf_at(const void *c, double k) {
+  const HypergeometricTable *h = c;
+  return stats_hypergeometric_tail(k, h->N, h->K, h->n, 0);
+}
+
+pmf_table_t *hypergeometric_pmf_table(hypergeometric_t *hyp,
+                                      double tolerance) {
+  if (hyp->N == 0 || hyp->K > hyp->N || hyp->n > hyp->N) {
+    fprintf(stderr, "Error: hypergeometric_pmf_table() needs K <= N, n <= N "
+                    "and N > 0");
+    return NULL;
+  }
+
+  double N = hyp->N, K = hyp->K, n = hyp->n;
+  HypergeometricTable c = {N, K, n};
+  double lo = n - (N - K) > 0 ? n - (N - K) : 0, hi = n < K ? n : K;
+  double mode = floor((n + 1) * (K + 1) / (N + 2));
+  mode = mode < lo ? lo : mode > hi ? hi : mode;
+  TableLaw law = {lo, hi, mode, hypergeometric_up, hypergeometric_down,
+                  hypergeometric_log_pmf, hypergeometric_cdf_at, &c};
+  return pmf_table(&law, tolerance, "hypergeometric_pmf_table");
+}
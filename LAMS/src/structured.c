@@ -0,0 +1,910 @@
+#include "structured.h"
+#include "instrument.h"
+#include <string.h>
+
+// Diagonal functions
+// -----------------------------------------------------------------------------
+DiagonalMatrix *diagonal_new(int n) {
+  DiagonalMatrix *d = malloc(sizeof(DiagonalMatrix));
+
+  if (d == NULL) {
+    fprintf(stderr, "Error: diagonal_new() failed to allocate memory");
+    return NULL;
+  }
+
+  d->size = n;
+  d->data = calloc(n, sizeof(double));
+  if (d->data == NULL) {
+    fprintf(stderr, "Error: diagonal_new() failed to allocate memory");
+    free(d);
+    return NULL;
+  }
+
+  return d;
+}
+
+void diagonal_free(DiagonalMatrix *d) {
+  if (d == NULL) {
+    return;
+  }
+
+  free(d->data);
+  free(d);
+}
+
+DiagonalMatrix *diagonal_from_vector(Vector *v) {
+  DiagonalMatrix *d = diagonal_new(v->size);
+
+  if (d == NULL) {
+    return NULL;
+  }
+
+  memcpy(d->data, v->data, v->size * sizeof(double));
+  return d;
+}
+
+DiagonalMatrix *diagonal_from_matrix(Matrix *m) {
+  if (m->rows != m->cols) {
+    fprintf(stderr, "Error: diagonal_from_matrix() matrix must be square");
+    return NULL;
+  }
+
+  DiagonalMatrix *d = diagonal_new(m->rows);
+
+  if (d == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < m->rows; i++) {
+    d->data[i] = m->data[i][i];
+  }
+
+  return d;
+}
+
+Matrix *diagonal_to_matrix(DiagonalMatrix *d) {
+  Matrix *result = matrix_new(d->size, d->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: diagonal_to_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  matrix_fill(result, 0.0);
+  for (int i = 0; i < d->size; i++) {
+    result->data[i][i] = d->data[i];
+  }
+
+  return result;
+}
+
+Vector *diagonal_multiply_vector(DiagonalMatrix *d, Vector *v) {
+  if (d->size != v->size) {
+    fprintf(stderr, "Error: diagonal_multiply_vector() cannot multiply matrix "
+                    "and vector of incompatible sizes");
+    return NULL;
+  }
+
+  Vector *result = vector_new(v->size);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: diagonal_multiply_vector() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < v->size; i++) {
+    result->data[i] = d->data[i] * v->data[i];
+  }
+
+  return result;
+}
+
+// D * M scales the rows of M
+Matrix *diagonal_multiply_matrix(DiagonalMatrix *d, Matrix *m) {
+  if (d->size != m->rows) {
+    fprintf(stderr, "Error: diagonal_multiply_matrix() cannot multiply "
+                    "matrices of incompatible sizes");
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(m->rows, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: diagonal_multiply_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < m->rows; i++) {
+    double s = d->data[i];
+    for (int j = 0; j < m->cols; j++) {
+      result->data[i][j] = s * m->data[i][j];
+    }
+  }
+
+  return result;
+}
+
+// M * D scales the columns of M
+Matrix *matrix_multiply_diagonal(Matrix *m, DiagonalMatrix *d) {
+  if (m->cols != d->size) {
+    fprintf(stderr, "Error: matrix_multiply_diagonal() cannot multiply "
+                    "matrices of incompatible sizes");
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(m->rows, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: matrix_multiply_diagonal() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < m->rows; i++) {
+    for (int j = 0; j < m->cols; j++) {
+      result->data[i][j] = m->data[i][j] * d->data[j];
+    }
+  }
+
+  return result;
+}
+
+Vector *diagonal_solve(DiagonalMatrix *d, Vector *b) {
+  if (d->size != b->size) {
+    fprintf(stderr, "Error: diagonal_solve() matrix and right hand side have "
+                    "incompatible sizes");
+    return NULL;
+  }
+
+  for (int i = 0; i < d->size; i++) {
+    if (d->data[i] == 0.0) {
+      fprintf(stderr, "Error: diagonal_solve() matrix is singular");
+      return NULL;
+    }
+  }
+
+  Vector *result = vector_new(b->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: diagonal_solve() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < b->size; i++) {
+    result->data[i] = b->data[i] / d->data[i];
+  }
+
+  return result;
+}
+
+// Banded functions
+// -----------------------------------------------------------------------------
+static int banded_width(BandedMatrix *b) { return b->lower + b->upper + 1; }
+
+static int banded_contains(BandedMatrix *b, int i, int j) {
+  return i >= 0 && j >= 0 && i < b->size && j < b->size &&
+         j - i <= b->upper && i - j <= b->lower;
+}
+
+#define BAND(b, i, j)                                                          \
+  ((b)->data[(i) * banded_width(b) + (j) - (i) + (b)->lower])
+
+BandedMatrix *banded_new(int n, int lower, int upper) {
+  if (lower < 0 || upper < 0) {
+    fprintf(stderr, "Error: banded_new() bandwidths must be non-negative");
+    return NULL;
+  }
+
+  BandedMatrix *b = malloc(sizeof(BandedMatrix));
+
+  if (b == NULL) {
+    fprintf(stderr, "Error: banded_new() failed to allocate memory");
+    return NULL;
+  }
+
+  b->size = n;
+  b->lower = lower;
+  b->upper = upper;
+  b->data = calloc((size_t)n * (lower + upper + 1), sizeof(double));
+  if (b->data == NULL) {
+    fprintf(stderr, "Error: banded_new() failed to allocate memory");
+    free(b);
+    return NULL;
+  }
+
+  return b;
+}
+
+void banded_free(BandedMatrix *b) {
+  if (b == NULL) {
+    return;
+  }
+
+  free(b->data);
+  free(b);
+}
+
+double banded_get(BandedMatrix *b, int i, int j) {
+  return banded_contains(b, i, j) ? BAND(b, i, j) : 0.0;
+}
+
+void banded_set(BandedMatrix *b, int i, int j, double value) {
+  if (!banded_contains(b, i, j)) {
+    fprintf(stderr, "Error: banded_set() (%d, %d) is outside the band", i, j);
+    return;
+  }
+
+  BAND(b, i, j) = value;
+}
+
+// Entries outside the band are ignored
+BandedMatrix *banded_from_matrix(Matrix *m, int lower, int upper) {
+  if (m->rows != m->cols) {
+    fprintf(stderr, "Error: banded_from_matrix() matrix must be square");
+    return NULL;
+  }
+
+  BandedMatrix *b = banded_new(m->rows, lower, upper);
+
+  if (b == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < b->size; i++) {
+    int j0 = i - lower > 0 ? i - lower : 0;
+    int j1 = i + upper < b->size - 1 ? i + upper : b->size - 1;
+    for (int j = j0; j <= j1; j++) {
+      BAND(b, i, j) = m->data[i][j];
+    }
+  }
+
+  return b;
+}
+
+Matrix *banded_to_matrix(BandedMatrix *b) {
+  Matrix *result = matrix_new(b->size, b->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: banded_to_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < b->size; i++) {
+    for (int j = 0; j < b->size; j++) {
+      result->data[i][j] = banded_get(b, i, j);
+    }
+  }
+
+  return result;
+}
+
+Vector *banded_multiply_vector(BandedMatrix *b, Vector *v) {
+  LAMS_PROF_BEGIN();
+  if (b->size != v->size) {
+    fprintf(stderr, "Error: banded_multiply_vector() cannot multiply matrix "
+                    "and vector of incompatible sizes");
+    return NULL;
+  }
+
+  Vector *result = vector_new(b->size);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: banded_multiply_vector() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < b->size; i++) {
+    int j0 = i - b->lower > 0 ? i - b->lower : 0;
+    int j1 = i + b->upper < b->size - 1 ? i + b->upper : b->size - 1;
+    double sum = 0;
+    for (int j = j0; j <= j1; j++) {
+      sum += BAND(b, i, j) * v->data[j];
+    }
+    result->data[i] = sum;
+  }
+
+  LAMS_PROF_END(banded_multiply_vector,
+                2.0 * b->size * (b->lower + b->upper + 1));
+  return result;
+}
+
+Matrix *banded_multiply_matrix(BandedMatrix *b, Matrix *m) {
+  LAMS_PROF_BEGIN();
+  if (b->size != m->rows) {
+    fprintf(stderr, "Error: banded_multiply_matrix() cannot multiply "
+                    "matrices of incompatible sizes");
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(b->size, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: banded_multiply_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  matrix_fill(result, 0.0);
+  for (int i = 0; i < b->size; i++) {
+    int j0 = i - b->lower > 0 ? i - b->lower : 0;
+    int j1 = i + b->upper < b->size - 1 ? i + b->upper : b->size - 1;
+    double *out = result->data[i];
+    for (int j = j0; j <= j1; j++) {
+      double a = BAND(b, i, j);
+      double *row = m->data[j];
+      for (int k = 0; k < m->cols; k++) {
+        out[k] += a * row[k];
+      }
+    }
+  }
+
+  LAMS_PROF_END(banded_multiply_matrix,
+                2.0 * b->size * (b->lower + b->upper + 1) * m->cols);
+  return result;
+}
+
+// Gaussian elimination with partial pivoting restricted to the band. Row
+// swaps can push the upper bandwidth to lower + upper, so the factorization
+// works on a widened copy. Costs O(n * lower * (lower + upper)).
+Vector *banded_solve(BandedMatrix *b, Vector *rhs) {
+  LAMS_PROF_BEGIN();
+  if (b->size != rhs->size) {
+    fprintf(stderr, "Error: banded_solve() matrix and right hand side have "
+                    "incompatible sizes");
+    return NULL;
+  }
+
+  int n = b->size;
+  BandedMatrix *lu = banded_new(n, b->lower, b->lower + b->upper);
+  Vector *x = vector_copy(rhs);
+
+  if (lu == NULL || x == NULL) {
+    fprintf(stderr, "Error: banded_solve() failed to allocate memory");
+    banded_free(lu);
+    if (x != NULL) {
+      vector_free(x);
+    }
+    return NULL;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int j0 = i - b->lower > 0 ? i - b->lower : 0;
+    int j1 = i + b->upper < n - 1 ? i + b->upper : n - 1;
+    for (int j = j0; j <= j1; j++) {
+      BAND(lu, i, j) = BAND(b, i, j);
+    }
+  }
+
+  for (int k = 0; k < n; k++) {
+    int last_row = k + lu->lower < n - 1 ? k + lu->lower : n - 1;
+    int last_col = k + lu->upper < n - 1 ? k + lu->upper : n - 1;
+
+    int pivot = k;
+    for (int i = k + 1; i <= last_row; i++) {
+      if (fabs(BAND(lu, i, k)) > fabs(BAND(lu, pivot, k))) {
+        pivot = i;
+      }
+    }
+
+    if (BAND(lu, pivot, k) == 0.0) {
+      fprintf(stderr, "Error: banded_solve() matrix is singular");
+      banded_free(lu);
+      vector_free(x);
+      return NULL;
+    }
+
+    if (pivot != k) {
+      for (int j = k; j <= last_col; j++) {
+        double tmp = BAND(lu, k, j);
+        BAND(lu, k, j) = BAND(lu, pivot, j);
+        BAND(lu, pivot, j) = tmp;
+      }
+      double tmp = x->data[k];
+      x->data[k] = x->data[pivot];
+      x->data[pivot] = tmp;
+    }
+
+    for (int i = k + 1; i <= last_row; i++) {
+      double l = BAND(lu, i, k) / BAND(lu, k, k);
+      BAND(lu, i, k) = 0.0;
+      for (int j = k + 1; j <= last_col; j++) {
+        BAND(lu, i, j) -= l * BAND(lu, k, j);
+      }
+      x->data[i] -= l * x->data[k];
+    }
+  }
+
+  for (int i = n - 1; i >= 0; i--) {
+    int last_col = i + lu->upper < n - 1 ? i + lu->upper : n - 1;
+    double sum = x->data[i];
+    for (int j = i + 1; j <= last_col; j++) {
+      sum -= BAND(lu, i, j) * x->data[j];
+    }
+    x->data[i] = sum / BAND(lu, i, i);
+  }
+
+  banded_free(lu);
+  LAMS_PROF_END(banded_solve,
+                2.0 * n * b->lower * (2 * b->lower + b->upper + 1));
+  return x;
+}
+
+// Symmetric functions
+// -----------------------------------------------------------------------------
+// Lower triangle packed by rows, row i starts at i * (i + 1) / 2
+static size_t packed_lower(int i, int j) { return (size_t)i * (i + 1) / 2 + j; }
+
+// Upper triangle packed by rows, row i starts at i * n - i * (i - 1) / 2
+static size_t packed_upper(int n, int i, int j) {
+  return (size_t)i * n - (size_t)i * (i - 1) / 2 + (j - i);
+}
+
+SymmetricMatrix *symmetric_new(int n) {
+  SymmetricMatrix *s = malloc(sizeof(SymmetricMatrix));
+
+  if (s == NULL) {
+    fprintf(stderr, "Error: symmetric_new() failed to allocate memory");
+    return NULL;
+  }
+
+  s->size = n;
+  s->data = calloc((size_t)n * (n + 1) / 2, sizeof(double));
+  if (s->data == NULL) {
+    fprintf(stderr, "Error: symmetric_new() failed to allocate memory");
+    free(s);
+    return NULL;
+  }
+
+  return s;
+}
+
+void symmetric_free(SymmetricMatrix *s) {
+  if (s == NULL) {
+    return;
+  }
+
+  free(s->data);
+  free(s);
+}
+
+double symmetric_get(SymmetricMatrix *s, int i, int j) {
+  return i >= j ? s->data[packed_lower(i, j)] : s->data[packed_lower(j, i)];
+}
+
+void symmetric_set(SymmetricMatrix *s, int i, int j, double value) {
+  if (i >= j) {
+    s->data[packed_lower(i, j)] = value;
+  } else {
+    s->data[packed_lower(j, i)] = value;
+  }
+}
+
+// Only the lower triangle of m is read
+SymmetricMatrix *symmetric_from_matrix(Matrix *m) {
+  if (m->rows != m->cols) {
+    fprintf(stderr, "Error: symmetric_from_matrix() matrix must be square");
+    return NULL;
+  }
+
+  SymmetricMatrix *s = symmetric_new(m->rows);
+
+  if (s == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < s->size; i++) {
+    memcpy(&s->data[packed_lower(i, 0)], m->data[i], (i + 1) * sizeof(double));
+  }
+
+  return s;
+}
+
+Matrix *symmetric_to_matrix(SymmetricMatrix *s) {
+  Matrix *result = matrix_new(s->size, s->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: symmetric_to_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < s->size; i++) {
+    for (int j = 0; j <= i; j++) {
+      result->data[i][j] = s->data[packed_lower(i, j)];
+      result->data[j][i] = s->data[packed_lower(i, j)];
+    }
+  }
+
+  return result;
+}
+
+// One pass over the packed triangle, each off-diagonal entry is used twice
+Vector *symmetric_multiply_vector(SymmetricMatrix *s, Vector *v) {
+  LAMS_PROF_BEGIN();
+  if (s->size != v->size) {
+    fprintf(stderr, "Error: symmetric_multiply_vector() cannot multiply "
+                    "matrix and vector of incompatible sizes");
+    return NULL;
+  }
+
+  Vector *result = vector_new(s->size);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: symmetric_multiply_vector() failed to allocate memory");
+    return NULL;
+  }
+
+  double *y = result->data;
+  memset(y, 0, s->size * sizeof(double));
+  for (int i = 0; i < s->size; i++) {
+    double *row = &s->data[packed_lower(i, 0)];
+    double vi = v->data[i];
+    double sum = 0;
+    for (int j = 0; j < i; j++) {
+      sum += row[j] * v->data[j];
+      y[j] += row[j] * vi;
+    }
+    y[i] += sum + row[i] * vi;
+  }
+
+  LAMS_PROF_END(symmetric_multiply_vector, 2.0 * s->size * s->size);
+  return result;
+}
+
+Matrix *symmetric_multiply_matrix(SymmetricMatrix *s, Matrix *m) {
+  LAMS_PROF_BEGIN();
+  if (s->size != m->rows) {
+    fprintf(stderr, "Error: symmetric_multiply_matrix() cannot multiply "
+                    "matrices of incompatible sizes");
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(s->size, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: symmetric_multiply_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  matrix_fill(result, 0.0);
+  for (int i = 0; i < s->size; i++) {
+    double *row = &s->data[packed_lower(i, 0)];
+    for (int j = 0; j <= i; j++) {
+      double a = row[j];
+      for (int k = 0; k < m->cols; k++) {
+        result->data[i][k] += a * m->data[j][k];
+      }
+      if (j != i) {
+        for (int k = 0; k < m->cols; k++) {
+          result->data[j][k] += a * m->data[i][k];
+        }
+      }
+    }
+  }
+
+  LAMS_PROF_END(symmetric_multiply_matrix, 2.0 * s->size * s->size * m->cols);
+  return result;
+}
+
+// Solves through a packed Cholesky factorization, so s must be positive
+// definite
+Vector *symmetric_solve(SymmetricMatrix *s, Vector *b) {
+  LAMS_PROF_BEGIN();
+  if (s->size != b->size) {
+    fprintf(stderr, "Error: symmetric_solve() matrix and right hand side have "
+                    "incompatible sizes");
+    return NULL;
+  }
+
+  int n = s->size;
+  TriangularMatrix *l = triangular_new(n, TRIANGLE_LOWER);
+
+  if (l == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < n; i++) {
+    double *li = &l->data[packed_lower(i, 0)];
+    for (int j = 0; j <= i; j++) {
+      double *lj = &l->data[packed_lower(j, 0)];
+      double sum = s->data[packed_lower(i, j)];
+      for (int k = 0; k < j; k++) {
+        sum -= li[k] * lj[k];
+      }
+
+      if (i == j) {
+        if (sum <= 0.0) {
+          fprintf(stderr,
+                  "Error: symmetric_solve() matrix is not positive definite");
+          triangular_free(l);
+          return NULL;
+        }
+        li[i] = sqrt(sum);
+      } else {
+        li[j] = sum / lj[j];
+      }
+    }
+  }
+
+  // L y = b, then L^T x = y
+  Vector *x = triangular_solve(l, b);
+  if (x != NULL) {
+    for (int i = n - 1; i >= 0; i--) {
+      double sum = x->data[i];
+      for (int k = i + 1; k < n; k++) {
+        sum -= l->data[packed_lower(k, i)] * x->data[k];
+      }
+      x->data[i] = sum / l->data[packed_lower(i, i)];
+    }
+  }
+
+  triangular_free(l);
+  LAMS_PROF_END(symmetric_solve, (double)n * n * n / 3.0 + 2.0 * n * n);
+  return x;
+}
+
+// Triangular functions
+// -----------------------------------------------------------------------------
+static int triangular_contains(TriangularMatrix *t, int i, int j) {
+  return t->uplo == TRIANGLE_LOWER ? j <= i : j >= i;
+}
+
+static double *triangular_row(TriangularMatrix *t, int i) {
+  return t->uplo == TRIANGLE_LOWER ? &t->data[packed_lower(i, 0)]
+                                   : &t->data[packed_upper(t->size, i, i)];
+}
+
+TriangularMatrix *triangular_new(int n, Triangle uplo) {
+  TriangularMatrix *t = malloc(sizeof(TriangularMatrix));
+
+  if (t == NULL) {
+    fprintf(stderr, "Error: triangular_new() failed to allocate memory");
+    return NULL;
+  }
+
+  t->size = n;
+  t->uplo = uplo;
+  t->data = calloc((size_t)n * (n + 1) / 2, sizeof(double));
+  if (t->data == NULL) {
+    fprintf(stderr, "Error: triangular_new() failed to allocate memory");
+    free(t);
+    return NULL;
+  }
+
+  return t;
+}
+
+void triangular_free(TriangularMatrix *t) {
+  if (t == NULL) {
+    return;
+  }
+
+  free(t->data);
+  free(t);
+}
+
+double triangular_get(TriangularMatrix *t, int i, int j) {
+  if (!triangular_contains(t, i, j)) {
+    return 0.0;
+  }
+
+  return t->uplo == TRIANGLE_LOWER ? t->data[packed_lower(i, j)]
+                                   : t->data[packed_upper(t->size, i, j)];
+}
+
+void triangular_set(TriangularMatrix *t, int i, int j, double value) {
+  if (!triangular_contains(t, i, j)) {
+    fprintf(stderr, "Error: triangular_set() (%d, %d) is outside the triangle",
+            i, j);
+    return;
+  }
+
+  if (t->uplo == TRIANGLE_LOWER) {
+    t->data[packed_lower(i, j)] = value;
+  } else {
+    t->data[packed_upper(t->size, i, j)] = value;
+  }
+}
+
+// Entries outside the chosen triangle are ignored
+TriangularMatrix *triangular_from_matrix(Matrix *m, Triangle uplo) {
+  if (m->rows != m->cols) {
+    fprintf(stderr, "Error: triangular_from_matrix() matrix must be square");
+    return NULL;
+  }
+
+  TriangularMatrix *t = triangular_new(m->rows, uplo);
+
+  if (t == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < t->size; i++) {
+    if (uplo == TRIANGLE_LOWER) {
+      memcpy(triangular_row(t, i), m->data[i], (i + 1) * sizeof(double));
+    } else {
+      memcpy(triangular_row(t, i), &m->data[i][i],
+             (t->size - i) * sizeof(double));
+    }
+  }
+
+  return t;
+}
+
+Matrix *triangular_to_matrix(TriangularMatrix *t) {
+  Matrix *result = matrix_new(t->size, t->size);
+
+  if (result == NULL) {
+    fprintf(stderr, "Error: triangular_to_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < t->size; i++) {
+    for (int j = 0; j < t->size; j++) {
+      result->data[i][j] = triangular_get(t, i, j);
+    }
+  }
+
+  return result;
+}
+
+Vector *triangular_multiply_vector(TriangularMatrix *t, Vector *v) {
+  LAMS_PROF_BEGIN();
+  if (t->size != v->size) {
+    fprintf(stderr, "Error: triangular_multiply_vector() cannot multiply "
+                    "matrix and vector of incompatible sizes");
+    return NULL;
+  }
+
+  Vector *result = vector_new(t->size);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: triangular_multiply_vector() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int i = 0; i < t->size; i++) {
+    double *row = triangular_row(t, i);
+    int j0 = t->uplo == TRIANGLE_LOWER ? 0 : i;
+    int j1 = t->uplo == TRIANGLE_LOWER ? i : t->size - 1;
+    double sum = 0;
+    for (int j = j0; j <= j1; j++) {
+      sum += row[j - j0] * v->data[j];
+    }
+    result->data[i] = sum;
+  }
+
+  LAMS_PROF_END(triangular_multiply_vector, (double)t->size * (t->size + 1));
+  return result;
+}
+
+Matrix *triangular_multiply_matrix(TriangularMatrix *t, Matrix *m) {
+  LAMS_PROF_BEGIN();
+  if (t->size != m->rows) {
+    fprintf(stderr, "Error: triangular_multiply_matrix() cannot multiply "
+                    "matrices of incompatible sizes");
+    return NULL;
+  }
+
+  Matrix *result = matrix_new(t->size, m->cols);
+
+  if (result == NULL) {
+    fprintf(stderr,
+            "Error: triangular_multiply_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  matrix_fill(result, 0.0);
+  for (int i = 0; i < t->size; i++) {
+    double *row = triangular_row(t, i);
+    int j0 = t->uplo == TRIANGLE_LOWER ? 0 : i;
+    int j1 = t->uplo == TRIANGLE_LOWER ? i : t->size - 1;
+    double *out = result->data[i];
+    for (int j = j0; j <= j1; j++) {
+      double a = row[j - j0];
+      for (int k = 0; k < m->cols; k++) {
+        out[k] += a * m->data[j][k];
+      }
+    }
+  }
+
+  LAMS_PROF_END(triangular_multiply_matrix,
+                (double)t->size * (t->size + 1) * m->cols);
+  return result;
+}
+
+// Forward substitution for lower, back substitution for upper
+Vector *triangular_solve(TriangularMatrix *t, Vector *b) {
+  LAMS_PROF_BEGIN();
+  if (t->size != b->size) {
+    fprintf(stderr, "Error: triangular_solve() matrix and right hand side "
+                    "have incompatible sizes");
+    return NULL;
+  }
+
+  int n = t->size;
+  Vector *x = vector_copy(b);
+
+  if (x == NULL) {
+    fprintf(stderr, "Error: triangular_solve() failed to allocate memory");
+    return NULL;
+  }
+
+  for (int step = 0; step < n; step++) {
+    int i = t->uplo == TRIANGLE_LOWER ? step : n - 1 - step;
+    double *row = triangular_row(t, i);
+    double diag = t->uplo == TRIANGLE_LOWER ? row[i] : row[0];
+
+    if (diag == 0.0) {
+      fprintf(stderr, "Error: triangular_solve() matrix is singular");
+      vector_free(x);
+      return NULL;
+    }
+
+    double sum = x->data[i];
+    if (t->uplo == TRIANGLE_LOWER) {
+      for (int j = 0; j < i; j++) {
+        sum -= row[j] * x->data[j];
+      }
+    } else {
+      for (int j = i + 1; j < n; j++) {
+        sum -= row[j - i] * x->data[j];
+      }
+    }
+    x->data[i] = sum / diag;
+  }
+
+  LAMS_PROF_END(triangular_solve, (double)n * n);
+  return x;
+}
+
+Matrix *triangular_solve_matrix(TriangularMatrix *t, Matrix *b) {
+  if (t->size != b->rows) {
+    fprintf(stderr, "Error: triangular_solve_matrix() matrix and right hand "
+                    "side have incompatible sizes");
+    return NULL;
+  }
+
+  int n = t->size;
+  Matrix *x = matrix_copy(b);
+
+  if (x == NULL) {
+    fprintf(stderr,
+            "Error: triangular_solve_matrix() failed to allocate memory");
+    return NULL;
+  }
+
+  // Row oriented so every update is a contiguous axpy over the columns of b
+  for (int step = 0; step < n; step++) {
+    int i = t->uplo == TRIANGLE_LOWER ? step : n - 1 - step;
+    double *row = triangular_row(t, i);
+    double diag = t->uplo == TRIANGLE_LOWER ? row[i] : row[0];
+    double *xi = x->data[i];
+
+    if (diag == 0.0) {
+      fprintf(stderr, "Error: triangular_solve_matrix() matrix is singular");
+      matrix_free(x);
+      return NULL;
+    }
+
+    int j0 = t->uplo == TRIANGLE_LOWER ? 0 : i + 1;
+    int j1 = t->uplo == TRIANGLE_LOWER ? i - 1 : n - 1;
+    for (int j = j0; j <= j1; j++) {
+      double a = t->uplo == TRIANGLE_LOWER ? row[j] : row[j - i];
+      double *xj = x->data[j];
+      for (int k = 0; k < b->cols; k++) {
+        xi[k] -= a * xj[k];
+      }
+    }
+    for (int k = 0; k < b->cols; k++) {
+      xi[k] /= diag;
+    }
+  }
+
+  return x;
+}
@@ -0,0 +1,89 @@
+#ifndef STRUCTURED_H
+#define STRUCTURED_H
+
+#include "linear_algebra.h"
+
+/*
+ * Structured square matrices
+ *
+ * Compact storage for matrices with known structure, each with conversions
+ * to and from the dense Matrix and kernels that only touch the stored
+ * entries:
+ *
+ *   DiagonalMatrix    n entries
+ *   BandedMatrix      n * (lower + upper + 1) entries, row i holds columns
+ *                     i - lower .. i + upper
+ *   SymmetricMatrix   n * (n + 1) / 2 entries, lower triangle packed by rows
+ *   TriangularMatrix  n * (n + 1) / 2 entries, packed by rows
+ *
+ */
+
+typedef enum { TRIANGLE_LOWER, TRIANGLE_UPPER } Triangle;
+
+typedef struct {
+  int size;
+  double *data;
+} DiagonalMatrix;
+
+typedef struct {
+  int size, lower, upper;
+  double *data;
+} BandedMatrix;
+
+typedef struct {
+  int size;
+  double *data;
+} SymmetricMatrix;
+
+typedef struct {
+  int size;
+  Triangle uplo;
+  double *data;
+} TriangularMatrix;
+
+// Diagonal functions
+DiagonalMatrix *diagonal_new(int n);
+void diagonal_free(DiagonalMatrix *d);
+DiagonalMatrix *diagonal_from_vector(Vector *v);
+DiagonalMatrix *diagonal_from_matrix(Matrix *m);
+Matrix *diagonal_to_matrix(DiagonalMatrix *d);
+Vector *diagonal_multiply_vector(DiagonalMatrix *d, Vector *v);
+Matrix *diagonal_multiply_matrix(DiagonalMatrix *d, Matrix *m);
+Matrix *matrix_multiply_diagonal(Matrix *m, DiagonalMatrix *d);
+Vector *diagonal_solve(DiagonalMatrix *d, Vector *b);
+
+// Banded functions
+BandedMatrix *banded_new(int n, int lower, int upper);
+void banded_free(BandedMatrix *b);
+double banded_get(BandedMatrix *b, int i, int j);
+void banded_set(BandedMatrix *b, int i, int j, double value);
+BandedMatrix *banded_from_matrix(Matrix *m, int lower, int upper);
+Matrix *banded_to_matrix(BandedMatrix *b);
+Vector *banded_multiply_vector(BandedMatrix *b, Vector *v);
+Matrix *banded_multiply_matrix(BandedMatrix *b, Matrix *m);
+Vector *banded_solve(BandedMatrix *b, Vector *rhs);
+
+// Symmetric functions
+SymmetricMatrix *symmetric_new(int n);
+void symmetric_free(SymmetricMatrix *s);
+double symmetric_get(SymmetricMatrix *s, int i, int j);
+void symmetric_set(SymmetricMatrix *s, int i, int j, double value);
+SymmetricMatrix *symmetric_from_matrix(Matrix *m);
+Matrix *symmetric_to_matrix(SymmetricMatrix *s);
+Vector *symmetric_multiply_vector(SymmetricMatrix *s, Vector *v);
+Matrix *symmetric_multiply_matrix(SymmetricMatrix *s, Matrix *m);
+Vector *symmetric_solve(SymmetricMatrix *s, Vector *b);
+
+// Triangular functions
+TriangularMatrix *triangular_new(int n, Triangle uplo);
+void triangular_free(TriangularMatrix *t);
+double triangular_get(TriangularMatrix *t, int i, int j);
+void triangular_set(TriangularMatrix *t, int i, int j, double value);
+TriangularMatrix *triangular_from_matrix(Matrix *m, Triangle uplo);
+Matrix *triangular_to_matrix(TriangularMatrix *t);
+Vector *triangular_multiply_vector(TriangularMatrix *t, Vector *v);
+Matrix *triangular_multiply_matrix(TriangularMatrix *t, Matrix *m);
+Vector *triangular_solve(TriangularMatrix *t, Vector *b);
+Matrix *triangular_solve_matrix(TriangularMatrix *t, Matrix *b);
+
+#endif
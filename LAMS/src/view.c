@@ -0,0 +1,179 @@
+#include "view.h"
+#include "instrument.h"
+#include "parallel.h"
+#include <string.h>
+
+typedef struct {
+  Matrix *y, *x;
+  double alpha;
+} ViewJob;
+
+// Vector views
+// -----------------------------------------------------------------------------
+Vector vector_view(Vector *v, int offset, int size) {
+  if (offset < 0 || size < 0 || offset + size > v->size) {
+    fprintf(stderr, "Error: vector_view() out of bounds");
+    return (Vector){0, NULL};
+  }
+  return (Vector){size, v->data + offset};
+}
+
+Vector matrix_row_view(Matrix *m, int row) {
+  if (row < 0 || row >= m->rows) {
+    fprintf(stderr, "Error: matrix_row_view() out of bounds");
+    return (Vector){0, NULL};
+  }
+  return (Vector){m->cols, m->data[row]};
+}
+
+// Matrix views
+// -----------------------------------------------------------------------------
+// The row pointers live in the same allocation as the struct
+static Matrix *view_alloc(int rows, int cols) {
+  LAMS_PROF_BEGIN();
+  Matrix *view = malloc(sizeof(Matrix) + rows * sizeof(double *));
+
+  if (view == NULL) {
+    fprintf(stderr, "Error: matrix view failed to allocate memory");
+    return NULL;
+  }
+
+  view->rows = rows;
+  view->cols = cols;
+  view->data = (double **)(view + 1);
+  LAMS_PROF_ALLOC(matrix_view, sizeof(Matrix) + rows * sizeof(double *));
+  LAMS_PROF_END(matrix_view, 0);
+  return view;
+}
+
+Matrix *matrix_view(Matrix *m, int row, int col, int rows, int cols) {
+  if (row < 0 || col < 0 || rows < 0 || cols < 0 || row + rows > m->rows ||
+      col + cols > m->cols) {
+    fprintf(stderr, "Error: matrix_view() out of bounds");
+    return NULL;
+  }
+
+  Matrix *view = view_alloc(rows, cols);
+  if (view == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < rows; i++) {
+    view->data[i] = m->data[row + i] + col;
+  }
+  return view;
+}
+
+Matrix *matrix_column_view(Matrix *m, int col) {
+  return matrix_view(m, 0, col, m->rows, 1);
+}
+
+Matrix *matrix_diagonal_view(Matrix *m) {
+  int n = m->rows < m->cols ? m->rows : m->cols;
+  Matrix *view = view_alloc(n, 1);
+
+  if (view == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < n; i++) {
+    view->data[i] = m->data[i] + i;
+  }
+  return view;
+}
+
+void matrix_view_free(Matrix *view) { free(view); }
+
+// In place operations
+// -----------------------------------------------------------------------------
+static int same_shape(Matrix *a, Matrix *b, const char *name) {
+  if (a->rows != b->rows || a->cols != b->cols) {
+    fprintf(stderr, "Error: %s() shapes %dx%d and %dx%d do not match", name,
+            a->rows, a->cols, b->rows, b->cols);
+    return 0;
+  }
+  return 1;
+}
+
+static double dot_rows(long begin, long end, void *ctx) {
+  ViewJob *job = ctx;
+  double sum = 0.0;
+
+  for (long i = begin; i < end; i++) {
+    const double *a = job->y->data[i], *b = job->x->data[i];
+    for (int j = 0; j < job->y->cols; j++) {
+      sum += a[j] * b[j];
+    }
+  }
+  return sum;
+}
+
+static double add(double a, double b) { return a + b; }
+
+static void axpy_rows(long begin, long end, void *ctx) {
+  ViewJob *job = ctx;
+
+  for (long i = begin; i < end; i++) {
+    double *y = job->y->data[i];
+    const double *x = job->x->data[i];
+    for (int j = 0; j < job->y->cols; j++) {
+      y[j] += job->alpha * x[j];
+    }
+  }
+}
+
+static void scale_rows(long begin, long end, void *ctx) {
+  ViewJob *job = ctx;
+
+  for (long i = begin; i < end; i++) {
+    double *y = job->y->data[i];
+    for (int j = 0; j < job->y->cols; j++) {
+      y[j] *= job->alpha;
+    }
+  }
+}
+
+double matrix_dot(Matrix *a, Matrix *b) {
+  LAMS_PROF_BEGIN();
+  if (!same_shape(a, b, "matrix_dot")) {
+    return NAN;
+  }
+
+  ViewJob job = {a, b, 0.0};
+  double sum = lams_parallel_reduce(a->rows, lams_parallel_grain(a->cols), 0.0,
+                                    dot_rows, add, &job);
+
+  LAMS_PROF_END(matrix_dot, 2.0 * a->rows * a->cols);
+  return sum;
+}
+
+int matrix_axpy(Matrix *y, double alpha, Matrix *x) {
+  LAMS_PROF_BEGIN();
+  if (!same_shape(y, x, "matrix_axpy")) {
+    return -1;
+  }
+
+  ViewJob job = {y, x, alpha};
+  lams_parallel_for(y->rows, lams_parallel_grain(y->cols), axpy_rows, &job);
+
+  LAMS_PROF_END(matrix_axpy, 2.0 * y->rows * y->cols);
+  return 0;
+}
+
+void matrix_scale_in_place(Matrix *m, double s) {
+  LAMS_PROF_BEGIN();
+  ViewJob job = {m, NULL, s};
+  lams_parallel_for(m->rows, lams_parallel_grain(m->cols), scale_rows, &job);
+  LAMS_PROF_END(matrix_scale_in_place, (double)m->rows * m->cols);
+}
+
+int matrix_copy_into(Matrix *dst, Matrix *src) {
+  if (!same_shape(dst, src, "matrix_copy_into")) {
+    return -1;
+  }
+
+  for (int i = 0; i < dst->rows; i++) {
+    memmove(dst->data[i], src->data[i], dst->cols * sizeof(double));
+  }
+  return 0;
+}
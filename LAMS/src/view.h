@@ -0,0 +1,41 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "linear_algebra.h"
+
+/*
+ * Non-owning views of Vector and Matrix memory
+ *
+ * A row of a Matrix is contiguous, so a row view is a plain Vector whose
+ * data points into the row. Vector views are returned by value and have
+ * nothing to free; size is 0 and data NULL for an out of range request.
+ *
+ * A Matrix view is a Matrix whose row pointers point into the rows of
+ * another one, so a sub-block, a column (rows x 1) or the diagonal
+ * (n x 1) can be passed to every Matrix function without copying, and
+ * writes through the view land in the parent. A view holds only its row
+ * pointers, it is released with matrix_view_free (never matrix_free) and
+ * must not outlive the parent.
+ *
+ * Functions returning a new Matrix leave views alone, the in-place ones
+ * below write through them. They need operands of the same shape.
+ *
+ */
+
+Vector vector_view(Vector *v, int offset, int size);
+Vector matrix_row_view(Matrix *m, int row);
+
+Matrix *matrix_view(Matrix *m, int row, int col, int rows, int cols);
+Matrix *matrix_column_view(Matrix *m, int col);
+Matrix *matrix_diagonal_view(Matrix *m);
+void matrix_view_free(Matrix *view);
+
+// Sum of a_ij * b_ij, the dot product of two columns or rows
+double matrix_dot(Matrix *a, Matrix *b);
+
+// y += alpha * x, m *= s and dst = src in place
+int matrix_axpy(Matrix *y, double alpha, Matrix *x);
+void matrix_scale_in_place(Matrix *m, double s);
+int matrix_copy_into(Matrix *dst, Matrix *src);
+
+#endif
@@ -0,0 +1,308 @@
+#include "vmath.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Four double lanes and the matching signed 64-bit integer lanes. Comparisons
+// between vd values give vl masks with all bits set in the true lanes.
+typedef double vd __attribute__((vector_size(32)));
+typedef int64_t vl __attribute__((vector_size(32)));
+
+#define LANES 4
+
+// The helpers are always inlined into the array loops, so their 32-byte
+// vector arguments never cross a call boundary (-Wno-psabi in the Makefile)
+#define VMATH_INLINE static inline __attribute__((always_inline))
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define VMATH_TARGET __attribute__((target_clones("arch=x86-64-v3", "default")))
+#else
+#define VMATH_TARGET
+#endif
+
+static const double LN2_HI = 6.93147180369123816490e-01;
+static const double LN2_LO = 1.90821492927058770002e-10;
+static const double LOG2E = 1.44269504088896338700e+00;
+static const double SHIFT = 0x1.8p52;
+static const int64_t SHIFT_BITS = 0x4338000000000000LL;
+static const int64_t SIGN_BIT = INT64_MIN;
+static const double TWO_OVER_SQRT_PI = 1.12837916709551257390e+00;
+
+// 1/n! for n = 0..13, enough for |r| <= ln2/2 to stay below 1 ULP
+static const double EXP_COEFF[14] = {
+    1.0,
+    1.0,
+    1.0 / 2,
+    1.0 / 6,
+    1.0 / 24,
+    1.0 / 120,
+    1.0 / 720,
+    1.0 / 5040,
+    1.0 / 40320,
+    1.0 / 362880,
+    1.0 / 3628800,
+    1.0 / 39916800,
+    1.0 / 479001600,
+    1.0 / 6227020800.0,
+};
+
+// (-1)^n / (n! (2n+1)) for n = 0..24, the erf Taylor coefficients without
+// the 2/sqrt(pi) factor
+static const double ERF_COEFF[25] = {
+    1.0 / 1,
+    -1.0 / 3,
+    1.0 / 10,
+    -1.0 / 42,
+    1.0 / 216,
+    -1.0 / 1320,
+    1.0 / 9360,
+    -1.0 / 75600,
+    1.0 / 685440,
+    -1.0 / 6894720,
+    1.0 / 76204800,
+    -1.0 / 918086400,
+    1.0 / 11975040000.0,
+    -1.0 / 168129561600.0,
+    1.0 / 2528170444800.0,
+    -1.0 / 40537905408000.0,
+    1.0 / 690452066304000.0,
+    -1.0 / 12449059983360000.0,
+    1.0 / 236887827111936000.0,
+    -1.0 / 4744158915944448000.0,
+    1.0 / 99748982335242240000.0,
+    -1.0 / 2196910513383505920000.0,
+    1.0 / 50580032749992345600000.0,
+    -1.0 / 1215044786727593902080000.0,
+    1.0 / 30401971684928732528640000.0,
+};
+
+// erf(1 + j/8) for j = 0..40, rounded from quad precision
+static const double ERF_CENTER[41] = {
+    0.84270079294971489,
+    0.88838823170170778,
+    0.92290012825645829,
+    0.94817007278209031,
+    0.96610514647531076,
+    0.97844373323998368,
+    0.98667167121918242,
+    0.99199005767011994,
+    0.99532226501895271,
+    0.99734597064051767,
+    0.99853728341331882,
+    0.9992170617821089,
+    0.99959304798255499,
+    0.99979462426385879,
+    0.99989937807788032,
+    0.99995214516025621,
+    0.99997790950300136,
+    0.99999010326537474,
+    0.99999569722053627,
+    0.9999981847185726,
+    0.99999925690162761,
+    0.99999970485980749,
+    0.99999988627274339,
+    0.99999995748605597,
+    0.99999998458274209,
+    0.99999999457659916,
+    0.99999999814942586,
+    0.99999999938751671,
+    0.99999999980338394,
+    0.99999999993878386,
+    0.9999999999815149,
+    0.99999999999458655,
+    0.99999999999846256,
+    0.99999999999957656,
+    0.99999999999988687,
+    0.99999999999997069,
+    0.99999999999999267,
+    0.99999999999999822,
+    0.99999999999999956,
+    0.99999999999999989,
+    1,
+};
+
+VMATH_INLINE vd splat(double c) { return (vd){c, c, c, c}; }
+
+VMATH_INLINE vd select(vl mask, vd a, vd b) {
+  return (vd)(((vl)a & mask) | ((vl)b & ~mask));
+}
+
+VMATH_INLINE vd vabs(vd x) { return (vd)((vl)x & ~SIGN_BIT); }
+
+VMATH_INLINE vd copy_sign(vd magnitude, vd sign) {
+  return (vd)(((vl)magnitude & ~SIGN_BIT) | ((vl)sign & SIGN_BIT));
+}
+
+VMATH_INLINE int any(vl mask) {
+  return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+// 2^k as two factors so that results in the subnormal range and just below
+// overflow are reached without an intermediate overflow or double rounding
+VMATH_INLINE vd scale_pow2(vd p, vl k) {
+  vl k1 = k >> 1;
+  vl k2 = k - k1;
+  return p * (vd)((k1 + 1023) << 52) * (vd)((k2 + 1023) << 52);
+}
+
+// Reduces x = k ln2 + r with |r| <= ln2/2 and returns q = e^r - 1
+VMATH_INLINE vd exp_reduce(vd x, vl *k) {
+  vd t = x * LOG2E + SHIFT;
+  vd kd = t - SHIFT;
+  *k = (vl)t - SHIFT_BITS;
+
+  vd r = (x - kd * LN2_HI) - kd * LN2_LO;
+  vd q = splat(EXP_COEFF[13]);
+  for (int i = 12; i >= 1; i--) {
+    q = q * r + EXP_COEFF[i];
+  }
+  return q * r;
+}
+
+VMATH_INLINE vd v_exp(vd x) {
+  vd xc = select(x < -746.0, splat(-746.0), x);
+  xc = select(xc > 710.0, splat(710.0), xc);
+
+  vl k;
+  vd q = exp_reduce(xc, &k);
+  vd y = scale_pow2(q + 1.0, k);
+
+  return select(x != x, x, y);
+}
+
+// e^x - 1 = (2^k - 1) + 2^k q, exact for k == 0 so small x keeps full
+// relative precision. 2^k overflows above 709, where e^x - 1 rounds to e^x
+// and v_exp takes over up to its overflow threshold.
+VMATH_INLINE vd v_expm1(vd x) {
+  vd xc = select(x < -746.0, splat(-746.0), x);
+  xc = select(xc > 709.0, splat(709.0), xc);
+
+  vl k;
+  vd q = exp_reduce(xc, &k);
+  vd s = scale_pow2(splat(1.0), k);
+  vd y = (s - 1.0) + s * q;
+
+  vl large = x > 709.0;
+  if (any(large)) {
+    y = select(large, v_exp(x), y);
+  }
+  return select(x != x, x, y);
+}
+
+// log(x) = e ln2 + log(m) with m in [sqrt(1/2), sqrt(2)), log(m) from the
+// atanh series in s = f / (2 + f), f = m - 1
+VMATH_INLINE vd v_log(vd x) {
+  vl subnormal = (x < DBL_MIN) & (x > 0.0);
+  vd xs = select(subnormal, x * 0x1p54, x);
+  vl bits = (vl)xs;
+
+  vl e = ((bits >> 52) & 0x7ff) - 1023 - (subnormal & 54);
+  vd m = (vd)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+  vl big = m > 1.41421356237309504880;
+  m = select(big, m * 0.5, m);
+  e = e - big; // big lanes are -1
+
+  vd f = m - 1.0;
+  vd s = f / (f + 2.0);
+  vd z = s * s;
+  vd hfsq = 0.5 * f * f;
+
+  // R = 2z/3 + 2z^2/5 + ... + 2z^10/21
+  vd R = splat(2.0 / 21);
+  for (int i = 9; i >= 1; i--) {
+    R = R * z + 2.0 / (2 * i + 1);
+  }
+  R = R * z;
+
+  vd dk = __builtin_convertvector(e, vd);
+  vd y = dk * LN2_HI - ((hfsq - (s * (hfsq + R) + dk * LN2_LO)) - f);
+
+  y = select(x == 0.0, splat(-INFINITY), y);
+  y = select(x < 0.0, splat(NAN), y);
+  y = select(x == INFINITY, x, y);
+  return select(x != x, x, y);
+}
+
+// For |x| < 1 the Taylor series erf(x) = 2/sqrt(pi) sum (-1)^n x^(2n+1) /
+// (n! (2n+1)). Above that the Taylor series around the nearest tabulated
+// c = 1 + j/8, with the derivatives of erf from the Hermite polynomials:
+// erf(c + h) = erf(c) + 2/sqrt(pi) e^(-c^2) sum (-1)^(n-1) H_(n-1)(c) h^n / n!
+VMATH_INLINE vd v_erf(vd x) {
+  vd ax = vabs(x);
+  vl small = ax < 1.0;
+  vd y = splat(1.0);
+
+  if (any(small)) {
+    vd a = select(small, ax, splat(0.0));
+    vd z = a * a;
+    vd q = splat(ERF_COEFF[24]);
+    for (int i = 23; i >= 1; i--) {
+      q = q * z + ERF_COEFF[i];
+    }
+    q = q * z;
+    vd ka = a * TWO_OVER_SQRT_PI;
+    y = select(small, ka + ka * q, y);
+  }
+
+  vl mid = (ax >= 1.0) & (ax < 6.0);
+  if (any(mid)) {
+    vd a = select(mid, ax, splat(1.0));
+    vd t = (a - 1.0) * 8.0 + SHIFT;
+    vl j = (vl)t - SHIFT_BITS;
+    vd c = 1.0 + (t - SHIFT) * 0.125;
+    vd h = a - c; // exact, |h| <= 1/16
+
+    vd base;
+    for (int i = 0; i < LANES; i++) {
+      base[i] = ERF_CENTER[j[i]];
+    }
+
+    vd h_prev = splat(0.0), h_cur = splat(1.0);
+    vd p = h, sum = h;
+    for (int n = 1; n < 16; n++) {
+      vd h_next = 2.0 * c * h_cur - (2.0 * (n - 1)) * h_prev;
+      h_prev = h_cur;
+      h_cur = h_next;
+      p = p * h * (-1.0 / (n + 1));
+      sum = sum + h_cur * p;
+    }
+    vd corr = TWO_OVER_SQRT_PI * v_exp(-(c * c)) * sum;
+    y = select(mid, base + corr, y);
+  }
+
+  y = select(x != x, x, y);
+  return copy_sign(y, x);
+}
+
+// tanh(x) = e / (e + 2) with e = expm1(2|x|), saturated above |x| = 22
+VMATH_INLINE vd v_tanh(vd x) {
+  vd ax = vabs(x);
+  ax = select(ax > 22.0, splat(22.0), ax);
+  vd e = v_expm1(2.0 * ax);
+  vd y = e / (e + 2.0);
+  return copy_sign(y, x);
+}
+
+#define VMATH_ARRAY(name, kernel, pad)                                         \
+  VMATH_TARGET void name(const double *x, double *y, long n) {                 \
+    long i = 0;                                                                \
+    for (; i + LANES <= n; i += LANES) {                                       \
+      vd v;                                                                    \
+      memcpy(&v, x + i, sizeof(v));                                            \
+      v = kernel(v);                                                           \
+      memcpy(y + i, &v, sizeof(v));                                            \
+    }                                                                          \
+    if (i < n) {                                                               \
+      vd v = splat(pad);                                                       \
+      memcpy(&v, x + i, (n - i) * sizeof(double));                             \
+      v = kernel(v);                                                           \
+      memcpy(y + i, &v, (n - i) * sizeof(double));                             \
+    }                                                                          \
+  }
+
+VMATH_ARRAY(vmath_exp, v_exp, 0.0)
+VMATH_ARRAY(vmath_expm1, v_expm1, 0.0)
+VMATH_ARRAY(vmath_log, v_log, 1.0)
+VMATH_ARRAY(vmath_erf, v_erf, 0.0)
+VMATH_ARRAY(vmath_tanh, v_tanh, 0.0)
@@ -0,0 +1,29 @@
+#ifndef VMATH_H
+#define VMATH_H
+
+/*
+ * Vectorized transcendental functions over contiguous double arrays
+ *
+ * Each function evaluates four lanes at a time with GCC vector extensions
+ * and handles the tail through a padded block, so any length works and
+ * x == y (in place) is allowed. On x86-64 an AVX2/FMA clone is picked at
+ * load time when the CPU supports it.
+ *
+ * Maximum error against glibc's libm, measured over the ranges exercised
+ * in tests/tests.c (the tests allow one more ULP for libm itself):
+ *
+ *   vmath_exp    1 ULP    (overflow to inf, underflow through subnormals)
+ *   vmath_expm1  2 ULP
+ *   vmath_log    1 ULP    (x < 0 gives NaN, x == 0 gives -inf)
+ *   vmath_erf    2 ULP
+ *   vmath_tanh   4 ULP
+ *
+ */
+
+void vmath_exp(const double *x, double *y, long n);
+void vmath_expm1(const double *x, double *y, long n);
+void vmath_log(const double *x, double *y, long n);
+void vmath_erf(const double *x, double *y, long n);
+void vmath_tanh(const double *x, double *y, long n);
+
+#endif
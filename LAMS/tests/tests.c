@@ -1,4 +1,27 @@
+#include "../src/categorical.h"
+#include "../src/conv.h"
+#include "../src/disk.h"
+#include "../src/distribution.h"
+#include "../src/elementwise.h"
+#include "../src/instrument.h"
+#include "../src/kron.h"
 #include "../src/linear_algebra.h"
+#include "../src/lowrank.h"
+#include "../src/moments.h"
+#include "../src/mvnormal.h"
+#include "../src/parallel.h"
+#include "../src/pipeline.h"
+#include "../src/quant.h"
+#include "../src/random.h"
+#include "../src/reduce.h"
+#include "../src/small.h"
+#include "../src/stats.h"
+#include "../src/structured.h"
+#include "../src/view.h"
+#include "../src/vmath.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
 // Unit tests
 // -----------------------------------------------------------------------------
@@ -506,6 +529,2953 @@ void test_tensor_sub() {
   matrix_free(m);
 }
 
+// Instrumentation tests
+// -----------------------------------------------------------------------------
+void test_instrument_counters() {
+  lams_snapshot_t s;
+  int enabled = lams_instrument_enabled();
+
+  lams_instrument_reset();
+  Matrix *a = matrix_identity(4);
+  Matrix *b = matrix_multiply(a, a);
+  lams_instrument_snapshot(&s);
+
+  assert(s.kernels[LAMS_K_matrix_multiply].calls == (enabled ? 1 : 0));
+  assert(s.kernels[LAMS_K_matrix_multiply].flops == (enabled ? 128 : 0));
+  assert(s.kernels[LAMS_K_matrix_new].calls == (enabled ? 2 : 0));
+  if (enabled) {
+    assert(s.kernels[LAMS_K_matrix_new].bytes_allocated > 2 * 16 * 8);
+  }
+
+  lams_instrument_reset();
+  lams_instrument_snapshot(&s);
+  assert(s.kernels[LAMS_K_matrix_multiply].calls == 0);
+
+  matrix_free(a);
+  matrix_free(b);
+}
+
+void test_instrument_dump() {
+  lams_snapshot_t s;
+  char buf[4096];
+
+  lams_instrument_reset();
+  Vector *v = vector_new(8);
+  vector_free(v);
+  lams_instrument_snapshot(&s);
+
+  FILE *f = tmpfile();
+  assert(lams_instrument_dump_json(f, &s) == 0);
+  rewind(f);
+  size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+  buf[len] = '\0';
+  assert(strstr(buf, "\"kernels\"") != NULL);
+  if (lams_instrument_enabled()) {
+    assert(strstr(buf, "\"vector_new\": {\"calls\": 1") != NULL);
+  }
+  fclose(f);
+
+  f = tmpfile();
+  assert(lams_instrument_dump_prometheus(f, &s) == 0);
+  rewind(f);
+  len = fread(buf, 1, sizeof(buf) - 1, f);
+  buf[len] = '\0';
+  assert(strstr(buf, "# TYPE lams_kernel_calls_total counter") != NULL);
+  if (lams_instrument_enabled()) {
+    assert(strstr(buf, "lams_kernel_calls_total{kernel=\"vector_new\"} 1") !=
+           NULL);
+  }
+  fclose(f);
+}
+
+// Structured matrix tests
+// -----------------------------------------------------------------------------
+Matrix *test_matrix_from(int rows, int cols, double *data) {
+  Matrix *m = matrix_new(rows, cols);
+  matrix_set(m, data, rows * cols);
+  return m;
+}
+
+void test_diagonal() {
+  double d[] = {1.0, 2.0, 4.0};
+  double md[] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0};
+  Vector *v = vector_from_array(3, d);
+  Matrix *m = test_matrix_from(3, 3, md);
+  DiagonalMatrix *dm = diagonal_from_vector(v);
+
+  Matrix *dense = diagonal_to_matrix(dm);
+  assert(dense->data[1][1] == 2.0);
+  assert(dense->data[0][1] == 0.0);
+
+  Matrix *left = diagonal_multiply_matrix(dm, m);
+  Matrix *right = matrix_multiply_diagonal(m, dm);
+  Matrix *left_dense = matrix_multiply(dense, m);
+  Matrix *right_dense = matrix_multiply(m, dense);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      assert(left->data[i][j] == left_dense->data[i][j]);
+      assert(right->data[i][j] == right_dense->data[i][j]);
+    }
+  }
+
+  Vector *x = diagonal_solve(dm, v);
+  for (int i = 0; i < 3; i++) {
+    assert(x->data[i] == 1.0);
+  }
+
+  vector_free(v);
+  vector_free(x);
+  matrix_free(m);
+  matrix_free(dense);
+  matrix_free(left);
+  matrix_free(right);
+  matrix_free(left_dense);
+  matrix_free(right_dense);
+  diagonal_free(dm);
+}
+
+void test_banded() {
+  int n = 6;
+  Matrix *m = matrix_new(n, n);
+  Vector *v = vector_new(n);
+  matrix_fill(m, 0.0);
+  for (int i = 0; i < n; i++) {
+    v->data[i] = i + 1;
+    m->data[i][i] = 4.0;
+    if (i > 0) {
+      m->data[i][i - 1] = -1.0;
+    }
+    if (i + 2 < n) {
+      m->data[i][i + 2] = 2.0;
+    }
+  }
+
+  BandedMatrix *b = banded_from_matrix(m, 1, 2);
+  assert(banded_get(b, 0, 2) == 2.0);
+  assert(banded_get(b, 0, 3) == 0.0);
+
+  Matrix *dense = banded_to_matrix(b);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      assert(dense->data[i][j] == m->data[i][j]);
+    }
+  }
+
+  Vector *y = banded_multiply_vector(b, v);
+  Matrix *y_dense = matrix_multiply_vector(m, v);
+  for (int i = 0; i < n; i++) {
+    assert(y->data[i] == y_dense->data[i][0]);
+  }
+
+  Matrix *p = banded_multiply_matrix(b, m);
+  Matrix *p_dense = matrix_multiply(m, m);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      assert(p->data[i][j] == p_dense->data[i][j]);
+    }
+  }
+
+  vector_free(v);
+  vector_free(y);
+  matrix_free(m);
+  matrix_free(dense);
+  matrix_free(y_dense);
+  matrix_free(p);
+  matrix_free(p_dense);
+  banded_free(b);
+}
+
+void test_banded_solve() {
+  int n = 8;
+  BandedMatrix *b = banded_new(n, 2, 1);
+  Vector *x = vector_new(n);
+
+  // Small diagonal entries force row swaps inside the band
+  for (int i = 0; i < n; i++) {
+    x->data[i] = i - 3.0;
+    banded_set(b, i, i, 0.1 * (i + 1));
+    if (i > 0) {
+      banded_set(b, i, i - 1, 3.0);
+    }
+    if (i > 1) {
+      banded_set(b, i, i - 2, -1.0);
+    }
+    if (i + 1 < n) {
+      banded_set(b, i, i + 1, 1.0);
+    }
+  }
+
+  Vector *rhs = banded_multiply_vector(b, x);
+  Vector *solved = banded_solve(b, rhs);
+  assert(solved != NULL);
+  for (int i = 0; i < n; i++) {
+    assert(fabs(solved->data[i] - x->data[i]) < 1e-9);
+  }
+
+  vector_free(x);
+  vector_free(rhs);
+  vector_free(solved);
+  banded_free(b);
+}
+
+void test_symmetric() {
+  double data[] = {4.0, 1.0, 2.0, 1.0, 5.0, 3.0, 2.0, 3.0, 6.0};
+  double vd[] = {1.0, -2.0, 3.0};
+  Matrix *m = test_matrix_from(3, 3, data);
+  Vector *v = vector_from_array(3, vd);
+  SymmetricMatrix *s = symmetric_from_matrix(m);
+
+  assert(symmetric_get(s, 0, 2) == 2.0);
+  assert(symmetric_get(s, 2, 0) == 2.0);
+
+  Matrix *dense = symmetric_to_matrix(s);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      assert(dense->data[i][j] == m->data[i][j]);
+    }
+  }
+
+  Vector *y = symmetric_multiply_vector(s, v);
+  Matrix *y_dense = matrix_multiply_vector(m, v);
+  for (int i = 0; i < 3; i++) {
+    assert(y->data[i] == y_dense->data[i][0]);
+  }
+
+  Matrix *p = symmetric_multiply_matrix(s, m);
+  Matrix *p_dense = matrix_multiply(m, m);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      assert(fabs(p->data[i][j] - p_dense->data[i][j]) < 1e-12);
+    }
+  }
+
+  Vector *x = symmetric_solve(s, y);
+  assert(x != NULL);
+  for (int i = 0; i < 3; i++) {
+    assert(fabs(x->data[i] - v->data[i]) < 1e-12);
+  }
+
+  vector_free(v);
+  vector_free(y);
+  vector_free(x);
+  matrix_free(m);
+  matrix_free(dense);
+  matrix_free(y_dense);
+  matrix_free(p);
+  matrix_free(p_dense);
+  symmetric_free(s);
+}
+
+void test_triangular() {
+  double data[] = {2.0, 1.0, -1.0, 3.0, 4.0, 2.0, 5.0, 1.0, 8.0};
+  double vd[] = {1.0, 2.0, 3.0};
+  Matrix *m = test_matrix_from(3, 3, data);
+  Vector *v = vector_from_array(3, vd);
+
+  for (int t = 0; t < 2; t++) {
+    Triangle uplo = t == 0 ? TRIANGLE_LOWER : TRIANGLE_UPPER;
+    TriangularMatrix *tri = triangular_from_matrix(m, uplo);
+    Matrix *dense = triangular_to_matrix(tri);
+
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        int inside = uplo == TRIANGLE_LOWER ? j <= i : j >= i;
+        assert(dense->data[i][j] == (inside ? m->data[i][j] : 0.0));
+      }
+    }
+
+    Vector *y = triangular_multiply_vector(tri, v);
+    Matrix *y_dense = matrix_multiply_vector(dense, v);
+    for (int i = 0; i < 3; i++) {
+      assert(y->data[i] == y_dense->data[i][0]);
+    }
+
+    Vector *x = triangular_solve(tri, y);
+    for (int i = 0; i < 3; i++) {
+      assert(fabs(x->data[i] - v->data[i]) < 1e-12);
+    }
+
+    Matrix *p = triangular_multiply_matrix(tri, m);
+    Matrix *p_dense = matrix_multiply(dense, m);
+    Matrix *back = triangular_solve_matrix(tri, p);
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        assert(p->data[i][j] == p_dense->data[i][j]);
+        assert(fabs(back->data[i][j] - m->data[i][j]) < 1e-12);
+      }
+    }
+
+    vector_free(y);
+    vector_free(x);
+    matrix_free(dense);
+    matrix_free(y_dense);
+    matrix_free(p);
+    matrix_free(p_dense);
+    matrix_free(back);
+    triangular_free(tri);
+  }
+
+  vector_free(v);
+  matrix_free(m);
+}
+
+// Small matrix tests
+// -----------------------------------------------------------------------------
+void test_small_vectors() {
+  Vec3 a = {{1.0, 2.0, 3.0}};
+  Vec3 b = {{4.0, 5.0, 6.0}};
+
+  Vec3 sum = vec3_add(a, b);
+  Vec3 diff = vec3_sub(a, b);
+  Vec3 scaled = vec3_scale(a, 2.0);
+  assert(sum.data[2] == 9.0);
+  assert(diff.data[0] == -3.0);
+  assert(scaled.data[1] == 4.0);
+  assert(vec3_dot(a, b) == 32.0);
+  assert(vec3_norm(a) == sqrt(14.0));
+
+  Vec3 c = vec3_cross(a, b);
+  assert(c.data[0] == -3.0);
+  assert(c.data[1] == 6.0);
+  assert(c.data[2] == -3.0);
+
+  Vector *v = vec3_to_vector(c);
+  Vec3 back = vec3_from_vector(v);
+  assert(v->size == 3);
+  for (int i = 0; i < 3; i++) {
+    assert(back.data[i] == c.data[i]);
+  }
+  vector_free(v);
+
+  Vec4 d = vec4_normalize((Vec4){{2.0, 0.0, 0.0, 0.0}});
+  assert(d.data[0] == 1.0);
+}
+
+void test_small_matrices() {
+  Mat2 m2 = {{{4.0, 7.0}, {2.0, 6.0}}};
+  Mat3 m3 = {{{2.0, -1.0, 0.0}, {-1.0, 2.0, -1.0}, {0.0, -1.0, 2.0}}};
+  Mat4 m4 = {{{4.0, 0.0, 0.0, 1.0},
+              {1.0, 3.0, 0.0, 2.0},
+              {0.0, 1.0, 2.0, 0.0},
+              {1.0, 0.0, 1.0, 5.0}}};
+
+  assert(mat2_det(m2) == 10.0);
+  assert(fabs(mat3_det(m3) - 4.0) < 1e-12);
+
+  Matrix *dense = mat4_to_matrix(m4);
+  assert(dense->data[1][3] == 2.0);
+  Mat4 from = mat4_from_matrix(dense);
+  assert(from.data[3][3] == 5.0);
+  matrix_free(dense);
+
+  Mat2 p2 = mat2_multiply(m2, mat2_inverse(m2));
+  Mat3 p3 = mat3_multiply(m3, mat3_inverse(m3));
+  Mat4 p4 = mat4_multiply(mat4_inverse(m4), m4);
+  Mat4 id = mat4_identity();
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      if (i < 2 && j < 2) {
+        assert(fabs(p2.data[i][j] - id.data[i][j]) < 1e-12);
+      }
+      if (i < 3 && j < 3) {
+        assert(fabs(p3.data[i][j] - id.data[i][j]) < 1e-12);
+      }
+      assert(fabs(p4.data[i][j] - id.data[i][j]) < 1e-12);
+    }
+  }
+
+  Mat3 t = mat3_transpose(mat3_sub(mat3_add(m3, m3), mat3_scale(m3, 1.0)));
+  Vec3 mv = mat3_multiply_vec(t, (Vec3){{1.0, 1.0, 1.0}});
+  assert(mv.data[0] == 1.0);
+  assert(mv.data[1] == 0.0);
+  assert(mv.data[2] == 1.0);
+}
+
+void test_small_transform_points() {
+  Mat4 m = mat4_identity();
+  m.data[0][3] = 1.0;
+  m.data[1][3] = -2.0;
+  m.data[0][0] = 2.0;
+
+  Vec3 points[3] = {{{0.0, 0.0, 0.0}}, {{1.0, 1.0, 1.0}}, {{-1.0, 2.0, 3.0}}};
+  Vec3 out[3];
+  mat4_transform_points(m, points, out, 3);
+  assert(out[0].data[0] == 1.0 && out[0].data[1] == -2.0);
+  assert(out[1].data[0] == 3.0 && out[1].data[2] == 1.0);
+  assert(out[2].data[0] == -1.0 && out[2].data[1] == 0.0);
+
+  Mat3 r = {{{0.0, -1.0, 0.0}, {1.0, 0.0, 0.0}, {0.0, 0.0, 1.0}}};
+  mat3_multiply_vec_array(r, points, out, 3);
+  assert(out[1].data[0] == -1.0 && out[1].data[1] == 1.0);
+}
+
+// Element-wise tests
+// -----------------------------------------------------------------------------
+// Distance in representable doubles, a and b of the same sign
+static int64_t ulp_distance(double a, double b) {
+  int64_t ia, ib;
+  memcpy(&ia, &a, sizeof(ia));
+  memcpy(&ib, &b, sizeof(ib));
+  return ia > ib ? ia - ib : ib - ia;
+}
+
+static void check_vmath(void (*fn)(const double *, double *, long),
+                        double (*ref)(double), double lo, double hi,
+                        int64_t max_ulp) {
+  int n = 20001;
+  double *x = malloc(n * sizeof(double));
+  double *y = malloc(n * sizeof(double));
+
+  for (int i = 0; i < n; i++) {
+    x[i] = lo + (hi - lo) * i / (n - 1);
+  }
+  fn(x, y, n);
+
+  for (int i = 0; i < n; i++) {
+    double r = ref(x[i]);
+    if (r == 0.0 || y[i] == 0.0) {
+      assert(y[i] == r);
+    } else {
+      assert(ulp_distance(y[i], r) <= max_ulp);
+    }
+  }
+
+  free(x);
+  free(y);
+}
+
+static double log_of_exp(double x) { return log(exp(x)); }
+
+static void vmath_log_of_exp(const double *x, double *y, long n) {
+  for (long i = 0; i < n; i++) {
+    y[i] = exp(x[i]);
+  }
+  vmath_log(y, y, n);
+}
+
+void test_vmath_accuracy() {
+  // Bounds from vmath.h plus one ULP for libm itself
+  check_vmath(vmath_exp, exp, -745.0, 709.7, 2);
+  check_vmath(vmath_exp, exp, -1.0, 1.0, 2);
+  check_vmath(vmath_expm1, expm1, -40.0, 709.78, 3);
+  check_vmath(vmath_expm1, expm1, -1e-3, 1e-3, 3);
+  check_vmath(vmath_log_of_exp, log_of_exp, -740.0, 709.0, 2);
+  check_vmath(vmath_erf, erf, -7.0, 7.0, 3);
+  check_vmath(vmath_erf, erf, -0.5, 0.5, 3);
+  check_vmath(vmath_tanh, tanh, -25.0, 25.0, 5);
+  check_vmath(vmath_tanh, tanh, -0.01, 0.01, 5);
+}
+
+void test_vmath_special() {
+  double x[7] = {0.0, -0.0, INFINITY, -INFINITY, NAN, -1.0, 5e-324};
+  double y[7];
+
+  vmath_exp(x, y, 7);
+  assert(y[0] == 1.0 && y[2] == INFINITY && y[3] == 0.0 && isnan(y[4]));
+  vmath_expm1(x, y, 7);
+  assert(y[0] == 0.0 && y[2] == INFINITY && y[3] == -1.0 && isnan(y[4]));
+  double big[4] = {709.5, 709.78, 709.79, 1e4};
+  vmath_expm1(big, y, 4);
+  assert(ulp_distance(y[0], expm1(709.5)) <= 2);
+  assert(ulp_distance(y[1], expm1(709.78)) <= 2);
+  assert(y[2] == INFINITY && y[3] == INFINITY);
+  vmath_log(x, y, 7);
+  assert(y[0] == -INFINITY && y[2] == INFINITY && isnan(y[3]));
+  assert(isnan(y[4]) && isnan(y[5]) && y[6] == log(5e-324));
+  vmath_erf(x, y, 7);
+  assert(y[1] == 0.0 && signbit(y[1]) && y[2] == 1.0 && y[3] == -1.0);
+  vmath_tanh(x, y, 7);
+  assert(y[0] == 0.0 && y[2] == 1.0 && y[3] == -1.0 && isnan(y[4]));
+
+  // Every tail length, in place
+  for (int n = 1; n <= 7; n++) {
+    double z[7] = {0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 3.5};
+    vmath_exp(z, z, n);
+    for (int i = 0; i < 7; i++) {
+      double expected = i < n ? exp(0.5 * (i + 1)) : 0.5 * (i + 1);
+      assert(fabs(z[i] - expected) <= 4e-16 * expected);
+    }
+  }
+}
+
+static double add_one(double x) { return x + 1.0; }
+
+void test_elementwise_map() {
+  Matrix *m = test_matrix_from(2, 3, (double[]){-2, -1, 0, 1, 4, 9});
+
+  Matrix *sq = matrix_map(m, UNARY_SQUARE);
+  Matrix *ab = matrix_map(m, UNARY_ABS);
+  Matrix *ng = matrix_map(m, UNARY_NEG);
+  Matrix *ex = matrix_map(m, UNARY_EXP);
+  Matrix *ap = matrix_apply(m, add_one);
+  Matrix *cl = matrix_clamp(m, -1.0, 2.0);
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 3; j++) {
+      double x = m->data[i][j];
+      assert(sq->data[i][j] == x * x);
+      assert(ab->data[i][j] == fabs(x));
+      assert(ng->data[i][j] == -x);
+      assert(fabs(ex->data[i][j] - exp(x)) <= 4e-16 * exp(x));
+      assert(ap->data[i][j] == x + 1.0);
+      assert(cl->data[i][j] == (x < -1.0 ? -1.0 : x > 2.0 ? 2.0 : x));
+    }
+  }
+
+  Vector *v = vector_from_array(3, (double[]){1, 4, 9});
+  Vector *r = vector_map(v, UNARY_SQRT);
+  Vector *l = vector_map(v, UNARY_LOG);
+  assert(r->data[0] == 1.0 && r->data[1] == 2.0 && r->data[2] == 3.0);
+  assert(l->data[0] == 0.0 && fabs(l->data[1] - log(4.0)) < 1e-15);
+
+  Tensor *t = tensor_new(2, 3, 2);
+  tensor_insert(t, m, 0);
+  tensor_insert(t, sq, 1);
+  Tensor *tc = tensor_clamp(t, 0.0, 10.0);
+  Tensor *tt = tensor_map(t, UNARY_TANH);
+  assert(tc->data[0][0][0] == 0.0 && tc->data[1][1][2] == 10.0);
+  assert(fabs(tt->data[1][0][1] - tanh(1.0)) < 1e-15);
+
+  matrix_free(m);
+  matrix_free(sq);
+  matrix_free(ab);
+  matrix_free(ng);
+  matrix_free(ex);
+  matrix_free(ap);
+  matrix_free(cl);
+  vector_free(v);
+  vector_free(r);
+  vector_free(l);
+  tensor_free(t);
+  tensor_free(tc);
+  tensor_free(tt);
+}
+
+void test_elementwise_broadcast() {
+  Matrix *m = test_matrix_from(2, 3, (double[]){1, 2, 3, 4, 5, 6});
+  Vector *row = vector_from_array(3, (double[]){10, 20, 30});
+
+  Matrix *sum = matrix_binary_vector(m, row, BINARY_ADD);
+  assert(sum->rows == 2 && sum->cols == 3);
+  assert(sum->data[0][0] == 11.0 && sum->data[1][2] == 36.0);
+
+  Matrix *col = test_matrix_from(2, 1, (double[]){2, 3});
+  Matrix *line = test_matrix_from(1, 3, (double[]){1, 5, 9});
+  Matrix *outer = matrix_binary(col, line, BINARY_MUL);
+  Matrix *lo = matrix_binary(m, col, BINARY_MIN);
+  Matrix *hi = matrix_binary(line, m, BINARY_MAX);
+  assert(outer->rows == 2 && outer->cols == 3);
+  assert(outer->data[0][2] == 18.0 && outer->data[1][1] == 15.0);
+  assert(lo->data[0][2] == 2.0 && lo->data[1][0] == 3.0);
+  assert(hi->data[0][0] == 1.0 && hi->data[0][1] == 5.0);
+  assert(hi->data[1][1] == 5.0 && hi->data[1][2] == 9.0);
+
+  Vector *s = vector_from_array(1, (double[]){2});
+  Vector *q = vector_binary(row, s, BINARY_DIV);
+  Vector *d = vector_binary(s, row, BINARY_SUB);
+  assert(q->size == 3 && q->data[2] == 15.0);
+  assert(d->data[0] == -8.0 && d->data[2] == -28.0);
+
+  Tensor *t = tensor_new(2, 3, 2);
+  tensor_insert(t, m, 0);
+  tensor_insert(t, sum, 1);
+  Tensor *tm = tensor_binary_matrix(t, line, BINARY_SUB);
+  Tensor *tt = tensor_binary(t, t, BINARY_ADD);
+  assert(tm->rank == 2 && tm->rows == 2 && tm->cols == 3);
+  assert(tm->data[0][1][1] == 0.0 && tm->data[1][1][2] == 27.0);
+  assert(tt->data[1][0][0] == 22.0);
+
+  // Mismatched shapes
+  Vector *bad = vector_from_array(2, (double[]){1, 2});
+  assert(matrix_binary_vector(m, bad, BINARY_ADD) == NULL);
+  assert(vector_binary(row, bad, BINARY_ADD) == NULL);
+  Matrix *tall = test_matrix_from(3, 1, (double[]){1, 2, 3});
+  assert(matrix_binary(m, tall, BINARY_ADD) == NULL);
+
+  matrix_free(m);
+  vector_free(row);
+  matrix_free(sum);
+  matrix_free(col);
+  matrix_free(line);
+  matrix_free(outer);
+  matrix_free(lo);
+  matrix_free(hi);
+  vector_free(s);
+  vector_free(q);
+  vector_free(d);
+  tensor_free(t);
+  tensor_free(tm);
+  tensor_free(tt);
+  vector_free(bad);
+  matrix_free(tall);
+}
+
+void test_elementwise_parallel() {
+  // Large enough to be split across threads
+  int rows = 600, cols = 200;
+  Matrix *m = matrix_new(rows, cols);
+  Vector *v = vector_new(cols);
+  for (int j = 0; j < cols; j++) {
+    v->data[j] = j;
+  }
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      m->data[i][j] = (i - j) / 100.0;
+    }
+  }
+
+  Matrix *e = matrix_map(m, UNARY_ERF);
+  Matrix *s = matrix_binary_vector(m, v, BINARY_ADD);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      assert(fabs(e->data[i][j] - erf(m->data[i][j])) < 1e-15);
+      assert(s->data[i][j] == m->data[i][j] + j);
+    }
+  }
+
+  matrix_free(m);
+  vector_free(v);
+  matrix_free(e);
+  matrix_free(s);
+}
+
+// Reduction tests
+// -----------------------------------------------------------------------------
+void test_reduce_rows() {
+  Matrix *m =
+      test_matrix_from(2, 5, (double[]){1, -7, 3, 2, 1, 4, 4, -2, 0, 9});
+
+  Vector *sum = matrix_reduce(m, REDUCE_ROWS, REDUCE_SUM);
+  Vector *mean = matrix_reduce(m, REDUCE_ROWS, REDUCE_MEAN);
+  Vector *var = matrix_reduce(m, REDUCE_ROWS, REDUCE_VAR);
+  Vector *min = matrix_reduce(m, REDUCE_ROWS, REDUCE_MIN);
+  Vector *max = matrix_reduce(m, REDUCE_ROWS, REDUCE_MAX);
+  Vector *argmin = matrix_reduce(m, REDUCE_ROWS, REDUCE_ARGMIN);
+  Vector *argmax = matrix_reduce(m, REDUCE_ROWS, REDUCE_ARGMAX);
+  Vector *l1 = matrix_reduce(m, REDUCE_ROWS, REDUCE_NORM1);
+  Vector *l2 = matrix_reduce(m, REDUCE_ROWS, REDUCE_NORM2);
+  Vector *linf = matrix_reduce(m, REDUCE_ROWS, REDUCE_NORM_INF);
+
+  assert(sum->size == 2);
+  assert(sum->data[0] == 0.0 && sum->data[1] == 15.0);
+  assert(mean->data[0] == 0.0 && mean->data[1] == 3.0);
+  assert(var->data[0] == 64.0 / 5 && var->data[1] == 72.0 / 5);
+  assert(min->data[0] == -7.0 && min->data[1] == -2.0);
+  assert(max->data[0] == 3.0 && max->data[1] == 9.0);
+  assert(argmin->data[0] == 1.0 && argmin->data[1] == 2.0);
+  // First of the tied maxima
+  assert(argmax->data[0] == 2.0 && argmax->data[1] == 4.0);
+  assert(l1->data[0] == 14.0 && l1->data[1] == 19.0);
+  assert(l2->data[0] == 8.0 && l2->data[1] == sqrt(117.0));
+  assert(linf->data[0] == 7.0 && linf->data[1] == 9.0);
+
+  assert(matrix_norm_frobenius(m) == sqrt(181.0));
+
+  matrix_free(m);
+  vector_free(sum);
+  vector_free(mean);
+  vector_free(var);
+  vector_free(min);
+  vector_free(max);
+  vector_free(argmin);
+  vector_free(argmax);
+  vector_free(l1);
+  vector_free(l2);
+  vector_free(linf);
+}
+
+void test_reduce_cols() {
+  Matrix *m = test_matrix_from(3, 4, (double[]){1, -7, 3, 2, 4, 4, -2, 0, 9, 1,
+                                                 3, -5});
+  Matrix *t = matrix_transpose(m);
+
+  // Column reductions of m match row reductions of its transpose
+  for (int op = REDUCE_SUM; op <= REDUCE_NORM_INF; op++) {
+    Vector *cols = matrix_reduce(m, REDUCE_COLS, op);
+    Vector *rows = matrix_reduce(t, REDUCE_ROWS, op);
+    assert(cols->size == 4);
+    for (int j = 0; j < 4; j++) {
+      assert(fabs(cols->data[j] - rows->data[j]) < 1e-12);
+    }
+    vector_free(cols);
+    vector_free(rows);
+  }
+  matrix_free(m);
+  matrix_free(t);
+
+  // Few rows and many columns, one range spans several column tiles
+  m = matrix_new(5, 600);
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 600; j++) {
+      m->data[i][j] = ((i * 13 + j * 7) % 11) - 5.0;
+    }
+  }
+  t = matrix_transpose(m);
+  for (int op = REDUCE_SUM; op <= REDUCE_NORM_INF; op++) {
+    Vector *cols = matrix_reduce(m, REDUCE_COLS, op);
+    Vector *rows = matrix_reduce(t, REDUCE_ROWS, op);
+    for (int j = 0; j < 600; j++) {
+      assert(fabs(cols->data[j] - rows->data[j]) < 1e-12);
+    }
+    vector_free(cols);
+    vector_free(rows);
+  }
+  matrix_free(m);
+  matrix_free(t);
+
+  // NaN propagates the same way along both axes, wherever it sits
+  m = test_matrix_from(3, 4,
+                       (double[]){NAN, 1, 2, 3, 4, 5, NAN, 7, 8, NAN, 1, NAN});
+  t = matrix_transpose(m);
+  for (int op = REDUCE_MIN; op <= REDUCE_NORM_INF; op++) {
+    Vector *cols = matrix_reduce(m, REDUCE_COLS, op);
+    Vector *rows = matrix_reduce(t, REDUCE_ROWS, op);
+    for (int j = 0; j < 4; j++) {
+      assert(isnan(cols->data[j]) == isnan(rows->data[j]));
+      assert(isnan(cols->data[j]) || cols->data[j] == rows->data[j]);
+      assert(op == REDUCE_ARGMIN || op == REDUCE_ARGMAX ||
+             isnan(cols->data[j]));
+    }
+    if (op == REDUCE_ARGMIN || op == REDUCE_ARGMAX) {
+      assert(cols->data[0] == 0 && cols->data[1] == 2);
+      assert(cols->data[2] == 1 && cols->data[3] == 2);
+    }
+    vector_free(cols);
+    vector_free(rows);
+  }
+
+  matrix_free(m);
+  matrix_free(t);
+}
+
+void test_reduce_parallel() {
+  // Large enough to be split across threads along both axes
+  int rows = 300, cols = 400;
+  Matrix *m = matrix_new(rows, cols);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      m->data[i][j] = ((i * 31 + j * 17) % 23) - 11.0;
+    }
+  }
+  Matrix *t = matrix_transpose(m);
+
+  for (int op = REDUCE_SUM; op <= REDUCE_NORM_INF; op++) {
+    Vector *cols_m = matrix_reduce(m, REDUCE_COLS, op);
+    Vector *rows_t = matrix_reduce(t, REDUCE_ROWS, op);
+    for (int j = 0; j < cols; j++) {
+      assert(fabs(cols_m->data[j] - rows_t->data[j]) < 1e-9);
+    }
+    vector_free(cols_m);
+    vector_free(rows_t);
+  }
+
+  double sum = 0.0;
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      sum += m->data[i][j] * m->data[i][j];
+    }
+  }
+  assert(fabs(matrix_norm_frobenius(m) - sqrt(sum)) < 1e-9);
+
+  matrix_free(m);
+  matrix_free(t);
+}
+
+// Parallel runtime tests
+static void count_hits(long begin, long end, void *ctx) {
+  int *hits = ctx;
+  for (long i = begin; i < end; i++) {
+    __atomic_add_fetch(&hits[i], 1, __ATOMIC_RELAXED);
+  }
+}
+
+static void nested_hits(long begin, long end, void *ctx) {
+  int *hits = ctx;
+  for (long i = begin; i < end; i++) {
+    lams_parallel_for(64, 8, count_hits, hits + i * 64);
+  }
+}
+
+void test_parallel_for() {
+  assert(lams_num_threads() >= 1);
+
+  int n = 100000;
+  int *hits = calloc(n, sizeof(int));
+  lams_parallel_for(n, 1000, count_hits, hits);
+  for (int i = 0; i < n; i++) {
+    assert(hits[i] == 1);
+  }
+
+  // Nested loops share the pool and still cover every index once
+  memset(hits, 0, n * sizeof(int));
+  lams_parallel_for(n / 64, 4, nested_hits, hits);
+  for (int i = 0; i < n / 64 * 64; i++) {
+    assert(hits[i] == 1);
+  }
+
+  lams_parallel_for(0, 10, count_hits, hits);
+  free(hits);
+}
+
+static double sum_range(long begin, long end, void *ctx) {
+  const double *x = ctx;
+  double sum = 0.0;
+  for (long i = begin; i < end; i++) {
+    sum += x[i];
+  }
+  return sum;
+}
+
+static double add_doubles(double a, double b) { return a + b; }
+
+void test_parallel_reduce() {
+  int n = 200000;
+  double *x = malloc(n * sizeof(double));
+  for (int i = 0; i < n; i++) {
+    x[i] = 1.0 / (i + 1);
+  }
+
+  double first = lams_parallel_reduce(n, 1000, 0.0, sum_range, add_doubles, x);
+  double serial = sum_range(0, n, x);
+  assert(fabs(first - serial) < 1e-9);
+
+  // Same chunks every time, so the rounding is the same too
+  for (int k = 0; k < 10; k++) {
+    assert(lams_parallel_reduce(n, 1000, 0.0, sum_range, add_doubles, x) ==
+           first);
+  }
+  assert(lams_parallel_reduce(0, 1000, 5.0, sum_range, add_doubles, x) == 5.0);
+
+  free(x);
+}
+
+void test_parallel_kernels() {
+  int rows = 300, cols = 250, rank = 3;
+  Matrix *a = matrix_new(rows, cols);
+  Matrix *b = matrix_new(rows, cols);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      a->data[i][j] = i - 2.0 * j;
+      b->data[i][j] = 0.5 * i + j;
+    }
+  }
+
+  Matrix *sum = matrix_add(a, b);
+  Matrix *diff = matrix_sub(a, b);
+  Matrix *scaled = matrix_scale(a, 3.0);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      assert(sum->data[i][j] == a->data[i][j] + b->data[i][j]);
+      assert(diff->data[i][j] == a->data[i][j] - b->data[i][j]);
+      assert(scaled->data[i][j] == a->data[i][j] * 3.0);
+    }
+  }
+
+  Matrix *tall = matrix_new(rows + 1, cols);
+  assert(matrix_add(a, tall) == NULL);
+
+  // Tensor shape is rows x cols x rank, not a cube
+  Tensor *t = tensor_new(rows, cols, rank);
+  for (int d = 0; d < rank; d++) {
+    tensor_insert(t, d == 1 ? b : a, d);
+  }
+  Tensor *t2 = tensor_add(t, t);
+  Tensor *t3 = tensor_sub(t2, t);
+  assert(t2->rank == rank && t2->rows == rows && t2->cols == cols);
+  for (int d = 0; d < rank; d++) {
+    for (int i = 0; i < rows; i++) {
+      for (int j = 0; j < cols; j++) {
+        assert(t2->data[d][i][j] == 2 * t->data[d][i][j]);
+        assert(t3->data[d][i][j] == t->data[d][i][j]);
+      }
+    }
+  }
+
+  int n = 100000;
+  Vector *v = vector_new(n);
+  for (int i = 0; i < n; i++) {
+    v->data[i] = i;
+  }
+  Vector *vs = vector_scale(v, 0.5);
+  Vector *vsum = vector_add(v, vs);
+  for (int i = 0; i < n; i++) {
+    assert(vsum->data[i] == 1.5 * i);
+  }
+
+  matrix_free(a);
+  matrix_free(b);
+  matrix_free(sum);
+  matrix_free(diff);
+  matrix_free(scaled);
+  matrix_free(tall);
+  tensor_free(t);
+  tensor_free(t2);
+  tensor_free(t3);
+  vector_free(v);
+  vector_free(vs);
+  vector_free(vsum);
+}
+
+// Pipeline tests
+static Matrix *pipeline_test_sum(Matrix **inputs, void *ctx) {
+  int n = *(int *)ctx;
+  Matrix *result = matrix_copy(inputs[0]);
+  for (int k = 1; k < n; k++) {
+    Matrix *next = matrix_add(result, inputs[k]);
+    matrix_free(result);
+    result = next;
+  }
+  return result;
+}
+
+static Matrix *pipeline_test_fail(Matrix **inputs, void *ctx) {
+  (void)inputs;
+  (void)ctx;
+  return NULL;
+}
+
+void test_pipeline_independent() {
+  double a_data[] = {1, 2, 3, 4}, b_data[] = {0, 1, 1, 0};
+  double c_data[] = {2, 0, 0, 2}, d_data[] = {1, -1, 2, 3};
+  Matrix *a = test_matrix_from(2, 2, a_data);
+  Matrix *b = test_matrix_from(2, 2, b_data);
+  Matrix *c = test_matrix_from(2, 2, c_data);
+  Matrix *d = test_matrix_from(2, 2, d_data);
+
+  // (A * B + C * D) * 2 - A, the two products are independent
+  Pipeline *p = pipeline_new();
+  Future *fa = pipeline_matrix(p, a);
+  Future *ab = pipeline_multiply(p, fa, pipeline_matrix(p, b));
+  Future *cd = pipeline_multiply(p, pipeline_matrix(p, c),
+                                 pipeline_matrix(p, d));
+  Future *sum = pipeline_add(p, ab, cd);
+  Future *result = pipeline_sub(p, pipeline_scale(p, sum, 2.0), fa);
+  assert(pipeline_run(p) == 0);
+
+  Matrix *ab_m = matrix_multiply(a, b), *cd_m = matrix_multiply(c, d);
+  Matrix *sum_m = matrix_add(ab_m, cd_m);
+  Matrix *scaled_m = matrix_scale(sum_m, 2.0);
+  Matrix *expected = matrix_sub(scaled_m, a);
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 2; j++) {
+      assert(future_value(result)->data[i][j] == expected->data[i][j]);
+    }
+  }
+
+  // Intermediates were released or reused, inputs are untouched
+  assert(future_value(ab) == NULL && future_value(sum) == NULL);
+  assert(future_value(fa) == a && a->data[1][1] == 4);
+
+  Matrix *taken = future_take(result);
+  assert(future_value(result) == NULL);
+  pipeline_free(p);
+
+  assert(taken->data[0][0] == expected->data[0][0]);
+  matrix_free(taken);
+  matrix_free(ab_m);
+  matrix_free(cd_m);
+  matrix_free(sum_m);
+  matrix_free(scaled_m);
+  matrix_free(expected);
+  matrix_free(a);
+  matrix_free(b);
+  matrix_free(c);
+  matrix_free(d);
+}
+
+void test_pipeline_wide() {
+  // Many independent products summed by one call, with a kept intermediate
+  int n = 32, size = 40;
+  Matrix *m = matrix_new(size, size);
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j < size; j++) {
+      m->data[i][j] = (i + j) % 3;
+    }
+  }
+
+  Pipeline *p = pipeline_new();
+  Future *fm = pipeline_matrix(p, m);
+  Future *products[32];
+  for (int k = 0; k < n; k++) {
+    products[k] = pipeline_multiply(p, pipeline_scale(p, fm, k), fm);
+  }
+  pipeline_keep(products[3]);
+  Future *total = pipeline_call(p, pipeline_test_sum, &n, products, n);
+  assert(pipeline_start(p) == 0);
+  assert(pipeline_start(p) == -1);
+  assert(pipeline_wait(p) == 0);
+
+  // sum of k * M * M over k = 0..n-1
+  Matrix *square = matrix_multiply(m, m);
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j < size; j++) {
+      double expected = square->data[i][j] * n * (n - 1) / 2;
+      assert(future_value(total)->data[i][j] == expected);
+      assert(future_value(products[3])->data[i][j] == 3 * square->data[i][j]);
+    }
+  }
+  assert(future_value(products[4]) == NULL);
+
+  pipeline_free(p);
+  matrix_free(square);
+  matrix_free(m);
+}
+
+void test_pipeline_failure() {
+  Matrix *a = matrix_new(2, 3);
+  Matrix *b = matrix_new(3, 3);
+  matrix_fill(a, 1);
+  matrix_fill(b, 2);
+
+  Pipeline *p = pipeline_new();
+  Future *fa = pipeline_matrix(p, a), *fb = pipeline_matrix(p, b);
+  Future *bad = pipeline_add(p, fa, fb);
+  Future *after = pipeline_scale(p, bad, 2.0);
+  Future *failed = pipeline_call(p, pipeline_test_fail, NULL, &fb, 1);
+  Future *good = pipeline_multiply(p, fa, fb);
+  assert(pipeline_add(p, NULL, fa) == NULL);
+  assert(pipeline_run(p) == -1);
+
+  assert(future_value(bad) == NULL && future_value(after) == NULL);
+  assert(future_value(failed) == NULL);
+  assert(future_value(good)->data[1][2] == 6);
+
+  pipeline_free(p);
+  matrix_free(a);
+  matrix_free(b);
+}
+
+// Quantized matrix tests
+static Matrix *test_quant_matrix(int rows, int cols, int seed) {
+  Matrix *m = matrix_new(rows, cols);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      m->data[i][j] = sin(seed + i * 1.7 + j * 0.31) * (1 + i % 5);
+    }
+  }
+  return m;
+}
+
+static int test_quant_value(QMatrix *q, int i, int j) {
+  size_t k = (size_t)i * q->stride + j;
+  return q->type == QUANT_INT8 ? ((int8_t *)q->data)[k]
+                               : ((int16_t *)q->data)[k];
+}
+
+void test_quant_roundtrip() {
+  Matrix *m = test_quant_matrix(7, 100, 1);
+  m->data[2][5] = 0.0;
+
+  for (int type = QUANT_INT8; type <= QUANT_INT16; type++) {
+    for (int scheme = QUANT_PER_TENSOR; scheme <= QUANT_PER_ROW; scheme++) {
+      QMatrix *q = qmatrix_quantize(m, type, scheme);
+      Matrix *back = qmatrix_dequantize(q);
+      assert(q->stride % (type == QUANT_INT8 ? 64 : 32) == 0);
+      assert(q->stride >= q->cols);
+
+      for (int i = 0; i < m->rows; i++) {
+        if (scheme == QUANT_PER_TENSOR) {
+          assert(q->scale[i] == q->scale[0]);
+        }
+        int64_t sum = 0;
+        for (int j = 0; j < m->cols; j++) {
+          assert(fabs(back->data[i][j] - m->data[i][j]) <=
+                 q->scale[i] * 0.5 + 1e-12);
+          sum += test_quant_value(q, i, j);
+        }
+        assert(sum == q->row_sum[i]);
+        for (int j = m->cols; j < q->stride; j++) {
+          assert(test_quant_value(q, i, j) == 0);
+        }
+      }
+      assert(back->data[2][5] == 0.0);
+
+      qmatrix_free(q);
+      matrix_free(back);
+    }
+  }
+
+  matrix_free(m);
+}
+
+void test_quant_gemm() {
+  int m_rows = 9, n_rows = 70, k = 100;
+  Matrix *a = test_quant_matrix(m_rows, k, 2);
+  Matrix *b = test_quant_matrix(n_rows, k, 3);
+
+  for (int type = QUANT_INT8; type <= QUANT_INT16; type++) {
+    QMatrix *qa = qmatrix_quantize(a, type, QUANT_PER_ROW);
+    QMatrix *qb = qmatrix_quantize(b, type, QUANT_PER_TENSOR);
+    Matrix *c = qmatrix_multiply_transpose(qa, qb);
+    int32_t *raw = malloc(m_rows * n_rows * sizeof(int32_t));
+    assert(qmatrix_gemm_int32(qa, qb, raw) == (type == QUANT_INT8 ? 0 : -1));
+
+    for (int i = 0; i < m_rows; i++) {
+      for (int j = 0; j < n_rows; j++) {
+        int64_t exact = 0;
+        double dense = 0.0;
+        for (int t = 0; t < k; t++) {
+          exact += (int64_t)(test_quant_value(qa, i, t) - qa->zero_point[i]) *
+                   (test_quant_value(qb, j, t) - qb->zero_point[j]);
+          dense += a->data[i][t] * b->data[j][t];
+        }
+        if (type == QUANT_INT8) {
+          assert(raw[i * n_rows + j] == exact);
+        }
+        double scale = qa->scale[i] * qb->scale[j];
+        assert(fabs(c->data[i][j] - scale * exact) < 1e-9 * (1 + fabs(dense)));
+        // Each entry of both operands is off by at most half a step
+        double bound = k * (qa->scale[i] * 5 + qb->scale[j] * 5);
+        assert(fabs(c->data[i][j] - dense) < bound);
+      }
+    }
+
+    Vector *v = vector_new(k);
+    for (int t = 0; t < k; t++) {
+      v->data[t] = b->data[4][t];
+    }
+    Vector *y = qmatrix_multiply_vector(qa, v);
+    for (int i = 0; i < m_rows; i++) {
+      assert(fabs(y->data[i] - c->data[i][4]) <
+             k * (qa->scale[i] * 5 + qb->scale[4] * 5));
+    }
+
+    qmatrix_free(qa);
+    qmatrix_free(qb);
+    matrix_free(c);
+    free(raw);
+    vector_free(v);
+    vector_free(y);
+  }
+
+  // Mismatched inner sizes and types
+  Matrix *short_m = test_quant_matrix(3, k - 1, 4);
+  QMatrix *q8 = qmatrix_quantize(a, QUANT_INT8, QUANT_PER_ROW);
+  QMatrix *q16 = qmatrix_quantize(a, QUANT_INT16, QUANT_PER_ROW);
+  QMatrix *qs = qmatrix_quantize(short_m, QUANT_INT8, QUANT_PER_ROW);
+  assert(qmatrix_multiply_transpose(q8, q16) == NULL);
+  assert(qmatrix_multiply_transpose(q8, qs) == NULL);
+
+  qmatrix_free(q8);
+  qmatrix_free(q16);
+  qmatrix_free(qs);
+  matrix_free(short_m);
+  matrix_free(a);
+  matrix_free(b);
+}
+
+// Convolution tests
+static Tensor *test_tensor_fill(int rows, int cols, int rank, int seed) {
+  Tensor *t = tensor_new(rows, cols, rank);
+  for (int c = 0; c < rank; c++) {
+    for (int i = 0; i < rows; i++) {
+      for (int j = 0; j < cols; j++) {
+        t->data[c][i][j] = cos(seed + c * 0.7 + i * 1.3 + j * 0.29);
+      }
+    }
+  }
+  return t;
+}
+
+// Straight from the definition, zero outside the input
+static double test_conv_at(Tensor *x, Tensor *k, ConvOptions *o, int oy,
+                           int ox) {
+  double sum = 0.0;
+  for (int c = 0; c < x->rank; c++) {
+    for (int ki = 0; ki < k->rows; ki++) {
+      for (int kj = 0; kj < k->cols; kj++) {
+        int iy = oy * o->stride[0] - o->padding[0] + ki * o->dilation[0];
+        int ix = ox * o->stride[1] - o->padding[1] + kj * o->dilation[1];
+        if (iy < 0 || iy >= x->rows || ix < 0 || ix >= x->cols) {
+          continue;
+        }
+        int fi = o->mode == CONV_CONVOLVE ? k->rows - 1 - ki : ki;
+        int fj = o->mode == CONV_CONVOLVE ? k->cols - 1 - kj : kj;
+        sum += k->data[c][fi][fj] * x->data[c][iy][ix];
+      }
+    }
+  }
+  return sum;
+}
+
+void test_conv2d() {
+  Tensor *x = test_tensor_fill(13, 17, 3, 1);
+  Tensor *kernels[4];
+  Vector *bias = vector_new(4);
+  for (int o = 0; o < 4; o++) {
+    kernels[o] = test_tensor_fill(3 + (o == 0), 5, 3, 10 + o);
+    bias->data[o] = o - 1.5;
+  }
+
+  // 3x5 and 4x5 kernels, the sizes need to match
+  assert(tensor_conv2d(x, kernels, 4, NULL, NULL) == NULL);
+  tensor_free(kernels[0]);
+  kernels[0] = test_tensor_fill(3, 5, 3, 10);
+
+  ConvOptions cases[] = {
+      {{1, 1}, {0, 0}, {1, 1}, CONV_CORRELATE, CONV_AUTO},
+      {{2, 1}, {1, 2}, {1, 1}, CONV_CORRELATE, CONV_AUTO},
+      {{1, 3}, {2, 0}, {2, 1}, CONV_CONVOLVE, CONV_AUTO},
+      {{2, 2}, {1, 1}, {1, 2}, CONV_CONVOLVE, CONV_AUTO},
+  };
+
+  for (int t = 0; t < 4; t++) {
+    Tensor *out[2];
+    for (int a = 0; a < 2; a++) {
+      cases[t].algorithm = a == 0 ? CONV_DIRECT : CONV_IM2COL;
+      out[a] = tensor_conv2d(x, kernels, 4, bias, &cases[t]);
+      assert(out[a] != NULL && out[a]->rank == 4);
+    }
+
+    ConvOptions *o = &cases[t];
+    int rows = (13 + 2 * o->padding[0] - o->dilation[0] * 2 - 1) /
+                   o->stride[0] + 1;
+    int cols = (17 + 2 * o->padding[1] - o->dilation[1] * 4 - 1) /
+                   o->stride[1] + 1;
+    assert(out[0]->rows == rows && out[0]->cols == cols);
+    assert(out[1]->rows == rows && out[1]->cols == cols);
+
+    for (int k = 0; k < 4; k++) {
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          double expected = test_conv_at(x, kernels[k], o, i, j) +
+                            bias->data[k];
+          assert(fabs(out[0]->data[k][i][j] - expected) < 1e-12);
+          assert(fabs(out[1]->data[k][i][j] - expected) < 1e-12);
+        }
+      }
+    }
+    tensor_free(out[0]);
+    tensor_free(out[1]);
+  }
+
+  // Kernel larger than the padded input
+  ConvOptions dilated = {.dilation = {7, 7}};
+  assert(tensor_conv2d(x, kernels, 4, bias, &dilated) == NULL);
+
+  for (int o = 0; o < 4; o++) {
+    tensor_free(kernels[o]);
+  }
+  tensor_free(x);
+  vector_free(bias);
+}
+
+void test_im2col() {
+  Tensor *x = tensor_new(3, 3, 2);
+  for (int c = 0; c < 2; c++) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        x->data[c][i][j] = 100 * c + 10 * i + j;
+      }
+    }
+  }
+
+  ConvOptions o = {.padding = {1, 1}};
+  Matrix *m = tensor_im2col(x, 2, 2, &o);
+  assert(m->rows == 8 && m->cols == 16);
+  // Row (channel 1, kernel row 1, kernel col 0), output (1, 2) reads (1, 1)
+  assert(m->data[4 + 2][1 * 4 + 2] == 111);
+  // Output (0, 0) with kernel tap (0, 0) is padding
+  assert(m->data[0][0] == 0.0 && m->data[3][0] == 0.0);
+
+  matrix_free(m);
+  tensor_free(x);
+}
+
+void test_pool2d() {
+  Tensor *x = tensor_new(4, 5, 2);
+  for (int c = 0; c < 2; c++) {
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 5; j++) {
+        x->data[c][i][j] = (c ? -1 : 1) * (i * 5 + j);
+      }
+    }
+  }
+
+  // Stride defaults to the window, the last column does not fit
+  Tensor *max = tensor_pool2d(x, POOL_MAX, 2, 2, NULL);
+  assert(max->rank == 2 && max->rows == 2 && max->cols == 2);
+  assert(max->data[0][0][0] == 6 && max->data[0][1][1] == 18);
+  assert(max->data[1][0][0] == 0 && max->data[1][1][1] == -12);
+
+  // Padded windows average only the entries inside the input
+  ConvOptions o = {.stride = {1, 1}, .padding = {1, 1}};
+  Tensor *avg = tensor_pool2d(x, POOL_AVG, 2, 2, &o);
+  assert(avg->rows == 5 && avg->cols == 6);
+  assert(avg->data[0][0][0] == 0.0);
+  assert(avg->data[0][0][1] == 0.5);
+  assert(avg->data[0][1][1] == 3.0);
+  assert(avg->data[1][4][5] == -19.0);
+
+  ConvOptions too_padded = {.padding = {2, 0}};
+  assert(tensor_pool2d(x, POOL_MAX, 2, 2, &too_padded) == NULL);
+
+  // A dilated window can skip over a 1x1 input and see padding alone
+  Tensor *dot = tensor_new(1, 1, 1);
+  dot->data[0][0][0] = 3;
+  ConvOptions gap = {.stride = {1, 1}, .padding = {1, 1}, .dilation = {2, 2}};
+  assert(tensor_pool2d(dot, POOL_AVG, 2, 2, &gap) == NULL);
+  assert(tensor_pool2d(dot, POOL_MAX, 2, 2, &gap) == NULL);
+  gap.padding[0] = gap.padding[1] = 0;
+  gap.dilation[0] = gap.dilation[1] = 1;
+  Tensor *one = tensor_pool2d(dot, POOL_AVG, 1, 1, &gap);
+  assert(one->rows == 1 && one->cols == 1 && one->data[0][0][0] == 3);
+  tensor_free(dot);
+  tensor_free(one);
+
+  tensor_free(x);
+  tensor_free(max);
+  tensor_free(avg);
+}
+
+// Out-of-core tests
+static void test_disk_path(char *path, size_t size, const char *name) {
+  snprintf(path, size, "/tmp/lams_test_%d_%s.bin", (int)getpid(), name);
+}
+
+void test_disk_matrix_io() {
+  char path[128];
+  test_disk_path(path, sizeof(path), "io");
+  Matrix *m = matrix_new(5, 7);
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 7; j++) {
+      m->data[i][j] = i * 10 + j + 0.5;
+    }
+  }
+
+  DiskMatrix *d = disk_matrix_from_matrix(path, m);
+  assert(d != NULL && d->rows == 5 && d->cols == 7);
+  disk_matrix_close(d);
+
+  d = disk_matrix_open(path);
+  assert(d != NULL && d->rows == 5 && d->cols == 7);
+  Matrix *block = disk_matrix_read(d, 1, 2, 3, 4);
+  assert(block->data[0][0] == 12.5 && block->data[2][3] == 35.5);
+  assert(disk_matrix_read(d, 3, 0, 3, 1) == NULL);
+
+  matrix_fill(block, -1);
+  assert(disk_matrix_write(d, block, 2, 3) == 0);
+  assert(disk_matrix_write(d, block, 3, 3) == -1);
+  Matrix *back = disk_matrix_to_matrix(d);
+  assert(back->data[2][3] == -1 && back->data[4][6] == -1);
+  assert(back->data[2][2] == 22.5 && back->data[1][3] == 13.5);
+
+  disk_matrix_close(d);
+  unlink(path);
+  assert(disk_matrix_open(path) == NULL);
+  matrix_free(m);
+  matrix_free(block);
+  matrix_free(back);
+}
+
+void test_disk_matrix_multiply() {
+  char path_a[128], path_b[128], path_c[128];
+  test_disk_path(path_a, sizeof(path_a), "a");
+  test_disk_path(path_b, sizeof(path_b), "b");
+  test_disk_path(path_c, sizeof(path_c), "c");
+
+  int m = 37, k = 53, n = 29;
+  Matrix *a = matrix_new(m, k), *b = matrix_new(k, n);
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < k; j++) {
+      a->data[i][j] = sin(i * 0.3 + j);
+    }
+  }
+  for (int i = 0; i < k; i++) {
+    for (int j = 0; j < n; j++) {
+      b->data[i][j] = cos(i - j * 0.7);
+    }
+  }
+  Matrix *expected = matrix_multiply(a, b);
+
+  DiskMatrix *da = disk_matrix_from_matrix(path_a, a);
+  DiskMatrix *db = disk_matrix_from_matrix(path_b, b);
+
+  // 8x8 tiles of A, B and C, then a budget bigger than everything
+  size_t budgets[] = {5 * 64 * sizeof(double), 1 << 20};
+  for (int t = 0; t < 2; t++) {
+    da->bytes_read = db->bytes_read = 0;
+    DiskMatrix *dc = disk_matrix_multiply(da, db, path_c, budgets[t]);
+    assert(dc != NULL && dc->rows == m && dc->cols == n);
+    assert(dc->bytes_written == (long)(m * n * sizeof(double)));
+
+    Matrix *c = disk_matrix_to_matrix(dc);
+    for (int i = 0; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        assert(fabs(c->data[i][j] - expected->data[i][j]) < 1e-12);
+      }
+    }
+
+    // A is needed once per column of tiles, B once per row of tiles, less
+    // the tiles shared by consecutive steps
+    int tiles_i = t == 0 ? 5 : 1, tiles_j = t == 0 ? 4 : 1;
+    long a_bytes = (long)m * k * sizeof(double);
+    long b_bytes = (long)k * n * sizeof(double);
+    assert(da->bytes_read < tiles_j * a_bytes || tiles_j == 1);
+    assert(db->bytes_read < tiles_i * b_bytes || tiles_i == 1);
+    assert(da->bytes_read >= a_bytes && db->bytes_read >= b_bytes);
+    if (t == 1) {
+      assert(da->bytes_read == a_bytes && db->bytes_read == b_bytes);
+    }
+
+    matrix_free(c);
+    disk_matrix_close(dc);
+  }
+
+  assert(disk_matrix_multiply(da, db, path_c, 16) == NULL);
+  assert(disk_matrix_multiply(db, db, path_c, 1 << 20) == NULL);
+
+  disk_matrix_close(da);
+  disk_matrix_close(db);
+  unlink(path_a);
+  unlink(path_b);
+  unlink(path_c);
+  matrix_free(a);
+  matrix_free(b);
+  matrix_free(expected);
+}
+
+// Low-rank update tests
+static Matrix *test_spd_matrix(int n, int seed) {
+  Matrix *m = matrix_new(n, n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j <= i; j++) {
+      double v = sin(seed + i * 0.7 + j * 1.3) * 0.5;
+      m->data[i][j] = m->data[j][i] = i == j ? n + fabs(v) : v;
+    }
+  }
+  return m;
+}
+
+static void test_assert_close(Matrix *a, Matrix *b, double tolerance) {
+  for (int i = 0; i < a->rows; i++) {
+    for (int j = 0; j < a->cols; j++) {
+      assert(fabs(a->data[i][j] - b->data[i][j]) <= tolerance);
+    }
+  }
+}
+
+static void test_assert_factor(Matrix *R, Matrix *A, double tolerance) {
+  Matrix *Rt = matrix_transpose(R);
+  Matrix *RtR = matrix_multiply(Rt, R);
+  test_assert_close(RtR, A, tolerance);
+  for (int i = 0; i < R->rows; i++) {
+    assert(R->data[i][i] > 0);
+    for (int j = 0; j < i; j++) {
+      assert(R->data[i][j] == 0);
+    }
+  }
+  matrix_free(Rt);
+  matrix_free(RtR);
+}
+
+void test_cholesky() {
+  Matrix *A = test_spd_matrix(40, 1);
+  Matrix *R = matrix_cholesky(A);
+  test_assert_factor(R, A, 1e-10);
+
+  Matrix *b = test_quant_matrix(40, 3, 2);
+  Matrix *x = matrix_cholesky_solve(R, b);
+  Matrix *Ax = matrix_multiply(A, x);
+  test_assert_close(Ax, b, 1e-10);
+
+  // Indefinite and non-square matrices have no factor
+  Matrix *bad = test_matrix_from(2, 2, (double[]){1, 2, 2, 1});
+  assert(matrix_cholesky(bad) == NULL);
+  assert(matrix_cholesky(b) == NULL);
+
+  matrix_free(A);
+  matrix_free(R);
+  matrix_free(b);
+  matrix_free(x);
+  matrix_free(Ax);
+  matrix_free(bad);
+}
+
+void test_cholesky_update() {
+  int n = 30;
+  Matrix *A = test_spd_matrix(n, 3);
+  Matrix *R = matrix_cholesky(A);
+  Matrix *X = test_quant_matrix(3, n, 4);
+
+  // A + X^T X, then back to A
+  Matrix *Xt = matrix_transpose(X);
+  Matrix *XtX = matrix_multiply(Xt, X);
+  Matrix *B = matrix_add(A, XtX);
+  assert(matrix_cholesky_update_rank(R, X) == 0);
+  test_assert_factor(R, B, 1e-9);
+  assert(matrix_cholesky_downdate_rank(R, X) == 0);
+  test_assert_factor(R, A, 1e-9);
+
+  Vector x = {n, X->data[0]};
+  assert(matrix_cholesky_update(R, &x) == 0);
+  assert(matrix_cholesky_downdate(R, &x) == 0);
+  test_assert_factor(R, A, 1e-9);
+
+  // Removing more than A holds is refused and R is left as it was
+  Matrix *before = matrix_copy(R);
+  double big_data[30] = {0};
+  Vector big = {n, big_data};
+  big_data[4] = 2 * sqrt(A->data[4][4]);
+  assert(matrix_cholesky_downdate(R, &big) == -1);
+  Matrix *twice = matrix_scale(X, 10);
+  assert(matrix_cholesky_downdate_rank(R, twice) == -1);
+  test_assert_close(R, before, 0);
+
+  matrix_free(A);
+  matrix_free(R);
+  matrix_free(X);
+  matrix_free(Xt);
+  matrix_free(XtX);
+  matrix_free(B);
+  matrix_free(before);
+  matrix_free(twice);
+}
+
+void test_cholesky_refactor() {
+  int n = 4;
+  Matrix *I = matrix_identity(n);
+  Cholesky *c = cholesky_new(I);
+  assert(c != NULL && c->refactorizations == 0);
+
+  // Take almost all of the first direction out, the pivot falls below
+  // tolerance and the factor is rebuilt from A
+  double x_data[4] = {1 - 1e-6};
+  Vector x = {n, x_data};
+  assert(cholesky_downdate(c, &x) == 0);
+  assert(c->refactorizations == 0);
+  c->tolerance = 1e-2;
+  assert(cholesky_update(c, &x) == 0);
+  assert(c->refactorizations == 0);
+  assert(cholesky_downdate(c, &x) == 0);
+  assert(c->refactorizations == 1);
+  test_assert_factor(c->R, c->A, 1e-12);
+
+  // An indefinite result leaves both A and R as they were
+  x.data[0] = 2e-3;
+  Matrix *A = matrix_copy(c->A), *R = matrix_copy(c->R);
+  assert(cholesky_downdate(c, &x) == -1);
+  test_assert_close(c->A, A, 0);
+  test_assert_close(c->R, R, 0);
+
+  Matrix *X = matrix_new(2, n);
+  X->data[0][1] = 0.5;
+  X->data[1][0] = 1;
+  assert(cholesky_downdate_rank(c, X) == -1);
+  test_assert_close(c->A, A, 1e-12);
+  test_assert_factor(c->R, A, 1e-12);
+
+  matrix_free(A);
+  matrix_free(R);
+  matrix_free(X);
+  matrix_free(I);
+  cholesky_free(c);
+}
+
+void test_inverse_update() {
+  int n = 25, k = 3;
+  Matrix *A = test_spd_matrix(n, 5);
+  Matrix *I = matrix_identity(n);
+  Matrix *R = matrix_cholesky(A);
+  Matrix *inverse = matrix_cholesky_solve(R, I);
+
+  // Sherman-Morrison against A + u v^T times the updated inverse
+  Matrix *UV = test_quant_matrix(2, n, 6);
+  Vector u = {n, UV->data[0]}, v = {n, UV->data[1]};
+  assert(matrix_inverse_update_rank1(inverse, &u, &v) == 0);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      A->data[i][j] += u.data[i] * v.data[j];
+    }
+  }
+  Matrix *product = matrix_multiply(A, inverse);
+  test_assert_close(product, I, 1e-10);
+  matrix_free(product);
+
+  // Woodbury with a C
+  Matrix *U = test_quant_matrix(n, k, 7), *V = test_quant_matrix(k, n, 8);
+  Matrix *C = test_matrix_from(k, k, (double[]){2, 0, 1, 0, 1, 0, 1, 0, 3});
+  assert(matrix_inverse_update(inverse, U, C, V) == 0);
+  Matrix *UC = matrix_multiply(U, C);
+  Matrix *UCV = matrix_multiply(UC, V);
+  Matrix *B = matrix_add(A, UCV);
+  product = matrix_multiply(B, inverse);
+  test_assert_close(product, I, 1e-9);
+
+  // Taking a row of A back out makes it singular and nothing changes
+  Matrix *before = matrix_copy(inverse);
+  double e_data[25] = {-1};
+  Vector e = {n, e_data}, row = {n, B->data[0]};
+  assert(matrix_inverse_update_rank1(inverse, &e, &row) == -1);
+  test_assert_close(inverse, before, 0);
+  Matrix *E = matrix_new(n, 1), *Row = matrix_new(1, n);
+  E->data[0][0] = -1;
+  memcpy(Row->data[0], B->data[0], n * sizeof(double));
+  assert(matrix_inverse_update(inverse, E, NULL, Row) == -1);
+  test_assert_close(inverse, before, 0);
+  assert(matrix_inverse_update(inverse, U, NULL, U) == -1);
+
+  matrix_free(A);
+  matrix_free(I);
+  matrix_free(R);
+  matrix_free(inverse);
+  matrix_free(UV);
+  matrix_free(U);
+  matrix_free(V);
+  matrix_free(C);
+  matrix_free(UC);
+  matrix_free(UCV);
+  matrix_free(B);
+  matrix_free(product);
+  matrix_free(before);
+  matrix_free(E);
+  matrix_free(Row);
+}
+
+// View tests
+void test_vector_views() {
+  Vector *v = vector_new(6);
+  for (int i = 0; i < 6; i++) {
+    v->data[i] = i;
+  }
+
+  Vector slice = vector_view(v, 2, 3);
+  assert(slice.size == 3 && slice.data[0] == 2);
+  assert(vector_dot(&slice, &slice) == 4 + 9 + 16);
+  slice.data[1] = 30;
+  assert(v->data[3] == 30);
+  assert(vector_view(v, 4, 3).data == NULL);
+
+  Matrix *m = test_matrix_from(2, 3, (double[]){1, 2, 2, 3, 4, 12});
+  Vector row = matrix_row_view(m, 1);
+  assert(row.size == 3 && vector_norm(&row) == 13);
+  Vector *scaled = vector_scale(&row, 2);
+  assert(scaled->data[2] == 24 && m->data[1][2] == 12);
+  assert(matrix_row_view(m, 2).data == NULL);
+
+  vector_free(v);
+  vector_free(scaled);
+  matrix_free(m);
+}
+
+void test_matrix_views() {
+  Matrix *m = matrix_new(5, 6);
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 6; j++) {
+      m->data[i][j] = i * 10 + j;
+    }
+  }
+
+  // Any Matrix function reads a block in place
+  Matrix *block = matrix_view(m, 1, 2, 3, 2);
+  assert(block->rows == 3 && block->cols == 2 && block->data[0][0] == 12);
+  Matrix *t = matrix_transpose(block);
+  assert(t->rows == 2 && t->data[1][2] == 33);
+  Vector *sums = matrix_reduce(block, REDUCE_COLS, REDUCE_SUM);
+  assert(sums->data[0] == 12 + 22 + 32 && sums->data[1] == 13 + 23 + 33);
+
+  // and writes through it land in the parent
+  matrix_fill(block, -1);
+  assert(m->data[2][3] == -1 && m->data[2][4] == 24 && m->data[0][2] == 2);
+
+  Matrix *column = matrix_column_view(m, 5);
+  Matrix *diagonal = matrix_diagonal_view(m);
+  assert(column->rows == 5 && column->cols == 1);
+  assert(diagonal->rows == 5 && diagonal->data[4][0] == 44);
+  assert(matrix_dot(column, diagonal) == 5 * 0 + 15 * 11 - 25 + -35 + 45 * 44);
+
+  matrix_axpy(column, 2, diagonal);
+  assert(m->data[1][5] == 15 + 22 && m->data[0][5] == 5);
+  matrix_scale_in_place(diagonal, 0.5);
+  assert(m->data[4][4] == 22 && m->data[4][5] == 45 + 88);
+  Matrix *first = matrix_column_view(m, 0);
+  matrix_copy_into(first, column);
+  assert(m->data[1][0] == 37);
+
+  assert(matrix_axpy(block, 1, column) == -1);
+  assert(matrix_view(m, 3, 0, 3, 1) == NULL);
+
+  matrix_view_free(block);
+  matrix_view_free(column);
+  matrix_view_free(diagonal);
+  matrix_view_free(first);
+  matrix_free(m);
+  matrix_free(t);
+  vector_free(sums);
+}
+
+// Modified Gram-Schmidt on the columns, in place through column views
+void test_view_gram_schmidt() {
+  int n = 12, k = 5;
+  Matrix *q = test_quant_matrix(n, k, 9);
+  for (int j = 0; j < k; j++) {
+    q->data[j][j] += 4;
+  }
+  Matrix *original = matrix_copy(q);
+  Matrix *r = matrix_new(k, k);
+  matrix_fill(r, 0);
+
+  for (int j = 0; j < k; j++) {
+    Matrix *qj = matrix_column_view(q, j);
+    for (int i = 0; i < j; i++) {
+      Matrix *qi = matrix_column_view(q, i);
+      r->data[i][j] = matrix_dot(qi, qj);
+      matrix_axpy(qj, -r->data[i][j], qi);
+      matrix_view_free(qi);
+    }
+    r->data[j][j] = matrix_norm_frobenius(qj);
+    matrix_scale_in_place(qj, 1 / r->data[j][j]);
+    matrix_view_free(qj);
+  }
+
+  Matrix *qt = matrix_transpose(q);
+  Matrix *qtq = matrix_multiply(qt, q);
+  Matrix *qr = matrix_multiply(q, r);
+  for (int i = 0; i < k; i++) {
+    for (int j = 0; j < k; j++) {
+      assert(fabs(qtq->data[i][j] - (i == j)) < 1e-12);
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < k; j++) {
+      assert(fabs(qr->data[i][j] - original->data[i][j]) < 1e-12);
+    }
+  }
+
+  matrix_free(q);
+  matrix_free(original);
+  matrix_free(r);
+  matrix_free(qt);
+  matrix_free(qtq);
+  matrix_free(qr);
+}
+
+// Kronecker tests
+void test_kronecker() {
+  Matrix *a = test_matrix_from(2, 2, (double[]){1, 2, 3, 4});
+  Matrix *b = test_matrix_from(2, 3, (double[]){0, 5, 1, 6, 7, 2});
+
+  Matrix *k = matrix_kronecker(a, b);
+  double expected[4][6] = {{0, 5, 1, 0, 10, 2},
+                           {6, 7, 2, 12, 14, 4},
+                           {0, 15, 3, 0, 20, 4},
+                           {18, 21, 6, 24, 28, 8}};
+  assert(k->rows == 4 && k->cols == 6);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 6; j++) {
+      assert(k->data[i][j] == expected[i][j]);
+    }
+  }
+
+  Matrix *c = test_matrix_from(3, 2, (double[]){1, 2, 3, 4, 5, 6});
+  Matrix *kr = matrix_khatri_rao(a, c);
+  double columns[6][2] = {{1, 4}, {3, 8}, {5, 12}, {3, 8}, {9, 16}, {15, 24}};
+  assert(kr->rows == 6 && kr->cols == 2);
+  for (int i = 0; i < 6; i++) {
+    assert(kr->data[i][0] == columns[i][0] && kr->data[i][1] == columns[i][1]);
+  }
+  assert(matrix_khatri_rao(a, b) == NULL);
+
+  matrix_free(a);
+  matrix_free(b);
+  matrix_free(c);
+  matrix_free(k);
+  matrix_free(kr);
+}
+
+void test_kronecker_multiply() {
+  Matrix *a = test_quant_matrix(4, 3, 1), *b = test_quant_matrix(5, 6, 2);
+  Matrix *k = matrix_kronecker(a, b);
+  Matrix *x = test_quant_matrix(18, 3, 3);
+
+  Vector column = {18, malloc(18 * sizeof(double))};
+  for (int i = 0; i < 18; i++) {
+    column.data[i] = x->data[i][1];
+  }
+  Vector *y = kronecker_multiply_vector(a, b, &column);
+  Matrix *expected = matrix_multiply(k, x);
+  Matrix *Y = kronecker_multiply_matrix(a, b, x);
+  assert(y->size == 20 && Y->rows == 20 && Y->cols == 3);
+  for (int i = 0; i < 20; i++) {
+    assert(fabs(y->data[i] - expected->data[i][1]) < 1e-12);
+    for (int j = 0; j < 3; j++) {
+      assert(fabs(Y->data[i][j] - expected->data[i][j]) < 1e-12);
+    }
+  }
+
+  Vector short_x = {17, column.data};
+  assert(kronecker_multiply_vector(a, b, &short_x) == NULL);
+  Matrix *short_X = matrix_view(x, 1, 0, 17, 3);
+  assert(kronecker_multiply_matrix(a, b, short_X) == NULL);
+  matrix_view_free(short_X);
+
+  free(column.data);
+  vector_free(y);
+  matrix_free(a);
+  matrix_free(b);
+  matrix_free(k);
+  matrix_free(x);
+  matrix_free(expected);
+  matrix_free(Y);
+}
+
+// Multivariate normal tests
+void test_mvnormal() {
+  Vector mean = {2, (double[]){1, -1}};
+  Matrix *cov = test_matrix_from(2, 2, (double[]){4, 1, 1, 2});
+  mvnormal_t *mv = mvnormal_new(&mean, cov);
+  assert(mv != NULL && mv->dim == 2);
+  assert(fabs(mv->log_det - log(7)) < 1e-14);
+
+  // (x - mean)^T cov^-1 (x - mean) with cov^-1 = [2 -1; -1 4] / 7
+  Vector x = {2, (double[]){2, 1}};
+  double distance = (2 * 1 - 2 * 1 * 2 + 4 * 4) / 7.0;
+  double expected = -log(2 * M_PI) - 0.5 * log(7) - 0.5 * distance;
+  assert(fabs(mvnormal_logpdf(mv, &x) - expected) < 1e-14);
+  assert(fabs(mvnormal_pdf(mv, &x) - exp(expected)) < 1e-14);
+
+  // One dimension is the univariate normal
+  Vector mean1 = {1, (double[]){3}};
+  Matrix *var = test_matrix_from(1, 1, (double[]){0.25});
+  mvnormal_t *mv1 = mvnormal_new(&mean1, var);
+  Vector x1 = {1, (double[]){3.7}};
+  double pdf1 = exp(-0.49 / 0.5) / sqrt(2 * M_PI * 0.25);
+  assert(fabs(mvnormal_pdf(mv1, &x1) - pdf1) < 1e-14);
+
+  Matrix *bad = test_matrix_from(2, 2, (double[]){1, 2, 2, 1});
+  assert(mvnormal_new(&mean, bad) == NULL);
+  assert(mvnormal_new(&mean1, cov) == NULL);
+
+  // The lower triangle has to agree with the upper one
+  Matrix *skew = test_matrix_from(2, 2, (double[]){4, 1, 1.5, 2});
+  assert(mvnormal_new(&mean, skew) == NULL);
+  skew->data[1][0] = 1 + 1e-15;
+  mvnormal_t *close = mvnormal_new(&mean, skew);
+  assert(close != NULL);
+  mvnormal_free(close);
+  matrix_free(skew);
+
+  matrix_free(cov);
+  matrix_free(var);
+  matrix_free(bad);
+  mvnormal_free(mv);
+  mvnormal_free(mv1);
+}
+
+void test_mvnormal_batch() {
+  int d = 6, n = 200;
+  Matrix *cov = test_spd_matrix(d, 4);
+  Vector *mean = vector_new(d);
+  for (int i = 0; i < d; i++) {
+    mean->data[i] = i - 2.5;
+  }
+  mvnormal_t *mv = mvnormal_new(mean, cov);
+  Matrix *X = test_quant_matrix(n, d, 5);
+
+  // Against an explicit inverse
+  Matrix *I = matrix_identity(d);
+  Matrix *inverse = matrix_cholesky_solve(mv->R, I);
+  Vector *logpdf = mvnormal_logpdf_batch(mv, X);
+  Vector *distance = mvnormal_mahalanobis_batch(mv, X);
+  assert(logpdf->size == n && distance->size == n);
+  for (int r = 0; r < n; r++) {
+    double q = 0;
+    for (int i = 0; i < d; i++) {
+      for (int j = 0; j < d; j++) {
+        q += (X->data[r][i] - mean->data[i]) * inverse->data[i][j] *
+             (X->data[r][j] - mean->data[j]);
+      }
+    }
+    assert(fabs(distance->data[r] - q) < 1e-12);
+    double expected = -0.5 * (d * log(2 * M_PI) + mv->log_det + q);
+    assert(fabs(logpdf->data[r] - expected) < 1e-12);
+
+    Vector row = matrix_row_view(X, r);
+    assert(mvnormal_logpdf(mv, &row) == logpdf->data[r]);
+  }
+
+  Matrix *narrow = matrix_view(X, 0, 0, n, d - 1);
+  assert(mvnormal_logpdf_batch(mv, narrow) == NULL);
+
+  matrix_view_free(narrow);
+  matrix_free(cov);
+  matrix_free(X);
+  matrix_free(I);
+  matrix_free(inverse);
+  vector_free(mean);
+  vector_free(logpdf);
+  vector_free(distance);
+  mvnormal_free(mv);
+}
+
+// Statistics batch tests
+static void test_assert_float(float got, float expected, float tolerance) {
+  assert(fabsf(got - expected) <= tolerance * fmaxf(1, fabsf(expected)));
+}
+
+void test_stats_batch_discrete() {
+  // Short inputs are evaluated one by one, long ones from a table
+  long sizes[] = {9, 100000};
+  for (int s = 0; s < 2; s++) {
+    long n = sizes[s];
+    uint32_t *k = malloc(n * sizeof(uint32_t));
+    float *out = malloc(n * sizeof(float));
+    for (long i = 0; i < n; i++) {
+      k[i] = (i * 7) % 25;
+    }
+
+    binomial_t bin = {20, 0.3};
+    binomial_pmf_batch(&bin, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], k[i] <= 20 ? binomial_pmf(&bin, k[i]) : 0,
+                        1e-5);
+    }
+    binomial_cdf_batch(&bin, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], k[i] <= 20 ? binomial_cdf(&bin, k[i]) : 1,
+                        1e-5);
+    }
+
+    poisson_t poi = {4};
+    poisson_pmf_batch(&poi, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], poisson_pmf(&poi, k[i]), 1e-5);
+    }
+    poisson_cdf_batch(&poi, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], poisson_cdf(&poi, k[i]), 1e-5);
+    }
+
+    negative_binomial_t neg = {3, 0.4};
+    negative_binomial_pmf_batch(&neg, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], negative_binomial_pmf(&neg, k[i]), 1e-5);
+    }
+    negative_binomial_cdf_batch(&neg, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], negative_binomial_cdf(&neg, k[i]), 1e-5);
+    }
+
+    hypergeometric_t hyp = {50, 20, 10};
+    hypergeometric_pmf_batch(&hyp, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], k[i] <= 10 ? hypergeometric_pmf(&hyp, k[i]) : 0,
+                        1e-5);
+    }
+    hypergeometric_cdf_batch(&hyp, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], k[i] <= 10 ? hypergeometric_cdf(&hyp, k[i]) : 1,
+                        1e-5);
+    }
+
+    geometric_t geo = {0.2};
+    geometric_pmf_batch(&geo, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], geometric_pmf(&geo, k[i]), 1e-6);
+    }
+    geometric_cdf_batch(&geo, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], geometric_cdf(&geo, k[i]), 1e-6);
+    }
+
+    bernoulli_t ber = {0.25};
+    discrete_uniform_t dis = {3, 12, 0};
+    bernoulli_pmf_batch(&ber, k, out, n);
+    assert(out[0] == bernoulli_pmf(&ber, k[0]));
+    assert(out[1] == bernoulli_pmf(&ber, k[1]));
+    bernoulli_cdf_batch(&ber, k, out, n);
+    assert(out[0] == bernoulli_cdf(&ber, k[0]));
+    discrete_uniform_pmf_batch(&dis, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], discrete_uniform_pmf(&dis, k[i]), 1e-7);
+    }
+    discrete_uniform_cdf_batch(&dis, k, out, n);
+    for (long i = 0; i < n; i++) {
+      test_assert_float(out[i], discrete_uniform_cdf(&dis, k[i]), 1e-7);
+    }
+
+    free(k);
+    free(out);
+  }
+
+  // Inputs too far apart for a table are evaluated one by one
+  uint32_t huge[] = {0, 4000000000u};
+  float out[2];
+  poisson_t poi = {4};
+  poisson_cdf_batch(&poi, huge, out, 2);
+  test_assert_float(out[0], expf(-4), 1e-6);
+  assert(out[1] == 1);
+}
+
+void test_stats_batch_continuous() {
+  long n = 50000;
+  float *x = malloc(n * sizeof(float)), *out = malloc(n * sizeof(float));
+  for (long i = 0; i < n; i++) {
+    x[i] = -6 + 12.0 * i / n;
+  }
+
+  normal_t nor = {0.5, 1.5};
+  normal_pmf_batch(&nor, x, out, n);
+  for (long i = 0; i < n; i++) {
+    test_assert_float(out[i], normal_pmf(&nor, x[i]), 1e-6);
+  }
+  normal_logpdf_batch(&nor, x, out, n);
+  for (long i = 0; i < n; i++) {
+    test_assert_float(out[i], logf(normal_pmf(&nor, x[i])), 1e-6);
+  }
+  normal_cdf_batch(&nor, x, out, n);
+  for (long i = 0; i < n; i++) {
+    test_assert_float(out[i], normal_cdf(&nor, x[i]), 1e-6);
+  }
+
+  continuous_uniform_t uni = {1, 4, 0};
+  continuous_uniform_pmf_batch(&uni, x, out, n);
+  for (long i = 0; i < n; i++) {
+    test_assert_float(out[i], x[i] >= 1 && x[i] <= 4 ? 1 / 3.0f : 0, 1e-7);
+  }
+  continuous_uniform_cdf_batch(&uni, x, out, n);
+  for (long i = 0; i < n; i++) {
+    test_assert_float(out[i], continuous_uniform_cdf(&uni, x[i]), 1e-6);
+  }
+  continuous_uniform_logpdf_batch(&uni, x, out, n);
+  for (long i = 0; i < n; i++) {
+    assert(x[i] >= 1 && x[i] <= 4 ? fabsf(out[i] + logf(3)) < 1e-6
+                                  : out[i] == -INFINITY);
+  }
+
+  free(x);
+  free(out);
+}
+
+// Log-space pmf tests
+static double test_log_choose(double n, double k) {
+  return lgamma(n + 1) - lgamma(k + 1) - lgamma(n - k + 1);
+}
+
+void test_stats_logpmf() {
+  binomial_t bin = {1000, 0.3};
+  poisson_t poi = {200};
+  negative_binomial_t neg = {7, 0.25};
+  hypergeometric_t hyp = {500, 200, 60};
+  double p = bin.p, q = 1 - p;
+
+  for (uint32_t k = 0; k <= 1000; k += 37) {
+    double expected =
+        test_log_choose(1000, k) + k * log(p) + (1000 - k) * log(q);
+    test_assert_float(binomial_logpmf(&bin, k), expected, 1e-6);
+    test_assert_float(poisson_logpmf(&poi, k),
+                      k * log(200.0) - 200 - lgamma(k + 1.0), 1e-6);
+    double pn = neg.p, qn = 1 - pn;
+    test_assert_float(negative_binomial_logpmf(&neg, k),
+                      test_log_choose(k + 6.0, k) + 7 * log(pn) + k * log(qn),
+                      1e-6);
+  }
+  for (uint32_t k = 0; k <= 60; k++) {
+    double expected = test_log_choose(200, k) + test_log_choose(300, 60 - k) -
+                      test_log_choose(500, 60);
+    test_assert_float(hypergeometric_logpmf(&hyp, k), expected, 1e-6);
+  }
+  assert(binomial_logpmf(&bin, 1001) == -INFINITY);
+  assert(hypergeometric_logpmf(&hyp, 61) == -INFINITY);
+
+  // Counts past 34! used to overflow, the pmfs still sum to one
+  double sum_bin = 0, sum_poi = 0, sum_hyp = 0;
+  for (uint32_t k = 0; k <= 1000; k++) {
+    sum_bin += binomial_pmf(&bin, k);
+    sum_poi += poisson_pmf(&poi, k);
+    sum_hyp += hypergeometric_pmf(&hyp, k);
+  }
+  assert(fabs(sum_bin - 1) < 1e-5 && fabs(sum_poi - 1) < 1e-5);
+  assert(fabs(sum_hyp - 1) < 1e-5);
+  test_assert_float(poisson_pmf(&poi, 200), 0.028186, 1e-4);
+
+  // Edges of the probability range
+  binomial_t sure = {50, 1};
+  assert(binomial_pmf(&sure, 50) == 1 && binomial_pmf(&sure, 49) == 0);
+  poisson_t none = {0};
+  assert(poisson_pmf(&none, 0) == 1 && poisson_pmf(&none, 3) == 0);
+  negative_binomial_t no_success = {0, 0.4};
+  assert(negative_binomial_pmf(&no_success, 0) == 1);
+  assert(negative_binomial_pmf(&no_success, 2) == 0);
+  assert(negative_binomial_logpmf(&no_success, 0) == 0);
+  assert(negative_binomial_cdf(&no_success, 0) == 1);
+  uint32_t ks[2] = {0, 2};
+  float out[2];
+  negative_binomial_pmf_batch(&no_success, ks, out, 2);
+  assert(out[0] == 1 && out[1] == 0);
+
+  // One rounding to float, against long double references in the tails
+  binomial_t wide = {60, 0.3};
+  long double pw = wide.p;
+  for (uint32_t k = 0; k <= 60; k++) {
+    long double lp = lgammal(61.0L) - lgammal(k + 1.0L) -
+                     lgammal(61.0L - k) + k * logl(pw) + (60 - k) * log1pl(-pw);
+    float expected = expl(lp);
+    assert(fabsf(binomial_pmf(&wide, k) - expected) <= 3e-7f * expected);
+  }
+}
+
+// Tail probability tests
+static double test_log_binomial_tail(double lo, double hi, double n,
+                                     double p) {
+  double max = -INFINITY, sum = 0;
+  for (double k = lo; k <= hi; k++) {
+    double l = stats_log_binomial_raw(k, n, p, 1 - p);
+    sum = l > max ? sum * exp(max - l) + 1 : sum + exp(l - max);
+    max = l > max ? l : max;
+  }
+  return max + log(sum);
+}
+
+void test_stats_tails() {
+  binomial_t bin = {40, 0.3};
+  poisson_t poi = {12};
+  negative_binomial_t neg = {5, 0.35};
+  hypergeometric_t hyp = {80, 30, 25};
+  double sum_bin = 0, sum_poi = 0, sum_neg = 0, sum_hyp = 0;
+
+  // Against running sums of the pmf, with cdf + sf = 1
+  for (uint32_t k = 0; k <= 45; k++) {
+    sum_bin += binomial_pmf(&bin, k);
+    sum_poi += poisson_pmf(&poi, k);
+    sum_neg += negative_binomial_pmf(&neg, k);
+    sum_hyp += hypergeometric_pmf(&hyp, k);
+    test_assert_float(binomial_cdf(&bin, k), fmin(sum_bin, 1), 1e-5);
+    test_assert_float(poisson_cdf(&poi, k), fmin(sum_poi, 1), 1e-5);
+    test_assert_float(negative_binomial_cdf(&neg, k), fmin(sum_neg, 1), 1e-5);
+    test_assert_float(hypergeometric_cdf(&hyp, k), fmin(sum_hyp, 1), 1e-5);
+    test_assert_float(binomial_cdf(&bin, k) + binomial_sf(&bin, k), 1, 1e-6);
+    test_assert_float(poisson_cdf(&poi, k) + poisson_sf(&poi, k), 1, 1e-6);
+    test_assert_float(negative_binomial_cdf(&neg, k) +
+                          negative_binomial_sf(&neg, k),
+                      1, 1e-6);
+    test_assert_float(hypergeometric_cdf(&hyp, k) + hypergeometric_sf(&hyp, k),
+                      1, 1e-6);
+  }
+  assert(binomial_sf(&bin, 40) == 0 && hypergeometric_sf(&hyp, 25) == 0);
+
+  // Far tails keep their relative accuracy for a million trials
+  double n = 1e6;
+  binomial_t big = {n, 0.5};
+  for (double k = 497000; k <= 500000; k += 1000) {
+    double expected = test_log_binomial_tail(0, k, n, 0.5);
+    test_assert_float(logf(binomial_cdf(&big, k)), expected, 1e-5);
+    test_assert_float(log(stats_incomplete_beta(n - k, k + 1, 0.5, 0.5)),
+                      expected, 1e-12);
+  }
+  binomial_t rare = {n, 1e-7f};
+  double p = rare.p;
+  for (uint32_t k = 0; k < 6; k++) {
+    double expected = test_log_binomial_tail(k + 1, n, n, p);
+    test_assert_float(logf(binomial_sf(&rare, k)), expected, 1e-5);
+  }
+
+  // Q(k + 1, lambda) is the Poisson cdf, 1e6 = lambda - 10 sigma
+  double lambda = 1e6, log_cdf = -INFINITY;
+  for (double k = 0; k <= lambda - 1e4; k++) {
+    double l = stats_log_poisson_raw(k, lambda);
+    log_cdf = l > log_cdf ? l + log1p(exp(log_cdf - l))
+                          : log_cdf + log1p(exp(l - log_cdf));
+  }
+  test_assert_float(log(stats_incomplete_gamma_q(lambda - 1e4 + 1, lambda)),
+                    log_cdf, 1e-10);
+  test_assert_float(stats_incomplete_gamma_p(3, 2), 0.3233235838, 1e-9);
+  test_assert_float(stats_incomplete_gamma_q(0.5, 2), erfc(sqrt(2.0)), 1e-9);
+  test_assert_float(stats_incomplete_beta(2, 3, 0.4, 0.6), 0.5248, 1e-9);
+
+  // Hypergeometric with a population of billions, against the binomial
+  hypergeometric_t huge = {4000000000u, 2000000000u, 1000};
+  binomial_t coin = {1000, 0.5};
+  for (uint32_t k = 400; k <= 600; k += 50) {
+    test_assert_float(hypergeometric_cdf(&huge, k), binomial_cdf(&coin, k),
+                      1e-4);
+  }
+}
+
+// Pmf table tests
+static void test_assert_table(pmf_table_t *t, double (*log_pmf)(double k),
+                              double (*cdf)(double k)) {
+  for (long i = 0; i < t->size; i++) {
+    double k = t->first + i, expected = exp(log_pmf(k));
+    assert(fabs(t->pmf[i] - expected) <= 1e-12 * fmax(expected, 1e-300) ||
+           fabs(t->pmf[i] - expected) < 1e-300);
+    test_assert_float(t->cdf[i], cdf(k), 1e-9);
+  }
+}
+
+static double table_binomial_log_pmf(double k) {
+  return stats_log_binomial_raw(k, 1000, 0.3f, 1 - (double)0.3f);
+}
+static double table_binomial_cdf(double k) {
+  return stats_incomplete_beta(1000 - k, k + 1, 1 - (double)0.3f, 0.3f);
+}
+static double table_poisson_log_pmf(double k) {
+  return stats_log_poisson_raw(k, 1e6);
+}
+static double table_poisson_cdf(double k) {
+  return stats_incomplete_gamma_q(k + 1, 1e6);
+}
+static double table_hypergeometric_log_pmf(double k) {
+  double p = 60 / 500.0, q = 1 - p;
+  return stats_log_binomial_raw(k, 200, p, q) +
+         stats_log_binomial_raw(60 - k, 300, p, q) -
+         stats_log_binomial_raw(60, 500, p, q);
+}
+static double table_hypergeometric_cdf(double k) {
+  return stats_hypergeometric_tail(k, 500, 200, 60, 0);
+}
+
+void test_stats_pmf_table() {
+  binomial_t bin = {1000, 0.3};
+  pmf_table_t *t = binomial_pmf_table(&bin, 0);
+  assert(t->first == 0 && t->size == 1001);
+  test_assert_table(t, table_binomial_log_pmf, table_binomial_cdf);
+  test_assert_float(t->cdf[1000], 1, 1e-12);
+  pmf_table_free(t);
+
+  // A window around the mode, its cdf counts the mass cut off below
+  t = binomial_pmf_table(&bin, 1e-12);
+  assert(t->first > 150 && t->first + t->size - 1 < 450);
+  assert(table_binomial_cdf(t->first - 1) <= 0.5e-12);
+  assert(1 - t->cdf[t->size - 1] <= 0.5e-12);
+  test_assert_table(t, table_binomial_log_pmf, table_binomial_cdf);
+  pmf_table_free(t);
+
+  // A million-count Poisson takes a few thousand entries at 1e-10
+  poisson_t poi = {1000000};
+  t = poisson_pmf_table(&poi, 1e-10);
+  assert(t->size < 15000 && t->first < 1000000 - 6000);
+  test_assert_table(t, table_poisson_log_pmf, table_poisson_cdf);
+  pmf_table_free(t);
+
+  hypergeometric_t hyp = {500, 200, 60};
+  t = hypergeometric_pmf_table(&hyp, 0);
+  assert(t->first == 0 && t->size == 61);
+  test_assert_table(t, table_hypergeometric_log_pmf, table_hypergeometric_cdf);
+  pmf_table_free(t);
+
+  // Unbounded tails end where the pmf underflows
+  negative_binomial_t neg = {5, 0.3};
+  t = negative_binomial_pmf_table(&neg, 0);
+  assert(t->first == 0 && t->pmf[t->size - 1] < 1e-300);
+  for (long k = 0; k < t->size; k += 97) {
+    test_assert_float(t->pmf[k], exp(negative_binomial_logpmf(&neg, k)), 1e-5);
+  }
+  test_assert_float(t->cdf[t->size - 1], 1, 1e-12);
+  pmf_table_free(t);
+
+  // Degenerate laws are a single entry
+  binomial_t sure = {40, 1};
+  t = binomial_pmf_table(&sure, 1e-9);
+  assert(t->first == 40 && t->size == 1 && t->pmf[0] == 1);
+  pmf_table_free(t);
+}
+
+// Frozen distribution tests
+void test_distribution_frozen() {
+  binomial_t bin = {30, 0.4};
+  poisson_t poi = {7};
+  negative_binomial_t neg = {4, 0.3};
+  hypergeometric_t hyp = {60, 25, 12};
+  geometric_t geo = {0.15};
+  discrete_uniform_t dis = {3, 9, 0};
+  bernoulli_t ber = {0.7};
+  distribution_t *d[] = {binomial_freeze(&bin), poisson_freeze(&poi),
+                         negative_binomial_freeze(&neg),
+                         hypergeometric_freeze(&hyp), geometric_freeze(&geo),
+                         discrete_uniform_freeze(&dis),
+                         bernoulli_freeze(&ber)};
+
+  for (uint32_t k = 0; k <= 40; k++) {
+    float expected_pmf[] = {binomial_pmf(&bin, k),
+                            poisson_pmf(&poi, k),
+                            negative_binomial_pmf(&neg, k),
+                            hypergeometric_pmf(&hyp, k),
+                            geometric_pmf(&geo, k),
+                            discrete_uniform_pmf(&dis, k),
+                            k <= 1 ? bernoulli_pmf(&ber, k) : 0};
+    float expected_cdf[] = {binomial_cdf(&bin, k),
+                            poisson_cdf(&poi, k),
+                            negative_binomial_cdf(&neg, k),
+                            hypergeometric_cdf(&hyp, k),
+                            geometric_cdf(&geo, k),
+                            discrete_uniform_cdf(&dis, k),
+                            bernoulli_cdf(&ber, k)};
+    for (int i = 0; i < 7; i++) {
+      test_assert_float(distribution_pmf(d[i], k), expected_pmf[i], 1e-5);
+      test_assert_float(distribution_cdf(d[i], k), expected_cdf[i], 1e-5);
+      test_assert_float(distribution_cdf(d[i], k + 0.5), expected_cdf[i],
+                        1e-5);
+      test_assert_float(distribution_sf(d[i], k), 1 - expected_cdf[i], 1e-5);
+      assert(distribution_pmf(d[i], k + 0.5) == 0);
+    }
+  }
+
+  // Moments are cached in double, without the integer division of the
+  // scalar means
+  assert(fabs(d[3]->mean - 12 * 25 / 60.0) < 1e-12);
+  test_assert_float(d[2]->variance, 4 * 0.7 / (0.3 * 0.3), 1e-6);
+  assert(d[1]->hi == INFINITY && d[3]->lo == 0 && d[3]->hi == 12);
+
+  // Smallest x with cdf(x) >= u
+  for (int i = 0; i < 7; i++) {
+    for (double u = 0.01; u < 1; u += 0.07) {
+      double x = distribution_quantile(d[i], u);
+      assert(distribution_cdf(d[i], x) >= u);
+      assert(x == d[i]->lo || distribution_cdf(d[i], x - 1) < u);
+    }
+    assert(distribution_quantile(d[i], 0) == d[i]->lo);
+    assert(distribution_quantile(d[i], 1) == d[i]->hi);
+    assert(isnan(distribution_quantile(d[i], 1.5)));
+    distribution_free(d[i]);
+  }
+}
+
+void test_distribution_continuous() {
+  normal_t nor = {1.5, 2};
+  continuous_uniform_t uni = {2, 6, 0};
+  distribution_t *n = normal_freeze(&nor), *u = continuous_uniform_freeze(&uni);
+
+  for (double x = -6; x <= 8; x += 0.25) {
+    test_assert_float(distribution_pmf(n, x), normal_pmf(&nor, x), 1e-6);
+    test_assert_float(distribution_cdf(n, x), normal_cdf(&nor, x), 1e-6);
+    test_assert_float(distribution_logpmf(n, x),
+                      -(x - 1.5) * (x - 1.5) / 8 - log(2 * sqrt(2 * M_PI)),
+                      1e-12);
+    test_assert_float(distribution_cdf(u, x), continuous_uniform_cdf(&uni, x),
+                      1e-6);
+    test_assert_float(distribution_pmf(u, x), x >= 2 && x <= 6 ? 0.25 : 0,
+                      1e-12);
+  }
+  // The upper tail is not 1 - cdf, so it keeps its digits
+  test_assert_float(distribution_sf(n, 1.5 + 2 * 20), 0.5 * erfc(20 / sqrt(2)),
+                    1e-12);
+  assert(distribution_sf(n, 1.5 + 2 * 20) > 0);
+
+  for (double p = 0.001; p < 1; p += 0.0373) {
+    test_assert_float(distribution_cdf(n, distribution_quantile(n, p)), p,
+                      1e-12);
+    test_assert_float(distribution_quantile(u, p), 2 + 4 * p, 1e-12);
+  }
+  assert(distribution_quantile(n, 0) == -INFINITY);
+
+  // Parameters without a distribution
+  normal_t flat = {0, 0};
+  geometric_t never = {0};
+  hypergeometric_t empty = {10, 11, 3};
+  assert(normal_freeze(&flat) == NULL && geometric_freeze(&never) == NULL);
+  assert(hypergeometric_freeze(&empty) == NULL);
+
+  distribution_free(n);
+  distribution_free(u);
+}
+
+// Random variate tests
+void test_random_streams() {
+  rng_t a, b;
+
+  rng_seed(&a, 42);
+  rng_seed(&b, 42);
+  for (int i = 0; i < 100; i++) {
+    assert(rng_next(&a) == rng_next(&b));
+  }
+  rng_seed(&b, 43);
+  assert(rng_next(&a) != rng_next(&b));
+
+  // A fill takes block b from rng jumped b + 1 times and lane l of a block
+  // from that stream long jumped l times
+  long n = 2 * 65536 + 37;
+  Vector *v = vector_new(n), *w = vector_new(n);
+  continuous_uniform_t unit = {0, 1, 0};
+  rng_seed(&a, 7);
+  rng_seed(&b, 7);
+  assert(continuous_uniform_sample_fill(&unit, &a, v) == 0);
+
+  for (int block = 0; block < 3; block++) {
+    rng_t lane[4];
+    rng_jump(&b);
+    lane[0] = b;
+    for (int l = 1; l < 4; l++) {
+      lane[l] = lane[l - 1];
+      rng_long_jump(&lane[l]);
+    }
+    for (long i = 0; i < 600; i++) {
+      long j = block * 65536L + i;
+      double expected = rng_uniform(&lane[i % 4]);
+      assert(j >= n || v->data[j] == expected);
+    }
+  }
+  rng_jump(&b);
+  assert(memcmp(&a, &b, sizeof(rng_t)) == 0);
+
+  // The same seed gives the same values, on any number of threads
+  normal_t nor = {0, 1};
+  rng_seed(&a, 9);
+  rng_seed(&b, 9);
+  assert(normal_sample_fill(&nor, &a, v) == 0);
+  assert(normal_sample_fill(&nor, &b, w) == 0);
+  assert(memcmp(v->data, w->data, n * sizeof(double)) == 0);
+
+  for (long i = 0; i < n; i++) {
+    assert(v->data[i] == v->data[i] && fabs(v->data[i]) < 10);
+  }
+
+  // Parameters without a distribution
+  binomial_t bad = {10, 1.5};
+  normal_t negative = {0, -1};
+  hypergeometric_t empty = {10, 11, 3};
+  assert(binomial_sample_fill(&bad, &a, v) == -1);
+  assert(normal_sample_fill(&negative, &a, v) == -1);
+  assert(isnan(hypergeometric_sample(&empty, &a)));
+
+  vector_free(v);
+  vector_free(w);
+}
+
+// Sample mean and variance of v against d, and for discrete laws the
+// frequency of every k within three standard deviations of the mean
+void test_assert_sample(Vector *v, distribution_t *d) {
+  long n = v->size;
+  double mean = 0, variance = 0, sd = sqrt(d->variance);
+
+  for (long i = 0; i < n; i++) {
+    assert(v->data[i] >= d->lo && v->data[i] <= d->hi);
+    mean += v->data[i];
+  }
+  mean /= n;
+  for (long i = 0; i < n; i++) {
+    variance += (v->data[i] - mean) * (v->data[i] - mean);
+  }
+  variance /= n - 1;
+  assert(fabs(mean - d->mean) <= 6 * sd / sqrt(n));
+  assert(fabs(variance - d->variance) <= 0.05 * d->variance);
+
+  double lo = fmax(d->lo, floor(d->mean - 3 * sd));
+  double hi = fmin(d->hi, ceil(d->mean + 3 * sd));
+  for (double k = lo; d->ops->discrete && k <= hi; k++) {
+    long count = 0;
+    for (long i = 0; i < n; i++) {
+      count += v->data[i] == k;
+    }
+    double p = distribution_pmf(d, k);
+    assert(fabs((double)count / n - p) <= 6 * sqrt(p * (1 - p) / n) + 1e-9);
+  }
+  distribution_free(d);
+}
+
+void test_random_samplers() {
+  rng_t rng;
+  Vector *v = vector_new(200000);
+  rng_seed(&rng, 2024);
+
+  // Inversion, BTPE and both reflected
+  binomial_t bins[] = {{20, 0.3}, {1000, 0.4}, {1000, 0.7}, {200, 0.9}};
+  for (int i = 0; i < 4; i++) {
+    assert(binomial_sample_fill(&bins[i], &rng, v) == 0);
+    test_assert_sample(v, binomial_freeze(&bins[i]));
+  }
+
+  // Inversion and PTRS
+  poisson_t pois[] = {{4}, {500}};
+  for (int i = 0; i < 2; i++) {
+    assert(poisson_sample_fill(&pois[i], &rng, v) == 0);
+    test_assert_sample(v, poisson_freeze(&pois[i]));
+  }
+
+  // Walks from the mode, then HRUA directly, reflected in K and n and
+  // with N past 2^31
+  hypergeometric_t hyps[] = {{500, 200, 60},
+                             {60, 25, 12},
+                             {100000, 40000, 20000},
+                             {60000, 42000, 36000},
+                             {4000000000u, 1000000000u, 20000}};
+  for (int i = 0; i < 5; i++) {
+    assert(hypergeometric_sample_fill(&hyps[i], &rng, v) == 0);
+    test_assert_sample(v, hypergeometric_freeze(&hyps[i]));
+  }
+
+  geometric_t geo = {0.2};
+  assert(geometric_sample_fill(&geo, &rng, v) == 0);
+  test_assert_sample(v, geometric_freeze(&geo));
+
+  negative_binomial_t neg = {5, 0.3};
+  assert(negative_binomial_sample_fill(&neg, &rng, v) == 0);
+  test_assert_sample(v, negative_binomial_freeze(&neg));
+
+  discrete_uniform_t dis = {3, 9, 0};
+  assert(discrete_uniform_sample_fill(&dis, &rng, v) == 0);
+  test_assert_sample(v, discrete_uniform_freeze(&dis));
+
+  bernoulli_t ber = {0.7};
+  assert(bernoulli_sample_fill(&ber, &rng, v) == 0);
+  test_assert_sample(v, bernoulli_freeze(&ber));
+
+  continuous_uniform_t uni = {2, 6, 0};
+  assert(continuous_uniform_sample_fill(&uni, &rng, v) == 0);
+  test_assert_sample(v, continuous_uniform_freeze(&uni));
+
+  // The ziggurat against the cdf, including the tail past the last layer
+  normal_t nor = {2, 3};
+  distribution_t *d = normal_freeze(&nor);
+  Vector *z = vector_new(1000000);
+  assert(normal_sample_fill(&nor, &rng, z) == 0);
+  double cuts[] = {-2, -1, 0, 0.5, 1.5, 3.6541528853610088};
+  for (int c = 0; c < 6; c++) {
+    long below = 0;
+    for (long i = 0; i < z->size; i++) {
+      below += z->data[i] <= 2 + 3 * cuts[c];
+    }
+    double p = 0.5 * erfc(-cuts[c] / sqrt(2));
+    assert(fabs((double)below / z->size - p) <=
+           6 * sqrt(p * (1 - p) / z->size));
+  }
+  test_assert_sample(z, d);
+
+  // One variate at a time, through a frozen law and a scalar sampler
+  poisson_t poi = {12};
+  d = poisson_freeze(&poi);
+  for (long i = 0; i < v->size; i++) {
+    v->data[i] = distribution_sample(d, &rng);
+  }
+  test_assert_sample(v, d);
+  for (long i = 0; i < v->size; i++) {
+    v->data[i] = hypergeometric_sample(&hyps[0], &rng);
+  }
+  test_assert_sample(v, hypergeometric_freeze(&hyps[0]));
+
+  vector_free(v);
+  vector_free(z);
+}
+
+// Categorical sampler tests
+// Frequencies of every index of c against weight / total
+void test_assert_categorical(categorical_t *c, const double *weight,
+                             rng_t *rng) {
+  Vector *v = vector_new(100000);
+  double total = 0;
+  long n = c->size;
+
+  for (long i = 0; i < n; i++) {
+    total += weight[i];
+  }
+  assert(categorical_sample_fill(c, rng, v) == 0);
+  for (long i = 0; i < n; i++) {
+    long count = 0;
+    for (int j = 0; j < v->size; j++) {
+      count += v->data[j] == c->first + i;
+    }
+    double p = weight[i] / total;
+    assert(weight[i] > 0 || count == 0);
+    assert(fabs((double)count / v->size - p) <=
+           6 * sqrt(p * (1 - p) / v->size) + 1e-9);
+  }
+  vector_free(v);
+}
+
+void test_categorical_tables() {
+  double weight[] = {1, 0, 3, 6, 0.5, 0, 2.5, 7};
+  Vector *w = vector_from_array(8, weight);
+  rng_t rng;
+  rng_seed(&rng, 11);
+
+  CategoricalMethod methods[] = {CATEGORICAL_ALIAS, CATEGORICAL_GUIDE,
+                                 CATEGORICAL_FENWICK};
+  for (int m = 0; m < 3; m++) {
+    categorical_t *c = categorical_new(w, methods[m]);
+    assert(c != NULL && c->method == methods[m]);
+    assert(fabs(c->total - 20) < 1e-12);
+    test_assert_categorical(c, weight, &rng);
+
+    // Updates move a table onto the Fenwick tree, a rebuild moves it back
+    assert(categorical_update(c, 1, 4) == 0);
+    assert(categorical_update(c, 7, 0) == 0);
+    assert(c->method == CATEGORICAL_FENWICK);
+    double updated[] = {1, 4, 3, 6, 0.5, 0, 2.5, 0};
+    test_assert_categorical(c, updated, &rng);
+    assert(categorical_rebuild(c, methods[m]) == 0);
+    assert(c->method == methods[m]);
+    test_assert_categorical(c, updated, &rng);
+
+    assert(categorical_update(c, 8, 1) == -1);
+    assert(categorical_update(c, 0, -1) == -1);
+    categorical_free(c);
+  }
+
+  // The same seed gives the same draws
+  categorical_t *c = categorical_new(w, CATEGORICAL_ALIAS);
+  Vector *a = vector_new(70000), *b = vector_new(70000);
+  rng_t r1, r2;
+  rng_seed(&r1, 5);
+  rng_seed(&r2, 5);
+  categorical_sample_fill(c, &r1, a);
+  categorical_sample_fill(c, &r2, b);
+  assert(memcmp(a->data, b->data, a->size * sizeof(double)) == 0);
+  assert(categorical_sample(c, &r1) >= 0);
+  categorical_free(c);
+  vector_free(a);
+  vector_free(b);
+
+  // Weights without a distribution
+  w->data[2] = -1;
+  assert(categorical_new(w, CATEGORICAL_GUIDE) == NULL);
+  Vector *zero = vector_new(4);
+  for (int i = 0; i < 4; i++) {
+    zero->data[i] = 0;
+  }
+  assert(categorical_new(zero, CATEGORICAL_ALIAS) == NULL);
+  vector_free(zero);
+  vector_free(w);
+}
+
+void test_categorical_from_distribution() {
+  rng_t rng;
+  rng_seed(&rng, 12);
+
+  binomial_t bin = {30, 0.4};
+  distribution_t *d = binomial_freeze(&bin);
+  categorical_t *c = categorical_from_distribution(d, 0, CATEGORICAL_ALIAS);
+  assert(c != NULL && c->size == 31 && c->first == 0);
+  for (long i = 0; i < c->size; i++) {
+    assert(c->weight[i] == distribution_pmf(d, i));
+  }
+  test_assert_categorical(c, c->weight, &rng);
+  categorical_free(c);
+  distribution_free(d);
+
+  // Unbounded laws are cut at the tolerance
+  poisson_t poi = {40};
+  d = poisson_freeze(&poi);
+  assert(categorical_from_distribution(d, 0, CATEGORICAL_GUIDE) == NULL);
+  c = categorical_from_distribution(d, 1e-12, CATEGORICAL_GUIDE);
+  assert(c != NULL && c->first > 0 && c->first < 20);
+  assert(distribution_cdf(d, c->first - 1) < 0.5e-12);
+  assert(distribution_sf(d, c->first + c->size - 1) < 0.5e-12);
+  test_assert_categorical(c, c->weight, &rng);
+  categorical_free(c);
+  distribution_free(d);
+
+  normal_t nor = {0, 1};
+  d = normal_freeze(&nor);
+  assert(categorical_from_distribution(d, 1e-6, CATEGORICAL_ALIAS) == NULL);
+  distribution_free(d);
+}
+
+void test_normal_quantile() {
+  // Round trip through erfc, down into the far tails where one ulp of z
+  // moves the cdf by a relative z ulp(z)
+  for (double p = 1e-300; p < 0.5; p *= 7.3) {
+    double z = stats_normal_quantile(p);
+    assert(fabs(0.5 * erfc(-z * M_SQRT1_2) - p) <= 1e-12 * p);
+    assert(stats_normal_quantile(1 - p) ==
+           -stats_normal_quantile(1 - (1 - p)));
+  }
+  for (double p = 0.01; p < 1; p += 0.0137) {
+    double z = stats_normal_quantile(p);
+    assert(fabs(0.5 * erfc(-z * M_SQRT1_2) - p) <= 1e-15);
+  }
+  assert(stats_normal_quantile(0.5) == 0);
+  assert(stats_normal_quantile(0) == -INFINITY);
+  assert(stats_normal_quantile(1) == INFINITY);
+  assert(isnan(stats_normal_quantile(-0.1)) &&
+         isnan(stats_normal_quantile(NAN)));
+
+  normal_t nor = {3, 2};
+  float u[] = {0.001f, 0.25f, 0.5f, 0.975f}, out[4];
+  normal_quantile_batch(&nor, u, out, 4);
+  for (int i = 0; i < 4; i++) {
+    test_assert_float(out[i], 3 + 2 * stats_normal_quantile(u[i]), 1e-6);
+    assert(normal_quantile(&nor, u[i]) == out[i]);
+  }
+}
+
+void test_discrete_quantiles() {
+  binomial_t bin = {1000000, 0.3};
+  poisson_t poi = {1e5};
+  negative_binomial_t neg = {3, 0.02};
+  hypergeometric_t hyp = {5000, 1200, 800};
+  geometric_t geo = {0.001};
+  discrete_uniform_t dis = {4, 17, 0};
+  bernoulli_t ber = {0.3};
+  distribution_t *d[] = {binomial_freeze(&bin),
+                         poisson_freeze(&poi),
+                         negative_binomial_freeze(&neg),
+                         hypergeometric_freeze(&hyp),
+                         geometric_freeze(&geo),
+                         discrete_uniform_freeze(&dis),
+                         bernoulli_freeze(&ber)};
+  float u[] = {1e-12f, 1e-6f, 0.01f, 0.3f, 0.5f, 0.77f, 0.999f, 1 - 1e-7f};
+  float out[7][8];
+
+  binomial_quantile_batch(&bin, u, out[0], 8);
+  poisson_quantile_batch(&poi, u, out[1], 8);
+  negative_binomial_quantile_batch(&neg, u, out[2], 8);
+  hypergeometric_quantile_batch(&hyp, u, out[3], 8);
+  geometric_quantile_batch(&geo, u, out[4], 8);
+  discrete_uniform_quantile_batch(&dis, u, out[5], 8);
+  bernoulli_quantile_batch(&ber, u, out[6], 8);
+
+  // Smallest k with cdf(k) >= u, scalar and batch alike
+  for (int i = 0; i < 7; i++) {
+    for (int j = 0; j < 8; j++) {
+      double k = out[i][j];
+      assert(distribution_cdf(d[i], k) >= u[j]);
+      assert(k == d[i]->lo || distribution_cdf(d[i], k - 1) < u[j]);
+      assert(distribution_quantile(d[i], u[j]) == k);
+    }
+  }
+  assert(binomial_quantile(&bin, u[3]) == out[0][3]);
+  assert(poisson_quantile(&poi, u[5]) == out[1][5]);
+  assert(hypergeometric_quantile(&hyp, u[0]) == out[3][0]);
+  assert(geometric_quantile(&geo, u[7]) == out[4][7]);
+
+  // Ends of the support, and no answer outside [0, 1]
+  assert(poisson_quantile(&poi, 0) == 0);
+  assert(poisson_quantile(&poi, 1) == INFINITY);
+  assert(binomial_quantile(&bin, 1) == 1000000);
+  assert(isnan(binomial_quantile(&bin, 1.5f)));
+  assert(isnan(geometric_quantile(&geo, -0.5f)));
+  continuous_uniform_t uni = {2, 6, 0};
+  assert(continuous_uniform_quantile(&uni, 0.25f) == 3);
+  assert(isnan(continuous_uniform_quantile(&uni, 2)));
+
+  // Exactly on a step of the cdf, 0.56 * 100 rounds up past 56
+  discrete_uniform_t hundred = {0, 99, 0};
+  distribution_t *h = discrete_uniform_freeze(&hundred);
+  assert(distribution_cdf(h, 55) == 0.56);
+  assert(distribution_quantile(h, 0.56) == 55);
+  for (int k = 0; k < 100; k++) {
+    double step = distribution_cdf(h, k);
+    assert(distribution_quantile(h, step) == k);
+    assert(k == 99 || distribution_quantile(h, nextafter(step, 1)) == k + 1);
+  }
+  distribution_free(h);
+
+  for (int i = 0; i < 7; i++) {
+    distribution_free(d[i]);
+  }
+}
+
+// Two-pass central moments of x, the reference for the streaming ones
+static void test_reference_moments(const double *x, long n, double *mean,
+                                   double *m2, double *m3, double *m4) {
+  double sum = 0;
+  for (long i = 0; i < n; i++) {
+    sum += x[i] - x[0];
+  }
+  *mean = x[0] + sum / n;
+  *m2 = *m3 = *m4 = 0;
+  for (long i = 0; i < n; i++) {
+    double d = x[i] - *mean;
+    *m2 += d * d;
+    *m3 += d * d * d;
+    *m4 += d * d * d * d;
+  }
+}
+
+static void test_assert_moments(const moments_t *m, const double *x, long n) {
+  double mean, m2, m3, m4;
+  test_reference_moments(x, n, &mean, &m2, &m3, &m4);
+  assert(m->count == n);
+  assert(fabs(m->mean - mean) <= 1e-12 * (1 + fabs(mean)));
+  assert(fabs(m->m2 - m2) <= 1e-10 * m2);
+  assert(fabs(m->m3 - m3) <= 1e-9 * sqrt(m2 * m4));
+  assert(fabs(m->m4 - m4) <= 1e-9 * m4);
+}
+
+void test_moments_streaming() {
+  long n = 100003;
+  Vector *v = vector_new(n);
+  rng_t rng;
+  rng_seed(&rng, 5);
+
+  // Skewed, far from 0, so a one-pass sum of powers would lose it all
+  double lo = INFINITY, hi = -INFINITY;
+  for (long i = 0; i < n; i++) {
+    double u = rng_uniform(&rng);
+    v->data[i] = 1e6 + u * u * u;
+    lo = v->data[i] < lo ? v->data[i] : lo;
+    hi = v->data[i] > hi ? v->data[i] : hi;
+  }
+
+  moments_t one, array, vector, shards[3], merged;
+  moments_init(&one);
+  moments_init(&array);
+  moments_init(&vector);
+  moments_init(&merged);
+  for (long i = 0; i < n; i++) {
+    moments_push(&one, v->data[i]);
+  }
+  moments_push_array(&array, v->data, n);
+  moments_push_vector(&vector, v);
+
+  // Uneven shards merged out of order
+  long cut[] = {0, 17, 60000, n};
+  for (int s = 0; s < 3; s++) {
+    moments_init(&shards[s]);
+    moments_push_array(&shards[s], v->data + cut[s], cut[s + 1] - cut[s]);
+  }
+  moments_merge(&shards[2], &shards[0]);
+  moments_merge(&merged, &shards[1]);
+  moments_merge(&merged, &shards[2]);
+
+  moments_t *all[] = {&one, &array, &vector, &merged};
+  for (int k = 0; k < 4; k++) {
+    test_assert_moments(all[k], v->data, n);
+    assert(all[k]->min == lo && all[k]->max == hi);
+  }
+
+  // Uniform u^3 has skewness and kurtosis in closed form
+  double mean, m2, m3, m4;
+  test_reference_moments(v->data, n, &mean, &m2, &m3, &m4);
+  test_assert_float(moments_variance(&array), m2 / n, 1e-6);
+  test_assert_float(moments_sample_variance(&array), m2 / (n - 1), 1e-6);
+  test_assert_float(moments_skewness(&array), sqrt(n) * m3 / pow(m2, 1.5),
+                    1e-6);
+  test_assert_float(moments_kurtosis(&array), n * m4 / (m2 * m2) - 3, 1e-6);
+
+  // Nothing to say yet
+  moments_t empty;
+  moments_init(&empty);
+  assert(isnan(moments_variance(&empty)) && isnan(moments_skewness(&empty)));
+  moments_push(&empty, 2);
+  assert(moments_variance(&empty) == 0);
+  assert(isnan(moments_sample_variance(&empty)));
+  vector_free(v);
+}
+
+void test_mvmoments() {
+  int rows = 503, dim = 7;
+  Matrix *X = matrix_new(rows, dim);
+  rng_t rng;
+  rng_seed(&rng, 6);
+  for (int r = 0; r < rows; r++) {
+    double z = rng_uniform(&rng);
+    for (int j = 0; j < dim; j++) {
+      X->data[r][j] = 100 * j + z * (j + 1) + rng_uniform(&rng);
+    }
+  }
+
+  // Reference covariance, two passes
+  double mean[7] = {0};
+  for (int r = 0; r < rows; r++) {
+    for (int j = 0; j < dim; j++) {
+      mean[j] += X->data[r][j] / rows;
+    }
+  }
+
+  mvmoments_t *one = mvmoments_new(dim), *block = mvmoments_new(dim);
+  mvmoments_t *left = mvmoments_new(dim), *right = mvmoments_new(dim);
+  Vector *x = vector_new(dim);
+  for (int r = 0; r < rows; r++) {
+    for (int j = 0; j < dim; j++) {
+      x->data[j] = X->data[r][j];
+    }
+    assert(mvmoments_push(one, x) == 0);
+    assert(mvmoments_push(r < 200 ? left : right, x) == 0);
+  }
+  assert(mvmoments_push_rows(block, X) == 0);
+  assert(mvmoments_merge(left, right) == 0);
+
+  mvmoments_t *all[] = {one, block, left};
+  for (int k = 0; k < 3; k++) {
+    Matrix *cov = mvmoments_covariance(all[k]);
+    assert(all[k]->count == rows);
+    for (int i = 0; i < dim; i++) {
+      assert(fabs(all[k]->mean->data[i] - mean[i]) < 1e-9);
+      for (int j = 0; j < dim; j++) {
+        double expected = 0;
+        for (int r = 0; r < rows; r++) {
+          expected += (X->data[r][i] - mean[i]) * (X->data[r][j] - mean[j]);
+        }
+        assert(fabs(cov->data[i][j] - expected / (rows - 1)) < 1e-10);
+      }
+    }
+    matrix_free(cov);
+  }
+
+  // Sizes that do not match
+  mvmoments_t *small = mvmoments_new(3);
+  assert(mvmoments_push(small, x) == -1);
+  assert(mvmoments_push_rows(small, X) == -1);
+  assert(mvmoments_merge(small, one) == -1);
+  assert(mvmoments_covariance(small) == NULL);
+
+  mvmoments_free(small);
+  mvmoments_free(one);
+  mvmoments_free(block);
+  mvmoments_free(left);
+  mvmoments_free(right);
+  vector_free(x);
+  matrix_free(X);
+}
+
+void test_matrix_covariance() {
+  int rows = 5003, dim = 37;
+  Matrix *X = matrix_new(rows, dim);
+  rng_t rng;
+  rng_seed(&rng, 7);
+  for (int r = 0; r < rows; r++) {
+    double z = rng_uniform(&rng);
+    for (int j = 0; j < dim; j++) {
+      X->data[r][j] = 1e4 * (j + 1) + z * (j % 5) + rng_uniform(&rng);
+    }
+  }
+
+  // Reference, centered on means taken around the first row
+  double mean[37];
+  for (int j = 0; j < dim; j++) {
+    double sum = 0;
+    for (int r = 0; r < rows; r++) {
+      sum += X->data[r][j] - X->data[0][j];
+    }
+    mean[j] = X->data[0][j] + sum / rows;
+  }
+
+  Matrix *cov = matrix_covariance(X), *cor = matrix_correlation(X);
+  for (int i = 0; i < dim; i++) {
+    for (int j = 0; j < dim; j++) {
+      double expected = 0;
+      for (int r = 0; r < rows; r++) {
+        expected += (X->data[r][i] - mean[i]) * (X->data[r][j] - mean[j]);
+      }
+      expected /= rows - 1;
+      assert(fabs(cov->data[i][j] - expected) < 1e-12);
+      assert(cov->data[i][j] == cov->data[j][i]);
+      assert(fabs(cor->data[i][j] -
+                  expected / sqrt(cov->data[i][i] * cov->data[j][j])) <
+             1e-12);
+    }
+    assert(cor->data[i][i] == 1);
+  }
+  matrix_free(cov);
+  matrix_free(cor);
+
+  // A constant column has no correlation, one row has no covariance
+  for (int r = 0; r < rows; r++) {
+    X->data[r][3] = 2;
+  }
+  cor = matrix_correlation(X);
+  assert(isnan(cor->data[3][3]) && isnan(cor->data[0][3]));
+  assert(cor->data[0][0] == 1);
+  matrix_free(cor);
+  Matrix *one = matrix_new(1, dim);
+  assert(matrix_covariance(one) == NULL && matrix_correlation(one) == NULL);
+
+  // No columns, an empty result
+  Matrix *empty = matrix_new(4, 0);
+  cov = matrix_covariance(empty);
+  cor = matrix_correlation(empty);
+  assert(cov->rows == 0 && cov->cols == 0 && cor->rows == 0);
+  mvmoments_t *m = mvmoments_new(0);
+  assert(mvmoments_push_rows(m, empty) == 0 && m->count == 4);
+  mvmoments_free(m);
+  matrix_free(cov);
+  matrix_free(cor);
+  matrix_free(empty);
+
+  matrix_free(one);
+  matrix_free(X);
+}
+
 int main() {
   test_vector_new();
   printf("test_vector_new passed\n");
@@ -573,4 +3543,183 @@ int main() {
   printf("test_tensor_sub passed\n");
 
   printf("\nAll Tensor tests passed\n\n");
+
+  test_instrument_counters();
+  printf("test_instrument_counters passed\n");
+  test_instrument_dump();
+  printf("test_instrument_dump passed\n");
+
+  printf("\nAll Instrumentation tests passed\n\n");
+
+  test_diagonal();
+  printf("test_diagonal passed\n");
+  test_banded();
+  printf("test_banded passed\n");
+  test_banded_solve();
+  printf("test_banded_solve passed\n");
+  test_symmetric();
+  printf("test_symmetric passed\n");
+  test_triangular();
+  printf("test_triangular passed\n");
+
+  printf("\nAll Structured matrix tests passed\n\n");
+
+  test_small_vectors();
+  printf("test_small_vectors passed\n");
+  test_small_matrices();
+  printf("test_small_matrices passed\n");
+  test_small_transform_points();
+  printf("test_small_transform_points passed\n");
+
+  printf("\nAll Small matrix tests passed\n\n");
+
+  test_vmath_accuracy();
+  printf("test_vmath_accuracy passed\n");
+  test_vmath_special();
+  printf("test_vmath_special passed\n");
+  test_elementwise_map();
+  printf("test_elementwise_map passed\n");
+  test_elementwise_broadcast();
+  printf("test_elementwise_broadcast passed\n");
+  test_elementwise_parallel();
+  printf("test_elementwise_parallel passed\n");
+
+  printf("\nAll Element-wise tests passed\n\n");
+
+  test_reduce_rows();
+  printf("test_reduce_rows passed\n");
+  test_reduce_cols();
+  printf("test_reduce_cols passed\n");
+  test_reduce_parallel();
+  printf("test_reduce_parallel passed\n");
+
+  printf("\nAll Reduction tests passed\n\n");
+
+  test_parallel_for();
+  printf("test_parallel_for passed\n");
+  test_parallel_reduce();
+  printf("test_parallel_reduce passed\n");
+  test_parallel_kernels();
+  printf("test_parallel_kernels passed\n");
+
+  printf("\nAll Parallel tests passed\n\n");
+
+  test_pipeline_independent();
+  printf("test_pipeline_independent passed\n");
+  test_pipeline_wide();
+  printf("test_pipeline_wide passed\n");
+  test_pipeline_failure();
+  printf("test_pipeline_failure passed\n");
+
+  printf("\nAll Pipeline tests passed\n\n");
+
+  test_quant_roundtrip();
+  printf("test_quant_roundtrip passed\n");
+  test_quant_gemm();
+  printf("test_quant_gemm passed\n");
+
+  printf("\nAll Quantized matrix tests passed\n\n");
+
+  test_conv2d();
+  printf("test_conv2d passed\n");
+  test_im2col();
+  printf("test_im2col passed\n");
+  test_pool2d();
+  printf("test_pool2d passed\n");
+
+  printf("\nAll Convolution tests passed\n\n");
+
+  test_disk_matrix_io();
+  printf("test_disk_matrix_io passed\n");
+  test_disk_matrix_multiply();
+  printf("test_disk_matrix_multiply passed\n");
+
+  printf("\nAll Out-of-core tests passed\n\n");
+
+  test_cholesky();
+  printf("test_cholesky passed\n");
+  test_cholesky_update();
+  printf("test_cholesky_update passed\n");
+  test_cholesky_refactor();
+  printf("test_cholesky_refactor passed\n");
+  test_inverse_update();
+  printf("test_inverse_update passed\n");
+
+  printf("\nAll Low-rank update tests passed\n\n");
+
+  test_vector_views();
+  printf("test_vector_views passed\n");
+  test_matrix_views();
+  printf("test_matrix_views passed\n");
+  test_view_gram_schmidt();
+  printf("test_view_gram_schmidt passed\n");
+
+  printf("\nAll View tests passed\n\n");
+
+  test_kronecker();
+  printf("test_kronecker passed\n");
+  test_kronecker_multiply();
+  printf("test_kronecker_multiply passed\n");
+
+  printf("\nAll Kronecker tests passed\n\n");
+
+  test_mvnormal();
+  printf("test_mvnormal passed\n");
+  test_mvnormal_batch();
+  printf("test_mvnormal_batch passed\n");
+
+  printf("\nAll Multivariate normal tests passed\n\n");
+
+  test_stats_batch_discrete();
+  printf("test_stats_batch_discrete passed\n");
+  test_stats_batch_continuous();
+  printf("test_stats_batch_continuous passed\n");
+
+  printf("\nAll Statistics batch tests passed\n\n");
+
+  test_stats_logpmf();
+  printf("test_stats_logpmf passed\n");
+  test_stats_tails();
+  printf("test_stats_tails passed\n");
+  test_stats_pmf_table();
+  printf("test_stats_pmf_table passed\n");
+
+  printf("\nAll Log-space pmf and tail tests passed\n\n");
+
+  test_distribution_frozen();
+  printf("test_distribution_frozen passed\n");
+  test_distribution_continuous();
+  printf("test_distribution_continuous passed\n");
+
+  printf("\nAll Frozen distribution tests passed\n\n");
+
+  test_random_streams();
+  printf("test_random_streams passed\n");
+  test_random_samplers();
+  printf("test_random_samplers passed\n");
+
+  printf("\nAll Random variate tests passed\n\n");
+
+  test_categorical_tables();
+  printf("test_categorical_tables passed\n");
+  test_categorical_from_distribution();
+  printf("test_categorical_from_distribution passed\n");
+
+  printf("\nAll Categorical sampler tests passed\n\n");
+
+  test_normal_quantile();
+  printf("test_normal_quantile passed\n");
+  test_discrete_quantiles();
+  printf("test_discrete_quantiles passed\n");
+
+  printf("\nAll Quantile tests passed\n\n");
+
+  test_moments_streaming();
+  printf("test_moments_streaming passed\n");
+  test_mvmoments();
+  printf("test_mvmoments passed\n");
+  test_matrix_covariance();
+  printf("test_matrix_covariance passed\n");
+
+  printf("\nAll Streaming moment tests passed\n\n");
 }